@@ -0,0 +1,223 @@
+/* bench.c - Load generator for C-Redis (TCP or Unix domain socket) */
+#include "common.h"
+#include "listener.h" // listener_unix_addr(), so "@name" means the same here
+#include <getopt.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <time.h>
+
+// --- Configuration ---
+
+// Command each request sends (-t)
+typedef enum { BENCH_SET, BENCH_GET, BENCH_BFADD, BENCH_PFADD } bench_test_t;
+static const char* bench_test_names[] = { "SET", "GET", "BF.ADD", "PFADD" };
+
+typedef struct {
+    const char* host;
+    const char* port;
+    const char* unix_path; // Overrides host/port when set
+    int clients;
+    long requests;         // Total over all clients
+    int pipeline;
+    bench_test_t test;
+    int data_size;
+    long keyspace;         // > 0: random keys "key:<0..keyspace-1>" instead of one key
+                           // (BF.ADD/PFADD: random elements added to one key)
+} bench_config_t;
+
+// --- Per-connection state ---
+typedef struct {
+    pthread_t thread;
+    const bench_config_t* cfg;
+    long requests;          // This connection's share
+    long* latencies_ns;     // Round trip of each batch
+    long batches;
+    bool failed;
+} bench_client_t;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int bench_connect(const bench_config_t* cfg) {
+    if (cfg->unix_path) {
+        struct sockaddr_un addr;
+        socklen_t len = listener_unix_addr(cfg->unix_path, &addr);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1 || len == 0 || connect(fd, (struct sockaddr*)&addr, len) == -1) {
+            perror("connect(AF_UNIX)");
+            if (fd != -1) close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(cfg->host, cfg->port, &hints, &res) != 0) {
+        fprintf(stderr, "cannot resolve %s\n", cfg->host);
+        return -1;
+    }
+    int fd = socket(res->ai_family, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, res->ai_addr, res->ai_addrlen) == -1) {
+        perror("connect");
+        if (fd != -1) close(fd);
+        freeaddrinfo(res);
+        return -1;
+    }
+    freeaddrinfo(res);
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return fd;
+}
+
+static void* bench_client_run(void* arg) {
+    bench_client_t* c = (bench_client_t*)arg;
+    const bench_config_t* cfg = c->cfg;
+
+    int fd = bench_connect(cfg);
+    if (fd == -1) {
+        c->failed = true;
+        return NULL;
+    }
+
+    // One batch of 'pipeline' commands, sent with a single write()
+    char value[cfg->data_size + 1];
+    memset(value, 'x', cfg->data_size);
+    value[cfg->data_size] = '\0';
+    size_t cmd_max = 64 + sizeof(value);
+    char* batch = malloc(cmd_max * cfg->pipeline);
+    size_t batch_len = 0;
+    unsigned int seed = (unsigned int)(uintptr_t)c ^ (unsigned int)now_ns();
+    char reply[16384];
+    long sent = 0;
+    while (sent < c->requests) {
+        // Rebuilt per batch only with -r; otherwise the same batch is resent
+        if (batch_len == 0 || cfg->keyspace > 0) {
+            batch_len = 0;
+            for (int i = 0; i < cfg->pipeline; i++) {
+                char key[32];
+                if (cfg->keyspace > 0) snprintf(key, sizeof(key), "key:%ld", (long)(rand_r(&seed) % cfg->keyspace));
+                else snprintf(key, sizeof(key), "key:bench");
+                char* out = batch + batch_len;
+                switch (cfg->test) {
+                    case BENCH_SET:   batch_len += snprintf(out, cmd_max, "SET %s %s\r\n", key, value); break;
+                    case BENCH_GET:   batch_len += snprintf(out, cmd_max, "GET %s\r\n", key); break;
+                    case BENCH_BFADD: batch_len += snprintf(out, cmd_max, "BF.ADD bf:bench %s\r\n", key); break;
+                    case BENCH_PFADD: batch_len += snprintf(out, cmd_max, "PFADD hll:bench %s\r\n", key); break;
+                }
+            }
+        }
+        long t0 = now_ns();
+        for (size_t off = 0; off < batch_len; ) {
+            ssize_t n = write(fd, batch + off, batch_len - off);
+            if (n <= 0) { perror("write"); c->failed = true; goto done; }
+            off += n;
+        }
+        // Every reply of this protocol is a single line
+        int lines = 0;
+        while (lines < cfg->pipeline) {
+            ssize_t n = read(fd, reply, sizeof(reply));
+            if (n <= 0) { fprintf(stderr, "server closed the connection\n"); c->failed = true; goto done; }
+            for (ssize_t i = 0; i < n; i++) lines += reply[i] == '\n';
+        }
+        c->latencies_ns[c->batches++] = now_ns() - t0;
+        sent += cfg->pipeline;
+    }
+
+done:
+    free(batch);
+    close(fd);
+    return NULL;
+}
+
+static int cmp_long(const void* a, const void* b) {
+    long x = *(const long*)a, y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-h host] [-p port] [-s unix_path|@name] [-c clients] [-n requests]"
+                    " [-P pipeline] [-t set|get|bfadd|pfadd] [-d value_bytes] [-r keyspace]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+    bench_config_t cfg = {
+        .host = "127.0.0.1", .port = "6379", .unix_path = NULL,
+        .clients = 50, .requests = 100000, .pipeline = 1, .test = BENCH_SET, .data_size = 3, .keyspace = 0,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:s:c:n:P:t:d:r:")) != -1) {
+        switch (opt) {
+            case 'h': cfg.host = optarg; break;
+            case 'p': cfg.port = optarg; break;
+            case 's': cfg.unix_path = optarg; break;
+            case 'c': cfg.clients = MAX(atoi(optarg), 1); break;
+            case 'n': cfg.requests = MAX(atol(optarg), 1); break;
+            case 'P': cfg.pipeline = MAX(atoi(optarg), 1); break;
+            case 't':
+                if (strcasecmp(optarg, "set") == 0) cfg.test = BENCH_SET;
+                else if (strcasecmp(optarg, "get") == 0) cfg.test = BENCH_GET;
+                else if (strcasecmp(optarg, "bfadd") == 0) cfg.test = BENCH_BFADD;
+                else if (strcasecmp(optarg, "pfadd") == 0) cfg.test = BENCH_PFADD;
+                else usage(argv[0]);
+                break;
+            case 'd': cfg.data_size = MAX(atoi(optarg), 1); break;
+            case 'r': cfg.keyspace = atol(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (cfg.data_size > 900) cfg.data_size = 900; // Requests must fit the server's read buffer
+
+    bench_client_t* clients = calloc(cfg.clients, sizeof(bench_client_t));
+    long per_client = (cfg.requests + cfg.clients - 1) / cfg.clients;
+    long start = now_ns();
+    for (int i = 0; i < cfg.clients; i++) {
+        clients[i].cfg = &cfg;
+        clients[i].requests = per_client;
+        clients[i].latencies_ns = malloc(sizeof(long) * (per_client / cfg.pipeline + 1));
+        if (pthread_create(&clients[i].thread, NULL, bench_client_run, &clients[i]) != 0) {
+            ERROR_EXIT("pthread_create");
+        }
+    }
+
+    long total_batches = 0;
+    bool failed = false;
+    for (int i = 0; i < cfg.clients; i++) {
+        pthread_join(clients[i].thread, NULL);
+        total_batches += clients[i].batches;
+        failed |= clients[i].failed;
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    // Merge the per-batch round trips for percentiles
+    long* all = malloc(sizeof(long) * (total_batches + 1));
+    long k = 0;
+    for (int i = 0; i < cfg.clients; i++) {
+        memcpy(all + k, clients[i].latencies_ns, sizeof(long) * clients[i].batches);
+        k += clients[i].batches;
+        free(clients[i].latencies_ns);
+    }
+    qsort(all, total_batches, sizeof(long), cmp_long);
+
+    long done = total_batches * cfg.pipeline;
+    printf("%s via %s: %ld requests, %d clients, pipeline %d, %d byte values, %ld keys\n",
+           bench_test_names[cfg.test], cfg.unix_path ? cfg.unix_path : cfg.host,
+           done, cfg.clients, cfg.pipeline, cfg.data_size, cfg.keyspace > 0 ? cfg.keyspace : 1);
+    if (total_batches > 0) {
+        printf("  %.0f requests/s   round trip p50 %.1f us  p99 %.1f us  max %.1f us\n",
+               done / elapsed, all[total_batches / 2] / 1e3,
+               all[(long)(total_batches * 0.99)] / 1e3, all[total_batches - 1] / 1e3);
+    }
+
+    free(all);
+    free(clients);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+/* bloom.c - Blocked Bloom filter: every item's k bits live in one 64-byte block */
+#include "bloom.h"
+#include "murmur.h"
+#include "protocol.h"
+#include <math.h>
+
+// A classic Bloom filter scatters an item's k bits over the whole bit array,
+// so a lookup in a filter bigger than the cache costs k cache misses. Here
+// one hash picks a cache-line-sized block and all k bits are set inside it:
+// one miss per lookup, at the price of a slightly higher false positive rate
+// for the same memory (blocks fill unevenly).
+
+#define BLOOM_MAGIC 0x424c4f4fU // "BLOO"
+#define BLOOM_SEED_BLOCK 0x9747b28cULL
+#define BLOOM_SEED_BITS 0xc58f1a7bULL
+#define BLOOM_BLOCKED_OVERHEAD 1.1 // Extra bits that bring the blocked rate back to the target
+
+// Sits in front of the blocks; exactly one block long so they stay aligned.
+typedef struct {
+    uint32_t magic;
+    uint32_t k;            // Bits set per item
+    uint64_t num_blocks;
+    uint64_t capacity;     // Items the filter was sized for
+    uint64_t items;        // Items added (adds that set at least one new bit)
+    double error_rate;     // Target false positive rate at 'capacity'
+    uint8_t pad[BLOOM_BLOCK_BYTES - 40];
+} bloom_header_t;
+
+_Static_assert(sizeof(bloom_header_t) == BLOOM_BLOCK_BYTES, "header must be one block");
+
+// --- Filter ---
+
+char* bloom_create(double error_rate, uint64_t capacity, size_t* blob_len) {
+    // Optimal classic sizing: m = -n ln(p) / ln(2)^2 bits, k = (m / n) ln(2).
+    double ln2 = log(2.0);
+    double bits = -(double)capacity * log(error_rate) / (ln2 * ln2);
+    int k = (int)lround(bits / (double)capacity * ln2);
+    bits *= BLOOM_BLOCKED_OVERHEAD;
+    uint64_t num_blocks = (uint64_t)ceil(bits / BLOOM_BLOCK_BITS);
+    if (num_blocks == 0) num_blocks = 1;
+    if (k < 1) k = 1;
+    if (k > BLOOM_MAX_K) k = BLOOM_MAX_K;
+
+    size_t len = sizeof(bloom_header_t) + num_blocks * BLOOM_BLOCK_BYTES;
+    // Niche C: aligned_alloc wants a size that is a multiple of the alignment; ours is.
+    char* blob = (char*)aligned_alloc(BLOOM_BLOCK_BYTES, len);
+    if (!blob) return NULL;
+    memset(blob, 0, len);
+
+    bloom_header_t* hdr = (bloom_header_t*)blob;
+    hdr->magic = BLOOM_MAGIC;
+    hdr->k = (uint32_t)k;
+    hdr->num_blocks = num_blocks;
+    hdr->capacity = capacity;
+    hdr->error_rate = error_rate;
+    *blob_len = len;
+    return blob;
+}
+
+// Builds the item's bit pattern inside its block; returns the block.
+static uint64_t* bloom_locate(const char* blob, const char* item, size_t len, uint64_t mask[8]) {
+    const bloom_header_t* hdr = (const bloom_header_t*)blob;
+    uint64_t h1 = murmur64(item, len, BLOOM_SEED_BLOCK);
+    uint64_t h2 = murmur64(item, len, BLOOM_SEED_BITS);
+
+    // Niche C: multiply-shift maps h1 onto [0, num_blocks) without a division.
+    uint64_t block = (uint64_t)(((unsigned __int128)h1 * hdr->num_blocks) >> 64);
+
+    // Double hashing (Kirsch-Mitzenmacher): bit i = a + i*b, an odd b visits distinct bits.
+    uint32_t a = (uint32_t)h2;
+    uint32_t b = (uint32_t)(h2 >> 32) | 1;
+    memset(mask, 0, 8 * sizeof(uint64_t));
+    for (uint32_t i = 0; i < hdr->k; i++) {
+        uint32_t bit = (a + i * b) % BLOOM_BLOCK_BITS;
+        mask[bit / 64] |= 1ULL << (bit % 64);
+    }
+    return (uint64_t*)(blob + sizeof(bloom_header_t) + block * BLOOM_BLOCK_BYTES);
+}
+
+bool bloom_add(char* blob, const char* item, size_t len) {
+    uint64_t mask[8];
+    uint64_t* words = bloom_locate(blob, item, len, mask);
+    uint64_t added = 0;
+    for (int i = 0; i < 8; i++) {
+        added |= mask[i] & ~words[i];
+        words[i] |= mask[i];
+    }
+    if (added) ((bloom_header_t*)blob)->items++;
+    return added != 0;
+}
+
+bool bloom_exists(const char* blob, const char* item, size_t len) {
+    uint64_t mask[8];
+    const uint64_t* words = bloom_locate(blob, item, len, mask);
+    uint64_t missing = 0;
+    for (int i = 0; i < 8; i++) missing |= mask[i] & ~words[i];
+    return missing == 0;
+}
+
+// --- Commands ---
+
+// Finds the filter at 'key' (creating a default one if asked). Caller holds ht_lock.
+// On failure writes the error reply and returns NULL.
+static ht_entry_t* bloom_lookup(hash_table_t* db, const char* key, bool create,
+                                char* response_buf, size_t response_max) {
+    ht_entry_t* entry = ht_find_locked(db, key);
+    if (entry) {
+        if (entry->type == HT_BLOOM) return entry;
+        snprintf(response_buf, response_max, WRONGTYPE_REPLY);
+        return NULL;
+    }
+    if (!create) return NULL;
+
+    size_t len;
+    char* blob = bloom_create(BLOOM_DEFAULT_ERROR_RATE, BLOOM_DEFAULT_CAPACITY, &len);
+    entry = blob ? ht_add_locked(db, key, HT_BLOOM, blob, len) : NULL;
+    if (!entry) snprintf(response_buf, response_max, "-ERR out of memory\r\n");
+    return entry;
+}
+
+void bf_reserve_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    // BF.RESERVE key error_rate capacity
+    (void)argc;
+    char* end;
+    double error_rate = strtod(argv[2], &end);
+    if (*end || !(error_rate > 0.0 && error_rate < 1.0)) {
+        snprintf(response_buf, response_max, "-ERR (0 < error rate range < 1)\r\n");
+        return;
+    }
+    unsigned long long capacity = strtoull(argv[3], &end, 10);
+    if (*end || argv[3][0] == '-' || capacity == 0 || capacity > BLOOM_MAX_CAPACITY) {
+        snprintf(response_buf, response_max, "-ERR (capacity should be larger than 0)\r\n");
+        return;
+    }
+
+    ht_lock(db);
+    if (ht_find_locked(db, argv[1])) {
+        snprintf(response_buf, response_max, "-ERR item exists\r\n");
+    } else {
+        size_t len;
+        char* blob = bloom_create(error_rate, capacity, &len);
+        bool ok = blob && ht_add_locked(db, argv[1], HT_BLOOM, blob, len);
+        snprintf(response_buf, response_max, ok ? "+OK\r\n" : "-ERR out of memory\r\n");
+    }
+    ht_unlock(db);
+}
+
+void bf_add_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    // BF.ADD key item
+    (void)argc;
+    ht_lock(db);
+    ht_entry_t* entry = bloom_lookup(db, argv[1], true, response_buf, response_max);
+    if (entry) {
+        bool added = bloom_add(entry->value, argv[2], strlen(argv[2]));
+        if (added) ht_touch_locked(db, entry);
+        snprintf(response_buf, response_max, ":%d\r\n", added ? 1 : 0);
+    }
+    ht_unlock(db);
+}
+
+void bf_madd_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    // BF.MADD key item [item ...]
+    ht_lock(db);
+    ht_entry_t* entry = bloom_lookup(db, argv[1], true, response_buf, response_max);
+    if (entry) {
+        size_t pos = 0;
+        bool any = false;
+        reply_append(response_buf, response_max, &pos, "*%d\r\n", argc - 2);
+        for (int i = 2; i < argc; i++) {
+            bool added = bloom_add(entry->value, argv[i], strlen(argv[i]));
+            any |= added;
+            reply_append(response_buf, response_max, &pos, ":%d\r\n", added ? 1 : 0);
+        }
+        if (any) ht_touch_locked(db, entry);
+    }
+    ht_unlock(db);
+}
+
+void bf_exists_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    // BF.EXISTS key item
+    (void)argc;
+    response_buf[0] = '\0';
+    ht_lock(db);
+    ht_entry_t* entry = bloom_lookup(db, argv[1], false, response_buf, response_max);
+    if (entry || !response_buf[0]) { // A missing key holds no items
+        bool found = entry && bloom_exists(entry->value, argv[2], strlen(argv[2]));
+        snprintf(response_buf, response_max, ":%d\r\n", found ? 1 : 0);
+    }
+    ht_unlock(db);
+}
+
+void bf_mexists_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    // BF.MEXISTS key item [item ...]
+    response_buf[0] = '\0';
+    ht_lock(db);
+    ht_entry_t* entry = bloom_lookup(db, argv[1], false, response_buf, response_max);
+    if (entry || !response_buf[0]) {
+        size_t pos = 0;
+        reply_append(response_buf, response_max, &pos, "*%d\r\n", argc - 2);
+        for (int i = 2; i < argc; i++) {
+            bool found = entry && bloom_exists(entry->value, argv[i], strlen(argv[i]));
+            reply_append(response_buf, response_max, &pos, ":%d\r\n", found ? 1 : 0);
+        }
+    }
+    ht_unlock(db);
+}
@@ -0,0 +1,38 @@
+/* bloom.h - Blocked Bloom filter type (BF.RESERVE / BF.ADD / BF.EXISTS ...) */
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include "common.h"
+#include "hash_table.h"
+
+// --- Configuration ---
+#define BLOOM_BLOCK_BYTES 64           // One cache line per block: a lookup touches one line
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_BYTES * 8)
+#define BLOOM_MAX_K 16                 // Hash functions per item, at most
+#define BLOOM_DEFAULT_ERROR_RATE 0.01  // Filters auto-created by BF.ADD/BF.MADD
+#define BLOOM_DEFAULT_CAPACITY 100
+#define BLOOM_MAX_CAPACITY (1ULL << 32)
+
+// --- Public API ---
+
+/**
+ * @brief Allocates a zeroed filter sized for 'capacity' items at 'error_rate'.
+ * The blob is 64-byte aligned and stored as an HT_BLOOM value.
+ * @return The blob (free() it), or NULL if out of memory.
+ */
+char* bloom_create(double error_rate, uint64_t capacity, size_t* blob_len);
+
+// Sets the item's bits. Returns true if any was newly set (the item was not present).
+bool bloom_add(char* blob, const char* item, size_t len);
+
+// True if the item may have been added; false means it definitely was not.
+bool bloom_exists(const char* blob, const char* item, size_t len);
+
+// command_fn handlers
+void bf_reserve_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+void bf_add_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+void bf_madd_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+void bf_exists_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+void bf_mexists_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+
+#endif // BLOOM_H
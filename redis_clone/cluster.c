@@ -0,0 +1,529 @@
+/* cluster.c - Slot map, redirects and live slot migration */
+#include "cluster.h"
+#include "protocol.h"
+#include "server.h"      // for READ_BUFFER_SIZE, the longest line a node accepts
+#include <strings.h>     // for strcasecmp
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/time.h>    // for struct timeval (socket timeouts)
+
+// Buckets walked per ht_scan() call while gathering a migration batch.
+// Bounds how long one batch holds the table lock.
+#define MIGRATE_SCAN_BUCKETS 64
+
+// --- CRC16 (XMODEM, poly 0x1021) ---
+// Niche C: Same polynomial Redis Cluster uses, so slot numbers match real clients.
+static uint16_t crc16_table[256];
+static pthread_once_t crc16_once = PTHREAD_ONCE_INIT;
+
+static void crc16_init_table(void) {
+    for (int i = 0; i < 256; i++) {
+        uint16_t crc = (uint16_t)(i << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+        crc16_table[i] = crc;
+    }
+}
+
+static uint16_t crc16(const char* buf, size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc = (uint16_t)((crc << 8) ^ crc16_table[((crc >> 8) ^ (uint8_t)buf[i]) & 0xff]);
+    }
+    return crc;
+}
+
+int cluster_key_slot(const char* key) {
+    pthread_once(&crc16_once, crc16_init_table);
+    size_t len = strlen(key);
+
+    // Hash tags: only hash the part between the first '{' and the next '}',
+    // so "{user1}.name" and "{user1}.age" land in the same slot.
+    const char* open = strchr(key, '{');
+    if (open) {
+        const char* close = strchr(open + 1, '}');
+        if (close && close > open + 1) {
+            return crc16(open + 1, (size_t)(close - open - 1)) & (CLUSTER_SLOTS - 1);
+        }
+    }
+    return crc16(key, len) & (CLUSTER_SLOTS - 1);
+}
+
+// --- Topology ---
+
+// Returns the index of host:port in nodes[], adding it if 'create' is set. -1 if not found/full.
+static int find_node(cluster_t* cluster, const char* host, int port, bool create) {
+    for (int i = 0; i < cluster->num_nodes; i++) {
+        if (cluster->nodes[i].port == port && strcmp(cluster->nodes[i].host, host) == 0) {
+            return i;
+        }
+    }
+    if (!create || cluster->num_nodes >= CLUSTER_MAX_NODES) return -1;
+
+    cluster_node_t* node = &cluster->nodes[cluster->num_nodes];
+    snprintf(node->host, sizeof(node->host), "%s", host);
+    node->port = port;
+    return cluster->num_nodes++;
+}
+
+// Parses "host:port" into a node index (adding unknown nodes). -1 on bad input.
+static int parse_node_addr(cluster_t* cluster, const char* addr) {
+    char host[CLUSTER_HOST_LEN];
+    const char* colon = strrchr(addr, ':');
+    if (!colon || colon == addr || (size_t)(colon - addr) >= sizeof(host)) return -1;
+
+    memcpy(host, addr, (size_t)(colon - addr));
+    host[colon - addr] = '\0';
+    int port = atoi(colon + 1);
+    if (port <= 0 || port > 65535) return -1;
+    return find_node(cluster, host, port, true);
+}
+
+cluster_t* cluster_load(const char* path, int self_port) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror("fopen cluster config");
+        return NULL;
+    }
+
+    cluster_t* cluster = (cluster_t*)malloc(sizeof(cluster_t));
+    if (!cluster) ERROR_EXIT("malloc cluster_t");
+
+    cluster->num_nodes = 0;
+    cluster->self = -1;
+    for (int i = 0; i < CLUSTER_SLOTS; i++) {
+        cluster->slot_owner[i] = -1;
+        cluster->migrating_to[i] = -1;
+        cluster->importing_from[i] = -1;
+    }
+    pthread_rwlock_init(&cluster->lock, NULL);
+
+    // Format: "host port [first_slot last_slot]" per line, '#' starts a comment.
+    // A node may appear on several lines to own several ranges.
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        char host[CLUSTER_HOST_LEN];
+        int port, first, last;
+        if (line[0] == '#' || line[0] == '\n') continue;
+
+        int fields = sscanf(line, "%63s %d %d %d", host, &port, &first, &last);
+        if (fields != 2 && fields != 4) {
+            fprintf(stderr, "Cluster config %s:%d: expected 'host port [first last]'\n", path, line_no);
+            goto fail;
+        }
+
+        int node = find_node(cluster, host, port, true);
+        if (node == -1) {
+            fprintf(stderr, "Cluster config %s:%d: too many nodes\n", path, line_no);
+            goto fail;
+        }
+        if (port == self_port && cluster->self == -1) cluster->self = node;
+
+        if (fields == 4) {
+            if (first < 0 || last >= CLUSTER_SLOTS || first > last) {
+                fprintf(stderr, "Cluster config %s:%d: bad slot range %d-%d\n", path, line_no, first, last);
+                goto fail;
+            }
+            for (int slot = first; slot <= last; slot++) {
+                cluster->slot_owner[slot] = (int16_t)node;
+            }
+        }
+    }
+    fclose(file);
+
+    if (cluster->self == -1) {
+        fprintf(stderr, "Cluster config %s: no node listens on port %d\n", path, self_port);
+        cluster_destroy(cluster);
+        return NULL;
+    }
+    return cluster;
+
+fail:
+    fclose(file);
+    cluster_destroy(cluster);
+    return NULL;
+}
+
+void cluster_destroy(cluster_t* cluster) {
+    pthread_rwlock_destroy(&cluster->lock);
+    free(cluster);
+}
+
+// --- Redirects ---
+
+void cluster_read_lock(cluster_t* cluster) {
+    pthread_rwlock_rdlock(&cluster->lock);
+}
+
+void cluster_read_unlock(cluster_t* cluster) {
+    pthread_rwlock_unlock(&cluster->lock);
+}
+
+bool cluster_redirect(cluster_t* cluster, hash_table_t* db, const char* key, bool asking,
+                      char* response_buf, size_t response_max) {
+    pthread_rwlock_rdlock(&cluster->lock);
+    bool redirected = cluster_redirect_locked(cluster, db, key, asking, response_buf, response_max);
+    pthread_rwlock_unlock(&cluster->lock);
+    return redirected;
+}
+
+bool cluster_redirect_locked(cluster_t* cluster, hash_table_t* db, const char* key, bool asking,
+                             char* response_buf, size_t response_max) {
+    int slot = cluster_key_slot(key);
+    bool redirected = false;
+    int owner = cluster->slot_owner[slot];
+
+    if (owner == cluster->self) {
+        // We own the slot. While it is migrating, keys we no longer have
+        // (already moved, or new) are served by the target: -ASK.
+        int target = cluster->migrating_to[slot];
+        if (target != -1 && !ht_contains(db, key)) {
+            snprintf(response_buf, response_max, "-ASK %d %s:%d\r\n",
+                     slot, cluster->nodes[target].host, cluster->nodes[target].port);
+            redirected = true;
+        }
+    } else if (!(asking && cluster->importing_from[slot] != -1)) {
+        // Not ours (and not an ASKING client hitting a slot we import): -MOVED.
+        if (owner == -1) {
+            snprintf(response_buf, response_max, "-CLUSTERDOWN Hash slot %d not served\r\n", slot);
+        } else {
+            snprintf(response_buf, response_max, "-MOVED %d %s:%d\r\n",
+                     slot, cluster->nodes[owner].host, cluster->nodes[owner].port);
+        }
+        redirected = true;
+    }
+    return redirected;
+}
+
+// --- CLUSTER SLOTS ---
+
+static char* cluster_slots_reply(cluster_t* cluster, char* response_buf, size_t response_max) {
+    // Two passes: count contiguous ranges for the array header, then emit them.
+    // ~45 bytes per range: a fragmented map outgrows response_buf, so the
+    // reply is built in a growable buffer.
+    reply_buffer_t reply;
+    reply_buffer_init(&reply, response_max);
+    int ranges = 0;
+
+    pthread_rwlock_rdlock(&cluster->lock);
+    for (int slot = 0; slot < CLUSTER_SLOTS; slot++) {
+        int owner = cluster->slot_owner[slot];
+        if (owner != -1 && (slot == 0 || cluster->slot_owner[slot - 1] != owner)) ranges++;
+    }
+
+    reply_buffer_append(&reply, "*%d\r\n", ranges);
+    int start = 0;
+    for (int slot = 0; slot <= CLUSTER_SLOTS; slot++) {
+        bool range_ends = (slot == CLUSTER_SLOTS) ||
+                          (slot > 0 && cluster->slot_owner[slot] != cluster->slot_owner[slot - 1]);
+        if (range_ends && slot > 0) {
+            int owner = cluster->slot_owner[slot - 1];
+            if (owner != -1) {
+                // [start, end, [host, port]]
+                const cluster_node_t* node = &cluster->nodes[owner];
+                reply_buffer_append(&reply, "*3\r\n:%d\r\n:%d\r\n*2\r\n$%zu\r\n%s\r\n:%d\r\n",
+                                    start, slot - 1, strlen(node->host), node->host, node->port);
+            }
+            start = slot;
+        }
+    }
+    pthread_rwlock_unlock(&cluster->lock);
+    return reply_buffer_finish(&reply, response_buf, response_max);
+}
+
+// --- CLUSTER SETSLOT ---
+
+// First key of one slot found by a full ht_scan() walk
+typedef struct {
+    int slot;
+    bool found;
+    char key[65]; // Enough to name it in an error
+} slot_probe_t;
+
+static void probe_slot_key(const ht_entry_t* entry, void* ctx) {
+    slot_probe_t* probe = (slot_probe_t*)ctx;
+    if (probe->found || cluster_key_slot(entry->key) != probe->slot) return;
+    probe->found = true;
+    snprintf(probe->key, sizeof(probe->key), "%s", entry->key);
+}
+
+static void cluster_setslot(cluster_t* cluster, hash_table_t* db, int argc, char** argv,
+                            char* response_buf, size_t response_max) {
+    // CLUSTER SETSLOT <slot> MIGRATING|IMPORTING|NODE <host:port>
+    // CLUSTER SETSLOT <slot> STABLE
+    int slot = atoi(argv[2]);
+    if (slot < 0 || slot >= CLUSTER_SLOTS) {
+        snprintf(response_buf, response_max, "-ERR Invalid slot\r\n");
+        return;
+    }
+
+    pthread_rwlock_wrlock(&cluster->lock);
+    const char* error = NULL;
+    char error_buf[160];
+
+    if (strcasecmp(argv[3], "STABLE") == 0 && argc == 4) {
+        cluster->migrating_to[slot] = -1;
+        cluster->importing_from[slot] = -1;
+    } else if (argc == 5) {
+        int node = parse_node_addr(cluster, argv[4]);
+        if (node == -1) {
+            error = "-ERR Invalid node address\r\n";
+        } else if (strcasecmp(argv[3], "MIGRATING") == 0) {
+            if (cluster->slot_owner[slot] != cluster->self) error = "-ERR I'm not the owner of this slot\r\n";
+            else cluster->migrating_to[slot] = (int16_t)node;
+        } else if (strcasecmp(argv[3], "IMPORTING") == 0) {
+            if (cluster->slot_owner[slot] == cluster->self) error = "-ERR I'm already the owner of this slot\r\n";
+            else cluster->importing_from[slot] = (int16_t)node;
+        } else if (strcasecmp(argv[3], "NODE") == 0) {
+            // Handing a slot away while keys of it are still here would orphan
+            // them (e.g. Bloom filters and HyperLogLogs, which CLUSTER MIGRATE
+            // cannot move). Probed under the write lock: keyed commands hold
+            // the read lock from their redirect check until they have run, so
+            // none can add a key between this walk and the owner change.
+            slot_probe_t probe = { .slot = slot, .found = false };
+            if (cluster->slot_owner[slot] == cluster->self && node != cluster->self) {
+                size_t cursor = 0;
+                do {
+                    cursor = ht_scan(db, cursor, MIGRATE_SCAN_BUCKETS, probe_slot_key, &probe);
+                } while (cursor != 0 && !probe.found);
+            }
+            if (probe.found) {
+                snprintf(error_buf, sizeof(error_buf),
+                         "-ERR Slot %d still holds key '%s' on this node; migrate or delete it first\r\n",
+                         slot, probe.key);
+                error = error_buf;
+            } else {
+                // Final step of a migration: everyone learns the new owner.
+                cluster->slot_owner[slot] = (int16_t)node;
+                cluster->migrating_to[slot] = -1;
+                cluster->importing_from[slot] = -1;
+            }
+        } else {
+            error = "-ERR Unknown SETSLOT action\r\n";
+        }
+    } else {
+        error = "-ERR Wrong number of arguments for SETSLOT\r\n";
+    }
+
+    pthread_rwlock_unlock(&cluster->lock);
+    snprintf(response_buf, response_max, "%s", error ? error : "+OK\r\n");
+}
+
+// --- CLUSTER MIGRATE (live slot migration, one batch per call) ---
+
+// Keys (and values) of one slot copied out of the table
+typedef struct {
+    int slot;
+    int count;
+    int capacity;
+    char** keys;
+    char** values;
+    char* typed_key; // First Bloom filter / HyperLogLog of the slot seen, or NULL
+} migrate_batch_t;
+
+static void collect_slot_keys(const ht_entry_t* entry, void* ctx) {
+    migrate_batch_t* batch = (migrate_batch_t*)ctx;
+    if (cluster_key_slot(entry->key) != batch->slot) return;
+    // Bloom filters and HyperLogLogs are binary and cannot travel as "SET k v";
+    // they stay behind, and the reply names one so the slot is not handed
+    // over with them (SETSLOT NODE refuses while any key remains).
+    if (entry->type != HT_STRING) {
+        if (!batch->typed_key) batch->typed_key = strdup(entry->key);
+        return;
+    }
+
+    if (batch->count == batch->capacity) {
+        batch->capacity = (batch->capacity < 8) ? 8 : batch->capacity * 2;
+        batch->keys = (char**)realloc(batch->keys, sizeof(char*) * batch->capacity);
+        batch->values = (char**)realloc(batch->values, sizeof(char*) * batch->capacity);
+        if (!batch->keys || !batch->values) ERROR_EXIT("realloc migrate batch");
+    }
+    batch->keys[batch->count] = strdup(entry->key);
+    batch->values[batch->count] = strdup(entry->value);
+    batch->count++;
+}
+
+static void free_batch(migrate_batch_t* batch) {
+    for (int i = 0; i < batch->count; i++) {
+        free(batch->keys[i]);
+        free(batch->values[i]);
+    }
+    free(batch->keys);
+    free(batch->values);
+    free(batch->typed_key);
+}
+
+// Opens a blocking connection to another node, with I/O timeouts.
+static int connect_to_node(const cluster_node_t* node) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+
+    struct timeval tv = { .tv_sec = CLUSTER_IO_TIMEOUT_SEC, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(node->port);
+    if (inet_pton(AF_INET, node->host, &addr.sin_addr) != 1 ||
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sends one command line and waits for a "+OK" reply. Lock-step: one request in flight.
+static bool send_and_expect_ok(int fd, const char* line) {
+    size_t len = strlen(line), sent = 0;
+    while (sent < len) {
+        ssize_t n = send(fd, line + sent, len - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += (size_t)n;
+    }
+
+    char reply[64];
+    size_t got = 0;
+    while (got < sizeof(reply) - 1) {
+        ssize_t n = recv(fd, reply + got, sizeof(reply) - 1 - got, 0);
+        if (n <= 0) return false;
+        got += (size_t)n;
+        reply[got] = '\0';
+        if (strstr(reply, "\r\n")) break;
+    }
+    return strncmp(reply, "+OK\r\n", 5) == 0;
+}
+
+static void cluster_migrate(cluster_t* cluster, hash_table_t* db, int argc, char** argv,
+                            char* response_buf, size_t response_max) {
+    // CLUSTER MIGRATE <slot> <cursor> <count>
+    // Moves at least 'count' keys of 'slot' (if that many remain) to the node
+    // set with SETSLOT MIGRATING, and returns [next_cursor, moved]. Call again
+    // with next_cursor until it is 0; a pass that moves 0 keys means the slot is empty.
+    if (argc != 5) {
+        snprintf(response_buf, response_max, "-ERR Usage: CLUSTER MIGRATE <slot> <cursor> <count>\r\n");
+        return;
+    }
+    int slot = atoi(argv[2]);
+    size_t cursor = strtoull(argv[3], NULL, 10);
+    int count = atoi(argv[4]);
+    if (slot < 0 || slot >= CLUSTER_SLOTS || count <= 0) {
+        snprintf(response_buf, response_max, "-ERR Invalid slot or count\r\n");
+        return;
+    }
+
+    pthread_rwlock_rdlock(&cluster->lock);
+    int target = cluster->migrating_to[slot];
+    cluster_node_t target_node;
+    if (target != -1) target_node = cluster->nodes[target];
+    pthread_rwlock_unlock(&cluster->lock);
+
+    if (target == -1) {
+        snprintf(response_buf, response_max, "-ERR Slot %d is not MIGRATING\r\n", slot);
+        return;
+    }
+
+    // 1. Gather a batch. Each ht_scan() call holds the table lock for only
+    //    MIGRATE_SCAN_BUCKETS buckets, so other workers keep getting in.
+    migrate_batch_t batch = { .slot = slot, .count = 0, .capacity = 0, .keys = NULL, .values = NULL,
+                              .typed_key = NULL };
+    do {
+        cursor = ht_scan(db, cursor, MIGRATE_SCAN_BUCKETS, collect_slot_keys, &batch);
+    } while (cursor != 0 && batch.count < count);
+
+    // 2. Ship the batch. No table lock is held during network I/O.
+    int moved = 0;
+    if (batch.count > 0) {
+        int fd = connect_to_node(&target_node);
+        if (fd == -1) {
+            free_batch(&batch);
+            snprintf(response_buf, response_max, "-IOERR Cannot connect to %s:%d\r\n",
+                     target_node.host, target_node.port);
+            return;
+        }
+
+        const char* unsendable = NULL;
+        for (int i = 0; i < batch.count; i++) {
+            // Quoted like a client would send it, so spaces and quotes survive
+            char* set_argv[] = { "SET", batch.keys[i], batch.values[i] };
+            char* cmd = join_args(3, set_argv);
+            if (!cmd) ERROR_EXIT("malloc migrate line");
+            size_t len = strlen(cmd);
+
+            // The target reads one line of at most READ_BUFFER_SIZE - 1 bytes
+            // and splits on CR/LF, so such a key cannot travel; the rest of
+            // the batch still moves, then the reply names it.
+            if (len + 2 > READ_BUFFER_SIZE - 1 || strpbrk(cmd, "\r\n")) {
+                free(cmd);
+                if (!unsendable) unsendable = batch.keys[i];
+                continue;
+            }
+            char* line = (char*)realloc(cmd, len + 3);
+            if (!line) ERROR_EXIT("realloc migrate line");
+            memcpy(line + len, "\r\n", 3);
+
+            bool sent = send_and_expect_ok(fd, "ASKING\r\n") && send_and_expect_ok(fd, line);
+            free(line);
+            if (!sent) break;
+
+            // 3. Drop our copy, unless a client overwrote it meanwhile; that
+            //    key stays here and is picked up by the next pass.
+            if (ht_delete_if_equal(db, batch.keys[i], batch.values[i])) moved++;
+        }
+        close(fd);
+
+        if (unsendable) {
+            snprintf(response_buf, response_max,
+                     "-ERR Key '%.64s' does not fit one request line to the target (%d keys moved)\r\n",
+                     unsendable, moved);
+            free_batch(&batch);
+            return;
+        }
+    }
+    if (batch.typed_key) {
+        snprintf(response_buf, response_max,
+                 "-ERR Key '%.64s' is a Bloom filter or HyperLogLog and cannot be migrated (%d keys moved)\r\n",
+                 batch.typed_key, moved);
+        free_batch(&batch);
+        return;
+    }
+    free_batch(&batch);
+
+    char cursor_str[32];
+    size_t pos = 0;
+    snprintf(cursor_str, sizeof(cursor_str), "%zu", cursor);
+    reply_append(response_buf, response_max, &pos, "*2\r\n");
+    reply_bulk(response_buf, response_max, &pos, cursor_str);
+    reply_append(response_buf, response_max, &pos, ":%d\r\n", moved);
+}
+
+// --- CLUSTER dispatcher ---
+
+void cluster_command(cluster_t* cluster, hash_table_t* db, int argc, char** argv,
+                     char* response_buf, size_t response_max, char** long_reply) {
+    if (!cluster) {
+        snprintf(response_buf, response_max, "-ERR This instance has cluster support disabled\r\n");
+        return;
+    }
+    if (argc < 2) {
+        snprintf(response_buf, response_max, "-ERR Missing CLUSTER subcommand\r\n");
+        return;
+    }
+
+    if (strcasecmp(argv[1], "KEYSLOT") == 0 && argc == 3) {
+        snprintf(response_buf, response_max, ":%d\r\n", cluster_key_slot(argv[2]));
+    } else if (strcasecmp(argv[1], "SLOTS") == 0) {
+        *long_reply = cluster_slots_reply(cluster, response_buf, response_max);
+    } else if (strcasecmp(argv[1], "SETSLOT") == 0 && argc >= 4) {
+        cluster_setslot(cluster, db, argc, argv, response_buf, response_max);
+    } else if (strcasecmp(argv[1], "MIGRATE") == 0) {
+        cluster_migrate(cluster, db, argc, argv, response_buf, response_max);
+    } else {
+        snprintf(response_buf, response_max, "-ERR Unknown CLUSTER subcommand\r\n");
+    }
+}
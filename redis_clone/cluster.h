@@ -0,0 +1,72 @@
+/* cluster.h - Hash-slot sharding across multiple C-Redis processes */
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include "common.h"
+#include "hash_table.h"
+
+// --- Configuration ---
+#define CLUSTER_SLOTS 16384      // Keyspace is split into this many hash slots
+#define CLUSTER_MAX_NODES 64
+#define CLUSTER_HOST_LEN 64
+#define CLUSTER_IO_TIMEOUT_SEC 2 // Timeout for node-to-node migration traffic
+
+// --- Structures ---
+
+// One C-Redis process taking part in the cluster
+typedef struct {
+    char host[CLUSTER_HOST_LEN];
+    int port;
+} cluster_node_t;
+
+// Cluster topology as seen by this node
+typedef struct cluster_t {
+    int self;                    // Index of this process in nodes[]
+    int num_nodes;
+    cluster_node_t nodes[CLUSTER_MAX_NODES];
+
+    // Niche C: int16_t keeps the three slot maps at 32 KiB each.
+    int16_t slot_owner[CLUSTER_SLOTS];     // Node serving each slot (-1 = unassigned)
+    int16_t migrating_to[CLUSTER_SLOTS];   // Target node while we move a slot away (-1 = none)
+    int16_t importing_from[CLUSTER_SLOTS]; // Source node while a slot moves here (-1 = none)
+
+    pthread_rwlock_t lock;       // Readers: every keyed command, while it runs. Writers: CLUSTER SETSLOT.
+} cluster_t;
+
+// --- Public API ---
+
+/**
+ * @brief Loads the topology from a nodes file ("host port first_slot last_slot" per line).
+ * @param self_port The port this process listens on; identifies our own line.
+ * @return The cluster state, or NULL if the file is invalid.
+ */
+cluster_t* cluster_load(const char* path, int self_port);
+void cluster_destroy(cluster_t* cluster);
+
+// CRC16 (XMODEM) of the key, or of its "{hash tag}" if present, modulo CLUSTER_SLOTS.
+int cluster_key_slot(const char* key);
+
+/**
+ * @brief Decides whether this node may serve 'key'.
+ * @param asking True if the client sent ASKING just before this command.
+ * @return true if a -MOVED/-ASK redirect was written to response_buf instead.
+ */
+bool cluster_redirect(cluster_t* cluster, hash_table_t* db, const char* key, bool asking,
+                      char* response_buf, size_t response_max);
+
+// Hold the topology still from a redirect check until the command it let
+// through has run: CLUSTER SETSLOT (the writer) waits for it. Take this
+// before ht_lock(), never after.
+void cluster_read_lock(cluster_t* cluster);
+void cluster_read_unlock(cluster_t* cluster);
+// cluster_redirect() for a caller holding cluster_read_lock().
+bool cluster_redirect_locked(cluster_t* cluster, hash_table_t* db, const char* key, bool asking,
+                             char* response_buf, size_t response_max);
+
+// Handles "CLUSTER <subcommand> ..." (argv[0] is "CLUSTER"). A reply too
+// long for response_buf (CLUSTER SLOTS of a fragmented map) is returned in
+// *long_reply instead, malloc'd, for the caller to send and free.
+void cluster_command(cluster_t* cluster, hash_table_t* db, int argc, char** argv,
+                     char* response_buf, size_t response_max, char** long_reply);
+
+#endif // CLUSTER_H
@@ -0,0 +1,518 @@
+/* commands.c - Command parsing and execution (runs on worker threads) */
+#include "commands.h"
+#include "protocol.h"
+#include "cluster.h"
+#include "multi.h"
+#include "eval.h"
+#include "slowlog.h"
+#include "latency.h"
+#include "bloom.h"
+#include "hyperloglog.h"
+#include <strings.h> // for strcasecmp
+
+// --- Glob Matching (for SCAN MATCH) ---
+// Supports '*', '?', '[abc]', '[^a-z]' and '\' escapes, like Redis.
+static bool glob_match(const char* pattern, const char* str) {
+    while (*pattern) {
+        switch (*pattern) {
+            case '*':
+                while (pattern[1] == '*') pattern++; // "**" == "*"
+                pattern++;
+                // Try every possible split point, including the empty suffix
+                for (;;) {
+                    if (glob_match(pattern, str)) return true;
+                    if (*str == '\0') return false;
+                    str++;
+                }
+            case '?':
+                if (*str == '\0') return false;
+                pattern++;
+                str++;
+                break;
+            case '[': {
+                pattern++;
+                bool negate = (*pattern == '^');
+                if (negate) pattern++;
+                bool matched = false;
+                while (*pattern && *pattern != ']') {
+                    if (*pattern == '\\' && pattern[1]) {
+                        pattern++;
+                        if (*pattern == *str) matched = true;
+                        pattern++;
+                    } else if (pattern[1] == '-' && pattern[2] && pattern[2] != ']') {
+                        char lo = pattern[0], hi = pattern[2];
+                        if (lo > hi) { char tmp = lo; lo = hi; hi = tmp; }
+                        if (*str >= lo && *str <= hi) matched = true;
+                        pattern += 3;
+                    } else {
+                        if (*pattern == *str) matched = true;
+                        pattern++;
+                    }
+                }
+                if (*pattern == ']') pattern++;
+                if (*str == '\0' || matched == negate) return false;
+                str++;
+                break;
+            }
+            case '\\':
+                if (pattern[1]) pattern++; // Match the next character literally
+                /* fallthrough */
+            default:
+                if (*pattern != *str) return false;
+                pattern++;
+                str++;
+                break;
+        }
+    }
+    return *str == '\0';
+}
+
+// --- SCAN ---
+
+// Matching keys of one SCAN call, already encoded as RESP bulk strings
+typedef struct {
+    const char* pattern; // NULL matches everything
+    char* keys_buf;
+    size_t keys_max;
+    size_t keys_pos;
+    int found;
+    bool overflow;
+} scan_ctx_t;
+
+// Runs under the table lock: keep it to a compare and a copy.
+static void scan_collect(const ht_entry_t* entry, void* arg) {
+    scan_ctx_t* ctx = (scan_ctx_t*)arg;
+    if (ctx->pattern && !glob_match(ctx->pattern, entry->key)) return;
+
+    size_t len = strlen(entry->key);
+    if (ctx->keys_pos + len + 32 >= ctx->keys_max) {
+        ctx->overflow = true;
+        return;
+    }
+    reply_bulk(ctx->keys_buf, ctx->keys_max, &ctx->keys_pos, entry->key);
+    ctx->found++;
+}
+
+static void scan_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    // SCAN <cursor> [MATCH pattern] [COUNT count]
+    char* end;
+    size_t cursor = strtoull(argv[1], &end, 10);
+    if (*end != '\0') {
+        snprintf(response_buf, response_max, "-ERR invalid cursor\r\n");
+        return;
+    }
+
+    const char* pattern = NULL;
+    long count = SCAN_DEFAULT_COUNT;
+    for (int i = 2; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            snprintf(response_buf, response_max, "-ERR syntax error\r\n");
+            return;
+        }
+        if (strcasecmp(argv[i], "MATCH") == 0) {
+            // "*" matches everything; skip the matcher entirely
+            pattern = (strcmp(argv[i + 1], "*") == 0) ? NULL : argv[i + 1];
+        } else if (strcasecmp(argv[i], "COUNT") == 0) {
+            count = strtol(argv[i + 1], &end, 10);
+            if (*end != '\0' || count < 1) {
+                snprintf(response_buf, response_max, "-ERR value is not an integer or out of range\r\n");
+                return;
+            }
+        } else {
+            snprintf(response_buf, response_max, "-ERR syntax error\r\n");
+            return;
+        }
+    }
+
+    char keys_buf[WRITE_BUFFER_SIZE];
+    keys_buf[0] = '\0';
+    scan_ctx_t ctx = { .pattern = pattern, .keys_buf = keys_buf, .keys_max = sizeof(keys_buf) - 64,
+                       .keys_pos = 0, .found = 0, .overflow = false };
+
+    // One bucket per lock acquisition: a SCAN never holds the table lock for
+    // more than a single chain, so it cannot stall writers on a big keyspace.
+    size_t next = cursor;
+    size_t visited = 0;
+    size_t budget = (size_t)count * SCAN_BUCKETS_PER_KEY;
+    do {
+        // Remember where this bucket's keys start so an overflow can be rolled back
+        size_t saved_pos = ctx.keys_pos;
+        int saved_found = ctx.found;
+        size_t candidate = ht_scan(db, next, 1, scan_collect, &ctx);
+        if (ctx.overflow) {
+            // Bucket did not fit: drop its partial keys, the next call starts at it again
+            ctx.keys_pos = saved_pos;
+            ctx.found = saved_found;
+            keys_buf[saved_pos] = '\0';
+            break;
+        }
+        next = candidate;
+        visited++;
+    } while (next != 0 && ctx.found < count && visited < budget && ctx.keys_pos < ctx.keys_max / 2);
+
+    if (ctx.overflow && visited == 0) {
+        snprintf(response_buf, response_max, "-ERR SCAN reply does not fit the response buffer\r\n");
+        return;
+    }
+
+    // [next_cursor, [key, ...]]
+    char cursor_str[32];
+    size_t pos = 0;
+    snprintf(cursor_str, sizeof(cursor_str), "%zu", next);
+    reply_append(response_buf, response_max, &pos, "*2\r\n");
+    reply_bulk(response_buf, response_max, &pos, cursor_str);
+    reply_append(response_buf, response_max, &pos, "*%d\r\n%s", ctx.found, keys_buf);
+}
+
+// --- Keyspace Commands ---
+
+static void get_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    (void)argc;
+    // Niche C: look up under the (recursive) lock so "absent" and "not a string" differ.
+    ht_lock(db);
+    ht_entry_t* entry = ht_find_locked(db, argv[1]);
+    if (entry && entry->type != HT_STRING) {
+        snprintf(response_buf, response_max, WRONGTYPE_REPLY);
+    } else if (entry) {
+        // Respond with "+VALUE <value>\r\n" (simplified RESP-like)
+        snprintf(response_buf, response_max, "+%s\r\n", entry->value);
+    } else {
+        // Respond with "$-1\r\n" (Null bulk string)
+        snprintf(response_buf, response_max, "$-1\r\n");
+    }
+    ht_unlock(db);
+}
+
+static void set_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    (void)argc;
+    ht_set(db, argv[1], argv[2]);
+    // Respond with "+OK\r\n"
+    snprintf(response_buf, response_max, "+OK\r\n");
+}
+
+static void del_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    (void)argc;
+    snprintf(response_buf, response_max, ":%d\r\n", ht_delete(db, argv[1]) ? 1 : 0);
+}
+
+static void unlink_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    (void)argc;
+    // Detach now, free the memory on the lazyfree thread
+    snprintf(response_buf, response_max, ":%d\r\n", ht_unlink(db, argv[1]) ? 1 : 0);
+}
+
+// --- Command Table ---
+// Commands that can run standalone or queued inside MULTI.
+
+typedef void (*command_fn)(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+
+typedef struct {
+    const char* name;
+    int arity;       // Exact argc, or -N for "at least N"
+    int first_key;   // argv index of the key routed on in cluster mode (0 = keyless)
+    command_fn fn;
+} command_t;
+
+// first_key value for "<cmd> <x> <numkeys> key ..." (EVAL-style commands)
+#define KEYS_AFTER_NUMKEYS -1
+
+static const command_t command_table[] = {
+    {"GET",     2,  1, get_command},
+    {"SET",     3,  1, set_command},
+    {"DEL",     2,  1, del_command},
+    {"UNLINK",  2,  1, unlink_command},
+    {"SCAN",    -2, 0, scan_command}, // Scans this node's keys only
+    {"EVAL",    -3, KEYS_AFTER_NUMKEYS, eval_command},
+    {"EVALSHA", -3, KEYS_AFTER_NUMKEYS, evalsha_command},
+    {"SCRIPT",  -2, 0, script_command},
+    {"SLOWLOG", -2, 0, slowlog_command},
+    {"LATENCY", -2, 0, latency_command},
+    {"BF.RESERVE", 4,  1, bf_reserve_command},
+    {"BF.ADD",     3,  1, bf_add_command},
+    {"BF.MADD",    -3, 1, bf_madd_command},
+    {"BF.EXISTS",  3,  1, bf_exists_command},
+    {"BF.MEXISTS", -3, 1, bf_mexists_command},
+    {"PFADD",      -2, 1, pfadd_command},
+    {"PFCOUNT",    -2, 1, pfcount_command}, // Keys beyond the first must share its slot
+};
+
+// The key a command is routed by, or NULL if it touches no key
+static const char* command_key(const command_t* cmd, int argc, char** argv) {
+    if (cmd->first_key == KEYS_AFTER_NUMKEYS) {
+        // Route on the first key; keys of one script are expected to share a slot
+        return (atoi(argv[2]) > 0 && argc > 3) ? argv[3] : NULL;
+    }
+    return (cmd->first_key > 0) ? argv[cmd->first_key] : NULL;
+}
+
+static const command_t* lookup_command(const char* name, int argc) {
+    for (size_t i = 0; i < sizeof(command_table) / sizeof(command_table[0]); i++) {
+        const command_t* cmd = &command_table[i];
+        if (strcasecmp(cmd->name, name) != 0) continue;
+        bool arity_ok = (cmd->arity >= 0) ? (argc == cmd->arity) : (argc >= -cmd->arity);
+        return arity_ok ? cmd : NULL;
+    }
+    return NULL;
+}
+
+// --- Transactions ---
+
+// Returns the client's transaction state, creating it on first use. Caller holds client->lock.
+static multi_state_t* client_multi(client_t* client) {
+    if (!client->multi) client->multi = multi_create();
+    return client->multi;
+}
+
+static void watch_command(hash_table_t* db, cluster_t* cluster, client_t* client, int argc, char** argv,
+                          char* response_buf, size_t response_max) {
+    // WATCH key [key ...]
+    for (int i = 1; i < argc; i++) {
+        if (cluster && cluster_redirect(cluster, db, argv[i], false, response_buf, response_max)) return;
+    }
+
+    pthread_mutex_lock(&client->lock);
+    multi_state_t* ms = client_multi(client);
+    const char* error = NULL;
+    if (ms->in_multi) {
+        error = "-ERR WATCH inside MULTI is not allowed\r\n";
+    } else {
+        for (int i = 1; i < argc && !error; i++) {
+            // Reading the version outside the table lock is fine: a write
+            // racing with WATCH simply makes the later EXEC fail.
+            if (!multi_watch(ms, argv[i], ht_version(db, argv[i]))) error = "-ERR Too many watched keys\r\n";
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    snprintf(response_buf, response_max, "%s", error ? error : "+OK\r\n");
+}
+
+// Cluster mode: writes the redirect for the first queued key whose slot no
+// longer lives here (handed off since it was queued). Caller holds the
+// cluster read lock and the table lock.
+static bool exec_redirected(hash_table_t* db, cluster_t* cluster, const multi_state_t* tx,
+                            char* response_buf, size_t response_max) {
+    for (int i = 0; i < tx->num_queued; i++) {
+        char* line = strdup(tx->queued[i]); // split_args() cuts in place; the line runs later
+        if (!line) ERROR_EXIT("strdup queued command");
+        char* argv[MAX_ARGS];
+        int argc = split_args(line, argv, MAX_ARGS);
+        const char* key = command_key(lookup_command(argv[0], argc), argc, argv);
+        bool redirected = key && cluster_redirect_locked(cluster, db, key, tx->asking, response_buf, response_max);
+        free(line);
+        if (redirected) return true;
+    }
+    return false;
+}
+
+static void exec_command(hash_table_t* db, work_item_t* work, char* response_buf, size_t response_max) {
+    client_t* client = work->client;
+    cluster_t* cluster = work->server->cluster;
+    // Detach the transaction so the client lock (which the event loop also
+    // takes) is not held while the commands run.
+    multi_state_t tx;
+    pthread_mutex_lock(&client->lock);
+    bool in_multi = client->multi && client->multi->in_multi;
+    if (in_multi) multi_take(&tx, client->multi);
+    pthread_mutex_unlock(&client->lock);
+
+    if (!in_multi) {
+        snprintf(response_buf, response_max, "-ERR EXEC without MULTI\r\n");
+        return;
+    }
+    if (tx.aborted) {
+        snprintf(response_buf, response_max, "-EXECABORT Transaction discarded because of previous errors\r\n");
+        multi_reset(&tx);
+        return;
+    }
+
+    // One acquisition of the table lock for the version check *and* every
+    // queued command: nothing can slip in between, and no per-command locking.
+    // Each reply may take up to a whole response buffer, so they are
+    // collected in a growable one; a *N header is always followed by N replies.
+    // In cluster mode the slots are re-checked under the same locks: one
+    // handed off since MULTI would otherwise get keys it no longer serves.
+    reply_buffer_t replies;
+    reply_buffer_init(&replies, response_max);
+    char redirect[256];
+    if (cluster) cluster_read_lock(cluster);
+    ht_lock(db);
+    if (cluster && exec_redirected(db, cluster, &tx, redirect, sizeof(redirect))) {
+        reply_buffer_append(&replies, "%s", redirect); // Nothing runs; retry where it points
+    } else if (!multi_watches_intact(&tx, db)) {
+        reply_buffer_append(&replies, "*-1\r\n"); // Null array: a watched key changed
+    } else {
+        reply_buffer_append(&replies, "*%d\r\n", tx.num_queued);
+        for (int i = 0; i < tx.num_queued; i++) {
+            char* argv[MAX_ARGS];
+            int argc = split_args(tx.queued[i], argv, MAX_ARGS);
+            const command_t* cmd = lookup_command(argv[0], argc); // Validated when queued
+
+            char reply[WRITE_BUFFER_SIZE];
+            cmd->fn(db, argc, argv, reply, sizeof(reply));
+            reply_buffer_append(&replies, "%s", reply);
+        }
+    }
+    ht_unlock(db);
+    if (cluster) cluster_read_unlock(cluster);
+    multi_reset(&tx);
+
+    work->long_reply = reply_buffer_finish(&replies, response_buf, response_max); // Sent instead if set
+}
+
+// Handles MULTI/EXEC/DISCARD/WATCH/UNWATCH. Returns false if argv[0] is none of them.
+static bool transaction_command(hash_table_t* db, cluster_t* cluster, work_item_t* work, int argc, char** argv,
+                                char* response_buf, size_t response_max) {
+    client_t* client = work->client;
+    const char* reply = NULL;
+
+    if (strcasecmp(argv[0], "MULTI") == 0 && argc == 1) {
+        pthread_mutex_lock(&client->lock);
+        multi_state_t* ms = client_multi(client);
+        if (ms->in_multi) {
+            reply = "-ERR MULTI calls can not be nested\r\n";
+        } else {
+            ms->in_multi = true;
+            reply = "+OK\r\n";
+        }
+        pthread_mutex_unlock(&client->lock);
+    } else if (strcasecmp(argv[0], "EXEC") == 0 && argc == 1) {
+        exec_command(db, work, response_buf, response_max);
+        return true;
+    } else if (strcasecmp(argv[0], "DISCARD") == 0 && argc == 1) {
+        pthread_mutex_lock(&client->lock);
+        if (client->multi && client->multi->in_multi) {
+            multi_reset(client->multi); // Also forgets WATCHed keys, like Redis
+            reply = "+OK\r\n";
+        } else {
+            reply = "-ERR DISCARD without MULTI\r\n";
+        }
+        pthread_mutex_unlock(&client->lock);
+    } else if (strcasecmp(argv[0], "WATCH") == 0 && argc >= 2) {
+        watch_command(db, cluster, client, argc, argv, response_buf, response_max);
+        return true;
+    } else if (strcasecmp(argv[0], "UNWATCH") == 0 && argc == 1) {
+        pthread_mutex_lock(&client->lock);
+        if (client->multi && !client->multi->in_multi) multi_reset(client->multi);
+        pthread_mutex_unlock(&client->lock);
+        reply = "+OK\r\n";
+    } else {
+        return false;
+    }
+
+    snprintf(response_buf, response_max, "%s", reply);
+    return true;
+}
+
+// If the client is inside MULTI, queues the command and returns true.
+static bool maybe_queue_command(cluster_t* cluster, client_t* client, const command_t* cmd, int argc, char** argv,
+                                bool asking, char* response_buf, size_t response_max) {
+    pthread_mutex_lock(&client->lock);
+    multi_state_t* ms = client->multi;
+    if (!ms || !ms->in_multi) {
+        pthread_mutex_unlock(&client->lock);
+        return false;
+    }
+
+    const char* reply = "+QUEUED\r\n";
+    const char* key = command_key(cmd, argc, argv);
+    if (cluster && key) {
+        // EXEC runs under the table lock only, so every key must live in one slot here
+        int slot = cluster_key_slot(key);
+        if (ms->slot == -1) ms->slot = slot;
+        if (ms->slot != slot) reply = "-CROSSSLOT Keys in request don't hash to the same slot\r\n";
+        if (asking) ms->asking = true; // EXEC re-checks the slot as this command was let in
+    }
+    if (reply[0] == '+' && !multi_queue(ms, argc, argv)) reply = "-ERR Too many queued commands\r\n";
+    if (reply[0] == '-') ms->aborted = true;
+
+    pthread_mutex_unlock(&client->lock);
+    snprintf(response_buf, response_max, "%s", reply);
+    return true;
+}
+
+// Marks an open transaction as failed (a command could not be queued).
+static void abort_multi(client_t* client) {
+    pthread_mutex_lock(&client->lock);
+    if (client->multi && client->multi->in_multi) client->multi->aborted = true;
+    pthread_mutex_unlock(&client->lock);
+}
+
+/**
+ * @brief Parses the client command and interacts with the hash table.
+ * This is the "application logic" executed by the worker thread.
+ */
+// Runs one parsed command (argc > 0) and writes its reply.
+static void execute_command(hash_table_t* db, work_item_t* work, int argc, char** argv,
+                            char* response_buf, size_t response_max) {
+    cluster_t* cluster = work->server->cluster;
+    client_t* client = work->client;
+
+    // ASKING only applies to the very next command on this connection
+    pthread_mutex_lock(&client->lock);
+    bool asking = client->asking;
+    client->asking = false;
+    pthread_mutex_unlock(&client->lock);
+
+    if (strcasecmp(argv[0], "ASKING") == 0 && argc == 1) {
+        pthread_mutex_lock(&client->lock);
+        client->asking = true;
+        pthread_mutex_unlock(&client->lock);
+        snprintf(response_buf, response_max, "+OK\r\n");
+        return;
+    }
+    if (strcasecmp(argv[0], "CLUSTER") == 0) {
+        cluster_command(cluster, db, argc, argv, response_buf, response_max, &work->long_reply);
+        return;
+    }
+    if (transaction_command(db, cluster, work, argc, argv, response_buf, response_max)) {
+        return;
+    }
+
+    const command_t* cmd = lookup_command(argv[0], argc);
+    if (!cmd) {
+        abort_multi(client);
+        // Respond with "-ERR Unknown command or wrong args\r\n"
+        snprintf(response_buf, response_max, "-ERR Unknown command or wrong args\r\n");
+        return;
+    }
+
+    // Keyed commands: make sure the key's slot lives here, and keep it here
+    // until the command has run (a slot handed off in between would strand
+    // the key on a node that no longer serves it)
+    const char* key = command_key(cmd, argc, argv);
+    bool routed = key && cluster;
+    if (routed) {
+        cluster_read_lock(cluster);
+        if (cluster_redirect_locked(cluster, db, key, asking, response_buf, response_max)) {
+            cluster_read_unlock(cluster);
+            abort_multi(client);
+            return;
+        }
+    }
+
+    if (!maybe_queue_command(cluster, client, cmd, argc, argv, asking, response_buf, response_max)) {
+        cmd->fn(db, argc, argv, response_buf, response_max);
+    }
+    if (routed) cluster_read_unlock(cluster);
+}
+
+void handle_client_command(hash_table_t* db, work_item_t* work, char* response_buf, size_t response_max) {
+    // Simple text protocol: "CMD key [value]\r\n"
+    char* argv[MAX_ARGS];
+    int argc = split_args(work->request, argv, MAX_ARGS);
+
+    if (argc == 0) {
+        // Respond with "-ERR Invalid command format\r\n"
+        snprintf(response_buf, response_max, "-ERR Invalid command format\r\n");
+        return;
+    }
+
+    // Time spent waiting in the queue is not the command's fault; only execution counts
+    uint64_t start = monotonic_us();
+    execute_command(db, work, argc, argv, response_buf, response_max);
+    uint64_t duration = monotonic_us() - start;
+
+    slowlog_record(argc, argv, duration, work->client->addr);
+    latency_add_sample(LATENCY_COMMAND, duration);
+}
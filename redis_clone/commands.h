@@ -0,0 +1,22 @@
+/* commands.h - Command parsing and execution (runs on worker threads) */
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include "common.h"
+#include "hash_table.h"
+#include "thread_pool.h" // For work_item_t
+
+// --- Configuration ---
+#define SCAN_DEFAULT_COUNT 10
+#define SCAN_BUCKETS_PER_KEY 10 // Bucket budget per requested key, bounds work on sparse tables
+
+// --- Public API ---
+
+/**
+ * @brief Parses one request line and writes the reply into response_buf.
+ * A reply that does not fit (EXEC of many commands) is left in
+ * work->long_reply instead, malloc'd, for the caller to send and free.
+ */
+void handle_client_command(hash_table_t* db, work_item_t* work, char* response_buf, size_t response_max);
+
+#endif // COMMANDS_H
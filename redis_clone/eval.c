@@ -0,0 +1,325 @@
+/* eval.c - EVAL/EVALSHA: run C-Script bytecode next to the data */
+#include "eval.h"
+#include "sha1.h"
+#include "vm.h"       // From ../scripting_lang
+#include "compiler.h"
+#include "object.h"
+#include <ctype.h>
+#include <math.h>
+#include <strings.h>  // for strcasecmp
+#include <time.h>
+
+// --- Script Cache ---
+// Everything below (cache, VM, script context) is only touched while holding
+// the table lock: a script runs atomically, and the VM is a single global.
+
+typedef struct script_t {
+    char sha[SHA1_HEX_LEN];
+    Chunk chunk;             // Compiled once, run by every EVAL/EVALSHA
+    struct script_t* next;
+} script_t;
+
+static script_t* script_cache[SCRIPT_CACHE_BUCKETS];
+
+static size_t cache_bucket(const char* sha) {
+    // The digest is already uniformly distributed: its first 8 hex digits make a fine hash
+    char prefix[9];
+    memcpy(prefix, sha, 8);
+    prefix[8] = '\0';
+    return strtoul(prefix, NULL, 16) % SCRIPT_CACHE_BUCKETS;
+}
+
+static bool valid_sha(const char* sha) {
+    return strlen(sha) == SHA1_HEX_LEN - 1;
+}
+
+static script_t* cache_lookup(const char* sha) {
+    for (script_t* s = script_cache[cache_bucket(sha)]; s; s = s->next) {
+        if (strcmp(s->sha, sha) == 0) return s;
+    }
+    return NULL;
+}
+
+// Compiles 'source' and caches it under 'sha'. NULL on compile errors (logged to stderr).
+static script_t* cache_compile(const char* sha, const char* source) {
+    script_t* script = (script_t*)malloc(sizeof(script_t));
+    if (!script) return NULL;
+
+    initChunk(&script->chunk);
+    if (!compile(source, &script->chunk)) {
+        freeChunk(&script->chunk);
+        free(script);
+        return NULL;
+    }
+
+    memcpy(script->sha, sha, SHA1_HEX_LEN);
+    size_t bucket = cache_bucket(sha);
+    script->next = script_cache[bucket];
+    script_cache[bucket] = script;
+    return script;
+}
+
+static void cache_flush() {
+    for (size_t i = 0; i < SCRIPT_CACHE_BUCKETS; i++) {
+        script_t* s = script_cache[i];
+        while (s) {
+            script_t* next = s->next;
+            freeChunk(&s->chunk);
+            free(s);
+            s = next;
+        }
+        script_cache[i] = NULL;
+    }
+}
+
+// --- Running Script Context ---
+
+static struct {
+    hash_table_t* db;
+    char** keys;     // KEYS[1..num_keys]
+    int num_keys;
+    char** args;     // ARGV[1..num_args]
+    int num_args;
+    struct timespec deadline;
+} ctx;
+
+static long script_budget_us = SCRIPT_DEFAULT_BUDGET_US;
+
+// Interrupt hook: polled by the VM every INTERRUPT_INTERVAL instructions
+static bool budget_exceeded(void* unused) {
+    (void)unused;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > ctx.deadline.tv_sec ||
+           (now.tv_sec == ctx.deadline.tv_sec && now.tv_nsec > ctx.deadline.tv_nsec);
+}
+
+// Reads a 1-based index argument into names[]; false if out of range.
+static bool index_arg(Value v, int count, int* index) {
+    if (!IS_NUMBER(v)) return false;
+    double d = AS_NUMBER(v);
+    if (d < 1 || d > count || d != floor(d)) return false;
+    *index = (int)d - 1;
+    return true;
+}
+
+// Parses a whole string as a number if it is plain decimal text:
+// [-]digits[.digits], no leading zeros, spaces, exponent, hex, inf or nan.
+// Anything else (" 5", "0x10", "1e3", "007") stays a string, unchanged.
+static bool parse_number(const char* str, double* out) {
+    const char* p = str;
+    if (*p == '-') p++;
+    if (!isdigit((unsigned char)*p)) return false;
+    if (*p == '0' && isdigit((unsigned char)p[1])) return false;
+    while (isdigit((unsigned char)*p)) p++;
+    if (*p == '.') {
+        p++;
+        if (!isdigit((unsigned char)*p)) return false;
+        while (isdigit((unsigned char)*p)) p++;
+    }
+    if (*p != '\0') return false;
+    *out = strtod(str, NULL);
+    return true;
+}
+
+// Shortest of %.15g / %.17g that reads back as exactly 'd' (0.1 -> "0.1", not "0.10000000000000001")
+static void format_number(double d, char* buf, size_t size) {
+    snprintf(buf, size, "%.15g", d);
+    if (strtod(buf, NULL) != d) snprintf(buf, size, "%.17g", d);
+}
+
+// --- Natives: the keyspace, as seen from a script ---
+// Values that parse as numbers come in as numbers, anything else as a
+// string. Keys are named by position, like KEYS[i] in Redis: get(1) reads
+// the first key after numkeys.
+
+// Text from the keyspace or ARGV as a script value
+static Value text_value(const char* text) {
+    double number;
+    if (parse_number(text, &number)) return NUMBER_VAL(number);
+    return OBJ_VAL(copyString(text, (int)strlen(text)));
+}
+
+// get(i): value of KEYS[i], or nil if missing
+static bool native_get(int argCount, Value* args, Value* result) {
+    int i;
+    if (argCount != 1 || !index_arg(args[0], ctx.num_keys, &i)) return false;
+
+    char* value = ht_get(ctx.db, ctx.keys[i]);
+    if (!value) {
+        *result = NIL_VAL;
+        return true;
+    }
+    *result = text_value(value);
+    free(value);
+    return true;
+}
+
+// set(i, value): stores a number or string under KEYS[i] and returns it
+static bool native_set(int argCount, Value* args, Value* result) {
+    int i;
+    if (argCount != 2 || !index_arg(args[0], ctx.num_keys, &i)) return false;
+
+    if (IS_STRING(args[1])) {
+        ht_set(ctx.db, ctx.keys[i], AS_CSTRING(args[1]));
+    } else if (IS_NUMBER(args[1])) {
+        char value[32];
+        format_number(AS_NUMBER(args[1]), value, sizeof(value));
+        ht_set(ctx.db, ctx.keys[i], value);
+    } else {
+        return false;
+    }
+    *result = args[1];
+    return true;
+}
+
+// del(i): deletes KEYS[i], true if it existed
+static bool native_del(int argCount, Value* args, Value* result) {
+    int i;
+    if (argCount != 1 || !index_arg(args[0], ctx.num_keys, &i)) return false;
+    *result = BOOL_VAL(ht_delete(ctx.db, ctx.keys[i]));
+    return true;
+}
+
+// arg(i): ARGV[i]
+static bool native_arg(int argCount, Value* args, Value* result) {
+    int i;
+    if (argCount != 1 || !index_arg(args[0], ctx.num_args, &i)) return false;
+    *result = text_value(ctx.args[i]);
+    return true;
+}
+
+void eval_init(long budget_us, long gc_step, bool jit) {
+    script_budget_us = budget_us;
+    initVM();
+    setGCStepBudget(gc_step);
+    if (jit && !setJit(true)) fprintf(stderr, "No script JIT on this platform: --script-jit ignored.\n");
+    defineNative("get", native_get);
+    defineNative("set", native_set);
+    defineNative("del", native_del);
+    defineNative("arg", native_arg);
+    setInterruptHook(budget_exceeded, NULL);
+}
+
+void eval_shutdown() {
+    cache_flush();
+    freeVM();
+}
+
+// --- Commands ---
+
+// Runs a cached script against KEYS/ARGV and formats its value. Caller holds the table lock.
+static void run_script(hash_table_t* db, script_t* script, int argc, char** argv, int num_keys,
+                       char* response_buf, size_t response_max) {
+    ctx.db = db;
+    ctx.keys = argv + 3;
+    ctx.num_keys = num_keys;
+    ctx.args = argv + 3 + num_keys;
+    ctx.num_args = argc - 3 - num_keys;
+
+    clock_gettime(CLOCK_MONOTONIC, &ctx.deadline);
+    ctx.deadline.tv_sec += script_budget_us / 1000000;
+    ctx.deadline.tv_nsec += (script_budget_us % 1000000) * 1000;
+    if (ctx.deadline.tv_nsec >= 1000000000L) {
+        ctx.deadline.tv_sec++;
+        ctx.deadline.tv_nsec -= 1000000000L;
+    }
+
+    Value result;
+    if (runChunk(&script->chunk, &result) != INTERPRET_OK) {
+        // Writes made before the error stay applied (no rollback, like Redis)
+        snprintf(response_buf, response_max, "-ERR Error running script %s\r\n", script->sha);
+    } else if (IS_NIL(result)) {
+        snprintf(response_buf, response_max, "$-1\r\n");
+    } else if (IS_BOOL(result)) {
+        snprintf(response_buf, response_max, ":%d\r\n", AS_BOOL(result) ? 1 : 0);
+    } else if (IS_STRING(result)) {
+        // A truncated bulk reply would desync the client: refuse instead
+        ObjString* string = AS_STRING(result);
+        int written = snprintf(response_buf, response_max, "$%d\r\n%s\r\n", string->length, string->chars);
+        if (written < 0 || (size_t)written >= response_max) {
+            snprintf(response_buf, response_max, "-ERR Script result too large\r\n");
+        }
+    } else {
+        double d = AS_NUMBER(result);
+        if (d == floor(d) && fabs(d) < 9007199254740992.0) { // 2^53: exact as an integer
+            snprintf(response_buf, response_max, ":%lld\r\n", (long long)d);
+        } else {
+            char number[32];
+            format_number(d, number, sizeof(number));
+            snprintf(response_buf, response_max, "$%zu\r\n%s\r\n", strlen(number), number);
+        }
+    }
+    // Like Redis, scripts share no state: globals die with the script
+    clearGlobals();
+}
+
+// Validates "<numkeys> key... arg..." (argv[2] onwards). -1 if invalid.
+static int parse_numkeys(int argc, char** argv) {
+    char* end;
+    long num_keys = strtol(argv[2], &end, 10);
+    if (*end != '\0' || num_keys < 0 || num_keys > argc - 3) return -1;
+    return (int)num_keys;
+}
+
+void eval_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    // EVAL <script> <numkeys> [key ...] [arg ...]
+    int num_keys = parse_numkeys(argc, argv);
+    if (num_keys == -1) {
+        snprintf(response_buf, response_max, "-ERR Number of keys can't be negative or greater than the number of args\r\n");
+        return;
+    }
+
+    char sha[SHA1_HEX_LEN];
+    sha1_hex(argv[1], strlen(argv[1]), sha);
+
+    ht_lock(db);
+    script_t* script = cache_lookup(sha);
+    if (!script) script = cache_compile(sha, argv[1]); // Only the first EVAL pays for compile()
+    if (script) {
+        run_script(db, script, argc, argv, num_keys, response_buf, response_max);
+    } else {
+        snprintf(response_buf, response_max, "-ERR Error compiling script\r\n");
+    }
+    ht_unlock(db);
+}
+
+void evalsha_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    // EVALSHA <sha1> <numkeys> [key ...] [arg ...]
+    int num_keys = parse_numkeys(argc, argv);
+    if (num_keys == -1) {
+        snprintf(response_buf, response_max, "-ERR Number of keys can't be negative or greater than the number of args\r\n");
+        return;
+    }
+
+    ht_lock(db);
+    script_t* script = valid_sha(argv[1]) ? cache_lookup(argv[1]) : NULL;
+    if (script) {
+        run_script(db, script, argc, argv, num_keys, response_buf, response_max);
+    } else {
+        snprintf(response_buf, response_max, "-NOSCRIPT No matching script. Please use EVAL.\r\n");
+    }
+    ht_unlock(db);
+}
+
+void script_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    // SCRIPT LOAD <script> | SCRIPT EXISTS <sha1> | SCRIPT FLUSH
+    ht_lock(db);
+    if (strcasecmp(argv[1], "LOAD") == 0 && argc == 3) {
+        char sha[SHA1_HEX_LEN];
+        sha1_hex(argv[2], strlen(argv[2]), sha);
+        if (cache_lookup(sha) || cache_compile(sha, argv[2])) {
+            snprintf(response_buf, response_max, "$%d\r\n%s\r\n", SHA1_HEX_LEN - 1, sha);
+        } else {
+            snprintf(response_buf, response_max, "-ERR Error compiling script\r\n");
+        }
+    } else if (strcasecmp(argv[1], "EXISTS") == 0 && argc == 3) {
+        snprintf(response_buf, response_max, ":%d\r\n", (valid_sha(argv[2]) && cache_lookup(argv[2])) ? 1 : 0);
+    } else if (strcasecmp(argv[1], "FLUSH") == 0 && argc == 2) {
+        cache_flush();
+        snprintf(response_buf, response_max, "+OK\r\n");
+    } else {
+        snprintf(response_buf, response_max, "-ERR Unknown SCRIPT subcommand or wrong args\r\n");
+    }
+    ht_unlock(db);
+}
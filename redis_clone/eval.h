@@ -0,0 +1,29 @@
+/* eval.h - Server-side scripts (EVAL/EVALSHA) on the embedded C-Script VM */
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "common.h"
+#include "hash_table.h"
+
+// --- Configuration ---
+#define SCRIPT_DEFAULT_BUDGET_US 5000 // Max time a script may hold the table lock
+#define SCRIPT_DEFAULT_GC_STEP 1024   // Script GC work units per step (GC_DEFAULT_STEP_BUDGET)
+#define SCRIPT_CACHE_BUCKETS 256      // Compiled chunks, keyed by SHA-1 of the source
+
+// --- Public API ---
+
+/**
+ * @brief Starts the VM and registers the keyspace natives.
+ * @param budget_us Scripts running longer than this are aborted.
+ * @param gc_step Work units per incremental GC step (0 = stop-the-world collections).
+ * @param jit Run hot scripts as machine code (ignored where the VM has no JIT).
+ */
+void eval_init(long budget_us, long gc_step, bool jit);
+void eval_shutdown(); // Frees every cached chunk
+
+// Command handlers (command_fn signature, see commands.c)
+void eval_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+void evalsha_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+void script_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+
+#endif // EVAL_H
@@ -1,5 +1,8 @@
 /* hash_table.c - Implementation of the hash table */
 #include "hash_table.h"
+#include "lazyfree.h"
+#include "latency.h"
+#include <limits.h> // for CHAR_BIT
 
 // --- Hash Function (djb2) ---
 static size_t hash_key(const char* key) {
@@ -8,10 +11,56 @@ static size_t hash_key(const char* key) {
     while ((c = *key++)) {
         hash = ((hash << 5) + hash) + c; // hash * 33 + c
     }
+    // Niche C: Mix the high bits down (Murmur3 finalizer); we index with the
+    // low bits only, and djb2's low bits barely depend on the early characters.
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
     return hash;
 }
 
-hash_table_t* ht_create() {
+static inline size_t bucket_index(hash_table_t* ht, const char* key) {
+    return hash_key(key) & (ht->capacity - 1); // capacity is a power of two
+}
+
+/**
+ * @brief Rehashes every entry into a new bucket array. Caller holds the lock.
+ */
+static void ht_resize(hash_table_t* ht, size_t new_capacity) {
+    uint64_t start = monotonic_us();
+    ht_entry_t** new_buckets = (ht_entry_t**)calloc(new_capacity, sizeof(ht_entry_t*));
+    if (!new_buckets) {
+        // Not fatal: the table keeps working, just with longer chains.
+        LOG("calloc failed in ht_resize, staying at %zu buckets", ht->capacity);
+        return;
+    }
+    
+    for (size_t i = 0; i < ht->capacity; i++) {
+        ht_entry_t* entry = ht->buckets[i];
+        while (entry) {
+            ht_entry_t* next = entry->next;
+            size_t index = hash_key(entry->key) & (new_capacity - 1);
+            entry->next = new_buckets[index];
+            new_buckets[index] = entry;
+            entry = next;
+        }
+    }
+    
+    free(ht->buckets);
+    ht->buckets = new_buckets;
+    ht->capacity = new_capacity;
+    LOG("Resized hash table to %zu buckets (%zu keys)", new_capacity, ht->count);
+    latency_add_sample(LATENCY_REHASH, monotonic_us() - start);
+}
+
+// Halve the table once it is mostly empty. Caller holds the lock.
+static void ht_maybe_shrink(hash_table_t* ht) {
+    if (ht->capacity > HT_INITIAL_CAPACITY && ht->count < ht->capacity / HT_MIN_FILL) {
+        ht_resize(ht, ht->capacity / 2);
+    }
+}
+
+hash_table_t* ht_create(const slab_options_t* slab_opts) {
     hash_table_t* ht = (hash_table_t*)malloc(sizeof(hash_table_t));
     if (!ht) ERROR_EXIT("malloc hash_table_t");
     
@@ -20,46 +69,108 @@ hash_table_t* ht_create() {
     // Niche C: Use calloc to zero-initialize the bucket pointers
     ht->buckets = (ht_entry_t**)calloc(ht->capacity, sizeof(ht_entry_t*));
     if (!ht->buckets) ERROR_EXIT("calloc buckets");
+    // Niche C: entries are the hot part of every lookup; packing them into
+    // (possibly huge-page) slabs saves malloc headers and TLB misses.
+    ht->entry_slab = slab_create(sizeof(ht_entry_t), slab_opts);
+    if (!ht->entry_slab) ERROR_EXIT("slab_create entries");
     
-    pthread_mutex_init(&ht->lock, NULL);
+    // Niche C: A recursive mutex lets EXEC wrap a batch of ht_* calls in
+    // one acquisition without needing an "_unlocked" twin of every function.
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&ht->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    ht->version_clock = 0;
+    ht->delete_version = 0;
+    ht->lazyfree = NULL;
+    ht->lazyfree_threshold = 0;
+    ht->lazyfree_all = false;
     return ht;
 }
 
-static void ht_free_entry(ht_entry_t* entry) {
-    free(entry->key);
+void ht_set_lazyfree(hash_table_t* ht, lazyfree_t* lf, size_t threshold, bool lazyfree_all) {
+    pthread_mutex_lock(&ht->lock);
+    ht->lazyfree = lf;
+    ht->lazyfree_threshold = threshold;
+    ht->lazyfree_all = lazyfree_all;
+    pthread_mutex_unlock(&ht->lock);
+}
+
+void ht_free_entry(ht_entry_t* entry) {
+    free(entry->key); // NULL for value-only entries queued by an overwrite
     free(entry->value);
     free(entry);
 }
 
+/**
+ * @brief Hands key/value to the lazyfree thread in a malloc'd husk (the
+ * thread never touches the entry slab). Caller holds the lock.
+ * @return false if the husk could not be allocated; the caller frees inline.
+ */
+static bool ht_lazy_release(hash_table_t* ht, char* key, char* value, size_t value_len) {
+    ht_entry_t* husk = (ht_entry_t*)malloc(sizeof(ht_entry_t));
+    if (!husk) return false;
+    husk->key = key;
+    husk->value = value;
+    husk->value_len = value_len;
+    lazyfree_push(ht->lazyfree, husk);
+    return true;
+}
+
+/**
+ * @brief Frees an entry that is no longer linked into the table. Caller holds the lock.
+ * Big values go to the lazyfree thread so the lock is not held across free().
+ */
+static void ht_dispose_entry(hash_table_t* ht, ht_entry_t* entry, bool lazy) {
+    if (!(lazy && ht->lazyfree && entry->value_len >= ht->lazyfree_threshold &&
+          ht_lazy_release(ht, entry->key, entry->value, entry->value_len))) {
+        free(entry->key);
+        free(entry->value);
+    }
+    slab_free(ht->entry_slab, entry);
+}
+
 void ht_destroy(hash_table_t* ht) {
     pthread_mutex_lock(&ht->lock);
     for (size_t i = 0; i < ht->capacity; i++) {
         ht_entry_t* entry = ht->buckets[i];
         while (entry) {
             ht_entry_t* next = entry->next;
-            ht_free_entry(entry);
+            free(entry->key);
+            free(entry->value);
             entry = next;
         }
     }
     free(ht->buckets);
+    slab_destroy(ht->entry_slab); // Unmaps every entry at once
     pthread_mutex_unlock(&ht->lock);
     pthread_mutex_destroy(&ht->lock);
     free(ht);
 }
 
-// TODO: Add ht_resize() for production use
-
 void ht_set(hash_table_t* ht, const char* key, const char* value) {
     pthread_mutex_lock(&ht->lock);
     
-    size_t index = hash_key(key) % ht->capacity;
+    size_t index = bucket_index(ht, key);
     ht_entry_t* entry = ht->buckets[index];
     
     // Check if key already exists (update)
     while (entry) {
         if (strcmp(entry->key, key) == 0) {
-            free(entry->value); // Free old value
+            char* old_value = entry->value;
+            size_t old_len = entry->value_len;
             entry->value = strdup(value);
+            entry->value_len = strlen(value);
+            entry->type = HT_STRING; // SET replaces a value of any type
+            entry->version = ++ht->version_clock;
+            
+            // Free old value (in the background if it is big and lazy free is on)
+            if (ht->lazyfree_all && ht->lazyfree && old_len >= ht->lazyfree_threshold &&
+                ht_lazy_release(ht, NULL, old_value, old_len)) {
+                old_value = NULL;
+            }
+            free(old_value);
             pthread_mutex_unlock(&ht->lock);
             return;
         }
@@ -67,30 +178,41 @@ void ht_set(hash_table_t* ht, const char* key, const char* value) {
     }
     
     // Key not found, create new entry
-    ht_entry_t* new_entry = (ht_entry_t*)malloc(sizeof(ht_entry_t));
+    ht_entry_t* new_entry = (ht_entry_t*)slab_alloc(ht->entry_slab);
+    if (!new_entry) {
+        fprintf(stderr, "Out of memory for hash table entries.\n");
+        pthread_mutex_unlock(&ht->lock);
+        return;
+    }
     new_entry->key = strdup(key);
     new_entry->value = strdup(value);
+    new_entry->value_len = strlen(value);
+    new_entry->type = HT_STRING;
+    new_entry->version = ++ht->version_clock;
     
     // Prepend to the bucket's linked list
     new_entry->next = ht->buckets[index];
     ht->buckets[index] = new_entry;
     ht->count++;
     
-    pthread_mutex_unlock(&ht->lock);
+    // Keep chains short: double once the load factor passes HT_MAX_LOAD
+    if (ht->count > ht->capacity * HT_MAX_LOAD) {
+        ht_resize(ht, ht->capacity * 2);
+    }
     
-    // TODO: Check load factor and call ht_resize if needed
+    pthread_mutex_unlock(&ht->lock);
 }
 
 char* ht_get(hash_table_t* ht, const char* key) {
     pthread_mutex_lock(&ht->lock);
     
-    size_t index = hash_key(key) % ht->capacity;
+    size_t index = bucket_index(ht, key);
     ht_entry_t* entry = ht->buckets[index];
     
     char* result = NULL;
     while (entry) {
         if (strcmp(entry->key, key) == 0) {
-            result = strdup(entry->value); // Return a copy
+            if (entry->type == HT_STRING) result = strdup(entry->value); // Return a copy
             break;
         }
         entry = entry->next;
@@ -100,22 +222,171 @@ char* ht_get(hash_table_t* ht, const char* key) {
     return result;
 }
 
-void ht_delete(hash_table_t* ht, const char* key) {
+/**
+ * @brief Unlinks 'key' under the lock and disposes of it. Returns true if it existed.
+ */
+static bool ht_remove(hash_table_t* ht, const char* key, bool lazy) {
+    bool found = false;
     pthread_mutex_lock(&ht->lock);
     
-    size_t index = hash_key(key) % ht->capacity;
+    size_t index = bucket_index(ht, key);
     ht_entry_t** indirect = &ht->buckets[index]; // Pointer to the pointer
     
     while (*indirect) {
         if (strcmp((*indirect)->key, key) == 0) {
             ht_entry_t* entry_to_delete = *indirect;
             *indirect = entry_to_delete->next; // Bypass the node
-            ht_free_entry(entry_to_delete);
+            ht_dispose_entry(ht, entry_to_delete, lazy);
             ht->count--;
+            ht->delete_version = ++ht->version_clock; // Absent keys now report this
+            ht_maybe_shrink(ht);
+            found = true;
             break;
         }
         indirect = &(*indirect)->next;
     }
     
     pthread_mutex_unlock(&ht->lock);
+    return found;
+}
+
+bool ht_delete(hash_table_t* ht, const char* key) {
+    return ht_remove(ht, key, ht->lazyfree_all);
+}
+
+bool ht_unlink(hash_table_t* ht, const char* key) {
+    return ht_remove(ht, key, true);
+}
+
+bool ht_contains(hash_table_t* ht, const char* key) {
+    pthread_mutex_lock(&ht->lock);
+    
+    size_t index = bucket_index(ht, key);
+    ht_entry_t* entry = ht->buckets[index];
+    while (entry && strcmp(entry->key, key) != 0) {
+        entry = entry->next;
+    }
+    
+    pthread_mutex_unlock(&ht->lock);
+    return entry != NULL;
+}
+
+uint64_t ht_version(hash_table_t* ht, const char* key) {
+    pthread_mutex_lock(&ht->lock);
+    
+    size_t index = bucket_index(ht, key);
+    ht_entry_t* entry = ht->buckets[index];
+    while (entry && strcmp(entry->key, key) != 0) {
+        entry = entry->next;
+    }
+    uint64_t version = entry ? entry->version : ht->delete_version;
+    
+    pthread_mutex_unlock(&ht->lock);
+    return version;
+}
+
+void ht_lock(hash_table_t* ht) {
+    pthread_mutex_lock(&ht->lock);
+}
+
+void ht_unlock(hash_table_t* ht) {
+    pthread_mutex_unlock(&ht->lock);
+}
+
+ht_entry_t* ht_find_locked(hash_table_t* ht, const char* key) {
+    ht_entry_t* entry = ht->buckets[bucket_index(ht, key)];
+    while (entry && strcmp(entry->key, key) != 0) entry = entry->next;
+    return entry;
+}
+
+ht_entry_t* ht_add_locked(hash_table_t* ht, const char* key, ht_type_t type, char* value, size_t value_len) {
+    ht_entry_t* entry = (ht_entry_t*)slab_alloc(ht->entry_slab);
+    if (!entry) {
+        fprintf(stderr, "Out of memory for hash table entries.\n");
+        free(value);
+        return NULL;
+    }
+    entry->key = strdup(key);
+    entry->value = value;
+    entry->value_len = value_len;
+    entry->type = type;
+    entry->version = ++ht->version_clock;
+
+    size_t index = bucket_index(ht, key);
+    entry->next = ht->buckets[index];
+    ht->buckets[index] = entry;
+    ht->count++;
+
+    // Resizing relinks entries but never moves them, so 'entry' stays valid
+    if (ht->count > ht->capacity * HT_MAX_LOAD) {
+        ht_resize(ht, ht->capacity * 2);
+    }
+    return entry;
+}
+
+void ht_touch_locked(hash_table_t* ht, ht_entry_t* entry) {
+    entry->version = ++ht->version_clock;
+}
+
+bool ht_delete_if_equal(hash_table_t* ht, const char* key, const char* value) {
+    bool deleted = false;
+    pthread_mutex_lock(&ht->lock);
+    
+    size_t index = bucket_index(ht, key);
+    ht_entry_t** indirect = &ht->buckets[index];
+    
+    while (*indirect) {
+        if (strcmp((*indirect)->key, key) == 0) {
+            if ((*indirect)->type == HT_STRING && strcmp((*indirect)->value, value) == 0) {
+                ht_entry_t* entry_to_delete = *indirect;
+                *indirect = entry_to_delete->next;
+                ht_dispose_entry(ht, entry_to_delete, ht->lazyfree_all);
+                ht->count--;
+                ht->delete_version = ++ht->version_clock;
+                deleted = true;
+                ht_maybe_shrink(ht);
+            }
+            break;
+        }
+        indirect = &(*indirect)->next;
+    }
+    
+    pthread_mutex_unlock(&ht->lock);
+    return deleted;
+}
+
+// Niche C: Reverse the bits of a word (log2(64) swap steps instead of a loop per bit).
+static size_t rev_bits(size_t v) {
+    size_t s = CHAR_BIT * sizeof(v); // bit size; must be power of 2
+    size_t mask = ~(size_t)0;
+    while ((s >>= 1) > 0) {
+        mask ^= (mask << s);
+        v = ((v >> s) & mask) | ((v << s) & ~mask);
+    }
+    return v;
+}
+
+size_t ht_scan(hash_table_t* ht, size_t cursor, size_t max_buckets, ht_scan_fn fn, void* ctx) {
+    pthread_mutex_lock(&ht->lock);
+    
+    size_t mask = ht->capacity - 1;
+    for (size_t visited = 0; visited < max_buckets; visited++) {
+        for (ht_entry_t* entry = ht->buckets[cursor & mask]; entry; entry = entry->next) {
+            fn(entry, ctx);
+        }
+        
+        // Increment the cursor from its *high* bit down (reverse-binary order).
+        // Bucket i of a table of size N splits into buckets i and i+N when the
+        // table doubles; both share the same low bits, so a reversed counter
+        // never skips buckets covering keys it has not seen yet.
+        cursor |= ~mask;   // Set the bits above the mask so the carry falls off the top
+        cursor = rev_bits(cursor);
+        cursor++;
+        cursor = rev_bits(cursor);
+        
+        if (cursor == 0) break; // Wrapped around: every bucket was visited
+    }
+    
+    pthread_mutex_unlock(&ht->lock);
+    return cursor;
 }
@@ -3,32 +3,91 @@
 #define HASH_TABLE_H
 
 #include "common.h"
+#include "slab.h"
 
 // --- Configuration ---
-#define HT_INITIAL_CAPACITY 16
+#define HT_INITIAL_CAPACITY 16 // Must be a power of two (we index with hash & mask)
+#define HT_MAX_LOAD 1          // Grow when count > capacity * HT_MAX_LOAD
+#define HT_MIN_FILL 8          // Shrink when count < capacity / HT_MIN_FILL
 
 // --- Structures ---
 
+typedef struct lazyfree_t lazyfree_t;
+
+// What an entry's value holds
+typedef enum {
+    HT_STRING, // NUL-terminated string (GET/SET)
+    HT_BLOOM,  // Binary blob owned by bloom.c
+    HT_HLL     // Binary blob owned by hyperloglog.c
+} ht_type_t;
+
 // Entry in the hash table
 typedef struct ht_entry_t {
     char* key;
-    char* value;
+    char* value;             // malloc'd; binary for non-string types
+    size_t value_len;        // Decides whether freeing is worth a hand-off
+    ht_type_t type;
+    uint64_t version;        // Table clock value of the last write (for WATCH)
     struct ht_entry_t* next; // For collision chaining
 } ht_entry_t;
 
 // The hash table itself
 typedef struct {
     ht_entry_t** buckets;
-    size_t capacity;
+    slab_allocator_t* entry_slab; // ht_entry_t structs; keys and values are malloc'd
+    size_t capacity; // Always a power of two
     size_t count;
-    pthread_mutex_t lock; // Mutex to protect the table
+    pthread_mutex_t lock; // Recursive mutex: EXEC holds it across several commands
+    uint64_t version_clock; // Bumped by every write; never reused, so versions are unique
+    uint64_t delete_version; // Clock value of the last delete: the version every absent key reports
+    
+    // Lazy free: values >= lazyfree_threshold bytes are freed on the
+    // lazyfree thread instead of inline under 'lock'.
+    lazyfree_t* lazyfree;       // NULL = always free inline
+    size_t lazyfree_threshold;
+    bool lazyfree_all;          // Also offload DEL and overwriting SET, not just UNLINK
 } hash_table_t;
 
 // --- Public API ---
-hash_table_t* ht_create();
+// 'slab_opts' sets the backing (page size, NUMA node) of the entry slab; NULL = defaults.
+hash_table_t* ht_create(const slab_options_t* slab_opts);
 void ht_destroy(hash_table_t* ht);
 void ht_set(hash_table_t* ht, const char* key, const char* value);
-char* ht_get(hash_table_t* ht, const char* key); // Returns malloc'd value or NULL
-void ht_delete(hash_table_t* ht, const char* key);
+char* ht_get(hash_table_t* ht, const char* key); // Returns malloc'd value, NULL if absent or not a string
+bool ht_delete(hash_table_t* ht, const char* key); // Returns true if the key existed
+// Like ht_delete, but a large value is always freed on the lazyfree thread.
+bool ht_unlink(hash_table_t* ht, const char* key);
+void ht_set_lazyfree(hash_table_t* ht, lazyfree_t* lf, size_t threshold, bool lazyfree_all);
+// Frees a malloc'd husk entry (handed to the lazyfree thread) and its key/value
+void ht_free_entry(ht_entry_t* entry);
+bool ht_contains(hash_table_t* ht, const char* key);
+// Version of 'key': changes on every SET/DEL of it. An absent key reports the
+// table's last delete, so creating and deleting it again is seen too (as is,
+// conservatively, any other delete).
+uint64_t ht_version(hash_table_t* ht, const char* key);
+
+// Hold the table lock across several calls (e.g. one EXEC). The lock is
+// recursive, so the regular API can still be used while holding it.
+void ht_lock(hash_table_t* ht);
+void ht_unlock(hash_table_t* ht);
+// Typed values are read and updated in place while holding ht_lock():
+// Entry for 'key', or NULL. Valid until ht_unlock(); value/value_len may be replaced.
+ht_entry_t* ht_find_locked(hash_table_t* ht, const char* key);
+// Inserts an absent 'key' holding 'value' (malloc'd, ownership moves to the table).
+ht_entry_t* ht_add_locked(hash_table_t* ht, const char* key, ht_type_t type, char* value, size_t value_len);
+// Gives an entry changed in place a new version, so WATCH sees the write.
+void ht_touch_locked(hash_table_t* ht, ht_entry_t* entry);
+
+// Deletes 'key' only if it still maps to the string 'value'. Returns true if deleted.
+bool ht_delete_if_equal(hash_table_t* ht, const char* key, const char* value);
+
+// Visits every entry in up to 'max_buckets' buckets starting at 'cursor',
+// holding the table lock for just that batch. Returns the cursor to pass on
+// the next call, or 0 once the whole table has been visited.
+// Cursors walk bucket indexes in reverse-binary order, so every key present
+// for the whole iteration is visited at least once even if the table grows
+// or shrinks between calls (a key may be visited twice after a shrink).
+typedef void (*ht_scan_fn)(const ht_entry_t* entry, void* ctx);
+size_t ht_scan(hash_table_t* ht, size_t cursor, size_t max_buckets, ht_scan_fn fn, void* ctx);
 
 #endif // HASH_TABLE_H
@@ -0,0 +1,305 @@
+/* hyperloglog.c - HyperLogLog with sparse and dense register encodings */
+#include "hyperloglog.h"
+#include "murmur.h"
+#include "protocol.h"
+#include <math.h>
+
+// Each item hashes to one of HLL_REGISTERS registers, which keeps the longest
+// run of trailing zeros (+1) seen among that register's hashes. A fresh key
+// has almost every register at zero, so it starts *sparse*: a sorted array of
+// (index, value) pairs for the non-zero registers only, a few bytes for small
+// sets. Past HLL_SPARSE_MAX_BYTES it becomes *dense*: all registers packed
+// 6 bits each into 12 KiB, which never grows again.
+
+#define HLL_MAGIC 0x4c4c5948U // "HYLL"
+#define HLL_SEED 0xadc83b19ULL
+#define HLL_Q (64 - HLL_P)    // Hash bits left for the run length
+#define HLL_ALPHA_INF 0.721347520444481703680 // 1 / (2 ln 2)
+
+typedef enum { HLL_SPARSE, HLL_DENSE } hll_encoding_t;
+
+typedef struct {
+    uint32_t magic;
+    uint8_t encoding;      // hll_encoding_t
+    uint8_t card_valid;    // 'card' matches the registers
+    uint16_t unused;
+    uint32_t sparse_count; // Pairs that follow the header (sparse only)
+    uint64_t card;         // Cached PFCOUNT result
+} hll_header_t;
+
+// Sparse pair: register index in the high bits, value in the low 8 (sorts by index)
+#define HLL_PAIR(idx, val) (((uint32_t)(idx) << 8) | (uint32_t)(val))
+#define HLL_PAIR_INDEX(p) ((p) >> 8)
+#define HLL_PAIR_VALUE(p) ((uint8_t)((p) & 0xff))
+
+// --- Dense registers ---
+
+static inline uint8_t dense_get(const uint8_t* regs, uint32_t idx) {
+    uint32_t bit = idx * HLL_BITS;
+    uint32_t pair = regs[bit / 8] | ((uint32_t)regs[bit / 8 + 1] << 8);
+    return (uint8_t)((pair >> (bit % 8)) & ((1 << HLL_BITS) - 1));
+}
+
+static inline void dense_set(uint8_t* regs, uint32_t idx, uint8_t val) {
+    uint32_t bit = idx * HLL_BITS;
+    uint32_t pair = regs[bit / 8] | ((uint32_t)regs[bit / 8 + 1] << 8);
+    pair &= ~((uint32_t)((1 << HLL_BITS) - 1) << (bit % 8));
+    pair |= (uint32_t)val << (bit % 8);
+    regs[bit / 8] = (uint8_t)pair;
+    regs[bit / 8 + 1] = (uint8_t)(pair >> 8);
+}
+
+static inline uint8_t* dense_regs(char* blob) {
+    return (uint8_t*)blob + sizeof(hll_header_t);
+}
+
+static inline uint32_t* sparse_pairs(char* blob) {
+    return (uint32_t*)(blob + sizeof(hll_header_t));
+}
+
+// --- Hashing ---
+
+// Register index and run length for one item.
+static uint8_t hll_pattern(const char* item, size_t len, uint32_t* idx) {
+    uint64_t hash = murmur64(item, len, HLL_SEED);
+    *idx = (uint32_t)(hash & (HLL_REGISTERS - 1));
+    hash >>= HLL_P;
+    hash |= 1ULL << HLL_Q; // Sentinel: the run is at most HLL_Q zeros
+    return (uint8_t)(__builtin_ctzll(hash) + 1);
+}
+
+// --- Blob ---
+
+char* hll_create(size_t* blob_len) {
+    hll_header_t* hdr = (hll_header_t*)calloc(1, sizeof(hll_header_t));
+    if (!hdr) return NULL;
+    hdr->magic = HLL_MAGIC;
+    hdr->encoding = HLL_SPARSE;
+    hdr->card_valid = 1; // Empty: card = 0
+    *blob_len = sizeof(hll_header_t);
+    return (char*)hdr;
+}
+
+// Rewrites a sparse blob as dense. Returns the new blob or NULL (old one untouched).
+static char* hll_to_dense(char* blob, size_t* blob_len) {
+    char* dense = (char*)calloc(1, sizeof(hll_header_t) + HLL_DENSE_BYTES);
+    if (!dense) return NULL;
+    hll_header_t* hdr = (hll_header_t*)dense;
+    memcpy(hdr, blob, sizeof(hll_header_t));
+    hdr->encoding = HLL_DENSE;
+    hdr->sparse_count = 0;
+
+    const uint32_t* pairs = sparse_pairs(blob);
+    uint32_t count = ((hll_header_t*)blob)->sparse_count;
+    for (uint32_t i = 0; i < count; i++) {
+        dense_set(dense_regs(dense), HLL_PAIR_INDEX(pairs[i]), HLL_PAIR_VALUE(pairs[i]));
+    }
+    free(blob);
+    *blob_len = sizeof(hll_header_t) + HLL_DENSE_BYTES;
+    return dense;
+}
+
+int hll_add(char** blob, size_t* blob_len, const char* item, size_t len) {
+    uint32_t idx;
+    uint8_t val = hll_pattern(item, len, &idx);
+    hll_header_t* hdr = (hll_header_t*)*blob;
+
+    if (hdr->encoding == HLL_DENSE) {
+        uint8_t* regs = dense_regs(*blob);
+        if (dense_get(regs, idx) >= val) return 0;
+        dense_set(regs, idx, val);
+        hdr->card_valid = 0;
+        return 1;
+    }
+
+    // Sparse: binary search for the register's pair
+    uint32_t* pairs = sparse_pairs(*blob);
+    uint32_t lo = 0, hi = hdr->sparse_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (HLL_PAIR_INDEX(pairs[mid]) < idx) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < hdr->sparse_count && HLL_PAIR_INDEX(pairs[lo]) == idx) {
+        if (HLL_PAIR_VALUE(pairs[lo]) >= val) return 0;
+        pairs[lo] = HLL_PAIR(idx, val);
+        hdr->card_valid = 0;
+        return 1;
+    }
+
+    // New register: convert once the sparse form would outgrow its budget
+    if ((hdr->sparse_count + 1) * sizeof(uint32_t) > HLL_SPARSE_MAX_BYTES) {
+        char* dense = hll_to_dense(*blob, blob_len);
+        if (!dense) return -1;
+        *blob = dense;
+        return hll_add(blob, blob_len, item, len);
+    }
+    size_t new_len = *blob_len + sizeof(uint32_t);
+    char* grown = (char*)realloc(*blob, new_len);
+    if (!grown) return -1;
+    *blob = grown;
+    *blob_len = new_len;
+    hdr = (hll_header_t*)grown;
+    pairs = sparse_pairs(grown);
+    memmove(&pairs[lo + 1], &pairs[lo], (hdr->sparse_count - lo) * sizeof(uint32_t));
+    pairs[lo] = HLL_PAIR(idx, val);
+    hdr->sparse_count++;
+    hdr->card_valid = 0;
+    return 1;
+}
+
+// --- Estimation ---
+
+// Register histogram (how many registers hold each value) of one blob, added to 'hist'.
+static void hll_histogram(char* blob, uint32_t hist[HLL_Q + 2]) {
+    const hll_header_t* hdr = (const hll_header_t*)blob;
+    if (hdr->encoding == HLL_DENSE) {
+        const uint8_t* regs = dense_regs(blob);
+        for (uint32_t i = 0; i < HLL_REGISTERS; i++) hist[dense_get(regs, i)]++;
+        return;
+    }
+    const uint32_t* pairs = sparse_pairs(blob);
+    hist[0] += HLL_REGISTERS - hdr->sparse_count;
+    for (uint32_t i = 0; i < hdr->sparse_count; i++) hist[HLL_PAIR_VALUE(pairs[i])]++;
+}
+
+// Ertl's corrections for registers at 0 (sigma) and at the maximum (tau),
+// "New cardinality estimation algorithms for HyperLogLog sketches" (2017).
+static double hll_sigma(double x) {
+    if (x == 1.0) return INFINITY;
+    double y = 1.0, z = x, z_prev;
+    do {
+        x *= x;
+        z_prev = z;
+        z += x * y;
+        y += y;
+    } while (z_prev != z);
+    return z;
+}
+
+static double hll_tau(double x) {
+    if (x == 0.0 || x == 1.0) return 0.0;
+    double y = 1.0, z = 1.0 - x, z_prev;
+    do {
+        x = sqrt(x);
+        z_prev = z;
+        y *= 0.5;
+        z -= pow(1.0 - x, 2) * y;
+    } while (z_prev != z);
+    return z / 3.0;
+}
+
+// Improved raw estimator: unbiased from 0 to 2^64 without range-specific tweaks.
+static uint64_t hll_estimate(const uint32_t hist[HLL_Q + 2]) {
+    double m = HLL_REGISTERS;
+    double z = m * hll_tau((m - hist[HLL_Q + 1]) / m);
+    for (int j = HLL_Q; j >= 1; j--) {
+        z += hist[j];
+        z *= 0.5;
+    }
+    z += m * hll_sigma(hist[0] / m);
+    return (uint64_t)llround(HLL_ALPHA_INF * m * m / z);
+}
+
+uint64_t hll_count(char* blob) {
+    hll_header_t* hdr = (hll_header_t*)blob;
+    if (!hdr->card_valid) {
+        uint32_t hist[HLL_Q + 2] = {0};
+        hll_histogram(blob, hist);
+        hdr->card = hll_estimate(hist);
+        hdr->card_valid = 1;
+    }
+    return hdr->card;
+}
+
+// --- Commands ---
+
+void pfadd_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    // PFADD key [element ...]
+    ht_lock(db);
+    ht_entry_t* entry = ht_find_locked(db, argv[1]);
+    bool changed = false;
+    if (entry && entry->type != HT_HLL) {
+        snprintf(response_buf, response_max, WRONGTYPE_REPLY);
+        ht_unlock(db);
+        return;
+    }
+    if (!entry) {
+        size_t len;
+        char* blob = hll_create(&len);
+        entry = blob ? ht_add_locked(db, argv[1], HT_HLL, blob, len) : NULL;
+        if (!entry) {
+            snprintf(response_buf, response_max, "-ERR out of memory\r\n");
+            ht_unlock(db);
+            return;
+        }
+        changed = true; // Creating the key counts as a change, like Redis
+    }
+
+    for (int i = 2; i < argc; i++) {
+        int rc = hll_add(&entry->value, &entry->value_len, argv[i], strlen(argv[i]));
+        if (rc < 0) {
+            if (changed) ht_touch_locked(db, entry);
+            snprintf(response_buf, response_max, "-ERR out of memory\r\n");
+            ht_unlock(db);
+            return;
+        }
+        changed |= (rc == 1);
+    }
+    if (changed) ht_touch_locked(db, entry);
+    ht_unlock(db);
+    snprintf(response_buf, response_max, ":%d\r\n", changed ? 1 : 0);
+}
+
+void pfcount_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    // PFCOUNT key [key ...]
+    uint64_t card = 0;
+    ht_lock(db);
+    if (argc == 2) {
+        ht_entry_t* entry = ht_find_locked(db, argv[1]);
+        if (entry && entry->type != HT_HLL) {
+            snprintf(response_buf, response_max, WRONGTYPE_REPLY);
+            ht_unlock(db);
+            return;
+        }
+        if (entry) card = hll_count(entry->value);
+    } else {
+        // Union: register-wise max over all keys, then one estimate
+        uint8_t* regs = (uint8_t*)calloc(HLL_REGISTERS, 1);
+        if (!regs) {
+            snprintf(response_buf, response_max, "-ERR out of memory\r\n");
+            ht_unlock(db);
+            return;
+        }
+        for (int i = 1; i < argc; i++) {
+            ht_entry_t* entry = ht_find_locked(db, argv[i]);
+            if (!entry) continue;
+            if (entry->type != HT_HLL) {
+                free(regs);
+                snprintf(response_buf, response_max, WRONGTYPE_REPLY);
+                ht_unlock(db);
+                return;
+            }
+            hll_header_t* hdr = (hll_header_t*)entry->value;
+            if (hdr->encoding == HLL_DENSE) {
+                const uint8_t* dense = dense_regs(entry->value);
+                for (uint32_t r = 0; r < HLL_REGISTERS; r++) {
+                    uint8_t v = dense_get(dense, r);
+                    if (v > regs[r]) regs[r] = v;
+                }
+            } else {
+                const uint32_t* pairs = sparse_pairs(entry->value);
+                for (uint32_t p = 0; p < hdr->sparse_count; p++) {
+                    uint32_t r = HLL_PAIR_INDEX(pairs[p]);
+                    if (HLL_PAIR_VALUE(pairs[p]) > regs[r]) regs[r] = HLL_PAIR_VALUE(pairs[p]);
+                }
+            }
+        }
+        uint32_t hist[HLL_Q + 2] = {0};
+        for (uint32_t r = 0; r < HLL_REGISTERS; r++) hist[regs[r]]++;
+        free(regs);
+        card = hll_estimate(hist);
+    }
+    ht_unlock(db);
+    snprintf(response_buf, response_max, ":%llu\r\n", (unsigned long long)card);
+}
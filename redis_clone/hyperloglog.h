@@ -0,0 +1,33 @@
+/* hyperloglog.h - HyperLogLog cardinality estimator type (PFADD / PFCOUNT) */
+#ifndef HYPERLOGLOG_H
+#define HYPERLOGLOG_H
+
+#include "common.h"
+#include "hash_table.h"
+
+// --- Configuration ---
+#define HLL_P 14                        // 2^14 registers: standard error 1.04/sqrt(m) = 0.81%
+#define HLL_REGISTERS (1 << HLL_P)
+#define HLL_BITS 6                      // Register width; holds run lengths up to 63
+#define HLL_DENSE_BYTES ((HLL_REGISTERS * HLL_BITS + 7) / 8 + 1) // +1: reads may span a byte past the end
+#define HLL_SPARSE_MAX_BYTES 3000       // Sparse encodings bigger than this turn dense
+
+// --- Public API ---
+
+// Allocates an empty (sparse) HyperLogLog blob for an HT_HLL value.
+char* hll_create(size_t* blob_len);
+
+/**
+ * @brief Adds 'item'; may reallocate the blob (sparse growth or the switch to dense).
+ * @return 1 if a register changed, 0 if not, -1 if out of memory (blob unchanged).
+ */
+int hll_add(char** blob, size_t* blob_len, const char* item, size_t len);
+
+// Estimated number of distinct items; caches the result in the blob.
+uint64_t hll_count(char* blob);
+
+// command_fn handlers
+void pfadd_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+void pfcount_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+
+#endif // HYPERLOGLOG_H
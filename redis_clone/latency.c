@@ -0,0 +1,109 @@
+/* latency.c - Latency monitor: spikes per event class (LATENCY command) */
+#include "latency.h"
+#include "protocol.h"
+#include <strings.h> // for strcasecmp
+
+typedef struct {
+    int64_t time;        // Unix time of the sample
+    uint32_t duration_us;
+} latency_sample_t;
+
+// Ring of the most recent spikes of one event class
+typedef struct {
+    latency_sample_t samples[LATENCY_HISTORY_LEN];
+    int next;            // Slot the next sample goes to
+    int count;
+    uint32_t max_us;     // Worst spike since the last RESET
+} latency_series_t;
+
+static const char* event_names[LATENCY_NUM_EVENTS] = { "command", "event-loop", "rehash" };
+
+static atomic_long threshold_us;
+static pthread_mutex_t latency_lock = PTHREAD_MUTEX_INITIALIZER;
+static latency_series_t series[LATENCY_NUM_EVENTS];
+
+void latency_init(long threshold) {
+    atomic_store(&threshold_us, threshold);
+    memset(series, 0, sizeof(series));
+}
+
+void latency_add_sample(latency_event_t event, uint64_t duration_us) {
+    long threshold = atomic_load_explicit(&threshold_us, memory_order_relaxed);
+    if (threshold <= 0 || duration_us < (uint64_t)threshold) return;
+
+    uint32_t us = duration_us > UINT32_MAX ? UINT32_MAX : (uint32_t)duration_us;
+    int64_t now = (int64_t)time(NULL);
+
+    pthread_mutex_lock(&latency_lock);
+    latency_series_t* s = &series[event];
+    latency_sample_t* last = s->count ? &s->samples[(s->next + LATENCY_HISTORY_LEN - 1) % LATENCY_HISTORY_LEN] : NULL;
+    if (last && last->time == now) {
+        // Same second: keep the worst one, so a burst cannot flush the history
+        if (us > last->duration_us) last->duration_us = us;
+    } else {
+        s->samples[s->next] = (latency_sample_t){ .time = now, .duration_us = us };
+        s->next = (s->next + 1) % LATENCY_HISTORY_LEN;
+        if (s->count < LATENCY_HISTORY_LEN) s->count++;
+    }
+    if (us > s->max_us) s->max_us = us;
+    pthread_mutex_unlock(&latency_lock);
+}
+
+static int find_event(const char* name) {
+    for (int i = 0; i < LATENCY_NUM_EVENTS; i++) {
+        if (strcasecmp(name, event_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+void latency_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    (void)db;
+    size_t pos = 0;
+
+    pthread_mutex_lock(&latency_lock);
+    if (strcasecmp(argv[1], "LATEST") == 0 && argc == 2) {
+        // [[event, time, latest_us, max_us], ...] for events with samples
+        int n = 0;
+        for (int i = 0; i < LATENCY_NUM_EVENTS; i++) n += series[i].count > 0;
+        reply_append(response_buf, response_max, &pos, "*%d\r\n", n);
+        for (int i = 0; i < LATENCY_NUM_EVENTS; i++) {
+            latency_series_t* s = &series[i];
+            if (s->count == 0) continue;
+            latency_sample_t* last = &s->samples[(s->next + LATENCY_HISTORY_LEN - 1) % LATENCY_HISTORY_LEN];
+            reply_append(response_buf, response_max, &pos, "*4\r\n");
+            reply_bulk(response_buf, response_max, &pos, event_names[i]);
+            reply_append(response_buf, response_max, &pos, ":%lld\r\n:%u\r\n:%u\r\n",
+                         (long long)last->time, last->duration_us, s->max_us);
+        }
+    } else if (strcasecmp(argv[1], "HISTORY") == 0 && argc == 3) {
+        int ev = find_event(argv[2]);
+        if (ev < 0) {
+            reply_append(response_buf, response_max, &pos, "-ERR unknown latency event '%s'\r\n", argv[2]);
+        } else {
+            // [[time, us], ...] oldest first; only the newest samples if they don't all fit
+            latency_series_t* s = &series[ev];
+            int fit = (int)((response_max - 32) / 48); // Worst-case size of one sample
+            int n = MAX(0, s->count < fit ? s->count : fit);
+            reply_append(response_buf, response_max, &pos, "*%d\r\n", n);
+            for (int k = n; k > 0; k--) {
+                latency_sample_t* smp = &s->samples[(s->next + LATENCY_HISTORY_LEN - k) % LATENCY_HISTORY_LEN];
+                reply_append(response_buf, response_max, &pos, "*2\r\n:%lld\r\n:%u\r\n",
+                             (long long)smp->time, smp->duration_us);
+            }
+        }
+    } else if (strcasecmp(argv[1], "RESET") == 0) {
+        // No names = every event. Replies with the number of series reset.
+        int reset = 0;
+        for (int i = 0; i < LATENCY_NUM_EVENTS; i++) {
+            bool selected = argc == 2;
+            for (int a = 2; a < argc && !selected; a++) selected = strcasecmp(argv[a], event_names[i]) == 0;
+            if (!selected) continue;
+            reset += series[i].count > 0;
+            memset(&series[i], 0, sizeof(series[i]));
+        }
+        reply_append(response_buf, response_max, &pos, ":%d\r\n", reset);
+    } else {
+        reply_append(response_buf, response_max, &pos, "-ERR Unknown LATENCY subcommand or wrong args\r\n");
+    }
+    pthread_mutex_unlock(&latency_lock);
+}
@@ -0,0 +1,38 @@
+/* latency.h - Latency monitor: spikes per event class (LATENCY command) */
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "common.h"
+#include "hash_table.h"
+#include <time.h>
+
+// --- Configuration ---
+#define LATENCY_DEFAULT_THRESHOLD_US 10000 // Record events at least this slow (0 = monitor off)
+#define LATENCY_HISTORY_LEN 160            // Samples kept per event, at most one per second
+
+// Event classes that report their duration
+typedef enum {
+    LATENCY_COMMAND,    // One command on a worker (same measurement as SLOWLOG)
+    LATENCY_EVENT_LOOP, // One epoll_wait() round of the main thread, excluding the wait
+    LATENCY_REHASH,     // One stop-the-world hash table resize
+    LATENCY_NUM_EVENTS
+} latency_event_t;
+
+// Monotonic clock in microseconds. Niche C: served from the vDSO, no syscall.
+static inline uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// --- Public API ---
+void latency_init(long threshold_us);
+
+// Records 'duration_us' for 'event' if it reaches the threshold. Below the
+// threshold this is a single compare, so it stays on in production.
+void latency_add_sample(latency_event_t event, uint64_t duration_us);
+
+// "LATENCY LATEST | HISTORY <event> | RESET [event ...]" (command_fn signature)
+void latency_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+
+#endif // LATENCY_H
@@ -0,0 +1,82 @@
+/* lazyfree.c - Implementation of the lazy free thread */
+#include "lazyfree.h"
+
+/**
+ * @brief Takes the queued entries in batches and frees them, off the table lock.
+ */
+static void* lazyfree_thread_func(void* arg) {
+    lazyfree_t* lf = (lazyfree_t*)arg;
+    
+    while (true) {
+        pthread_mutex_lock(&lf->queue_lock);
+        while (lf->queue_head == NULL && !atomic_load_explicit(&lf->shutdown, memory_order_relaxed)) {
+            pthread_cond_wait(&lf->queue_cond, &lf->queue_lock);
+        }
+        // Detach the whole list: pushers only wait for the lock this long
+        ht_entry_t* entry = lf->queue_head;
+        lf->queue_head = NULL;
+        lf->queue_tail = NULL;
+        pthread_mutex_unlock(&lf->queue_lock);
+        
+        // Drain everything before honouring shutdown
+        if (entry == NULL) break;
+        
+        while (entry) {
+            ht_entry_t* next = entry->next;
+            atomic_fetch_add_explicit(&lf->freed_bytes, entry->value_len, memory_order_relaxed);
+            ht_free_entry(entry);
+            atomic_fetch_sub_explicit(&lf->pending, 1, memory_order_relaxed);
+            entry = next;
+        }
+    }
+    
+    LOG("Lazy free thread exiting (%zu bytes reclaimed).",
+        atomic_load_explicit(&lf->freed_bytes, memory_order_relaxed));
+    return NULL;
+}
+
+lazyfree_t* lazyfree_create() {
+    lazyfree_t* lf = (lazyfree_t*)malloc(sizeof(lazyfree_t));
+    if (!lf) ERROR_EXIT("malloc lazyfree_t");
+    
+    lf->queue_head = NULL;
+    lf->queue_tail = NULL;
+    pthread_mutex_init(&lf->queue_lock, NULL);
+    pthread_cond_init(&lf->queue_cond, NULL);
+    atomic_init(&lf->shutdown, false);
+    atomic_init(&lf->pending, 0);
+    atomic_init(&lf->freed_bytes, 0);
+    
+    if (pthread_create(&lf->thread, NULL, lazyfree_thread_func, lf) != 0) {
+        ERROR_EXIT("pthread_create lazyfree");
+    }
+    return lf;
+}
+
+void lazyfree_destroy(lazyfree_t* lf) {
+    pthread_mutex_lock(&lf->queue_lock);
+    atomic_store_explicit(&lf->shutdown, true, memory_order_release);
+    pthread_cond_signal(&lf->queue_cond);
+    pthread_mutex_unlock(&lf->queue_lock);
+    
+    pthread_join(lf->thread, NULL); // Thread drains the queue before exiting
+    
+    pthread_mutex_destroy(&lf->queue_lock);
+    pthread_cond_destroy(&lf->queue_cond);
+    free(lf);
+}
+
+void lazyfree_push(lazyfree_t* lf, ht_entry_t* entry) {
+    entry->next = NULL;
+    atomic_fetch_add_explicit(&lf->pending, 1, memory_order_relaxed);
+    
+    pthread_mutex_lock(&lf->queue_lock);
+    if (lf->queue_tail) {
+        lf->queue_tail->next = entry;
+    } else {
+        lf->queue_head = entry;
+    }
+    lf->queue_tail = entry;
+    pthread_cond_signal(&lf->queue_cond);
+    pthread_mutex_unlock(&lf->queue_lock);
+}
@@ -0,0 +1,36 @@
+/* lazyfree.h - Background thread that frees detached hash table entries */
+#ifndef LAZYFREE_H
+#define LAZYFREE_H
+
+#include "common.h"
+#include "hash_table.h"
+
+// --- Configuration ---
+// Values smaller than this are cheaper to free inline than to hand off.
+#define LAZYFREE_DEFAULT_THRESHOLD 4096
+
+// --- Structures ---
+
+typedef struct lazyfree_t {
+    pthread_t thread;
+    // Detached entries waiting to be freed, linked through their 'next'.
+    // Niche C: an intrusive list under a mutex instead of lf_queue_t, whose
+    // pop cannot free its old head node and would leak one node per entry.
+    ht_entry_t* queue_head;
+    ht_entry_t* queue_tail;
+
+    pthread_mutex_t queue_lock;  // Protects the list (and the condition variable)
+    pthread_cond_t queue_cond;   // Signalled when entries are queued
+    atomic_bool shutdown;
+
+    atomic_size_t pending;       // Entries queued but not yet freed
+    atomic_size_t freed_bytes;   // Total value bytes reclaimed by the thread
+} lazyfree_t;
+
+// --- Public API ---
+lazyfree_t* lazyfree_create();
+void lazyfree_destroy(lazyfree_t* lf); // Frees everything still queued, then joins
+// Hands a detached entry (not linked into any table) to the background thread.
+void lazyfree_push(lazyfree_t* lf, ht_entry_t* entry);
+
+#endif // LAZYFREE_H
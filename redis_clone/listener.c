@@ -0,0 +1,120 @@
+/* listener.c - TCP and Unix domain socket listeners */
+#include "listener.h"
+#include <stddef.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/stat.h>
+
+int listener_open_tcp(listener_t* l, const listen_config_t* cfg) {
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", cfg->port);
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;     // "::1" and "127.0.0.1" both work
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;     // NULL bind_addr = wildcard address
+    const char* host = cfg->bind_addr;
+    if (host && strcmp(host, "*") == 0) host = NULL;
+    if (host == NULL) hints.ai_family = AF_INET; // Wildcard stays IPv4, like before
+
+    int rc = getaddrinfo(host, port_str, &hints, &res);
+    if (rc != 0) {
+        fprintf(stderr, "bind address %s: %s\n", host ? host : "*", gai_strerror(rc));
+        return -1;
+    }
+
+    // Niche C: SOCK_NONBLOCK saves the fcntl() round trip (edge-triggered epoll needs it)
+    int fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd == -1) {
+        perror("socket"); freeaddrinfo(res); return -1;
+    }
+
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    if (cfg->defer_accept_secs > 0) {
+        // Niche C: the kernel finishes the handshake but only queues the connection
+        // for accept() once the first request bytes arrive (or the timeout expires),
+        // so idle connects never wake the event loop.
+        int secs = cfg->defer_accept_secs;
+        if (setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &secs, sizeof(secs)) == -1) {
+            perror("setsockopt(TCP_DEFER_ACCEPT)");
+        }
+    }
+
+    if (bind(fd, res->ai_addr, res->ai_addrlen) == -1) {
+        perror("bind"); close(fd); freeaddrinfo(res); return -1;
+    }
+    freeaddrinfo(res);
+
+    if (listen(fd, cfg->backlog) == -1) {
+        perror("listen"); close(fd); return -1;
+    }
+
+    l->fd = fd;
+    l->is_unix = false;
+    l->tcp_nodelay = cfg->tcp_nodelay;
+    snprintf(l->name, sizeof(l->name), "%s:%d", host ? host : "*", cfg->port);
+    return 0;
+}
+
+socklen_t listener_unix_addr(const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    size_t len = strlen(path);
+    if (len == 0 || len >= sizeof(addr->sun_path)) return 0;
+    memcpy(addr->sun_path, path, len);
+
+    if (path[0] == '@') {
+        // Abstract namespace: sun_path starts with a NUL and the name is *not*
+        // NUL-terminated; its length comes from the address length alone.
+        addr->sun_path[0] = '\0';
+        return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len);
+    }
+    return (socklen_t)sizeof(*addr);
+}
+
+int listener_open_unix(listener_t* l, const listen_config_t* cfg) {
+    struct sockaddr_un addr;
+    socklen_t addr_len = listener_unix_addr(cfg->unix_path, &addr);
+    if (addr_len == 0) {
+        fprintf(stderr, "unix socket path too long: %s\n", cfg->unix_path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd == -1) {
+        perror("socket(AF_UNIX)"); return -1;
+    }
+
+    bool abstract = cfg->unix_path[0] == '@';
+    if (!abstract) {
+        // A socket file left behind by a previous run would make bind() fail
+        struct stat st;
+        if (stat(cfg->unix_path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(cfg->unix_path);
+    }
+
+    if (bind(fd, (struct sockaddr*)&addr, addr_len) == -1) {
+        perror("bind(AF_UNIX)"); close(fd); return -1;
+    }
+    if (listen(fd, cfg->backlog) == -1) {
+        perror("listen(AF_UNIX)"); close(fd);
+        if (!abstract) unlink(cfg->unix_path);
+        return -1;
+    }
+
+    l->fd = fd;
+    l->is_unix = true;
+    l->tcp_nodelay = false; // Not a TCP socket
+    snprintf(l->name, sizeof(l->name), "%s", cfg->unix_path);
+    return 0;
+}
+
+void listener_close(listener_t* l) {
+    close(l->fd);
+    if (l->is_unix && l->name[0] != '@') unlink(l->name);
+}
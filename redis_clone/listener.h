@@ -0,0 +1,55 @@
+/* listener.h - TCP and Unix domain socket listeners */
+#ifndef LISTENER_H
+#define LISTENER_H
+
+#include "common.h"
+#include <sys/un.h>
+
+// --- Configuration ---
+#define MAX_LISTENERS 2             // One TCP and one Unix domain socket
+#define DEFAULT_TCP_BACKLOG 511     // Same as Redis; the kernel caps it at somaxconn
+#define LISTENER_NAME_LEN 128
+
+// --- Structures ---
+
+// Listener settings, filled in from the command line (see main.c)
+typedef struct {
+    const char* bind_addr;  // TCP address or hostname, NULL = all interfaces
+    int port;               // TCP port, 0 = no TCP listener
+    int backlog;            // listen() backlog for both listeners
+    bool tcp_nodelay;       // Set TCP_NODELAY on accepted TCP connections
+    int defer_accept_secs;  // TCP_DEFER_ACCEPT: wake accept() only once data arrived (0 = off)
+    const char* unix_path;  // Unix socket path, "@name" = abstract namespace, NULL = none
+} listen_config_t;
+
+// One open listening socket
+typedef struct {
+    int fd;
+    bool is_unix;
+    bool tcp_nodelay;                // Apply TCP_NODELAY to sockets accepted here
+    char name[LISTENER_NAME_LEN];    // For messages, and the file to unlink on close
+} listener_t;
+
+// --- Public API ---
+
+/**
+ * @brief Opens a non-blocking TCP listener on cfg->bind_addr:cfg->port.
+ * @return 0 on success, -1 (after printing why) on failure.
+ */
+int listener_open_tcp(listener_t* l, const listen_config_t* cfg);
+
+/**
+ * @brief Opens a non-blocking Unix domain socket listener on cfg->unix_path.
+ * A leading '@' selects the Linux abstract namespace: no file is created, and
+ * the name disappears with the process. A stale socket file is replaced.
+ * @return 0 on success, -1 (after printing why) on failure.
+ */
+int listener_open_unix(listener_t* l, const listen_config_t* cfg);
+
+// Closes the socket and removes the socket file of a path-based Unix listener.
+void listener_close(listener_t* l);
+
+// Fills 'addr' for a Unix socket path ("@name" = abstract). Returns the address length, or 0 if too long.
+socklen_t listener_unix_addr(const char* path, struct sockaddr_un* addr);
+
+#endif // LISTENER_H
@@ -3,12 +3,18 @@
 #include "slab.h"
 #include "thread_pool.h"
 #include "hash_table.h"
+#include "cluster.h"
+#include "lazyfree.h"
+#include "eval.h"
+#include "slowlog.h"
+#include "latency.h"
 #include <signal.h>
 
 #define DEFAULT_PORT 6379
 
 static server_t server;
 static hash_table_t* database;
+static lazyfree_t* lazyfree;
 
 // Handle Ctrl+C
 void handle_shutdown(int sig) {
@@ -18,14 +24,19 @@ void handle_shutdown(int sig) {
     // Signal thread pool to shutdown
     thread_pool_destroy(server.pool);
     
-    // Close listening socket
-    close(server.listen_fd);
+    // Close listening sockets (removes the Unix socket file)
+    for (int i = 0; i < server.num_listeners; i++) listener_close(&server.listeners[i]);
     
     // Close epoll fd
     close(server.epoll_fd);
 
-    // Destroy hash table
+    // Destroy hash table, then let the lazyfree thread drain what it still holds
     ht_destroy(database);
+    lazyfree_destroy(lazyfree);
+    eval_shutdown();
+    slowlog_shutdown();
+    
+    if (server.cluster) cluster_destroy(server.cluster);
     
     // Destroy slab allocator (this assumes all clients were closed)
     slab_destroy(server.client_slab);
@@ -34,33 +45,160 @@ void handle_shutdown(int sig) {
     exit(0);
 }
 
-int main(void) {
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [--port N] [--bind ADDR] [--tcp-backlog N] [--tcp-nodelay yes|no]"
+                    " [--tcp-defer-accept SECS] [--unixsocket PATH|@name]\n"
+                    "       [--cluster nodes.conf] [--lazyfree] [--lazyfree-threshold BYTES]"
+                    " [--script-budget-us N] [--script-gc-step N] [--script-jit]\n"
+                    "       [--slab-pages normal|thp|hugetlb] [--slab-size BYTES] [--slab-numa off|local|NODE]\n"
+                    "       [--slowlog-log-slower-than US] [--slowlog-max-len N] [--latency-monitor-threshold US]\n"
+                    "       [--read-budget BYTES] [--cmd-budget N] [--output-limit BYTES] [--max-inflight N]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+    listen_config_t listen_cfg = {
+        .bind_addr = NULL,
+        .port = DEFAULT_PORT,
+        .backlog = DEFAULT_TCP_BACKLOG,
+        .tcp_nodelay = true,
+        .defer_accept_secs = 0,
+        .unix_path = NULL,
+    };
+    const char* cluster_config = NULL;
+    bool lazyfree_all = false;
+    size_t lazyfree_threshold = LAZYFREE_DEFAULT_THRESHOLD;
+    long script_budget_us = SCRIPT_DEFAULT_BUDGET_US;
+    long script_gc_step = SCRIPT_DEFAULT_GC_STEP;
+    bool script_jit = false;
+    long slowlog_slower_than = SLOWLOG_DEFAULT_SLOWER_THAN_US;
+    int slowlog_max_len = SLOWLOG_DEFAULT_MAX_LEN;
+    long latency_threshold = LATENCY_DEFAULT_THRESHOLD_US;
+    slab_options_t slab_opts = { .slab_size = 0, .pages = SLAB_PAGES_NORMAL, .numa_node = SLAB_NUMA_NONE };
+
+    server.read_budget = DEFAULT_READ_BUDGET;
+    server.cmd_budget = DEFAULT_CMD_BUDGET;
+    server.output_limit = DEFAULT_OUTPUT_LIMIT;
+    server.max_inflight = DEFAULT_MAX_INFLIGHT;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            listen_cfg.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bind") == 0 && i + 1 < argc) {
+            listen_cfg.bind_addr = argv[++i];
+        } else if (strcmp(argv[i], "--tcp-backlog") == 0 && i + 1 < argc) {
+            listen_cfg.backlog = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tcp-nodelay") == 0 && i + 1 < argc) {
+            listen_cfg.tcp_nodelay = strcmp(argv[++i], "no") != 0;
+        } else if (strcmp(argv[i], "--tcp-defer-accept") == 0 && i + 1 < argc) {
+            listen_cfg.defer_accept_secs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--unixsocket") == 0 && i + 1 < argc) {
+            listen_cfg.unix_path = argv[++i];
+        } else if (strcmp(argv[i], "--cluster") == 0 && i + 1 < argc) {
+            cluster_config = argv[++i];
+        } else if (strcmp(argv[i], "--lazyfree") == 0) {
+            lazyfree_all = true;
+        } else if (strcmp(argv[i], "--lazyfree-threshold") == 0 && i + 1 < argc) {
+            lazyfree_threshold = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--script-budget-us") == 0 && i + 1 < argc) {
+            script_budget_us = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--script-gc-step") == 0 && i + 1 < argc) {
+            script_gc_step = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--script-jit") == 0) {
+            script_jit = true;
+        } else if (strcmp(argv[i], "--slab-pages") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "thp") == 0) slab_opts.pages = SLAB_PAGES_THP;
+            else if (strcmp(mode, "hugetlb") == 0) slab_opts.pages = SLAB_PAGES_HUGETLB;
+            else if (strcmp(mode, "normal") == 0) slab_opts.pages = SLAB_PAGES_NORMAL;
+            else usage(argv[0]);
+        } else if (strcmp(argv[i], "--slab-size") == 0 && i + 1 < argc) {
+            slab_opts.slab_size = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--slab-numa") == 0 && i + 1 < argc) {
+            const char* node = argv[++i];
+            if (strcmp(node, "off") == 0) slab_opts.numa_node = SLAB_NUMA_NONE;
+            else if (strcmp(node, "local") == 0) slab_opts.numa_node = SLAB_NUMA_LOCAL;
+            else slab_opts.numa_node = MAX(atoi(node), 0);
+        } else if (strcmp(argv[i], "--slowlog-log-slower-than") == 0 && i + 1 < argc) {
+            slowlog_slower_than = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--slowlog-max-len") == 0 && i + 1 < argc) {
+            slowlog_max_len = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--latency-monitor-threshold") == 0 && i + 1 < argc) {
+            latency_threshold = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--read-budget") == 0 && i + 1 < argc) {
+            server.read_budget = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cmd-budget") == 0 && i + 1 < argc) {
+            server.cmd_budget = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output-limit") == 0 && i + 1 < argc) {
+            server.output_limit = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-inflight") == 0 && i + 1 < argc) {
+            server.max_inflight = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    // Zero or negative limits would stall every client
+    listen_cfg.backlog = MAX(listen_cfg.backlog, 1);
+    server.read_budget = MAX(server.read_budget, 1);
+    server.cmd_budget = MAX(server.cmd_budget, 1);
+    server.output_limit = MAX(server.output_limit, (size_t)1);
+    server.max_inflight = MAX(server.max_inflight, 1);
+
     signal(SIGINT, handle_shutdown);
     signal(SIGPIPE, SIG_IGN); // Important for network servers
 
     // --- 1. Initialize Core Components ---
-    database = ht_create();
-    server.client_slab = slab_create(sizeof(client_t));
-    server.pool = thread_pool_create(database, server.client_slab); // Pass db and slab
-
-    // --- 2. Create Listening Socket ---
-    server.listen_fd = create_and_bind(DEFAULT_PORT);
+    server.cluster = NULL;
+    if (cluster_config) {
+        server.cluster = cluster_load(cluster_config, listen_cfg.port);
+        if (!server.cluster) exit(EXIT_FAILURE);
+    }
+    database = ht_create(&slab_opts);
+    lazyfree = lazyfree_create(); // Always running: UNLINK needs it even without --lazyfree
+    ht_set_lazyfree(database, lazyfree, lazyfree_threshold, lazyfree_all);
+    eval_init(script_budget_us, script_gc_step, script_jit);
+    slowlog_init(slowlog_slower_than, slowlog_max_len);
+    latency_init(latency_threshold);
+    server.client_slab = slab_create(sizeof(client_t), &slab_opts);
+    if (!server.client_slab) ERROR_EXIT("slab_create clients");
+    char slab_info[128];
+    slab_describe(database->entry_slab, slab_info, sizeof(slab_info));
+    printf("Memory: %s\n", slab_info);
+    server.pool = thread_pool_create(database, &server); // Pass db and server
 
-    // --- 3. Create Epoll Instance ---
+    // --- 2. Create Epoll Instance ---
     server.epoll_fd = epoll_create1(0);
     if (server.epoll_fd == -1) ERROR_EXIT("epoll_create1");
 
-    // --- 4. Add Listening Socket to Epoll ---
-    struct epoll_event event;
-    event.events = EPOLLIN | EPOLLET; // Edge triggered for listen socket too
-    event.data.fd = server.listen_fd; // Use fd directly for listen socket
-    
-    if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event) == -1) {
-        ERROR_EXIT("epoll_ctl ADD listen_fd");
+    // --- 3. Create Listening Sockets and Add Them to Epoll ---
+    server.num_listeners = 0;
+    if (listen_cfg.port > 0) {
+        if (listener_open_tcp(&server.listeners[server.num_listeners], &listen_cfg) == -1) exit(EXIT_FAILURE);
+        server.num_listeners++;
+    }
+    if (listen_cfg.unix_path) {
+        if (listener_open_unix(&server.listeners[server.num_listeners], &listen_cfg) == -1) exit(EXIT_FAILURE);
+        server.num_listeners++;
+    }
+    if (server.num_listeners == 0) {
+        fprintf(stderr, "Nothing to listen on: give a --port or a --unixsocket.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < server.num_listeners; i++) {
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET; // Edge triggered for listen sockets too
+        event.data.ptr = &server.listeners[i]; // Clients store their client_t* instead
+        if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listeners[i].fd, &event) == -1) {
+            ERROR_EXIT("epoll_ctl ADD listener");
+        }
     }
 
-    // --- 5. Run the Main Event Loop ---
-    printf("C-Redis server started on port %d\n", DEFAULT_PORT);
+    // --- 4. Run the Main Event Loop ---
+    printf("C-Redis server started on");
+    for (int i = 0; i < server.num_listeners; i++) printf(" %s", server.listeners[i].name);
+    printf("%s\n", server.cluster ? " (cluster mode)" : "");
     server_run(&server);
 
     // Should never be reached
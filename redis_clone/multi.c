@@ -0,0 +1,71 @@
+/* multi.c - Implementation of the transaction state */
+#include "multi.h"
+#include "protocol.h"
+
+multi_state_t* multi_create() {
+    multi_state_t* ms = (multi_state_t*)malloc(sizeof(multi_state_t));
+    if (!ms) ERROR_EXIT("malloc multi_state_t");
+    
+    ms->in_multi = false;
+    ms->aborted = false;
+    ms->slot = -1;
+    ms->asking = false;
+    ms->num_queued = 0;
+    ms->num_watched = 0;
+    return ms;
+}
+
+void multi_destroy(multi_state_t* ms) {
+    if (!ms) return;
+    multi_reset(ms);
+    free(ms);
+}
+
+void multi_reset(multi_state_t* ms) {
+    for (int i = 0; i < ms->num_queued; i++) free(ms->queued[i]);
+    for (int i = 0; i < ms->num_watched; i++) free(ms->watched[i].key);
+    ms->num_queued = 0;
+    ms->num_watched = 0;
+    ms->in_multi = false;
+    ms->aborted = false;
+    ms->slot = -1;
+    ms->asking = false;
+}
+
+void multi_take(multi_state_t* to, multi_state_t* from) {
+    *to = *from; // Niche C: struct copy moves the pointer arrays wholesale
+    from->num_queued = 0;
+    from->num_watched = 0;
+    multi_reset(from);
+}
+
+bool multi_queue(multi_state_t* ms, int argc, char** argv) {
+    if (ms->num_queued >= MULTI_MAX_QUEUED) return false;
+    
+    // Re-join the words so EXEC can split them again (quoting where needed)
+    char* line = join_args(argc, argv);
+    if (!line) return false;
+    
+    ms->queued[ms->num_queued++] = line;
+    return true;
+}
+
+bool multi_watch(multi_state_t* ms, const char* key, uint64_t version) {
+    // Re-watching a key keeps the first version seen
+    for (int i = 0; i < ms->num_watched; i++) {
+        if (strcmp(ms->watched[i].key, key) == 0) return true;
+    }
+    if (ms->num_watched >= MULTI_MAX_WATCHED) return false;
+    
+    ms->watched[ms->num_watched].key = strdup(key);
+    ms->watched[ms->num_watched].version = version;
+    ms->num_watched++;
+    return true;
+}
+
+bool multi_watches_intact(const multi_state_t* ms, hash_table_t* db) {
+    for (int i = 0; i < ms->num_watched; i++) {
+        if (ht_version(db, ms->watched[i].key) != ms->watched[i].version) return false;
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+/* multi.h - MULTI/EXEC transaction queue and WATCH bookkeeping */
+#ifndef MULTI_H
+#define MULTI_H
+
+#include "common.h"
+#include "hash_table.h"
+
+// --- Configuration ---
+#define MULTI_MAX_QUEUED 128  // Commands per transaction
+#define MULTI_MAX_WATCHED 64  // Keys per WATCH set
+
+// --- Structures ---
+
+// A watched key and the entry version it had when WATCH ran (absent: the table's last delete)
+typedef struct {
+    char* key;
+    uint64_t version;
+} watched_key_t;
+
+// Per-client transaction state (allocated on first MULTI/WATCH).
+// Protected by the owning client_t's lock.
+typedef struct multi_state_t {
+    bool in_multi;
+    bool aborted;        // A command failed to queue: EXEC replies -EXECABORT
+    int slot;            // Cluster mode: slot all queued keys share (-1 = none yet)
+    bool asking;         // Cluster mode: a command was queued right after ASKING
+
+    int num_queued;
+    char* queued[MULTI_MAX_QUEUED]; // Command lines, re-split at EXEC time
+
+    int num_watched;
+    watched_key_t watched[MULTI_MAX_WATCHED];
+} multi_state_t;
+
+// --- Public API ---
+multi_state_t* multi_create();
+void multi_destroy(multi_state_t* ms);
+// Drops queued commands and watched keys, leaving MULTI mode.
+void multi_reset(multi_state_t* ms);
+// Moves everything out of 'from' into 'to' and resets 'from' (so EXEC can run unlocked).
+void multi_take(multi_state_t* to, multi_state_t* from);
+
+bool multi_queue(multi_state_t* ms, int argc, char** argv); // false if the queue is full
+bool multi_watch(multi_state_t* ms, const char* key, uint64_t version); // false if full
+
+/**
+ * @brief True if no watched key changed since WATCH.
+ * Caller holds the table lock so the answer stays valid while EXEC runs.
+ */
+bool multi_watches_intact(const multi_state_t* ms, hash_table_t* db);
+
+#endif // MULTI_H
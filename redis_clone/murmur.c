@@ -0,0 +1,39 @@
+/* murmur.c - MurmurHash64A by Austin Appleby (public domain), little-endian loads */
+#include "murmur.h"
+
+uint64_t murmur64(const void* data, size_t len, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + (len & ~(size_t)7);
+    uint64_t h = seed ^ (len * m);
+
+    while (p != end) {
+        // Niche C: memcpy is the portable unaligned load; compilers emit a single mov.
+        uint64_t k;
+        memcpy(&k, p, sizeof(k));
+        p += 8;
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    switch (len & 7) {
+        case 7: h ^= (uint64_t)p[6] << 48; /* fallthrough */
+        case 6: h ^= (uint64_t)p[5] << 40; /* fallthrough */
+        case 5: h ^= (uint64_t)p[4] << 32; /* fallthrough */
+        case 4: h ^= (uint64_t)p[3] << 24; /* fallthrough */
+        case 3: h ^= (uint64_t)p[2] << 16; /* fallthrough */
+        case 2: h ^= (uint64_t)p[1] << 8;  /* fallthrough */
+        case 1: h ^= (uint64_t)p[0];
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
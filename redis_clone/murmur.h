@@ -0,0 +1,10 @@
+/* murmur.h - MurmurHash64A (element hashing for Bloom filters and HyperLogLog) */
+#ifndef MURMUR_H
+#define MURMUR_H
+
+#include "common.h"
+
+// 64-bit MurmurHash2 (variant A) of data[0..len). Fast and well mixed; not cryptographic.
+uint64_t murmur64(const void* data, size_t len, uint64_t seed);
+
+#endif // MURMUR_H
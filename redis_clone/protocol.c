@@ -0,0 +1,122 @@
+/* protocol.c - Request tokenizing and reply formatting helpers */
+#include "protocol.h"
+#include <stdarg.h>
+
+int split_args(char* line, char** argv, int max_args) {
+    int argc = 0;
+    char* p = line;
+
+    while (*p && argc < max_args) {
+        // Skip leading whitespace
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0') break;
+
+        if (*p == '"') {
+            // Quoted word: may contain spaces; \" and \\ are escapes.
+            // Niche C: unescape in place, the write pointer trails the read pointer.
+            char* out = ++p;
+            argv[argc++] = out;
+            while (*p && *p != '"') {
+                if (*p == '\\' && (p[1] == '"' || p[1] == '\\')) p++;
+                *out++ = *p++;
+            }
+            if (*p) p++; // Skip the closing quote
+            *out = '\0';
+            continue;
+        }
+
+        argv[argc++] = p;
+
+        // Find the end of this word and terminate it
+        while (*p && *p != ' ' && *p != '\t') p++;
+        if (*p) *p++ = '\0';
+    }
+    return argc;
+}
+
+// Does 'arg' need quotes to survive a round trip through split_args()?
+static bool needs_quotes(const char* arg) {
+    if (*arg == '\0') return true;
+    return strpbrk(arg, " \t\"\\") != NULL;
+}
+
+char* join_args(int argc, char** argv) {
+    // Worst case: every byte escaped, plus two quotes and a separator per word
+    size_t len = 1;
+    for (int i = 0; i < argc; i++) len += 2 * strlen(argv[i]) + 3;
+
+    char* line = (char*)malloc(len);
+    if (!line) return NULL;
+
+    char* p = line;
+    for (int i = 0; i < argc; i++) {
+        if (i > 0) *p++ = ' ';
+        if (needs_quotes(argv[i])) {
+            *p++ = '"';
+            for (const char* c = argv[i]; *c; c++) {
+                if (*c == '"' || *c == '\\') *p++ = '\\';
+                *p++ = *c;
+            }
+            *p++ = '"';
+        } else {
+            size_t n = strlen(argv[i]);
+            memcpy(p, argv[i], n);
+            p += n;
+        }
+    }
+    *p = '\0';
+    return line;
+}
+
+void reply_append(char* buf, size_t max, size_t* pos, const char* fmt, ...) {
+    if (*pos >= max) return; // Buffer already full, drop the rest
+
+    va_list args;
+    va_start(args, fmt);
+    int written = vsnprintf(buf + *pos, max - *pos, fmt, args);
+    va_end(args);
+
+    if (written < 0) return;
+    // Niche C: vsnprintf returns the length it *wanted* to write; clamp on truncation.
+    *pos += ((size_t)written < max - *pos) ? (size_t)written : max - *pos - 1;
+}
+
+void reply_bulk(char* buf, size_t max, size_t* pos, const char* str) {
+    reply_append(buf, max, pos, "$%zu\r\n%s\r\n", strlen(str), str);
+}
+
+void reply_buffer_init(reply_buffer_t* rb, size_t initial) {
+    rb->cap = initial > 0 ? initial : 1;
+    rb->len = 0;
+    rb->buf = (char*)malloc(rb->cap);
+    if (!rb->buf) ERROR_EXIT("malloc reply buffer");
+    rb->buf[0] = '\0';
+}
+
+void reply_buffer_append(reply_buffer_t* rb, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list retry;
+    va_copy(retry, args); // Niche C: a va_list is used up by one vsnprintf
+    int needed = vsnprintf(rb->buf + rb->len, rb->cap - rb->len, fmt, args);
+    va_end(args);
+
+    if (needed >= 0 && (size_t)needed >= rb->cap - rb->len) {
+        while ((size_t)needed >= rb->cap - rb->len) rb->cap *= 2;
+        rb->buf = (char*)realloc(rb->buf, rb->cap);
+        if (!rb->buf) ERROR_EXIT("realloc reply buffer");
+        vsnprintf(rb->buf + rb->len, rb->cap - rb->len, fmt, retry);
+    }
+    va_end(retry);
+    if (needed > 0) rb->len += (size_t)needed;
+}
+
+char* reply_buffer_finish(reply_buffer_t* rb, char* response_buf, size_t response_max) {
+    if (rb->len < response_max) {
+        memcpy(response_buf, rb->buf, rb->len + 1);
+        free(rb->buf);
+        return NULL;
+    }
+    response_buf[0] = '\0';
+    return rb->buf;
+}
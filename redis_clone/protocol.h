@@ -0,0 +1,46 @@
+/* protocol.h - Request tokenizing and reply formatting helpers */
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "common.h"
+
+// --- Configuration ---
+#define MAX_ARGS 16 // Max whitespace-separated words in one request line
+
+// Reply for a command used on a key of another type (e.g. GET on a Bloom filter)
+#define WRONGTYPE_REPLY "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n"
+
+// --- Public API ---
+
+// Splits 'line' in place on spaces/tabs; "double quoted" words may contain
+// spaces (with \" and \\ escapes). Returns the number of words stored in argv.
+int split_args(char* line, char** argv, int max_args);
+
+// The inverse of split_args(): joins the words with spaces, quoting and
+// escaping those that need it. Returns a malloc'd line, or NULL if out of memory.
+char* join_args(int argc, char** argv);
+
+// Appends formatted text at buf + *pos, never writing past 'max' (always NUL-terminated).
+void reply_append(char* buf, size_t max, size_t* pos, const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+// Appends a RESP bulk string ("$<len>\r\n<str>\r\n").
+void reply_bulk(char* buf, size_t max, size_t* pos, const char* str);
+
+// --- Growable Replies ---
+// For replies with no fixed bound (EXEC, CLUSTER SLOTS): appending never
+// truncates, so an array header is always followed by all its elements.
+typedef struct {
+    char* buf;
+    size_t len;
+    size_t cap;
+} reply_buffer_t;
+
+void reply_buffer_init(reply_buffer_t* rb, size_t initial);
+void reply_buffer_append(reply_buffer_t* rb, const char* fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+// Copies the reply into response_buf and returns NULL if it fits; otherwise
+// returns it (malloc'd, for the caller to send and free) and empties response_buf.
+char* reply_buffer_finish(reply_buffer_t* rb, char* response_buf, size_t response_max);
+
+#endif // PROTOCOL_H
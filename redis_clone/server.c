@@ -2,8 +2,12 @@
 #include "server.h"
 #include "slab.h"
 #include "thread_pool.h"
+#include "multi.h"
+#include "latency.h"
 #include <fcntl.h>
+#include <netdb.h>
 #include <sys/socket.h>
+#include <netinet/tcp.h>
 
 /**
  * @brief Sets a file descriptor to non-blocking mode.
@@ -19,53 +23,93 @@ int set_nonblocking(int fd) {
     return 0;
 }
 
-/**
- * @brief Creates and binds the main listening socket.
- */
-int create_and_bind(int port) {
-    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_fd == -1) ERROR_EXIT("socket");
+// --- Ready list (main thread only) ---
+// Clients with buffered commands or unread socket data wait here for their
+// turn; the event loop serves each one a bounded slice per iteration.
 
-    int opt = 1;
-    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+static void ready_push(server_t *s, client_t *client) {
+    if (client->in_ready_list) return;
+    client->ready_prev = s->ready_tail;
+    client->ready_next = NULL;
+    if (s->ready_tail) s->ready_tail->ready_next = client;
+    else s->ready_head = client;
+    s->ready_tail = client;
+    client->in_ready_list = true;
+    s->ready_count++;
+}
 
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = INADDR_ANY;
+static void ready_remove(server_t *s, client_t *client) {
+    if (!client->in_ready_list) return;
+    if (client->ready_prev) client->ready_prev->ready_next = client->ready_next;
+    else s->ready_head = client->ready_next;
+    if (client->ready_next) client->ready_next->ready_prev = client->ready_prev;
+    else s->ready_tail = client->ready_prev;
+    client->in_ready_list = false;
+    s->ready_count--;
+}
 
-    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
-        close(listen_fd); ERROR_EXIT("bind");
-    }
-    if (set_nonblocking(listen_fd) == -1) {
-        close(listen_fd); ERROR_EXIT("set_nonblocking listen_fd");
-    }
-    if (listen(listen_fd, SOMAXCONN) == -1) {
-        close(listen_fd); ERROR_EXIT("listen");
-    }
-    return listen_fd;
+// True when the client must stop reading. Caller holds client->lock.
+static bool client_over_limit(server_t *s, client_t *client) {
+    return client->out_len - client->out_sent >= s->output_limit ||
+           client->inflight >= s->max_inflight;
 }
 
 /**
- * @brief Removes a client: closes socket, removes from epoll, frees struct.
+ * @brief Returns the struct to the slab. Only called once the socket is closed
+ *        and no worker still references the client.
  */
-static void remove_client(server_t *s, int client_fd, client_t* client) {
-    LOG("Removing client %d", client_fd);
-    epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, client_fd, NULL);
-    close(client_fd);
+static void client_free(server_t *s, client_t *client) {
+    while (client->work_head) { // Queued in the turn that saw the client go away
+        work_item_t* dropped = client->work_head;
+        client->work_head = dropped->next;
+        free(dropped);
+    }
+    multi_destroy(client->multi);
+    free(client->out_buf);
     pthread_mutex_destroy(&client->lock);
     slab_free(s->client_slab, client); // Return struct to slab
 }
 
+/**
+ * @brief Removes a client: closes socket, removes from epoll, frees struct.
+ * Niche C: a worker may still own the client's command queue, so it frees the
+ * struct instead once it lets go (see client_next_command).
+ */
+static void remove_client(server_t *s, client_t* client) {
+    LOG("Removing client %d", client->fd);
+    ready_remove(s, client);
+
+    pthread_mutex_lock(&client->lock);
+    // Under the lock, so no worker can epoll_ctl() a reused fd afterwards
+    epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    client->state = STATE_CLOSING;
+    bool idle = !client->scheduled;
+    pthread_mutex_unlock(&client->lock);
+
+    if (idle) client_free(s, client);
+}
+
+// Formats the peer of an accepted socket as "ip:port" ("socket_path:fd" for Unix peers).
+static void describe_peer(const listener_t *l, int fd, const struct sockaddr_storage *addr,
+                          socklen_t len, char *out, size_t max) {
+    char host[INET6_ADDRSTRLEN], port[8];
+    if (l->is_unix || getnameinfo((const struct sockaddr*)addr, len, host, sizeof(host), port, sizeof(port),
+                                  NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        snprintf(out, max, "%s:%d", l->name, fd);
+    } else {
+        snprintf(out, max, "%s:%s", host, port);
+    }
+}
+
 /**
  * @brief Accepts new connections and adds them to epoll.
  */
-static void accept_new_connection(server_t *s) {
+static void accept_new_connection(server_t *s, listener_t *l) {
     while (1) {
-        struct sockaddr_in client_addr;
+        struct sockaddr_storage client_addr; // Big enough for IPv4, IPv6 and Unix peers
         socklen_t client_len = sizeof(client_addr);
-        int client_fd = accept(s->listen_fd, (struct sockaddr*)&client_addr, &client_len);
+        int client_fd = accept(l->fd, (struct sockaddr*)&client_addr, &client_len);
         
         if (client_fd == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) return; // No more pending
@@ -76,6 +120,13 @@ static void accept_new_connection(server_t *s) {
             close(client_fd); continue;
         }
 
+        // Replies go out in bursts as each pipeline drains; don't let Nagle hold
+        // the tail of one back waiting for the client's delayed ACK.
+        if (l->tcp_nodelay) {
+            int nodelay = 1;
+            setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        }
+
         // Allocate a client_t struct from the slab
         client_t *client = (client_t*)slab_alloc(s->client_slab);
         if (!client) {
@@ -86,10 +137,20 @@ static void accept_new_connection(server_t *s) {
 
         // Initialize client state
         client->fd = client_fd;
+        describe_peer(l, client_fd, &client_addr, client_len, client->addr, sizeof(client->addr));
         client->state = STATE_READING;
         client->read_pos = 0;
-        client->write_pos = 0;
-        client->total_to_write = 0;
+        client->read_buffer[0] = '\0';
+        client->read_drained = false;
+        client->ready_prev = client->ready_next = NULL;
+        client->in_ready_list = false;
+        client->out_buf = NULL;
+        client->out_len = client->out_sent = client->out_cap = 0;
+        client->inflight = 0;
+        client->work_head = client->work_tail = NULL;
+        client->scheduled = false;
+        client->asking = false;
+        client->multi = NULL;
         pthread_mutex_init(&client->lock, NULL);
 
         // Add to epoll, watch for read and edge-triggered events
@@ -100,86 +161,236 @@ static void accept_new_connection(server_t *s) {
 
         if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, client_fd, &event) == -1) {
             perror("epoll_ctl ADD client");
+            pthread_mutex_destroy(&client->lock);
             slab_free(s->client_slab, client);
             close(client_fd);
+            continue;
         }
         LOG("Accepted client %d", client_fd);
     }
 }
 
 /**
- * @brief Handles readable event on a client socket.
+ * @brief Queues one command line on the client (schedule_client() wakes a worker).
+ * @return false if the client crossed a backpressure limit and is now paused.
  */
-static void handle_client_read(server_t *s, client_t *client) {
-    LOG("Handling read for fd %d", client->fd);
-    bool connection_closed = false;
-    
+static bool dispatch_command(server_t *s, client_t *client, const char* line) {
+    work_item_t* work = (work_item_t*)malloc(sizeof(work_item_t));
+    if (!work) ERROR_EXIT("malloc work_item_t");
+    work->client_fd = client->fd;
+    work->client = client;
+    strncpy(work->request, line, sizeof(work->request) - 1);
+    work->request[sizeof(work->request) - 1] = '\0';
+    work->server = s; // Pass server pointer
+    work->long_reply = NULL;
+    work->next = NULL;
+
+    pthread_mutex_lock(&client->lock);
+    if (client->work_tail) client->work_tail->next = work;
+    else client->work_head = work;
+    client->work_tail = work;
+    client->inflight++;
+    bool paused = client_over_limit(s, client);
+    if (paused) client->state = STATE_PAUSED;
+    pthread_mutex_unlock(&client->lock);
+
+    return !paused;
+}
+
+/**
+ * @brief Hands the client to the thread pool if it has queued commands and no
+ *        worker owns it yet (otherwise the owning worker gets to them).
+ * Niche C: called once per turn, so a pipeline is queued whole before a worker
+ * starts on it and its replies leave in one send() instead of trickling out.
+ */
+static void schedule_client(server_t *s, client_t *client) {
+    pthread_mutex_lock(&client->lock);
+    bool schedule = client->work_head && !client->scheduled;
+    if (schedule) client->scheduled = true;
+    pthread_mutex_unlock(&client->lock);
+
+    if (schedule) thread_pool_add_client(s->pool, client);
+}
+
+// read_and_dispatch() results
+#define TURN_DONE 0      // Input exhausted (or client paused)
+#define TURN_MORE 1      // Budget used up with input left
+#define TURN_CLOSED (-1) // Client was removed; the pointer may be gone
+
+/**
+ * @brief Dispatches buffered commands and reads more input until the command
+ *        or byte budget runs out.
+ */
+static int read_and_dispatch(server_t *s, client_t *client) {
+    int cmds_left = s->cmd_budget;
+    int bytes_left = s->read_budget;
+
+    // Replies may have piled up since the last turn
+    pthread_mutex_lock(&client->lock);
+    if (client_over_limit(s, client)) client->state = STATE_PAUSED;
+    bool paused = client->state == STATE_PAUSED;
+    pthread_mutex_unlock(&client->lock);
+    if (paused) return TURN_DONE; // handle_client_write() requeues us once drained
+
     while (true) {
+        // --- Simple Protocol Parsing (find \r\n) ---
+        char *newline;
+        while (cmds_left > 0 && (newline = strstr(client->read_buffer, "\r\n"))) {
+            *newline = '\0'; // Null-terminate the command line
+            bool keep_going = dispatch_command(s, client, client->read_buffer);
+            cmds_left--;
+
+            // Shift remaining data in buffer
+            int cmd_len = (newline - client->read_buffer) + 2; // Include \r\n
+            memmove(client->read_buffer, newline + 2, client->read_pos - cmd_len + 1); // + NUL
+            client->read_pos -= cmd_len;
+
+            if (!keep_going) return TURN_DONE;
+        }
+
+        // Turn used up: back of the queue, other clients go first
+        if (cmds_left == 0 || bytes_left <= 0) return TURN_MORE;
+        if (client->read_drained) return TURN_DONE; // Wait for the next EPOLLIN edge
+
+        // If buffer is full and we still haven't found \r\n, cmd too long
+        if (client->read_pos == READ_BUFFER_SIZE - 1) {
+            // Simplified: Just close connection
+            LOG("Command too long for fd %d", client->fd);
+            remove_client(s, client);
+            return TURN_CLOSED;
+        }
+
+        // Keep one byte free so the buffer is always NUL-terminated for strstr()
         ssize_t bytes_read = read(client->fd,
                                   client->read_buffer + client->read_pos,
-                                  READ_BUFFER_SIZE - client->read_pos);
-        
+                                  READ_BUFFER_SIZE - 1 - client->read_pos);
         if (bytes_read == 0) {
             // Client closed connection
-            connection_closed = true;
-            break;
-        } else if (bytes_read > 0) {
-            client->read_pos += bytes_read;
-            
-            // --- Simple Protocol Parsing (find \r\n) ---
-            char *newline = strstr(client->read_buffer, "\r\n");
-            while (newline) {
-                *newline = '\0'; // Null-terminate the command line
-                
-                // --- Dispatch to Thread Pool ---
-                work_item_t* work = (work_item_t*)malloc(sizeof(work_item_t));
-                work->client_fd = client->fd;
-                strncpy(work->request, client->read_buffer, sizeof(work->request) - 1);
-                work->request[sizeof(work->request) - 1] = '\0';
-                work->server = s; // Pass server pointer
-                
-                client->state = STATE_PROCESSING; // Mark as busy
-                thread_pool_add_work(s->pool, work);
-                
-                // Shift remaining data in buffer
-                int cmd_len = (newline - client->read_buffer) + 2; // Include \r\n
-                memmove(client->read_buffer, newline + 2, client->read_pos - cmd_len);
-                client->read_pos -= cmd_len;
-                
-                // Look for next command in buffer
-                newline = strstr(client->read_buffer, "\r\n");
-            }
-
-            // If buffer is full and we still haven't found \r\n, cmd too long
-            if (client->read_pos == READ_BUFFER_SIZE && !strstr(client->read_buffer, "\r\n")) {
-                // Simplified: Just close connection
-                LOG("Command too long for fd %d", client->fd);
-                connection_closed = true;
-                break;
-            }
-            
-            // If we read less than the buffer size, we're done reading for now
-            if (bytes_read < READ_BUFFER_SIZE - client->read_pos) {
-                break;
-            }
-            // Otherwise, loop again to try reading more (because of EPOLLET)
-
-        } else { // bytes_read < 0
+            remove_client(s, client);
+            return TURN_CLOSED;
+        }
+        if (bytes_read < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // No more data to read right now
-                break;
+                // Niche C: with EPOLLET we only learn about new data from the next edge
+                client->read_drained = true;
+                return TURN_DONE;
             }
             perror("read client");
-            connection_closed = true;
-            break;
+            remove_client(s, client);
+            return TURN_CLOSED;
         }
+        client->read_pos += bytes_read;
+        client->read_buffer[client->read_pos] = '\0';
+        bytes_left -= bytes_read;
     }
+}
 
-    if (connection_closed) {
-        remove_client(s, client->fd, client);
+/**
+ * @brief Gives one client its turn.
+ * @return true if the client still has work and should be queued again.
+ */
+static bool serve_client(server_t *s, client_t *client) {
+    int turn = read_and_dispatch(s, client);
+    if (turn == TURN_CLOSED) return false;
+    schedule_client(s, client);
+    return turn == TURN_MORE;
+}
+
+/**
+ * @brief Handles readable event on a client socket.
+ * Nothing is read here; the client just joins the ready list and gets its
+ * share of the loop in serve_ready_clients().
+ */
+static void handle_client_read(server_t *s, client_t *client) {
+    LOG("Handling read for fd %d", client->fd);
+    client->read_drained = false;
+    if (client->state == STATE_READING) ready_push(s, client);
+}
+
+/**
+ * @brief Serves every client on the ready list once, in arrival order.
+ */
+static void serve_ready_clients(server_t *s) {
+    // Niche C: clients requeued during this round land behind the ones counted here
+    int round = s->ready_count;
+    for (int i = 0; i < round && s->ready_head; i++) {
+        client_t* client = s->ready_head;
+        ready_remove(s, client);
+        if (serve_client(s, client)) ready_push(s, client);
     }
 }
 
+// Appends to the output buffer, growing it by doubling. Caller holds client->lock.
+static void output_append(client_t *client, const char* data, size_t len) {
+    if (client->out_sent > 0 && client->out_len + len > client->out_cap) {
+        // Reclaim the already-sent prefix before growing
+        memmove(client->out_buf, client->out_buf + client->out_sent,
+                client->out_len - client->out_sent);
+        client->out_len -= client->out_sent;
+        client->out_sent = 0;
+    }
+    if (client->out_len + len > client->out_cap) {
+        size_t cap = client->out_cap ? client->out_cap : WRITE_BUFFER_SIZE;
+        while (cap < client->out_len + len) cap *= 2;
+        char* grown = realloc(client->out_buf, cap);
+        if (!grown) ERROR_EXIT("realloc output buffer");
+        client->out_buf = grown;
+        client->out_cap = cap;
+    }
+    memcpy(client->out_buf + client->out_len, data, len);
+    client->out_len += len;
+}
+
+work_item_t* client_next_command(server_t *s, client_t *client) {
+    pthread_mutex_lock(&client->lock);
+    if (client->state == STATE_CLOSING) {
+        // Nobody will read the replies: drop what is still queued
+        while (client->work_head) {
+            work_item_t* dropped = client->work_head;
+            client->work_head = dropped->next;
+            client->inflight--;
+            free(dropped);
+        }
+        client->work_tail = NULL;
+    }
+
+    work_item_t* work = client->work_head;
+    if (work) {
+        client->work_head = work->next;
+        if (!client->work_head) client->work_tail = NULL;
+        pthread_mutex_unlock(&client->lock);
+        return work;
+    }
+
+    client->scheduled = false; // The next dispatch_command() queues us again
+    bool release = client->state == STATE_CLOSING;
+    pthread_mutex_unlock(&client->lock);
+
+    if (release) client_free(s, client); // remove_client() left this to us
+    return NULL;
+}
+
+void client_reply(server_t *s, client_t *client, const char* reply, size_t len) {
+    pthread_mutex_lock(&client->lock);
+    client->inflight--;
+    if (client->state != STATE_CLOSING) {
+        output_append(client, reply, len);
+
+        // Pipelined commands still queued will reply shortly; flushing once the
+        // queue is empty sends the whole batch with one send() instead of one each.
+        if (client->work_head == NULL) {
+            // Tell the main thread's epoll to watch for EPOLLOUT.
+            // Done under the lock so it cannot race with the flush switching back to EPOLLIN.
+            struct epoll_event event;
+            event.events = EPOLLOUT | EPOLLIN | EPOLLET; // Watch for write-ready + read
+            event.data.ptr = client; // The event loop expects the client_t pointer back
+            if (epoll_ctl(s->epoll_fd, EPOLL_CTL_MOD, client->fd, &event) == -1) {
+                perror("epoll_ctl MOD in worker");
+            }
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+}
 
 /**
  * @brief Handles writable event on a client socket.
@@ -187,17 +398,18 @@ static void handle_client_read(server_t *s, client_t *client) {
 static void handle_client_write(server_t *s, client_t *client) {
     LOG("Handling write for fd %d", client->fd);
     bool connection_closed = false;
+    bool resume = false;
     
     pthread_mutex_lock(&client->lock);
     
-    while (client->write_pos < client->total_to_write) {
+    while (client->out_sent < client->out_len) {
         ssize_t bytes_sent = send(client->fd,
-                                  client->write_buffer + client->write_pos,
-                                  client->total_to_write - client->write_pos,
+                                  client->out_buf + client->out_sent,
+                                  client->out_len - client->out_sent,
                                   MSG_NOSIGNAL); // Avoid SIGPIPE
                                   
         if (bytes_sent >= 0) {
-            client->write_pos += bytes_sent;
+            client->out_sent += bytes_sent;
         } else { // bytes_sent < 0
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // Cannot write more now, wait for next EPOLLOUT
@@ -210,10 +422,14 @@ static void handle_client_write(server_t *s, client_t *client) {
     }
 
     // If we finished writing everything
-    if (!connection_closed && client->write_pos == client->total_to_write) {
-        // We finished sending the response. Go back to reading state.
-        client->state = STATE_READING;
-        client->read_pos = 0; // Reset read buffer
+    if (!connection_closed && client->out_sent == client->out_len) {
+        client->out_sent = client->out_len = 0;
+        if (client->out_cap > OUTPUT_BUFFER_KEEP) {
+            // A big burst is over; don't keep its buffer around for an idle client
+            free(client->out_buf);
+            client->out_buf = NULL;
+            client->out_cap = 0;
+        }
         
         // Modify epoll interest back to EPOLLIN
         struct epoll_event event;
@@ -222,11 +438,19 @@ static void handle_client_write(server_t *s, client_t *client) {
         epoll_ctl(s->epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
         LOG("Finished writing to fd %d, switching back to read", client->fd);
     }
+
+    // Backpressure released: the client may read again
+    if (!connection_closed && client->state == STATE_PAUSED && !client_over_limit(s, client)) {
+        client->state = STATE_READING;
+        resume = true;
+    }
     
     pthread_mutex_unlock(&client->lock);
 
     if (connection_closed) {
-        remove_client(s, client->fd, client);
+        remove_client(s, client);
+    } else if (resume) {
+        ready_push(s, client);
     }
 }
 
@@ -235,34 +459,43 @@ static void handle_client_write(server_t *s, client_t *client) {
  */
 void server_run(server_t *s) {
     struct epoll_event events[MAX_EVENTS];
+
+    s->ready_head = s->ready_tail = NULL;
+    s->ready_count = 0;
     
     LOG("Server running. Waiting for events...");
     
     while (1) {
-        int n = epoll_wait(s->epoll_fd, events, MAX_EVENTS, -1);
+        // Don't block while some client still has input waiting for its turn
+        int n = epoll_wait(s->epoll_fd, events, MAX_EVENTS, s->ready_head ? 0 : -1);
         if (n == -1) {
             if (errno == EINTR) continue; // Interrupted by signal, just retry
             ERROR_EXIT("epoll_wait");
         }
+        uint64_t iteration_start = monotonic_us(); // The wait itself is idle time, not latency
         
         for (int i = 0; i < n; i++) {
-            client_t* client = (client_t*)events[i].data.ptr;
-            int fd = (client == NULL) ? events[i].data.fd : client->fd; // Handle listen_fd vs client_fd
+            // Listening sockets point into s->listeners, clients at their client_t
+            void* ptr = events[i].data.ptr;
+            client_t* client = (client_t*)ptr;
 
-            if (fd == s->listen_fd) {
-                accept_new_connection(s);
+            if (ptr >= (void*)s->listeners && ptr < (void*)(s->listeners + s->num_listeners)) {
+                accept_new_connection(s, (listener_t*)ptr);
             } else {
                 if (events[i].events & (EPOLLERR | EPOLLHUP)) {
-                    remove_client(s, fd, client);
+                    remove_client(s, client);
                     continue;
                 }
                 if (events[i].events & EPOLLIN) {
                     handle_client_read(s, client);
                 }
                 if (events[i].events & EPOLLOUT) {
-                    handle_client_write(s, client);
+                    handle_client_write(s, client); // May remove the client; keep it last
                 }
             }
         }
+
+        serve_ready_clients(s);
+        latency_add_sample(LATENCY_EVENT_LOOP, monotonic_us() - iteration_start);
     }
 }
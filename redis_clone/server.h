@@ -3,6 +3,7 @@
 #define SERVER_H
 
 #include "common.h"
+#include "listener.h"
 #include <sys/epoll.h>
 #include <netinet/in.h>
 
@@ -13,45 +14,90 @@
 // Forward declarations
 typedef struct slab_allocator_t slab_allocator_t;
 typedef struct thread_pool_t thread_pool_t;
+typedef struct cluster_t cluster_t;
+typedef struct multi_state_t multi_state_t;
+typedef struct work_item_t work_item_t;
+
+// --- Fairness / backpressure defaults (see --read-budget etc. in main.c) ---
+#define DEFAULT_READ_BUDGET (16 * 1024)       // Bytes read from one client per loop turn
+#define DEFAULT_CMD_BUDGET 32                 // Commands dispatched for one client per loop turn
+#define DEFAULT_OUTPUT_LIMIT (1024 * 1024)    // Pause reads above this much unsent output...
+#define DEFAULT_MAX_INFLIGHT 256              // ...or this many commands awaiting a reply
+#define OUTPUT_BUFFER_KEEP (16 * 1024)        // Idle output buffers larger than this are freed
+#define CLIENT_ADDR_LEN 64                    // "ip:port" or "socket_path:fd"
 
 // Client state machine
 typedef enum {
-    STATE_READING,
-    STATE_PROCESSING, // Handed off to worker thread
-    STATE_WRITING,
-    STATE_CLOSING
+    STATE_READING, // Input is read and dispatched as the client's turn comes up
+    STATE_PAUSED,  // Backpressure: reads stop until the output buffer drains
+    STATE_CLOSING  // Socket closed; the struct lives on until no worker holds it
 } client_state_t;
 
 // Client connection state
-typedef struct {
+typedef struct client_t {
     int fd;
-    client_state_t state;
+    char addr[CLIENT_ADDR_LEN]; // Peer, for SLOWLOG
+    client_state_t state; // Changed by the main thread only, always under 'lock'
     
     char read_buffer[READ_BUFFER_SIZE];
     int read_pos;
+    bool read_drained;    // Last read() hit EAGAIN: nothing more until the next EPOLLIN edge
+
+    // Ready list links (main thread only): clients with input still to process
+    struct client_t* ready_prev;
+    struct client_t* ready_next;
+    bool in_ready_list;
     
     // Niche C: Use atomic flags if state transitions happen across threads
     // For simplicity, we use a mutex here.
-    pthread_mutex_t lock; // Protects write buffer and state
-    char write_buffer[WRITE_BUFFER_SIZE];
-    int write_pos;
-    int total_to_write;
+    pthread_mutex_t lock; // Protects the command queue, output buffer, inflight and state
+    work_item_t* work_head; // Commands read but not yet run, in arrival order
+    work_item_t* work_tail;
+    bool scheduled;       // A worker owns (or is about to own) the command queue
+    char* out_buf;        // Replies appended by workers, flushed by the main thread
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+    int inflight;         // Commands queued or running and not yet answered
+    
+    bool asking; // Cluster: next command may touch a slot we are IMPORTING
+    multi_state_t* multi; // MULTI queue and WATCHed keys (NULL until first used)
     
 } client_t;
 
 // Main server state
 typedef struct server_t {
     int epoll_fd;
-    int listen_fd;
+    listener_t listeners[MAX_LISTENERS]; // Registered with data.ptr = &listeners[i]
+    int num_listeners;
     
     slab_allocator_t* client_slab; // Slab for client_t structs
     thread_pool_t* pool;         // Worker thread pool
+    cluster_t* cluster;          // Slot map, or NULL when not in cluster mode
+
+    // Round-robin list of clients that still have input to read or dispatch
+    client_t* ready_head;
+    client_t* ready_tail;
+    int ready_count;
+
+    int read_budget;             // Bytes read from one client before moving on
+    int cmd_budget;              // Commands dispatched for one client before moving on
+    size_t output_limit;         // Unsent output that pauses a client's reads
+    int max_inflight;            // In-flight commands that pause a client's reads
     
 } server_t;
 
 // Prototypes
-int create_and_bind(int port);
 int set_nonblocking(int fd);
 void server_run(server_t *s);
 
+// Called by the worker that owns the client: pops its next queued command.
+// Returns NULL once the queue is empty; ownership is then released and a
+// client closed in the meantime is freed, so the caller must drop the pointer.
+work_item_t* client_next_command(server_t *s, client_t *client);
+
+// Called by a worker when a command finished: appends the reply to the client's
+// output buffer and asks the event loop to flush it.
+void client_reply(server_t *s, client_t *client, const char* reply, size_t len);
+
 #endif // SERVER_H
@@ -0,0 +1,54 @@
+/* sha1.c - Compact SHA-1 (FIPS 180-1), enough for script cache keys */
+#include "sha1.h"
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+// Processes one 64-byte block into the running state
+static void sha1_block(uint32_t state[5], const uint8_t block[64]) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = ROL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+        else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+        else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+        else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+        uint32_t temp = ROL32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROL32(b, 30);
+        b = a;
+        a = temp;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+}
+
+void sha1_hex(const void* data, size_t len, char hex[SHA1_HEX_LEN]) {
+    uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    const uint8_t* bytes = (const uint8_t*)data;
+
+    size_t full = len / 64;
+    for (size_t i = 0; i < full; i++) sha1_block(state, bytes + i * 64);
+
+    // Pad: 0x80, zeros, then the bit length as a 64-bit big-endian integer
+    uint8_t tail[128] = {0};
+    size_t rest = len % 64;
+    memcpy(tail, bytes + full * 64, rest);
+    tail[rest] = 0x80;
+    size_t tail_len = (rest < 56) ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++) tail[tail_len - 1 - i] = (uint8_t)(bits >> (i * 8));
+
+    sha1_block(state, tail);
+    if (tail_len == 128) sha1_block(state, tail + 64);
+
+    for (int i = 0; i < 5; i++) snprintf(hex + i * 8, 9, "%08x", state[i]);
+}
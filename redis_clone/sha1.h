@@ -0,0 +1,12 @@
+/* sha1.h - SHA-1 digest (script cache keys for EVALSHA) */
+#ifndef SHA1_H
+#define SHA1_H
+
+#include "common.h"
+
+#define SHA1_HEX_LEN 41 // 40 hex digits + NUL
+
+// Writes the lowercase hex SHA-1 of data[0..len) into hex.
+void sha1_hex(const void* data, size_t len, char hex[SHA1_HEX_LEN]);
+
+#endif // SHA1_H
@@ -1,28 +1,130 @@
 #include "slab.h"
-#include <sys/mman.h> // for mmap/munmap
+#include <sys/mman.h>        // for mmap/munmap/madvise
+#include <sys/syscall.h>     // for SYS_mbind, SYS_getcpu
+#include <linux/mempolicy.h> // for MPOL_PREFERRED
+
+#define SLAB_NUMA_MASK_WORDS 16 // Node mask for mbind(): up to 1024 nodes
+
+// Report each fallback once per process, not once per allocator
+static atomic_bool warned_hugetlb, warned_thp, warned_numa;
+
+// Maps 'size' bytes aligned to 'align' by over-mapping and trimming both ends.
+static void* map_aligned(size_t size, size_t align) {
+    size_t span = size + align;
+    char* raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+
+    char* start = (char*)(((uintptr_t)raw + align - 1) & ~(uintptr_t)(align - 1));
+    if (start > raw) munmap(raw, start - raw);
+    size_t tail = (raw + span) - (start + size);
+    if (tail) munmap(start + size, tail);
+    return start;
+}
+
+/**
+ * @brief Maps one slab with the configured page size. Niche C: HUGETLB fails
+ * without a reserved pool and MADV_HUGEPAGE fails when THP is compiled out;
+ * either way we drop one level for this and all later slabs and say so once.
+ */
+static void* slab_map(slab_allocator_t* allocator) {
+    size_t size = allocator->slab_size;
+
+    if (allocator->pages == SLAB_PAGES_HUGETLB) {
+        void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem != MAP_FAILED) {
+            allocator->huge_slabs++;
+            return mem;
+        }
+        if (!atomic_exchange(&warned_hugetlb, true)) {
+            fprintf(stderr, "Slab Allocator: MAP_HUGETLB failed (%s), using transparent huge pages.\n",
+                    strerror(errno));
+        }
+        allocator->pages = SLAB_PAGES_THP;
+    }
+
+    if (allocator->pages == SLAB_PAGES_THP) {
+        // THP can only back 2 MiB-aligned ranges, so align the slab to one
+        void* mem = map_aligned(size, SLAB_HUGE_PAGE_SIZE);
+        if (mem == NULL) return NULL;
+        if (madvise(mem, size, MADV_HUGEPAGE) == 0) {
+            allocator->huge_slabs++;
+            return mem;
+        }
+        if (!atomic_exchange(&warned_thp, true)) {
+            fprintf(stderr, "Slab Allocator: MADV_HUGEPAGE failed (%s), using normal pages.\n",
+                    strerror(errno));
+        }
+        allocator->pages = SLAB_PAGES_NORMAL;
+        return mem; // Already mapped; it is just regular memory now
+    }
+
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+/**
+ * @brief Prefers the configured NUMA node for a freshly mapped slab.
+ * Must run before the first touch: pages are placed when they fault in.
+ * Niche C: raw syscalls, so there is no libnuma dependency. MPOL_PREFERRED
+ * (not MPOL_BIND) lets the kernel spill to another node instead of OOMing.
+ */
+static void slab_bind_node(slab_allocator_t* allocator, void* mem) {
+    if (allocator->numa_node == SLAB_NUMA_NONE) return;
+
+    unsigned int node = (unsigned int)allocator->numa_node;
+    if (allocator->numa_node == SLAB_NUMA_LOCAL) {
+        unsigned int cpu;
+        if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) return;
+    }
+
+    unsigned long mask[SLAB_NUMA_MASK_WORDS] = {0};
+    if (node >= SLAB_NUMA_MASK_WORDS * 64) {
+        errno = EINVAL;
+    } else {
+        mask[node / 64] = 1UL << (node % 64);
+        if (syscall(SYS_mbind, mem, allocator->slab_size, MPOL_PREFERRED,
+                    mask, SLAB_NUMA_MASK_WORDS * 64, 0) == 0) {
+            return;
+        }
+    }
+    // No NUMA support (ENOSYS in some containers) or no such node
+    if (!atomic_exchange(&warned_numa, true)) {
+        fprintf(stderr, "Slab Allocator: mbind to NUMA node %u failed (%s), using default placement.\n",
+                node, strerror(errno));
+    }
+    allocator->numa_node = SLAB_NUMA_NONE;
+}
 
 /**
  * @brief Allocates a new slab from the OS.
  */
 static bool slab_grow(slab_allocator_t* allocator) {
-    if (allocator->num_slabs >= MAX_SLABS) {
-        fprintf(stderr, "Slab Allocator: Max slabs reached.\n");
-        return false;
+    if (allocator->num_slabs == allocator->slab_capacity) {
+        int capacity = allocator->slab_capacity * 2;
+        void** slabs = realloc(allocator->slabs, capacity * sizeof(void*));
+        if (!slabs) {
+            fprintf(stderr, "Slab Allocator: cannot track more slabs.\n");
+            return false;
+        }
+        allocator->slabs = slabs;
+        allocator->slab_capacity = capacity;
     }
     
-    // Allocate a new slab using mmap
-    void* new_slab = mmap(NULL, SLAB_SIZE, PROT_READ | PROT_WRITE,
-                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (new_slab == MAP_FAILED) {
+    void* new_slab = slab_map(allocator);
+    if (new_slab == NULL) {
         perror("mmap failed in slab_grow");
         return false;
     }
+    slab_bind_node(allocator, new_slab);
     
     allocator->slabs[allocator->num_slabs++] = new_slab;
     LOG("Grew slab allocator. New slab %d at %p", allocator->num_slabs, new_slab);
 
     // Carve up the new slab and add its blocks to the free list
-    for (size_t i = 0; i < allocator->slab_item_count; i++) {
+    // Niche C: walk backwards so the list hands out ascending addresses,
+    // which keeps consecutive allocations on the same (huge) page.
+    for (size_t i = allocator->slab_item_count; i-- > 0; ) {
         free_block_t* block = (free_block_t*)((char*)new_slab + (i * allocator->item_size));
         block->next = allocator->free_list;
         allocator->free_list = block;
@@ -30,7 +132,7 @@ static bool slab_grow(slab_allocator_t* allocator) {
     return true;
 }
 
-slab_allocator_t* slab_create(size_t item_size) {
+slab_allocator_t* slab_create(size_t item_size, const slab_options_t* opts) {
     // Niche C: Ensure item_size is at least the size of a pointer
     // so we can overlay the free_block_t struct.
     item_size = MAX(item_size, sizeof(free_block_t));
@@ -43,13 +145,27 @@ slab_allocator_t* slab_create(size_t item_size) {
     if (!allocator) ERROR_EXIT("malloc slab_allocator_t");
     
     allocator->item_size = item_size;
-    allocator->slab_item_count = SLAB_SIZE / item_size;
+    allocator->pages = opts ? opts->pages : SLAB_PAGES_NORMAL;
+    allocator->numa_node = opts ? opts->numa_node : SLAB_NUMA_NONE;
+    allocator->slab_size = (opts && opts->slab_size) ? opts->slab_size : SLAB_SIZE;
+    if (allocator->pages != SLAB_PAGES_NORMAL) {
+        // Huge-page slabs: at least one huge page, and whole huge pages only
+        if (!(opts && opts->slab_size)) allocator->slab_size = SLAB_HUGE_PAGE_SIZE;
+        allocator->slab_size = (allocator->slab_size + SLAB_HUGE_PAGE_SIZE - 1) & ~(size_t)(SLAB_HUGE_PAGE_SIZE - 1);
+    }
+    allocator->slab_size = MAX(allocator->slab_size, item_size);
+    allocator->slab_item_count = allocator->slab_size / item_size;
+    allocator->slab_capacity = SLAB_INITIAL_SLOTS;
+    allocator->slabs = (void**)malloc(allocator->slab_capacity * sizeof(void*));
+    if (!allocator->slabs) ERROR_EXIT("malloc slab array");
     allocator->num_slabs = 0;
+    allocator->huge_slabs = 0;
     allocator->free_list = NULL;
     pthread_mutex_init(&allocator->lock, NULL);
     
     // Pre-allocate one slab
     if (!slab_grow(allocator)) {
+        free(allocator->slabs);
         free(allocator);
         return NULL;
     }
@@ -62,13 +178,27 @@ slab_allocator_t* slab_create(size_t item_size) {
 void slab_destroy(slab_allocator_t* allocator) {
     pthread_mutex_lock(&allocator->lock);
     for (int i = 0; i < allocator->num_slabs; i++) {
-        munmap(allocator->slabs[i], SLAB_SIZE);
+        munmap(allocator->slabs[i], allocator->slab_size);
     }
     pthread_mutex_unlock(&allocator->lock);
     pthread_mutex_destroy(&allocator->lock);
+    free(allocator->slabs);
     free(allocator);
 }
 
+void slab_describe(slab_allocator_t* allocator, char* buf, size_t len) {
+    static const char* page_names[] = { "normal pages", "THP", "hugetlb" };
+    pthread_mutex_lock(&allocator->lock);
+    int n = snprintf(buf, len, "%zu KiB slabs, %s (%d/%d huge)", allocator->slab_size / 1024,
+                     page_names[allocator->pages], allocator->huge_slabs, allocator->num_slabs);
+    if (n > 0 && (size_t)n < len) {
+        if (allocator->numa_node == SLAB_NUMA_NONE) snprintf(buf + n, len - n, ", default NUMA placement");
+        else if (allocator->numa_node == SLAB_NUMA_LOCAL) snprintf(buf + n, len - n, ", NUMA-local");
+        else snprintf(buf + n, len - n, ", NUMA node %d", allocator->numa_node);
+    }
+    pthread_mutex_unlock(&allocator->lock);
+}
+
 void* slab_alloc(slab_allocator_t* allocator) {
     pthread_mutex_lock(&allocator->lock);
     
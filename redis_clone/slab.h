@@ -5,8 +5,27 @@
 #include "common.h"
 
 // --- Configuration ---
-#define SLAB_SIZE (1024 * 1024) // Allocate 1MB slabs
-#define MAX_SLABS 100           // Max total slabs
+#define SLAB_SIZE (1024 * 1024)               // Allocate 1MB slabs (4 KiB pages)
+#define SLAB_HUGE_PAGE_SIZE (2 * 1024 * 1024) // x86-64 huge page; huge-page slabs are multiples of it
+#define SLAB_INITIAL_SLOTS 16                 // Initial size of the slab pointer array (grows)
+
+// Page backing for new slabs. Each mode degrades to the next one down when
+// the kernel refuses it, so asking for more never breaks startup.
+typedef enum {
+    SLAB_PAGES_NORMAL,  // Plain anonymous 4 KiB pages
+    SLAB_PAGES_THP,     // madvise(MADV_HUGEPAGE): transparent huge pages, best effort
+    SLAB_PAGES_HUGETLB  // MAP_HUGETLB from the reserved pool (vm.nr_hugepages)
+} slab_pages_t;
+
+#define SLAB_NUMA_NONE (-1)  // Kernel default placement (first touch)
+#define SLAB_NUMA_LOCAL (-2) // Node of the CPU running the thread that grows the slab
+
+// Backing options, shared by every allocator of the process (see main.c)
+typedef struct {
+    size_t slab_size;   // 0 = SLAB_SIZE, or one huge page with THP/HUGETLB
+    slab_pages_t pages;
+    int numa_node;      // Node id, SLAB_NUMA_NONE or SLAB_NUMA_LOCAL
+} slab_options_t;
 
 // --- Structures ---
 
@@ -16,12 +35,17 @@ typedef struct free_block_t {
 } free_block_t;
 
 // The slab allocator state
-typedef struct {
+typedef struct slab_allocator_t {
     size_t item_size;             // Size of each item we allocate
     size_t slab_item_count;       // How many items fit in one slab
+    size_t slab_size;             // Bytes per slab
+    slab_pages_t pages;           // Backing actually in use (after any fallback)
+    int numa_node;                // Placement actually in use (after any fallback)
     
-    void* slabs[MAX_SLABS];       // Pointers to the start of each slab
+    void** slabs;                 // Pointers to the start of each slab
     int num_slabs;
+    int slab_capacity;            // Length of 'slabs'
+    int huge_slabs;               // Slabs that got the huge pages they asked for
     
     free_block_t *free_list;      // Head of the linked list of free blocks
     pthread_mutex_t lock;         // Mutex to protect the free list
@@ -29,9 +53,12 @@ typedef struct {
 } slab_allocator_t;
 
 // --- Public API ---
-slab_allocator_t* slab_create(size_t item_size);
+// 'opts' may be NULL for plain 1 MiB slabs with default placement.
+slab_allocator_t* slab_create(size_t item_size, const slab_options_t* opts);
 void slab_destroy(slab_allocator_t* allocator);
 void* slab_alloc(slab_allocator_t* allocator);
 void slab_free(slab_allocator_t* allocator, void* ptr);
+// One-line summary of the backing in use, e.g. "2048 KiB slabs, THP, NUMA node 0".
+void slab_describe(slab_allocator_t* allocator, char* buf, size_t len);
 
 #endif // SLAB_H
@@ -0,0 +1,111 @@
+/* slowlog.c - Ring buffer of commands that ran longer than a threshold */
+#include "slowlog.h"
+#include <strings.h> // for strcasecmp
+#include <time.h>
+
+// Room for a cut argument plus its "... (N more bytes)" marker
+#define SLOWLOG_ARG_BUF (SLOWLOG_ARG_MAX_LEN + 40)
+
+typedef struct {
+    uint64_t id;                 // Increases by one per entry, survives RESET
+    int64_t time;                // Unix time the command finished
+    uint64_t duration_us;
+    int argc;
+    char argv[MAX_ARGS][SLOWLOG_ARG_BUF];
+    char client[SLOWLOG_CLIENT_LEN];
+} slowlog_entry_t;
+
+static atomic_long slower_than_us;
+static pthread_mutex_t slowlog_lock = PTHREAD_MUTEX_INITIALIZER;
+static slowlog_entry_t* entries; // Ring of max_len entries, allocated once
+static int max_len;
+static int next_slot;            // Slot the next entry goes to
+static int count;
+static uint64_t next_id;
+
+void slowlog_init(long threshold_us, int len) {
+    atomic_store(&slower_than_us, threshold_us);
+    max_len = MAX(len, 1);
+    // Niche C: fixed-size entries, so recording never mallocs while holding the lock
+    entries = (slowlog_entry_t*)calloc(max_len, sizeof(slowlog_entry_t));
+    if (!entries) ERROR_EXIT("calloc slowlog");
+    next_slot = count = 0;
+    next_id = 0;
+}
+
+void slowlog_shutdown() {
+    free(entries);
+    entries = NULL;
+}
+
+void slowlog_record(int argc, char** argv, uint64_t duration_us, const char* client) {
+    long threshold = atomic_load_explicit(&slower_than_us, memory_order_relaxed);
+    if (threshold < 0 || duration_us < (uint64_t)threshold) return;
+
+    pthread_mutex_lock(&slowlog_lock);
+    slowlog_entry_t* e = &entries[next_slot];
+    e->id = next_id++;
+    e->time = (int64_t)time(NULL);
+    e->duration_us = duration_us;
+    e->argc = argc < MAX_ARGS ? argc : MAX_ARGS;
+    for (int i = 0; i < e->argc; i++) {
+        size_t len = strlen(argv[i]);
+        if (len <= SLOWLOG_ARG_MAX_LEN) {
+            memcpy(e->argv[i], argv[i], len + 1);
+        } else {
+            // Big values would make the log a memory hog; keep the head only
+            snprintf(e->argv[i], SLOWLOG_ARG_BUF, "%.*s... (%zu more bytes)",
+                     SLOWLOG_ARG_MAX_LEN, argv[i], len - SLOWLOG_ARG_MAX_LEN);
+        }
+    }
+    snprintf(e->client, sizeof(e->client), "%s", client);
+    next_slot = (next_slot + 1) % max_len;
+    if (count < max_len) count++;
+    pthread_mutex_unlock(&slowlog_lock);
+}
+
+// Appends one entry: [id, time, duration_us, [arg, ...], client]
+static void append_entry(const slowlog_entry_t* e, char* buf, size_t max, size_t* pos) {
+    reply_append(buf, max, pos, "*5\r\n:%llu\r\n:%lld\r\n:%llu\r\n*%d\r\n",
+                 (unsigned long long)e->id, (long long)e->time,
+                 (unsigned long long)e->duration_us, e->argc);
+    for (int i = 0; i < e->argc; i++) reply_bulk(buf, max, pos, e->argv[i]);
+    reply_bulk(buf, max, pos, e->client);
+}
+
+void slowlog_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max) {
+    (void)db;
+    size_t pos = 0;
+
+    pthread_mutex_lock(&slowlog_lock);
+    if (strcasecmp(argv[1], "GET") == 0 && argc <= 3) {
+        long wanted = argc == 3 ? strtol(argv[2], NULL, 10) : SLOWLOG_GET_DEFAULT;
+        if (wanted < 0 || wanted > count) wanted = count; // Like Redis, -1 means all
+
+        // Newest first. Entries are rendered aside and only kept while the
+        // whole reply fits, so a long log truncates cleanly instead of mid-entry.
+        char entries_buf[response_max]; // Niche C: VLA, the reply buffer is a few KiB
+        size_t entries_pos = 0, entries_max = response_max - 32; // Room for the "*<n>" header
+        int shown = 0;
+        for (; shown < wanted; shown++) {
+            const slowlog_entry_t* e = &entries[(next_slot + max_len - 1 - shown) % max_len];
+            size_t saved = entries_pos;
+            append_entry(e, entries_buf, entries_max, &entries_pos);
+            if (entries_pos >= entries_max - 1) { // Clamped: this entry did not fit
+                entries_pos = saved;
+                entries_buf[saved] = '\0';
+                break;
+            }
+        }
+        reply_append(response_buf, response_max, &pos, "*%d\r\n", shown);
+        if (shown > 0) reply_append(response_buf, response_max, &pos, "%s", entries_buf);
+    } else if (strcasecmp(argv[1], "LEN") == 0 && argc == 2) {
+        reply_append(response_buf, response_max, &pos, ":%d\r\n", count);
+    } else if (strcasecmp(argv[1], "RESET") == 0 && argc == 2) {
+        next_slot = count = 0;
+        reply_append(response_buf, response_max, &pos, "+OK\r\n");
+    } else {
+        reply_append(response_buf, response_max, &pos, "-ERR Unknown SLOWLOG subcommand or wrong args\r\n");
+    }
+    pthread_mutex_unlock(&slowlog_lock);
+}
@@ -0,0 +1,29 @@
+/* slowlog.h - Ring buffer of commands that ran longer than a threshold */
+#ifndef SLOWLOG_H
+#define SLOWLOG_H
+
+#include "common.h"
+#include "hash_table.h"
+#include "protocol.h" // For MAX_ARGS
+
+// --- Configuration ---
+#define SLOWLOG_DEFAULT_SLOWER_THAN_US 10000 // Log commands at least this slow (< 0 = off, 0 = all)
+#define SLOWLOG_DEFAULT_MAX_LEN 128          // Entries kept; the oldest is overwritten
+#define SLOWLOG_ARG_MAX_LEN 64               // Longer arguments are cut to this many bytes
+#define SLOWLOG_CLIENT_LEN 64
+#define SLOWLOG_GET_DEFAULT 10               // SLOWLOG GET without a count
+
+// --- Public API ---
+void slowlog_init(long slower_than_us, int max_len);
+void slowlog_shutdown();
+
+/**
+ * @brief Logs a command that took 'duration_us' if that reaches the threshold.
+ * Below the threshold this is a single compare, so it stays on in production.
+ */
+void slowlog_record(int argc, char** argv, uint64_t duration_us, const char* client);
+
+// "SLOWLOG GET [count] | LEN | RESET" (command_fn signature)
+void slowlog_command(hash_table_t* db, int argc, char** argv, char* response_buf, size_t response_max);
+
+#endif // SLOWLOG_H
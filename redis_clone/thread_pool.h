@@ -9,23 +9,27 @@
 
 // --- Configuration ---
 #define NUM_WORKER_THREADS 4
+#define WORKER_BATCH 32 // Commands run for one client before it goes back in the queue
 
 // --- Structures ---
 
-// Represents a work item for the thread pool
-typedef struct {
+// One command line, queued on its client until a worker runs it
+typedef struct work_item_t {
+    struct work_item_t* next; // Next command of the same client (FIFO)
     int client_fd;
+    client_t* client;   // Connection the reply goes back to
     char request[1024]; // Simplified: Assume fixed max request size
     // We need the server struct to modify epoll interest
     server_t *server; 
+    char* long_reply;   // malloc'd reply that outgrew the response buffer (EXEC), sent instead of it
 } work_item_t;
 
 // The thread pool state
-typedef struct {
+typedef struct thread_pool_t {
     pthread_t threads[NUM_WORKER_THREADS];
-    lf_queue_t* work_queue;         // Queue for incoming requests
+    lf_queue_t* work_queue;         // Clients with queued commands and no worker yet
     hash_table_t* db;             // Handle to the main database
-    slab_allocator_t *client_slab; // Need this to access client data
+    server_t* server;             // Clients are handed back through the server
     
     // Niche C: We need a condition variable to wake up threads efficiently
     pthread_mutex_t queue_lock;     // Lock for the condition variable
@@ -35,8 +39,12 @@ typedef struct {
 } thread_pool_t;
 
 // --- Public API ---
-thread_pool_t* thread_pool_create(hash_table_t* db, slab_allocator_t *client_slab);
+thread_pool_t* thread_pool_create(hash_table_t* db, server_t* server);
 void thread_pool_destroy(thread_pool_t* pool);
-void thread_pool_add_work(thread_pool_t* pool, work_item_t* work);
+
+// Queues a client whose commands need running. The caller guarantees a client
+// is queued at most once at a time (client_t.scheduled), so one client's
+// commands never run on two workers at once and replies keep request order.
+void thread_pool_add_client(thread_pool_t* pool, client_t* client);
 
 #endif // THREAD_POOL_H
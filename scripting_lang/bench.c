@@ -0,0 +1,366 @@
+/* bench.c - VM microbenchmark: runs arithmetic-heavy scripts in a tight loop */
+#define _POSIX_C_SOURCE 199309L // clock_gettime under -std=c99
+#include "common.h"
+#include "chunk.h"
+#include "compiler.h"
+#include "object.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_TERMS 120           // Number literals per script (the pool holds 256)
+#define BENCH_DEFAULT_RUNS 200000
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Appends 'terms' literals joined by a rotating mix of operators.
+// pattern: characters from "+-*/n" ('n' negates the next literal).
+static void buildScript(char* out, size_t max, const char* pattern, int terms) {
+    size_t pos = 0;
+    size_t patternLen = strlen(pattern);
+    pos += snprintf(out + pos, max - pos, "1");
+    for (int i = 1, p = 0; i < terms && pos < max; i++, p++) {
+        char op = pattern[p % patternLen];
+        if (op == 'n') {
+            pos += snprintf(out + pos, max - pos, " - -%d", i % 9 + 1);
+        } else {
+            pos += snprintf(out + pos, max - pos, " %c %d", op, i % 9 + 1);
+        }
+    }
+}
+
+// Right-nested "1 + (2 * (3 - ...))": every literal is pushed before the
+// first operator runs, so the stack grows to 'terms' values.
+static void buildNestedScript(char* out, size_t max, const char* pattern, int terms) {
+    size_t pos = 0;
+    size_t patternLen = strlen(pattern);
+    for (int i = 1; i < terms && pos < max; i++) {
+        pos += snprintf(out + pos, max - pos, "%d %c (", i % 9 + 1, pattern[(i - 1) % patternLen]);
+    }
+    if (pos < max) pos += snprintf(out + pos, max - pos, "1");
+    for (int i = 1; i < terms && pos < max; i++) pos += snprintf(out + pos, max - pos, ")");
+}
+
+// Blocks mixing native calls with constant subexpressions, the shape -O
+// is for: "x() * (2 + 3) - -x() / 4 + (x() - 1) * -2 + ..."
+static void buildCallScript(char* out, size_t max, int blocks) {
+    size_t pos = 0;
+    for (int i = 0; i < blocks && pos < max; i++) {
+        pos += snprintf(out + pos, max - pos, "%sx() * (2 + %d) - -x() / 4 + (x() - 1) * -2",
+                        i == 0 ? "" : " + ", i % 9 + 1);
+    }
+}
+
+// "a + b * c - a / b ..." over three variables: locals of a block (indexed
+// stack loads) or globals (a hash lookup per read).
+static void buildVariableScript(char* out, size_t max, bool locals, int terms) {
+    static const char names[] = "abc";
+    static const char ops[] = "+*-/";
+    size_t pos = 0;
+    pos += snprintf(out + pos, max - pos, locals ? "var r; { var a = 3; var b = 2; var c = 5; r = a"
+                                                 : "var a = 3; var b = 2; var c = 5; a");
+    for (int i = 1; i < terms && pos < max; i++) {
+        pos += snprintf(out + pos, max - pos, " %c %c", ops[i % 4], names[i % 3]);
+    }
+    if (locals && pos < max) pos += snprintf(out + pos, max - pos, "; } r");
+}
+
+// x(): a number the compiler cannot see
+static bool xNative(int argCount, Value* args, Value* result) {
+    (void)argCount;
+    (void)args;
+    *result = NUMBER_VAL(3);
+    return true;
+}
+
+// Instructions executed by one run (scripts are straight-line code).
+static long countInstructions(Chunk* chunk) {
+    long count = 0;
+    for (int offset = 0; offset < chunk->count; count++) {
+        offset += instructionLength(chunk, offset);
+    }
+    return count;
+}
+
+// The same for register code, whose global reads and assignments carry a cache word.
+static long countRegInstructions(RegChunk* rc) {
+    long count = 0;
+    for (int i = 0; i < rc->count; i++, count++) {
+        if (REG_OP(rc->code[i]) == ROP_GET_GLOBAL || REG_OP(rc->code[i]) == ROP_SET_GLOBAL) i++;
+    }
+    return count;
+}
+
+// Runs the chunk 'runs' times on the current backend and prints one result line.
+static Value timeRuns(const char* name, const char* variant, Chunk* chunk, long instructions, long runs) {
+    Value result = NIL_VAL;
+    double start = nowSeconds();
+    for (long i = 0; i < runs; i++) {
+        if (runChunk(chunk, &result) != INTERPRET_OK) exit(70);
+    }
+    double elapsed = nowSeconds() - start;
+
+    double total = (double)instructions * runs;
+    printf("%-8s %-11s %4ld instr/run  %7.1f ns/run  %8.1f M instr/s  %5.2f ns/instr  (result ",
+           name, variant, instructions, elapsed * 1e9 / runs, total / elapsed / 1e6, elapsed * 1e9 / total);
+    printValue(result);
+    printf(")\n");
+    return result;
+}
+
+// Every variant must compute what the plain stack VM computes.
+static void checkResult(const char* name, Value expected, Value actual) {
+    if (IS_NUMBER(expected) && IS_NUMBER(actual) && AS_NUMBER(expected) == AS_NUMBER(actual)) return;
+    fprintf(stderr, "%s: result differs from the unoptimized stack VM\n", name);
+    exit(70);
+}
+
+// Times the script on both backends, without and with -O.
+static void runBenchmark(const char* name, const char* source, long runs) {
+    Value expected = NIL_VAL;
+    for (int optimize = 0; optimize <= 1; optimize++) {
+        setOptimization(optimize);
+        Chunk chunk;
+        initChunk(&chunk);
+        if (!compile(source, &chunk)) {
+            fprintf(stderr, "%s: compile error\n", name);
+            exit(65);
+        }
+
+        setBackend(BACKEND_STACK);
+        Value result = timeRuns(name, optimize ? "stack -O" : "stack", &chunk, countInstructions(&chunk), runs);
+        if (optimize) checkResult(name, expected, result);
+        else expected = result;
+
+        setBackend(BACKEND_REGISTER);
+        runChunk(&chunk, &result); // Lowers the chunk (once)
+        if (chunk.regCode) {
+            result = timeRuns(name, optimize ? "register -O" : "register", &chunk, countRegInstructions(chunk.regCode), runs);
+            checkResult(name, expected, result);
+        } else {
+            printf("%-8s register (not lowered, runs on the stack VM)\n", name);
+        }
+        freeChunk(&chunk);
+    }
+    setOptimization(false);
+}
+
+// --- Calls ---
+
+#define FIB_N 30
+
+// Calls fib(n) makes, itself included
+static long fibCalls(int n) {
+    return n < 2 ? 1 : 1 + fibCalls(n - 1) + fibCalls(n - 2);
+}
+
+// Recursive fib(FIB_N): one run, dominated by OP_CALL/OP_RETURN and the
+// comparison and jump in the base case, timed per script-level call. The
+// "stack jit" row runs fib's chunk as machine code (jit.h) once it is hot;
+// calls and returns still go through the interpreter.
+static void runCallBenchmark() {
+    static const char source[] =
+        "fun fib(n) { if (n < 2) return n; return fib(n - 2) + fib(n - 1); } fib(" STRINGIFY(FIB_N) ")";
+    long calls = fibCalls(FIB_N);
+    static const char* variants[] = {"stack", "stack -O", "stack jit"};
+    for (int variant = 0; variant < 3; variant++) {
+        if (variant == 2 && !setJit(true)) break; // No JIT on this platform
+        setOptimization(variant == 1);
+        Chunk chunk;
+        initChunk(&chunk);
+        if (!compile(source, &chunk)) {
+            fprintf(stderr, "fib: compile error\n");
+            exit(65);
+        }
+        setBackend(BACKEND_STACK);
+        Value result = NIL_VAL;
+        double start = nowSeconds();
+        if (runChunk(&chunk, &result) != INTERPRET_OK) exit(70);
+        double elapsed = nowSeconds() - start;
+        if (!IS_NUMBER(result) || AS_NUMBER(result) != 832040) {
+            fprintf(stderr, "fib: wrong result\n");
+            exit(70);
+        }
+        printf("fib(%d)  %-11s %8ld calls    %7.1f ns/call  %8.1f ms total\n",
+               FIB_N, variants[variant], calls, elapsed * 1e9 / calls, elapsed * 1e3);
+        freeChunk(&chunk);
+    }
+    setOptimization(false);
+    setJit(false);
+}
+
+// --- Inline Caches ---
+
+#define GLOBAL_LOOP_ITERATIONS 1000
+
+// A loop over globals: three reads and one assignment per iteration, with
+// the inline caches off (every access hashes the name), on, and on with the
+// loop run as machine code (which reads the same caches).
+static void runInlineCacheBenchmark(long runs) {
+    static const char source[] =
+        "var a = 3; var b = 2; var n = 0;"
+        "for (var i = 0; i < " STRINGIFY(GLOBAL_LOOP_ITERATIONS) "; i = i + 1) { n = n + a * b; } n";
+    runs = runs / 100 > 0 ? runs / 100 : 1; // Each run is a whole loop
+    setBackend(BACKEND_STACK);
+    static const char* variants[] = {"uncached", "cached", "cached jit"};
+    for (int variant = 0; variant < 3; variant++) {
+        if (variant == 2 && !setJit(true)) break;
+        setInlineCaches(variant >= 1);
+        clearGlobals(); // Empties every cache
+        Chunk chunk;
+        initChunk(&chunk);
+        if (!compile(source, &chunk)) {
+            fprintf(stderr, "global loop: compile error\n");
+            exit(65);
+        }
+        Value result = NIL_VAL;
+        uint64_t lookups = vm.globalLookups;
+        double start = nowSeconds();
+        for (long i = 0; i < runs; i++) {
+            if (runChunk(&chunk, &result) != INTERPRET_OK) exit(70);
+        }
+        double elapsed = nowSeconds() - start;
+        lookups = vm.globalLookups - lookups;
+        if (!IS_NUMBER(result) || AS_NUMBER(result) != 6 * GLOBAL_LOOP_ITERATIONS) {
+            fprintf(stderr, "global loop: wrong result\n");
+            exit(70);
+        }
+        printf("gloop    %-11s %7.2f ns/iteration  %10.1f hash lookups/run\n", variants[variant],
+               elapsed * 1e9 / ((double)runs * GLOBAL_LOOP_ITERATIONS), (double)lookups / runs);
+        freeChunk(&chunk);
+    }
+    setInlineCaches(true);
+    setJit(false);
+}
+
+// --- GC ---
+
+// s(): a fresh string on every call, so each run's concatenations are new garbage
+static bool sNative(int argCount, Value* args, Value* result) {
+    static unsigned long calls = 0;
+    (void)args;
+    if (argCount != 0) return false;
+    char text[32];
+    int length = snprintf(text, sizeof(text), "run %lu:", calls++);
+    *result = OBJ_VAL(copyString(text, length));
+    return true;
+}
+
+// s() + "w0" + "w1" + ...: every intermediate string becomes garbage at once
+static void buildStringScript(char* out, size_t max, int terms) {
+    size_t pos = (size_t)snprintf(out, max, "s()");
+    for (int i = 0; i < terms && pos < max; i++) pos += snprintf(out + pos, max - pos, " + \"w%d\"", i % 10);
+}
+
+// Times the string script under a few heap-growth factors (stop-the-world)
+// and step budgets (incremental) and reports GC pauses.
+// A pool of GC_BALLAST_STRINGS live strings (rooted by an extra chunk) gives the
+// collector something to mark, as a long-running host's cached scripts would.
+#define GC_BALLAST_STRINGS 4096
+static void runGCBenchmark(long runs) {
+    static const struct {
+        double growth;
+        long stepBudget;
+    } configs[] = {{1.5, 0}, {2.0, 0}, {4.0, 0}, {2.0, 256}, {2.0, 1024}, {2.0, 4096}, {2.0, 16384}};
+    Chunk ballast;
+    initChunk(&ballast);
+    char text[512];
+    memset(text, 'b', sizeof(text));
+    for (int i = 0; i < GC_BALLAST_STRINGS; i++) {
+        int length = snprintf(text, sizeof(text), "%d", i);
+        text[length] = 'b'; // Distinct 512-byte strings
+        addConstant(&ballast, OBJ_VAL(copyString(text, sizeof(text))));
+    }
+
+    char source[4096];
+    buildStringScript(source, sizeof(source), BENCH_TERMS / 2);
+    Chunk chunk;
+    initChunk(&chunk);
+    if (!compile(source, &chunk)) {
+        fprintf(stderr, "gc: compile error\n");
+        exit(65);
+    }
+
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        collectGarbage(); // Start each row between cycles
+        setGCGrowthFactor(configs[c].growth);
+        setGCStepBudget(configs[c].stepBudget);
+        vm.gc.maxPauseNs = 0; // Per row
+        GCStats before = gcStats();
+        Value result;
+        double start = nowSeconds();
+        for (long i = 0; i < runs; i++) runChunk(&chunk, &result);
+        double elapsed = nowSeconds() - start;
+        GCStats after = gcStats();
+
+        uint64_t collections = after.collections - before.collections;
+        uint64_t pauses = after.pauses - before.pauses;
+        double pauseNs = (double)(after.totalPauseNs - before.totalPauseNs);
+        // 99th percentile, to the histogram's power-of-two resolution
+        uint64_t seen = 0;
+        int p99 = 0;
+        while (p99 < GC_PAUSE_BUCKETS - 1) {
+            seen += after.pauseBuckets[p99] - before.pauseBuckets[p99];
+            if (seen * 100 >= pauses * 99) break;
+            p99++;
+        }
+        char mode[32];
+        if (configs[c].stepBudget == 0) snprintf(mode, sizeof(mode), "stw %.1f", configs[c].growth);
+        else snprintf(mode, sizeof(mode), "step %ld", configs[c].stepBudget);
+        printf("gc       %-10s %8.1f ns/run  %4llu cycles  %6llu pauses  %5.1f%% in GC  pause mean %8.1f us"
+               "  p99 < %6ld us  max %8.1f us\n",
+               mode, elapsed * 1e9 / runs, (unsigned long long)collections, (unsigned long long)pauses,
+               100.0 * pauseNs / (elapsed * 1e9), pauses ? pauseNs / 1e3 / pauses : 0.0, 1L << p99,
+               after.maxPauseNs / 1e3);
+    }
+    freeChunk(&chunk);
+    freeChunk(&ballast);
+    setGCGrowthFactor(GC_DEFAULT_GROWTH_FACTOR);
+    setGCStepBudget(GC_DEFAULT_STEP_BUDGET);
+}
+
+int main(int argc, const char* argv[]) {
+    long runs = (argc > 1) ? atol(argv[1]) : BENCH_DEFAULT_RUNS;
+    if (runs < 1) runs = 1;
+    initVM();
+
+#ifdef CSCRIPT_THREADED_DISPATCH
+    const char* dispatch = "threaded (computed goto)";
+#else
+    const char* dispatch = "switch";
+#endif
+    printf("dispatch: %s, %zu-byte values, %ld runs per script\n", dispatch, sizeof(Value), runs);
+    defineNative("x", xNative);
+
+    char source[4096];
+    buildScript(source, sizeof(source), "+", BENCH_TERMS);
+    runBenchmark("add", source, runs);    // CONSTANT, ADD, CONSTANT, ADD ...
+    buildScript(source, sizeof(source), "+*-/", BENCH_TERMS);
+    runBenchmark("mixed", source, runs);  // All four binary operators
+    buildScript(source, sizeof(source), "n*n+", BENCH_TERMS);
+    runBenchmark("negate", source, runs); // NEGATE in the mix
+    buildNestedScript(source, sizeof(source), "+*-/", BENCH_TERMS);
+    runBenchmark("nested", source, runs); // Stack grows to BENCH_TERMS values
+    buildCallScript(source, sizeof(source), 12);
+    runBenchmark("calls", source, runs);  // Natives + constant subexpressions
+    buildVariableScript(source, sizeof(source), true, BENCH_TERMS);
+    runBenchmark("locals", source, runs);  // GET_LOCAL: an indexed load
+    buildVariableScript(source, sizeof(source), false, BENCH_TERMS);
+    runBenchmark("globals", source, runs); // GET_GLOBAL: hash the name, then load
+    runCallBenchmark(); // The register backend does not lower functions yet
+    runInlineCacheBenchmark(runs);
+
+    defineNative("s", sNative);
+    runGCBenchmark(runs);
+
+    freeVM();
+    return 0;
+}
@@ -1,20 +1,43 @@
 /* chunk.c - Implementation of the Chunk dynamic array */
 #include "chunk.h"
+#include "object.h"
+#include "memory.h"
+#include "regcompiler.h"
+#include "jit.h"
+#include <stdio.h>  // for perror
 #include <stdlib.h>
+#include <string.h>
 
-void initChunk(Chunk* chunk) {
+static void resetChunk(Chunk* chunk) {
     chunk->count = 0;
     chunk->capacity = 0;
     chunk->code = NULL;
     chunk->lines = NULL;
+    chunk->lineCount = 0;
+    chunk->lineCapacity = 0;
+    chunk->regCode = NULL;
+    chunk->regLowered = false;
+    chunk->jit = NULL;
+    chunk->hotness = 0;
+    chunk->constantSlots = NULL;
+    chunk->constantSlotCapacity = 0;
     initValueArray(&chunk->constants);
 }
 
+void initChunk(Chunk* chunk) {
+    resetChunk(chunk);
+    trackChunk(chunk);
+}
+
 void freeChunk(Chunk* chunk) {
     free(chunk->code);
     free(chunk->lines);
+    freeRegChunk(chunk->regCode);
+    freeJitCode(chunk->jit);
+    free(chunk->constantSlots);
     freeValueArray(&chunk->constants);
-    initChunk(chunk); // Zero out the struct
+    untrackChunk(chunk);
+    resetChunk(chunk); // Zero out the struct
 }
 
 void writeChunk(Chunk* chunk, uint8_t byte, int line) {
@@ -22,21 +45,156 @@ void writeChunk(Chunk* chunk, uint8_t byte, int line) {
         int oldCapacity = chunk->capacity;
         chunk->capacity = (oldCapacity < 8) ? 8 : oldCapacity * 2;
         chunk->code = (uint8_t*)realloc(chunk->code, sizeof(uint8_t) * chunk->capacity);
-        chunk->lines = (int*)realloc(chunk->lines, sizeof(int) * chunk->capacity);
-        if (chunk->code == NULL || chunk->lines == NULL) {
+        if (chunk->code == NULL) {
             perror("realloc Chunk");
             exit(1);
         }
     }
-
     chunk->code[chunk->count] = byte;
-    chunk->lines[chunk->count] = line;
     chunk->count++;
+
+    // Same line as the byte before: the current run covers it
+    if (chunk->lineCount > 0 && chunk->lines[chunk->lineCount - 1].line == line) return;
+
+    if (chunk->lineCapacity < chunk->lineCount + 1) {
+        chunk->lineCapacity = (chunk->lineCapacity < 8) ? 8 : chunk->lineCapacity * 2;
+        chunk->lines = (LineStart*)realloc(chunk->lines, sizeof(LineStart) * chunk->lineCapacity);
+        if (chunk->lines == NULL) {
+            perror("realloc Chunk lines");
+            exit(1);
+        }
+    }
+    LineStart* start = &chunk->lines[chunk->lineCount++];
+    start->offset = chunk->count - 1;
+    start->line = line;
+}
+
+int getLine(Chunk* chunk, int offset) {
+    // Last run starting at or before 'offset'
+    int low = 0;
+    int high = chunk->lineCount - 1;
+    while (low < high) {
+        int mid = low + (high - low + 1) / 2;
+        if (chunk->lines[mid].offset <= offset) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return (chunk->lineCount > 0) ? chunk->lines[low].line : 0;
+}
+
+// --- Constant Deduplication ---
+// Generated scripts repeat the same literals over and over; they share one
+// pool entry. Constants are compared by bits rather than with ==, so 0 and
+// -0 stay apart and a NaN literal still matches itself.
+
+static bool sameConstant(Value a, Value b) {
+#ifdef CSCRIPT_NAN_BOXING
+    return a == b;
+#else
+    if (a.type != b.type) return false;
+    if (IS_NUMBER(a)) return memcmp(&a.as.number, &b.as.number, sizeof(double)) == 0;
+    if (IS_BOOL(a)) return AS_BOOL(a) == AS_BOOL(b);
+    if (IS_OBJ(a)) return AS_OBJ(a) == AS_OBJ(b); // Strings are interned
+    return true; // nil
+#endif
+}
+
+static uint32_t hashConstant(Value value) {
+    uint64_t bits;
+#ifdef CSCRIPT_NAN_BOXING
+    bits = value;
+#else
+    bits = (uint64_t)value.type;
+    if (IS_NUMBER(value)) memcpy(&bits, &value.as.number, sizeof(bits));
+    if (IS_BOOL(value)) bits += AS_BOOL(value) ? 16 : 8;
+    if (IS_OBJ(value)) bits = (uint64_t)(uintptr_t)AS_OBJ(value);
+#endif
+    // Niche C: the 64-bit finalizer of MurmurHash3; doubles differ mostly in high bits.
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    return (uint32_t)bits;
+}
+
+// Slot holding 'value''s pool index, or the empty slot where it would go.
+static int* findConstantSlot(Chunk* chunk, Value value) {
+    uint32_t mask = (uint32_t)chunk->constantSlotCapacity - 1;
+    uint32_t slot = hashConstant(value) & mask;
+    for (;;) {
+        int* entry = &chunk->constantSlots[slot];
+        if (*entry == -1 || sameConstant(chunk->constants.values[*entry], value)) return entry;
+        slot = (slot + 1) & mask; // Linear probing
+    }
+}
+
+static void growConstantSlots(Chunk* chunk) {
+    free(chunk->constantSlots);
+    chunk->constantSlotCapacity = (chunk->constantSlotCapacity < 16) ? 16 : chunk->constantSlotCapacity * 2;
+    chunk->constantSlots = (int*)malloc(sizeof(int) * chunk->constantSlotCapacity);
+    if (chunk->constantSlots == NULL) {
+        perror("malloc constant index");
+        exit(1);
+    }
+    memset(chunk->constantSlots, -1, sizeof(int) * chunk->constantSlotCapacity); // All bytes 0xff is -1
+    for (int i = 0; i < chunk->constants.count; i++) {
+        *findConstantSlot(chunk, chunk->constants.values[i]) = i;
+    }
 }
 
 int addConstant(Chunk* chunk, Value value) {
-    // Write the value to the constant pool
-    writeValueArray(&chunk->constants, value);
-    // Return the index where it was stored
-    return chunk->constants.count - 1;
+    // Keep the index at most 3/4 full so probe sequences stay short
+    if ((chunk->constants.count + 1) * 4 > chunk->constantSlotCapacity * 3) growConstantSlots(chunk);
+
+    int* slot = findConstantSlot(chunk, value);
+    if (*slot == -1) {
+        writeValueArray(&chunk->constants, value);
+        *slot = chunk->constants.count - 1;
+    }
+    gcBarrier(value); // The collector may have scanned this pool already
+    return *slot;
+}
+
+ValueArray takeConstants(Chunk* chunk) {
+    ValueArray constants = chunk->constants;
+    initValueArray(&chunk->constants);
+    free(chunk->constantSlots);
+    chunk->constantSlots = NULL;
+    chunk->constantSlotCapacity = 0;
+    return constants;
+}
+
+int instructionLength(Chunk* chunk, int offset) {
+    switch (chunk->code[offset]) {
+        case OP_CONSTANT:
+        case OP_ADD_CONSTANT:
+        case OP_SUBTRACT_CONSTANT:
+        case OP_MULTIPLY_CONSTANT:
+        case OP_DIVIDE_CONSTANT:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_CALL:
+        case OP_GET_UPVALUE:
+        case OP_SET_UPVALUE:
+            return 2;
+        case OP_CALL_NATIVE:
+        case OP_DEFINE_GLOBAL:
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_LOOP:
+            return 3;
+        case OP_CLOSURE: {
+            // The function constant says how many upvalue pairs follow
+            int constant = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+            return 3 + 2 * AS_FUNCTION(chunk->constants.values[constant])->upvalueCount;
+        }
+        case OP_CONSTANT_LONG:
+            return 4;
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+            return 3 + GLOBAL_CACHE_BYTES;
+        default:
+            return 1;
+    }
 }
@@ -5,10 +5,15 @@
 #include "common.h"
 #include "value.h" // A chunk has a constant pool (ValueArray)
 
+// --- Configuration ---
+#define MAX_CONSTANTS (1 << 24) // Largest pool OP_CONSTANT_LONG can index
+#define GLOBAL_CACHE_BYTES 4    // Inline cache of OP_GET_GLOBAL / OP_SET_GLOBAL: zero when empty
+
 // --- The Bytecode ---
 // These are the "opcodes" our VM will execute.
 typedef enum {
     OP_CONSTANT, // Push a constant from the pool
+    OP_CONSTANT_LONG, // Same, for pool index 256 and up: [24-bit index, high byte first]
     OP_NIL,
     OP_TRUE,
     OP_FALSE,
@@ -17,24 +22,96 @@ typedef enum {
     OP_SUBTRACT,
     OP_MULTIPLY,
     OP_DIVIDE,
+    OP_CALL_NATIVE, // Call a host function: [native index] [arg count]
     OP_RETURN,   // Return from a function (or end script)
+    OP_POP,      // Discard the top of the stack (expression statements, leaving a scope)
+
+    // Variables. Locals live in stack slots the compiler assigns: [slot].
+    // Globals are named by a string constant: [16-bit index, high byte first].
+    // Reads and assignments carry an inline cache after it (GlobalCache in vm.c).
+    OP_GET_LOCAL,
+    OP_SET_LOCAL,
+    OP_DEFINE_GLOBAL,
+    OP_GET_GLOBAL,    // [16-bit name][GLOBAL_CACHE_BYTES cache]
+    OP_SET_GLOBAL,
+
+    // Comparisons. a != b, a >= b and a <= b compile to one of these + OP_NOT.
+    OP_EQUAL,
+    OP_GREATER,
+    OP_LESS,
+    OP_NOT,
+
+    // Control flow: [16-bit offset, high byte first] from the next instruction.
+    OP_JUMP,
+    OP_JUMP_IF_FALSE, // Leaves the condition on the stack
+    OP_LOOP,          // Jumps backwards
+
+    // Functions. A callee sits below its arguments and becomes slot 0 of its frame.
+    OP_CALL,          // [arg count]
+    OP_CLOSURE,       // [16-bit function constant], then [is local][index] per upvalue
+    OP_GET_UPVALUE,   // [upvalue index]
+    OP_SET_UPVALUE,
+    OP_CLOSE_UPVALUE, // Pops a captured local, moving it into its upvalue
+
+    // Superinstructions from the optimizer (-O): "x op constant" in one
+    // dispatch instead of OP_CONSTANT + the operator. [constant index]
+    OP_ADD_CONSTANT,
+    OP_SUBTRACT_CONSTANT,
+    OP_MULTIPLY_CONSTANT,
+    OP_DIVIDE_CONSTANT,
 } OpCode;
 
+struct RegChunk; // regcompiler.h
+struct JitCode;  // jit.h
+
+// One run of the line table: bytes from 'offset' up to the next run's offset
+// all come from source line 'line'.
+typedef struct {
+    int offset;
+    int line;
+} LineStart;
+
 /*
  * A Chunk is a dynamic array of bytecode.
- * It also stores the "constant pool" (literals like numbers).
+ * It also stores the "constant pool" (literals like numbers and strings).
+ * Its constants are GC roots from initChunk() until freeChunk(), so a chunk
+ * must stay at one address (not be copied around) in between.
  */
-typedef struct {
+typedef struct Chunk {
     int count;
     int capacity;
     uint8_t* code;     // The bytecode
     ValueArray constants; // The constant pool
-    int* lines;        // Line numbers (for error reporting)
+    int* constantSlots;   // Dedup index: open-addressed pool indices (-1 = empty)
+    int constantSlotCapacity;
+    // Niche C: line numbers are only needed for errors and disassembly, so
+    // instead of an int per byte they are run-length encoded (one entry per
+    // change of line) and looked up by binary search.
+    LineStart* lines;
+    int lineCount;
+    int lineCapacity;
+    struct RegChunk* regCode; // Register-backend translation, made on first run
+    bool regLowered;          // Translation attempted (regCode NULL = unsupported)
+    struct JitCode* jit;      // Machine code, made once the chunk is hot (NULL before)
+    uint32_t hotness;         // Entries into the code while the JIT is on
+    struct Chunk* prevLive;   // The GC's list of live chunks (memory.c)
+    struct Chunk* nextLive;
 } Chunk;
 
 void initChunk(Chunk* chunk);
+// Frees the chunk's memory and stops rooting its constants; initChunk() it to reuse it.
 void freeChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
+// Adds 'value' to the constant pool, or finds the identical constant already
+// there, and returns its index. Identical means same bits: 0 and -0 differ.
 int addConstant(Chunk* chunk, Value value);
+// Source line of the byte at 'offset'.
+int getLine(Chunk* chunk, int offset);
+// Detaches the constant pool, leaving the chunk an empty one. For passes that
+// renumber constants: they re-add the ones they keep.
+ValueArray takeConstants(Chunk* chunk);
+// Size in bytes of the instruction at 'offset' (opcode + operands). For
+// OP_CLOSURE it reads the function constant, which must be valid.
+int instructionLength(Chunk* chunk, int offset);
 
 #endif
@@ -7,9 +7,25 @@
 #include <stdint.h>
 
 /*
- * This flag enables a "trace" of the VM's execution.
- * It's *slow* but essential for debugging.
+ * Build with -DCSCRIPT_TRACE (make TRACE=1) to compile in the per-instruction
+ * hook that --trace and setInstructionHook() use. Release builds leave the
+ * dispatch loop without any tracing code at all.
  */
-#define DEBUG_TRACE_EXECUTION
+
+/*
+ * Threaded dispatch: with GCC/Clang the VM jumps straight from one opcode
+ * handler to the next through a table of label addresses ("computed goto").
+ * Build with -DCSCRIPT_SWITCH_DISPATCH to use the portable switch instead.
+ */
+#if defined(__GNUC__) && !defined(CSCRIPT_SWITCH_DISPATCH)
+#define CSCRIPT_THREADED_DISPATCH
+#endif
+
+/*
+ * Build with -DCSCRIPT_NAN_BOXING (make NAN_BOXING=1) for 8-byte NaN-boxed
+ * Values instead of the 16-byte tagged union; see value.h.
+ */
+
+#define UINT8_COUNT (UINT8_MAX + 1)
 
 #endif
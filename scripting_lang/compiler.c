@@ -2,11 +2,16 @@
 #include "compiler.h"
 #include "common.h"
 #include "debug.h"
+#include "object.h"
+#include "optimizer.h"
 #include <stdio.h>
 #include <stdlib.h> // for strtod
+#include <string.h>
 
 Parser parser;
+static Compiler* current = NULL;
 Chunk* compilingChunk;
+static bool resultOnStack; // The script ended in a bare expression: it is the result
 
 // --- Error Handling ---
 static void errorAt(Token* token, const char* message) {
@@ -27,7 +32,7 @@ static void errorAtCurrent(const char* message) { errorAt(&parser.current, messa
 
 // --- Emitter Functions ---
 static Chunk* currentChunk() {
-    return compilingChunk;
+    return current->function != NULL ? &current->function->chunk : compilingChunk;
 }
 static void emitByte(uint8_t byte) {
     writeChunk(currentChunk(), byte, parser.previous.line);
@@ -37,30 +42,95 @@ static void emitBytes(uint8_t b1, uint8_t b2) {
     emitByte(b2);
 }
 static void emitReturn() {
+    if (current->type == TYPE_FUNCTION) emitByte(OP_NIL); // Falling off the end returns nil
     emitByte(OP_RETURN);
 }
-static uint8_t makeConstant(Value value) {
+static int makeConstant(Value value) {
     int constant = addConstant(currentChunk(), value);
-    if (constant > 255) {
+    if (constant >= MAX_CONSTANTS) {
         error("Too many constants in one chunk.");
         return 0;
     }
-    return (uint8_t)constant;
+    return constant;
 }
 static void emitConstant(Value value) {
-    emitBytes(OP_CONSTANT, makeConstant(value));
+    int constant = makeConstant(value);
+    if (constant <= UINT8_MAX) {
+        emitBytes(OP_CONSTANT, (uint8_t)constant);
+    } else {
+        // Past the first 256 constants: 24-bit operand, high byte first
+        emitByte(OP_CONSTANT_LONG);
+        emitBytes((uint8_t)(constant >> 16), (uint8_t)(constant >> 8));
+        emitByte((uint8_t)constant);
+    }
+}
+static void emitShort(uint8_t op, int operand) {
+    emitByte(op);
+    emitBytes((uint8_t)(operand >> 8), (uint8_t)operand);
+}
+// Emits a forward jump with a placeholder offset; returns where to patch it.
+static int emitJump(uint8_t instruction) {
+    emitByte(instruction);
+    emitBytes(0xff, 0xff);
+    return currentChunk()->count - 2;
+}
+static void patchJump(int offset) {
+    // -2: the offset counts from the end of the jump's own operand
+    int jump = currentChunk()->count - offset - 2;
+    if (jump > UINT16_MAX) error("Too much code to jump over.");
+    currentChunk()->code[offset] = (uint8_t)((jump >> 8) & 0xff);
+    currentChunk()->code[offset + 1] = (uint8_t)(jump & 0xff);
+}
+static void emitLoop(int loopStart) {
+    emitByte(OP_LOOP);
+    int offset = currentChunk()->count - loopStart + 2;
+    if (offset > UINT16_MAX) error("Loop body too large.");
+    emitBytes((uint8_t)((offset >> 8) & 0xff), (uint8_t)(offset & 0xff));
+}
+
+static void initCompiler(Compiler* compiler, FunctionType type) {
+    compiler->enclosing = current;
+    compiler->function = NULL;
+    compiler->type = type;
+    compiler->localCount = 0;
+    compiler->scopeDepth = 0;
+    if (type == TYPE_SCRIPT) {
+        current = compiler;
+        return;
+    }
+    compiler->function = newFunction();
+    current = compiler; // Rooted from here on (markCompilerRoots)
+    current->function->name = copyString(parser.previous.start, parser.previous.length);
+
+    // Slot 0 holds the function being called
+    Local* local = &current->locals[current->localCount++];
+    local->depth = 0;
+    local->isCaptured = false;
+    local->name.start = "";
+    local->name.length = 0;
 }
-static void endCompiler() {
+
+// Finishes the innermost function (NULL for the script) and returns to the one around it.
+static ObjFunction* endCompiler() {
+    if (current->type == TYPE_SCRIPT && !resultOnStack) {
+        emitByte(OP_NIL); // Scripts without a final expression return nil
+    }
     emitReturn();
-    #ifdef DEBUG_TRACE_EXECUTION
-    if (!parser.hadError) {
-        disassembleChunk(currentChunk(), "code");
+    ObjFunction* function = current->function;
+    if (!parser.hadError && optimizationEnabled()) {
+        optimizeChunk(currentChunk());
     }
-    #endif
+    if (!parser.hadError && traceExecution()) {
+        disassembleChunk(currentChunk(), function != NULL ? function->name->chars : "code");
+    }
+    current = current->enclosing;
+    return function;
 }
 
 // --- Parser Forward Declarations ---
 static void expression();
+static void statement();
+static void declaration();
 static ParseRule* getRule(TokenType type);
 static void parsePrecedence(Precedence precedence);
 
@@ -80,33 +150,52 @@ static void consume(TokenType type, const char* message) {
     }
     errorAtCurrent(message);
 }
+static bool check(TokenType type) {
+    return parser.current.type == type;
+}
+static bool match(TokenType type) {
+    if (!check(type)) return false;
+    advance();
+    return true;
+}
 
 // --- Parsing Functions (the Pratt part) ---
 
 // e.g., "5.0"
-static void number() {
+static void number(bool canAssign) {
+    (void)canAssign;
     double value = strtod(parser.previous.start, NULL);
     emitConstant(NUMBER_VAL(value));
 }
 
+// e.g., "\"hello\"": the string is interned now and lives in the constant pool
+static void string(bool canAssign) {
+    (void)canAssign;
+    emitConstant(OBJ_VAL(copyString(parser.previous.start + 1, parser.previous.length - 2)));
+}
+
 // e.g., "(1 + 2)"
-static void grouping() {
+static void grouping(bool canAssign) {
+    (void)canAssign;
     expression();
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
 }
 
-// e.g., "-1"
-static void unary() {
+// e.g., "-1", "!done"
+static void unary(bool canAssign) {
+    (void)canAssign;
     TokenType operatorType = parser.previous.type;
     parsePrecedence(PREC_UNARY); // Parse the operand
     switch (operatorType) {
+        case TOKEN_BANG:  emitByte(OP_NOT); break;
         case TOKEN_MINUS: emitByte(OP_NEGATE); break;
         default: return;
     }
 }
 
 // e.g., "1 + 2"
-static void binary() {
+static void binary(bool canAssign) {
+    (void)canAssign;
     TokenType operatorType = parser.previous.type;
     ParseRule* rule = getRule(operatorType);
     parsePrecedence((Precedence)(rule->precedence + 1));
@@ -116,11 +205,214 @@ static void binary() {
         case TOKEN_MINUS:   emitByte(OP_SUBTRACT); break;
         case TOKEN_STAR:    emitByte(OP_MULTIPLY); break;
         case TOKEN_SLASH:   emitByte(OP_DIVIDE); break;
+        case TOKEN_BANG_EQUAL:    emitBytes(OP_EQUAL, OP_NOT); break;
+        case TOKEN_EQUAL_EQUAL:   emitByte(OP_EQUAL); break;
+        case TOKEN_GREATER:       emitByte(OP_GREATER); break;
+        case TOKEN_GREATER_EQUAL: emitBytes(OP_LESS, OP_NOT); break;
+        case TOKEN_LESS:          emitByte(OP_LESS); break;
+        case TOKEN_LESS_EQUAL:    emitBytes(OP_GREATER, OP_NOT); break;
         default: return;
     }
 }
 
-static void literal() {
+// e.g., "a and b": the right operand only runs if the left one is truthy
+static void and_(bool canAssign) {
+    (void)canAssign;
+    int endJump = emitJump(OP_JUMP_IF_FALSE);
+    emitByte(OP_POP);
+    parsePrecedence(PREC_AND);
+    patchJump(endJump);
+}
+
+static void or_(bool canAssign) {
+    (void)canAssign;
+    int elseJump = emitJump(OP_JUMP_IF_FALSE);
+    int endJump = emitJump(OP_JUMP);
+    patchJump(elseJump);
+    emitByte(OP_POP);
+    parsePrecedence(PREC_OR);
+    patchJump(endJump);
+}
+
+static uint8_t argumentList() {
+    int argCount = 0;
+    if (!check(TOKEN_RIGHT_PAREN)) {
+        do {
+            expression();
+            if (argCount == 255) error("Can't have more than 255 arguments.");
+            argCount++;
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+    return (uint8_t)argCount;
+}
+
+// e.g., "f(1, 2)" for any callee expression
+static void call(bool canAssign) {
+    (void)canAssign;
+    uint8_t argCount = argumentList();
+    emitBytes(OP_CALL, argCount);
+}
+
+// e.g., "get(1)": a call to a host function registered with defineNative()
+static void nativeCall(Token name) {
+    int native = findNative(name.start, name.length);
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+    uint8_t argCount = argumentList();
+    emitBytes(OP_CALL_NATIVE, (uint8_t)native);
+    emitByte(argCount);
+}
+
+// --- Variables ---
+
+static bool identifiersEqual(Token* a, Token* b) {
+    return a->length == b->length && memcmp(a->start, b->start, a->length) == 0;
+}
+
+// A global's name goes in the constant pool; the VM finds its slot by it.
+static int identifierConstant(Token* name) {
+    int constant = makeConstant(OBJ_VAL(copyString(name->start, name->length)));
+    if (constant > UINT16_MAX) {
+        error("Too many constants in one chunk.");
+        return 0;
+    }
+    return constant;
+}
+
+// Stack slot of the innermost local called 'name', or -1 for a global.
+static int resolveLocal(Compiler* compiler, Token* name) {
+    for (int i = compiler->localCount - 1; i >= 0; i--) {
+        Local* local = &compiler->locals[i];
+        if (identifiersEqual(name, &local->name)) {
+            if (local->depth == -1) error("Can't read local variable in its own initializer.");
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal) {
+    int upvalueCount = compiler->function->upvalueCount;
+    for (int i = 0; i < upvalueCount; i++) {
+        Upvalue* upvalue = &compiler->upvalues[i];
+        if (upvalue->index == index && upvalue->isLocal == isLocal) return i;
+    }
+    if (upvalueCount == UINT8_COUNT) {
+        error("Too many closure variables in function.");
+        return 0;
+    }
+    compiler->upvalues[upvalueCount].isLocal = isLocal;
+    compiler->upvalues[upvalueCount].index = index;
+    return compiler->function->upvalueCount++;
+}
+
+// Index of the upvalue through which 'compiler' reaches an enclosing
+// function's local 'name', or -1. Captures it in every function in between.
+static int resolveUpvalue(Compiler* compiler, Token* name) {
+    if (compiler->enclosing == NULL) return -1;
+    int local = resolveLocal(compiler->enclosing, name);
+    if (local != -1) {
+        compiler->enclosing->locals[local].isCaptured = true;
+        return addUpvalue(compiler, (uint8_t)local, true);
+    }
+    int upvalue = resolveUpvalue(compiler->enclosing, name);
+    if (upvalue != -1) return addUpvalue(compiler, (uint8_t)upvalue, false);
+    return -1;
+}
+
+// True if 'name' is a local of this function or of one around it.
+static bool isLexical(Token* name) {
+    for (Compiler* compiler = current; compiler != NULL; compiler = compiler->enclosing) {
+        for (int i = compiler->localCount - 1; i >= 0; i--) {
+            if (identifiersEqual(name, &compiler->locals[i].name)) return true;
+        }
+    }
+    return false;
+}
+
+static void addLocal(Token name) {
+    if (current->localCount == UINT8_COUNT) {
+        error("Too many local variables in function.");
+        return;
+    }
+    Local* local = &current->locals[current->localCount++];
+    local->name = name;
+    local->depth = -1; // Declared, not yet usable
+    local->isCaptured = false;
+}
+
+static void declareVariable() {
+    if (current->scopeDepth == 0) return; // Globals are late bound
+    Token* name = &parser.previous;
+    for (int i = current->localCount - 1; i >= 0; i--) {
+        Local* local = &current->locals[i];
+        if (local->depth != -1 && local->depth < current->scopeDepth) break;
+        if (identifiersEqual(name, &local->name)) error("Already a variable with this name in this scope.");
+    }
+    addLocal(*name);
+}
+
+static int parseVariable(const char* errorMessage) {
+    consume(TOKEN_IDENTIFIER, errorMessage);
+    declareVariable();
+    if (current->scopeDepth > 0) return 0;
+    return identifierConstant(&parser.previous);
+}
+
+static void markInitialized() {
+    if (current->scopeDepth == 0) return;
+    current->locals[current->localCount - 1].depth = current->scopeDepth;
+}
+
+static void defineVariable(int global) {
+    if (current->scopeDepth > 0) {
+        markInitialized(); // The initializer's value is already in the local's slot
+        return;
+    }
+    emitShort(OP_DEFINE_GLOBAL, global);
+}
+
+static void namedVariable(Token name, bool canAssign) {
+    uint8_t getOp, setOp;
+    int arg = resolveLocal(current, &name);
+    if (arg != -1) {
+        getOp = OP_GET_LOCAL;
+        setOp = OP_SET_LOCAL;
+    } else if ((arg = resolveUpvalue(current, &name)) != -1) {
+        getOp = OP_GET_UPVALUE;
+        setOp = OP_SET_UPVALUE;
+    } else {
+        arg = identifierConstant(&name);
+        getOp = OP_GET_GLOBAL;
+        setOp = OP_SET_GLOBAL;
+    }
+
+    uint8_t op = getOp;
+    if (canAssign && match(TOKEN_EQUAL)) {
+        expression();
+        op = setOp;
+    }
+    if (op == OP_GET_GLOBAL || op == OP_SET_GLOBAL) {
+        emitShort(op, arg);
+        for (int i = 0; i < GLOBAL_CACHE_BYTES; i++) emitByte(0); // Empty inline cache
+    } else {
+        emitBytes(op, (uint8_t)arg);
+    }
+}
+
+// e.g., "x", "x = 1" or "get(1)". A host function's name calls it directly,
+// unless a local of that name hides it.
+static void variable(bool canAssign) {
+    Token name = parser.previous;
+    if (check(TOKEN_LEFT_PAREN) && findNative(name.start, name.length) != -1 && !isLexical(&name)) {
+        nativeCall(name);
+        return;
+    }
+    namedVariable(name, canAssign);
+}
+
+static void literal(bool canAssign) {
+    (void)canAssign;
     switch(parser.previous.type) {
         case TOKEN_FALSE: emitByte(OP_FALSE); break;
         case TOKEN_NIL: emitByte(OP_NIL); break;
@@ -133,7 +425,7 @@ static void literal() {
 // Niche C: This is an array of structs, where some
 // fields are function pointers.
 ParseRule rules[] = {
-    [TOKEN_LEFT_PAREN]  = {grouping, NULL,   PREC_NONE},
+    [TOKEN_LEFT_PAREN]  = {grouping, call,   PREC_CALL},
     [TOKEN_RIGHT_PAREN] = {NULL,     NULL,   PREC_NONE},
     [TOKEN_LEFT_BRACE]  = {NULL,     NULL,   PREC_NONE}, 
     [TOKEN_RIGHT_BRACE] = {NULL,     NULL,   PREC_NONE},
@@ -144,7 +436,18 @@ ParseRule rules[] = {
     [TOKEN_SEMICOLON]   = {NULL,     NULL,   PREC_NONE},
     [TOKEN_SLASH]       = {NULL,     binary, PREC_FACTOR},
     [TOKEN_STAR]        = {NULL,     binary, PREC_FACTOR},
+    [TOKEN_BANG]        = {unary,    NULL,   PREC_NONE},
+    [TOKEN_BANG_EQUAL]  = {NULL,     binary, PREC_EQUALITY},
+    [TOKEN_EQUAL_EQUAL] = {NULL,     binary, PREC_EQUALITY},
+    [TOKEN_GREATER]     = {NULL,     binary, PREC_COMPARISON},
+    [TOKEN_GREATER_EQUAL] = {NULL,   binary, PREC_COMPARISON},
+    [TOKEN_LESS]        = {NULL,     binary, PREC_COMPARISON},
+    [TOKEN_LESS_EQUAL]  = {NULL,     binary, PREC_COMPARISON},
+    [TOKEN_AND]         = {NULL,     and_,   PREC_AND},
+    [TOKEN_OR]          = {NULL,     or_,    PREC_OR},
+    [TOKEN_IDENTIFIER]  = {variable, NULL,   PREC_NONE},
     [TOKEN_NUMBER]      = {number,   NULL,   PREC_NONE},
+    [TOKEN_STRING]      = {string,   NULL,   PREC_NONE},
     [TOKEN_FALSE]       = {literal,  NULL,   PREC_NONE},
     [TOKEN_NIL]         = {literal,  NULL,   PREC_NONE},
     [TOKEN_TRUE]        = {literal,  NULL,   PREC_NONE},
@@ -163,31 +466,256 @@ static void parsePrecedence(Precedence precedence) {
         error("Expect expression.");
         return;
     }
-    prefixRule();
+    bool canAssign = precedence <= PREC_ASSIGNMENT;
+    prefixRule(canAssign);
 
     while (precedence <= getRule(parser.current.type)->precedence) {
         advance();
         ParseFn infixRule = getRule(parser.previous.type)->infix;
-        infixRule();
+        infixRule(canAssign);
     }
+
+    if (canAssign && match(TOKEN_EQUAL)) error("Invalid assignment target.");
 }
 
 static void expression() {
     parsePrecedence(PREC_ASSIGNMENT);
 }
 
+// --- Statements ---
+
+static void beginScope() {
+    current->scopeDepth++;
+}
+
+static void endScope() {
+    current->scopeDepth--;
+    while (current->localCount > 0 && current->locals[current->localCount - 1].depth > current->scopeDepth) {
+        // A captured local outlives its slot: move it into its upvalue
+        emitByte(current->locals[current->localCount - 1].isCaptured ? OP_CLOSE_UPVALUE : OP_POP);
+        current->localCount--;
+    }
+}
+
+static void block() {
+    while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) declaration();
+    consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+}
+
+// Compiles a function's parameters and body, then emits the closure for it.
+static void function(FunctionType type) {
+    Compiler compiler;
+    initCompiler(&compiler, type);
+    beginScope(); // Never ended: OP_RETURN discards the whole frame
+
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+    if (!check(TOKEN_RIGHT_PAREN)) {
+        do {
+            current->function->arity++;
+            if (current->function->arity > 255) errorAtCurrent("Can't have more than 255 parameters.");
+            int constant = parseVariable("Expect parameter name.");
+            defineVariable(constant);
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+    consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+    block();
+
+    ObjFunction* function = endCompiler();
+    // Now a constant of the enclosing chunk, which keeps it alive
+    int constant = makeConstant(OBJ_VAL(function));
+    if (constant > UINT16_MAX) error("Too many constants in one chunk.");
+    emitShort(OP_CLOSURE, constant);
+    for (int i = 0; i < function->upvalueCount; i++) {
+        emitBytes(compiler.upvalues[i].isLocal ? 1 : 0, compiler.upvalues[i].index);
+    }
+}
+
+static void funDeclaration() {
+    int global = parseVariable("Expect function name.");
+    markInitialized(); // A local function may call itself
+    function(TYPE_FUNCTION);
+    defineVariable(global);
+}
+
+static void varDeclaration() {
+    int global = parseVariable("Expect variable name.");
+    if (match(TOKEN_EQUAL)) {
+        expression();
+    } else {
+        emitByte(OP_NIL);
+    }
+    consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
+    defineVariable(global);
+}
+
+static void expressionStatement() {
+    expression();
+    // A bare expression closing the script is its result, as before statements
+    if (current->type == TYPE_SCRIPT && current->scopeDepth == 0 && check(TOKEN_EOF)) {
+        resultOnStack = true;
+        return;
+    }
+    consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
+    emitByte(OP_POP);
+}
+
+static void ifStatement() {
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
+    expression();
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+    int thenJump = emitJump(OP_JUMP_IF_FALSE);
+    emitByte(OP_POP); // The condition
+    statement();
+    int elseJump = emitJump(OP_JUMP);
+    patchJump(thenJump);
+    emitByte(OP_POP);
+    if (match(TOKEN_ELSE)) statement();
+    patchJump(elseJump);
+}
+
+static void whileStatement() {
+    int loopStart = currentChunk()->count;
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
+    expression();
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+    int exitJump = emitJump(OP_JUMP_IF_FALSE);
+    emitByte(OP_POP);
+    statement();
+    emitLoop(loopStart);
+    patchJump(exitJump);
+    emitByte(OP_POP);
+}
+
+// "for (init; condition; increment) body": the increment is compiled before
+// the body but runs after it, so the body jumps back to it.
+static void forStatement() {
+    beginScope();
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
+    if (match(TOKEN_SEMICOLON)) {
+        // No initializer
+    } else if (match(TOKEN_VAR)) {
+        varDeclaration();
+    } else {
+        expression();
+        consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
+        emitByte(OP_POP);
+    }
+
+    int loopStart = currentChunk()->count;
+    int exitJump = -1;
+    if (!match(TOKEN_SEMICOLON)) {
+        expression();
+        consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
+        exitJump = emitJump(OP_JUMP_IF_FALSE);
+        emitByte(OP_POP);
+    }
+
+    if (!match(TOKEN_RIGHT_PAREN)) {
+        int bodyJump = emitJump(OP_JUMP);
+        int incrementStart = currentChunk()->count;
+        expression();
+        emitByte(OP_POP);
+        consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
+        emitLoop(loopStart);
+        loopStart = incrementStart;
+        patchJump(bodyJump);
+    }
+
+    statement();
+    emitLoop(loopStart);
+    if (exitJump != -1) {
+        patchJump(exitJump);
+        emitByte(OP_POP);
+    }
+    endScope();
+}
+
+static void returnStatement() {
+    if (current->type == TYPE_SCRIPT) error("Can't return from top-level code.");
+    if (match(TOKEN_SEMICOLON)) {
+        emitReturn();
+    } else {
+        expression();
+        consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
+        emitByte(OP_RETURN);
+    }
+}
+
+static void statement() {
+    if (match(TOKEN_IF)) {
+        ifStatement();
+    } else if (match(TOKEN_WHILE)) {
+        whileStatement();
+    } else if (match(TOKEN_FOR)) {
+        forStatement();
+    } else if (match(TOKEN_RETURN)) {
+        returnStatement();
+    } else if (match(TOKEN_LEFT_BRACE)) {
+        beginScope();
+        block();
+        endScope();
+    } else {
+        expressionStatement();
+    }
+}
+
+// Skips to a likely statement boundary after an error, so one mistake
+// reports one error.
+static void synchronize() {
+    parser.panicMode = false;
+    while (parser.current.type != TOKEN_EOF) {
+        if (parser.previous.type == TOKEN_SEMICOLON) return;
+        switch (parser.current.type) {
+            case TOKEN_FUN:
+            case TOKEN_VAR:
+            case TOKEN_FOR:
+            case TOKEN_IF:
+            case TOKEN_WHILE:
+            case TOKEN_RETURN:
+            case TOKEN_LEFT_BRACE:
+                return;
+            default:
+                ; // Keep skipping
+        }
+        advance();
+    }
+}
+
+static void declaration() {
+    if (match(TOKEN_FUN)) {
+        funDeclaration();
+    } else if (match(TOKEN_VAR)) {
+        varDeclaration();
+    } else {
+        statement();
+    }
+    if (parser.panicMode) synchronize();
+}
+
 // --- Public API ---
 bool compile(const char* source, Chunk* chunk) {
     initLexer(source);
+    Compiler compiler;
+    current = NULL;
+    initCompiler(&compiler, TYPE_SCRIPT);
     compilingChunk = chunk;
-    
+    resultOnStack = false;
+
     parser.hadError = false;
     parser.panicMode = false;
 
     advance();
-    expression();
-    consume(TOKEN_EOF, "Expect end of expression.");
-    
+    while (!match(TOKEN_EOF)) declaration();
+
     endCompiler();
     return !parser.hadError;
 }
+
+void markCompilerRoots() {
+    for (Compiler* compiler = current; compiler != NULL; compiler = compiler->enclosing) {
+        markObject((Obj*)compiler->function);
+    }
+}
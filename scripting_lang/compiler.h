@@ -4,6 +4,7 @@
 
 #include "vm.h" // For Chunk
 #include "lexer.h"
+#include "object.h"
 
 // --- Parser Struct ---
 // Holds the state of the compiler
@@ -14,6 +15,37 @@ typedef struct {
     bool panicMode;
 } Parser;
 
+// --- Scopes ---
+// A local variable: the compiler knows its stack slot (its index in
+// Compiler.locals), so the VM reads it with OP_GET_LOCAL <slot>, no lookup.
+typedef struct {
+    Token name;
+    int depth; // Scope depth of its block; -1 while its initializer is compiled
+    bool isCaptured; // A closure refers to it: leaving the scope closes an upvalue
+} Local;
+
+// A variable of an enclosing function that this one refers to
+typedef struct {
+    uint8_t index;  // Slot of the enclosing function's local, or index of its upvalue
+    bool isLocal;
+} Upvalue;
+
+typedef enum {
+    TYPE_FUNCTION,
+    TYPE_SCRIPT,
+} FunctionType;
+
+// One per function being compiled, innermost first through 'enclosing'.
+typedef struct Compiler {
+    struct Compiler* enclosing;
+    ObjFunction* function; // NULL for the script: it compiles into the caller's Chunk
+    FunctionType type;
+    Local locals[UINT8_COUNT];
+    int localCount;
+    Upvalue upvalues[UINT8_COUNT];
+    int scopeDepth; // 0 = top level: variables declared there are globals
+} Compiler;
+
 // --- Precedence ---
 // For our Pratt Parser
 typedef enum {
@@ -30,8 +62,9 @@ typedef enum {
     PREC_PRIMARY
 } Precedence;
 
-// Function pointer for a parsing rule
-typedef void (*ParseFn)();
+// Function pointer for a parsing rule. canAssign: the expression may be
+// the target of an "=" (only at assignment precedence).
+typedef void (*ParseFn)(bool canAssign);
 
 // A rule for the Pratt parser
 typedef struct {
@@ -48,5 +81,8 @@ typedef struct {
  */
 bool compile(const char* source, Chunk* chunk);
 
+// GC support: marks the functions still being compiled.
+void markCompilerRoots();
+
 #endif
 
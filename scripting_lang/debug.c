@@ -1,5 +1,7 @@
 #include "debug.h"
+#include "object.h"
 #include <stdio.h>
+#include <string.h>
 
 // Helper for simple instructions
 static int simpleInstruction(const char* name, int offset) {
@@ -16,19 +18,92 @@ static int constantInstruction(const char* name, Chunk* chunk, int offset) {
     return offset + 2; // opcode + 1-byte constant index
 }
 
+// Helper for OP_CONSTANT_LONG: 24-bit constant index, high byte first
+static int constantLongInstruction(const char* name, Chunk* chunk, int offset) {
+    int constant_index = (chunk->code[offset + 1] << 16) | (chunk->code[offset + 2] << 8) |
+                         chunk->code[offset + 3];
+    printf("%-16s %4d '", name, constant_index);
+    printValue(chunk->constants.values[constant_index]);
+    printf("'\n");
+    return offset + 4;
+}
+
+// Helper for global variable instructions: 16-bit name constant, high byte first
+static int globalInstruction(const char* name, Chunk* chunk, int offset) {
+    int constant_index = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    printf("%-16s %4d '", name, constant_index);
+    printValue(chunk->constants.values[constant_index]);
+    printf("'\n");
+    return offset + 3;
+}
+
+// A global read or assignment: the name, then its inline cache
+static int cachedGlobalInstruction(const char* name, Chunk* chunk, int offset) {
+    int constant_index = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    printf("%-16s %4d '", name, constant_index);
+    printValue(chunk->constants.values[constant_index]);
+    uint16_t cache[2];
+    memcpy(cache, chunk->code + offset + 3, sizeof(cache)); // Same layout as GlobalCache in vm.c
+    if (cache[0] == 0) printf("' (cache empty)\n");
+    else printf("' (cache: version %d, slot %d)\n", cache[0], cache[1]);
+    return offset + 3 + GLOBAL_CACHE_BYTES;
+}
+
+// Helper for one-byte operands: a local's stack slot, an upvalue index, an argument count
+static int byteInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t slot = chunk->code[offset + 1];
+    printf("%-16s %4d\n", name, slot);
+    return offset + 2;
+}
+
+// Helper for jumps: 16-bit offset, printed as the target ('sign' -1 for OP_LOOP)
+static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset) {
+    int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    printf("%-16s %4d -> %d\n", name, offset, offset + 3 + sign * jump);
+    return offset + 3;
+}
+
+// Helper for OP_CLOSURE: the function, then one line per captured variable
+static int closureInstruction(const char* name, Chunk* chunk, int offset) {
+    int constant_index = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    offset += 3;
+    printf("%-16s %4d ", name, constant_index);
+    printValue(chunk->constants.values[constant_index]);
+    printf("\n");
+    ObjFunction* function = AS_FUNCTION(chunk->constants.values[constant_index]);
+    for (int j = 0; j < function->upvalueCount; j++) {
+        int isLocal = chunk->code[offset];
+        int index = chunk->code[offset + 1];
+        printf("%04d      |                     %s %d\n", offset, isLocal ? "local" : "upvalue", index);
+        offset += 2;
+    }
+    return offset;
+}
+
+// Helper for OP_CALL_NATIVE: native index + argument count
+static int nativeInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t native = chunk->code[offset + 1];
+    uint8_t argCount = chunk->code[offset + 2];
+    printf("%-16s %4d (%d args)\n", name, native, argCount);
+    return offset + 3;
+}
+
 // Public API
 int disassembleInstruction(Chunk* chunk, int offset) {
     printf("%04d ", offset);
-    if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1]) {
+    int line = getLine(chunk, offset);
+    if (offset > 0 && line == getLine(chunk, offset - 1)) {
         printf("   | "); // Same line as previous
     } else {
-        printf("%4d ", chunk->lines[offset]);
+        printf("%4d ", line);
     }
 
     uint8_t instruction = chunk->code[offset];
     switch (instruction) {
         case OP_CONSTANT:
             return constantInstruction("OP_CONSTANT", chunk, offset);
+        case OP_CONSTANT_LONG:
+            return constantLongInstruction("OP_CONSTANT_LONG", chunk, offset);
         case OP_NIL:
             return simpleInstruction("OP_NIL", offset);
         case OP_TRUE:
@@ -45,8 +120,54 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return simpleInstruction("OP_MULTIPLY", offset);
         case OP_DIVIDE:
             return simpleInstruction("OP_DIVIDE", offset);
+        case OP_CALL_NATIVE:
+            return nativeInstruction("OP_CALL_NATIVE", chunk, offset);
         case OP_RETURN:
             return simpleInstruction("OP_RETURN", offset);
+        case OP_POP:
+            return simpleInstruction("OP_POP", offset);
+        case OP_GET_LOCAL:
+            return byteInstruction("OP_GET_LOCAL", chunk, offset);
+        case OP_SET_LOCAL:
+            return byteInstruction("OP_SET_LOCAL", chunk, offset);
+        case OP_DEFINE_GLOBAL:
+            return globalInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+        case OP_GET_GLOBAL:
+            return cachedGlobalInstruction("OP_GET_GLOBAL", chunk, offset);
+        case OP_SET_GLOBAL:
+            return cachedGlobalInstruction("OP_SET_GLOBAL", chunk, offset);
+        case OP_EQUAL:
+            return simpleInstruction("OP_EQUAL", offset);
+        case OP_GREATER:
+            return simpleInstruction("OP_GREATER", offset);
+        case OP_LESS:
+            return simpleInstruction("OP_LESS", offset);
+        case OP_NOT:
+            return simpleInstruction("OP_NOT", offset);
+        case OP_JUMP:
+            return jumpInstruction("OP_JUMP", 1, chunk, offset);
+        case OP_JUMP_IF_FALSE:
+            return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+        case OP_LOOP:
+            return jumpInstruction("OP_LOOP", -1, chunk, offset);
+        case OP_CALL:
+            return byteInstruction("OP_CALL", chunk, offset);
+        case OP_CLOSURE:
+            return closureInstruction("OP_CLOSURE", chunk, offset);
+        case OP_GET_UPVALUE:
+            return byteInstruction("OP_GET_UPVALUE", chunk, offset);
+        case OP_SET_UPVALUE:
+            return byteInstruction("OP_SET_UPVALUE", chunk, offset);
+        case OP_CLOSE_UPVALUE:
+            return simpleInstruction("OP_CLOSE_UPVALUE", offset);
+        case OP_ADD_CONSTANT:
+            return constantInstruction("OP_ADD_CONSTANT", chunk, offset);
+        case OP_SUBTRACT_CONSTANT:
+            return constantInstruction("OP_SUBTRACT_CONSTANT", chunk, offset);
+        case OP_MULTIPLY_CONSTANT:
+            return constantInstruction("OP_MULTIPLY_CONSTANT", chunk, offset);
+        case OP_DIVIDE_CONSTANT:
+            return constantInstruction("OP_DIVIDE_CONSTANT", chunk, offset);
         default:
             printf("Unknown opcode %d\n", instruction);
             return offset + 1;
@@ -59,3 +180,15 @@ void disassembleChunk(Chunk* chunk, const char* name) {
         offset = disassembleInstruction(chunk, offset);
     }
 }
+
+void traceInstruction(Chunk* chunk, int offset, Value* stack, Value* stackTop, void* context) {
+    (void)context;
+    printf("          ");
+    for (Value* slot = stack; slot < stackTop; slot++) {
+        printf("[ ");
+        printValue(*slot);
+        printf(" ]");
+    }
+    printf("\n");
+    disassembleInstruction(chunk, offset);
+}
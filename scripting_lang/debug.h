@@ -7,5 +7,7 @@
 
 void disassembleChunk(Chunk* chunk, const char* name);
 int disassembleInstruction(Chunk* chunk, int offset);
+// InstructionHookFn behind --trace: prints the stack, then the instruction.
+void traceInstruction(Chunk* chunk, int offset, Value* stack, Value* stackTop, void* context);
 
 #endif
@@ -0,0 +1,565 @@
+/* image.c - Writes chunks to .csc images and maps them back in */
+#define _POSIX_C_SOURCE 200809L // mmap, fstat and getpid under -std=c99
+#include "image.h"
+#include "object.h"
+#include "vm.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// --- Image Layout ---
+// [ImageHeader][code bytes][line runs][constants][natives]
+// The header carries a hash of everything after it (hashBody), so an image
+// changed on disk is recompiled rather than trusted.
+// Everything is in host byte order: an image from a machine of the other
+// endianness fails the magic check and is simply recompiled.
+//   line run:  LineStart as in memory (two ints)
+//   constant:  [tag:1], then [number:8] for NUMBER, [length:4][chars] for STRING
+//              or a function body for FUNCTION
+//   function:  [arity:1][upvalue count:1][name length:4][name]
+//              [code length:4][line count:4][constant count:4][code][line runs][constants]
+//   native:    [index:1][name length:1][name]; one per native the code (of
+//              the script or any function in it) calls, so an image never
+//              runs against a host with another native table.
+
+#define IMAGE_MAGIC 0x31435343 // "CSC1" read as a little-endian uint32
+#define IMAGE_OPTIMIZED 0x1    // Compiled with -O
+#define IMAGE_NESTING_MAX 256  // Deeper function nesting is treated as malformed
+
+typedef enum {
+    IMAGE_NIL,
+    IMAGE_FALSE,
+    IMAGE_TRUE,
+    IMAGE_NUMBER,
+    IMAGE_STRING,
+    IMAGE_FUNCTION,
+} ImageTag;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t flags;
+    uint32_t codeLength;
+    uint32_t lineCount;
+    uint32_t constantCount;
+    uint32_t nativeCount;
+    uint32_t padding; // Keeps the struct free of compiler-inserted padding
+    uint64_t bodyHash; // hashBody() of the bytes after the header
+} ImageHeader;
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+uint64_t hashSource(const char* source, size_t length) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)source[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// FNV-1a style, but eight bytes per multiply: it runs on every load, over
+// the whole image. The shift folds the high bits back into the low ones,
+// which a multiply alone never changes.
+static uint64_t hashBody(const uint8_t* bytes, size_t length) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word)); // The mapping gives no alignment guarantee
+        hash = (hash ^ word) * FNV_PRIME;
+        hash ^= hash >> 32;
+    }
+    for (; i < length; i++) hash = (hash ^ bytes[i]) * FNV_PRIME;
+    return hash;
+}
+
+// --- Writing ---
+
+// Marks the natives 'chunk' and the functions in its pool call, by index.
+static void findCalledNatives(Chunk* chunk, bool called[], uint32_t* count) {
+    for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) {
+        if (chunk->code[offset] != OP_CALL_NATIVE) continue;
+        uint8_t native = chunk->code[offset + 1];
+        if (!called[native]) (*count)++;
+        called[native] = true;
+    }
+    for (int i = 0; i < chunk->constants.count; i++) {
+        Value value = chunk->constants.values[i];
+        if (IS_FUNCTION(value)) findCalledNatives(&AS_FUNCTION(value)->chunk, called, count);
+    }
+}
+
+static void writeConstants(FILE* file, Chunk* chunk);
+
+static void writeFunction(FILE* file, ObjFunction* function) {
+    uint8_t counts[2] = {(uint8_t)function->arity, (uint8_t)function->upvalueCount};
+    fwrite(counts, 1, 2, file);
+    uint32_t nameLength = (uint32_t)function->name->length;
+    fwrite(&nameLength, sizeof(nameLength), 1, file);
+    fwrite(function->name->chars, 1, nameLength, file);
+
+    Chunk* chunk = &function->chunk;
+    uint32_t lengths[3] = {(uint32_t)chunk->count, (uint32_t)chunk->lineCount, (uint32_t)chunk->constants.count};
+    fwrite(lengths, sizeof(uint32_t), 3, file);
+    fwrite(chunk->code, 1, chunk->count, file);
+    fwrite(chunk->lines, sizeof(LineStart), chunk->lineCount, file);
+    writeConstants(file, chunk);
+}
+
+static void writeConstants(FILE* file, Chunk* chunk) {
+    for (int i = 0; i < chunk->constants.count; i++) {
+        Value value = chunk->constants.values[i];
+        uint8_t tag = IS_NUMBER(value)   ? IMAGE_NUMBER
+                    : IS_STRING(value)   ? IMAGE_STRING
+                    : IS_FUNCTION(value) ? IMAGE_FUNCTION
+                    : IS_NIL(value)      ? IMAGE_NIL
+                    : AS_BOOL(value)     ? IMAGE_TRUE : IMAGE_FALSE;
+        fwrite(&tag, 1, 1, file);
+        if (tag == IMAGE_NUMBER) {
+            double number = AS_NUMBER(value);
+            fwrite(&number, sizeof(number), 1, file);
+        } else if (tag == IMAGE_STRING) {
+            uint32_t length = (uint32_t)AS_STRING(value)->length;
+            fwrite(&length, sizeof(length), 1, file);
+            fwrite(AS_CSTRING(value), 1, length, file);
+        } else if (tag == IMAGE_FUNCTION) {
+            writeFunction(file, AS_FUNCTION(value));
+        }
+    }
+}
+
+// Reads back what was written after the header, hashes it, then writes the header for real
+static bool finishHeader(FILE* file, ImageHeader* header) {
+    if (fflush(file) != 0) return false;
+    long end = ftell(file);
+    if (end < (long)sizeof(*header) || fseek(file, (long)sizeof(*header), SEEK_SET) != 0) return false;
+    size_t length = (size_t)end - sizeof(*header);
+    uint8_t* body = (uint8_t*)malloc(length > 0 ? length : 1);
+    if (body == NULL) return false;
+    bool complete = fread(body, 1, length, file) == length;
+    header->bodyHash = hashBody(body, length);
+    free(body);
+    if (!complete || fseek(file, 0, SEEK_SET) != 0) return false;
+    return fwrite(header, sizeof(*header), 1, file) == 1;
+}
+
+bool saveImage(Chunk* chunk, uint64_t sourceHash, const char* path) {
+    bool called[NATIVES_MAX] = {false};
+    uint32_t nativeCount = 0;
+    findCalledNatives(chunk, called, &nativeCount);
+
+    ImageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = IMAGE_MAGIC;
+    header.version = IMAGE_VERSION;
+    header.sourceHash = sourceHash;
+    header.flags = optimizationEnabled() ? IMAGE_OPTIMIZED : 0;
+    header.codeLength = (uint32_t)chunk->count;
+    header.lineCount = (uint32_t)chunk->lineCount;
+    header.constantCount = (uint32_t)chunk->constants.count;
+    header.nativeCount = nativeCount;
+
+    // Niche C: write to a private name, then rename(): readers never see half an image.
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", path, (long)getpid());
+    FILE* file = fopen(temporary, "w+b"); // Read back once to hash the body
+    if (file == NULL) {
+        fprintf(stderr, "Could not write \"%s\".\n", temporary);
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, file); // Placeholder until the body hash is known
+    fwrite(chunk->code, 1, chunk->count, file);
+    fwrite(chunk->lines, sizeof(LineStart), chunk->lineCount, file);
+    writeConstants(file, chunk);
+    for (int native = 0; native < NATIVES_MAX; native++) {
+        if (!called[native]) continue;
+        const char* name = nativeName(native);
+        uint8_t entry[2] = {(uint8_t)native, (uint8_t)strlen(name)};
+        fwrite(entry, 1, 2, file);
+        fwrite(name, 1, entry[1], file);
+    }
+
+    bool written = !ferror(file) && finishHeader(file, &header);
+    if (fclose(file) != 0) written = false;
+    if (!written || rename(temporary, path) != 0) {
+        fprintf(stderr, "Could not write \"%s\".\n", path);
+        remove(temporary);
+        return false;
+    }
+    return true;
+}
+
+// --- Reading ---
+
+// Bounds-checked cursor over the mapped file
+typedef struct {
+    const uint8_t* at;
+    const uint8_t* end;
+} Reader;
+
+static bool readBytes(Reader* reader, void* out, size_t size) {
+    if ((size_t)(reader->end - reader->at) < size) return false;
+    memcpy(out, reader->at, size); // The mapping gives no alignment guarantee past the header
+    reader->at += size;
+    return true;
+}
+
+static bool readConstants(Reader* reader, Chunk* chunk, uint32_t count, int depth);
+
+// Code and line table: copied into the chunk's own arrays, so the chunk
+// behaves exactly like a compiled one (and outlives the mapping).
+static bool readChunk(Reader* reader, Chunk* chunk, uint32_t codeLength, uint32_t lineCount,
+                      uint32_t constantCount, int depth) {
+    if (codeLength == 0 || lineCount == 0) return false;
+    size_t remaining = (size_t)(reader->end - reader->at); // Before trusting the sizes
+    if (remaining < codeLength || (remaining - codeLength) / sizeof(LineStart) < lineCount) return false;
+    chunk->code = (uint8_t*)malloc(codeLength);
+    chunk->lines = (LineStart*)malloc(sizeof(LineStart) * lineCount);
+    if (chunk->code == NULL || chunk->lines == NULL) return false;
+    chunk->count = chunk->capacity = (int)codeLength;
+    chunk->lineCount = chunk->lineCapacity = (int)lineCount;
+    if (!readBytes(reader, chunk->code, codeLength)) return false;
+    if (!readBytes(reader, chunk->lines, sizeof(LineStart) * lineCount)) return false;
+    return readConstants(reader, chunk, constantCount, depth);
+}
+
+static bool readFunction(Reader* reader, Chunk* parent, int depth) {
+    if (depth == IMAGE_NESTING_MAX) return false;
+    uint8_t counts[2];
+    uint32_t nameLength;
+    if (!readBytes(reader, counts, 2) || !readBytes(reader, &nameLength, sizeof(nameLength))) return false;
+    if ((size_t)(reader->end - reader->at) < nameLength) return false;
+
+    // Into the parent's pool before anything else allocates: that roots it
+    ObjFunction* function = newFunction();
+    writeValueArray(&parent->constants, OBJ_VAL(function));
+    gcBarrier(OBJ_VAL(function));
+    function->arity = counts[0];
+    function->upvalueCount = counts[1];
+    function->name = copyString((const char*)reader->at, (int)nameLength);
+    reader->at += nameLength;
+
+    uint32_t lengths[3];
+    if (!readBytes(reader, lengths, sizeof(lengths))) return false;
+    return readChunk(reader, &function->chunk, lengths[0], lengths[1], lengths[2], depth + 1);
+}
+
+static bool readConstants(Reader* reader, Chunk* chunk, uint32_t count, int depth) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t tag;
+        if (!readBytes(reader, &tag, 1)) return false;
+        switch (tag) {
+            case IMAGE_NIL:    writeValueArray(&chunk->constants, NIL_VAL); break;
+            case IMAGE_FALSE:  writeValueArray(&chunk->constants, BOOL_VAL(false)); break;
+            case IMAGE_TRUE:   writeValueArray(&chunk->constants, BOOL_VAL(true)); break;
+            case IMAGE_NUMBER: {
+                double number;
+                if (!readBytes(reader, &number, sizeof(number))) return false;
+                writeValueArray(&chunk->constants, NUMBER_VAL(number));
+                break;
+            }
+            case IMAGE_STRING: {
+                // Interned straight from the mapping; the chunk's pool roots it at once
+                uint32_t length;
+                if (!readBytes(reader, &length, sizeof(length))) return false;
+                if ((size_t)(reader->end - reader->at) < length) return false;
+                ObjString* string = copyString((const char*)reader->at, (int)length);
+                reader->at += length;
+                writeValueArray(&chunk->constants, OBJ_VAL(string));
+                gcBarrier(OBJ_VAL(string));
+                break;
+            }
+            case IMAGE_FUNCTION:
+                if (!readFunction(reader, chunk, depth)) return false;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+static int constantOperand(Chunk* chunk, int offset) {
+    uint8_t op = chunk->code[offset];
+    switch (op) {
+        case OP_DEFINE_GLOBAL:
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_CLOSURE:
+            return (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+        case OP_CONSTANT_LONG:
+            return (chunk->code[offset + 1] << 16) | (chunk->code[offset + 2] << 8) | chunk->code[offset + 3];
+        case OP_CONSTANT:
+        case OP_ADD_CONSTANT:
+        case OP_SUBTRACT_CONSTANT:
+        case OP_MULTIPLY_CONSTANT:
+        case OP_DIVIDE_CONSTANT:
+            return chunk->code[offset + 1];
+        default:
+            return -1;
+    }
+}
+
+// Values the instruction at 'offset' pops (or, for peeks, needs) and pushes.
+// OP_RETURN pops its result and ends the path, so 'pushes' is unused there.
+static void stackEffect(Chunk* chunk, int offset, int* pops, int* pushes) {
+    uint8_t op = chunk->code[offset];
+    *pops = 0;
+    *pushes = 0;
+    switch (op) {
+        case OP_CONSTANT:
+        case OP_CONSTANT_LONG:
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_GET_LOCAL:
+        case OP_GET_GLOBAL:
+        case OP_CLOSURE:
+        case OP_GET_UPVALUE:
+            *pushes = 1;
+            break;
+        case OP_NEGATE:
+        case OP_NOT:
+        case OP_SET_LOCAL:
+        case OP_SET_GLOBAL:
+        case OP_SET_UPVALUE:
+        case OP_JUMP_IF_FALSE:
+        case OP_ADD_CONSTANT:
+        case OP_SUBTRACT_CONSTANT:
+        case OP_MULTIPLY_CONSTANT:
+        case OP_DIVIDE_CONSTANT:
+            *pops = *pushes = 1; // In place, or a peek
+            break;
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_EQUAL:
+        case OP_GREATER:
+        case OP_LESS:
+            *pops = 2;
+            *pushes = 1;
+            break;
+        case OP_POP:
+        case OP_DEFINE_GLOBAL:
+        case OP_CLOSE_UPVALUE:
+        case OP_RETURN:
+            *pops = 1;
+            break;
+        case OP_CALL_NATIVE:
+            *pops = chunk->code[offset + 2]; // The arguments
+            *pushes = 1;
+            break;
+        case OP_CALL:
+            *pops = chunk->code[offset + 1] + 1; // The callee and its arguments
+            *pushes = 1;
+            break;
+        default: // OP_JUMP, OP_LOOP
+            break;
+    }
+}
+
+// Walks every path through 'chunk' from its entry with 'entryHeight'
+// values in the frame (the callee and arguments, none for the script) and
+// checks the stack never drops below the frame, never grows past the
+// UINT8_COUNT slots a call reserves, that paths meeting at an instruction
+// agree on its height, that every local or captured slot exists, and that
+// no path runs off the end of the code. Expects the other checks passed.
+static bool checkStackHeights(Chunk* chunk, int entryHeight) {
+    int* heights = (int*)malloc(sizeof(int) * chunk->count); // -1 = not reached yet
+    int* pending = (int*)malloc(sizeof(int) * chunk->count); // Each offset is queued at most once
+    if (heights == NULL || pending == NULL) {
+        free(heights);
+        free(pending);
+        return false;
+    }
+    for (int i = 0; i < chunk->count; i++) heights[i] = -1;
+
+    bool valid = true;
+    int pendingCount = 0;
+    heights[0] = entryHeight;
+    pending[pendingCount++] = 0;
+    while (valid && pendingCount > 0) {
+        int offset = pending[--pendingCount];
+        int height = heights[offset];
+        uint8_t op = chunk->code[offset];
+        int pops, pushes;
+        stackEffect(chunk, offset, &pops, &pushes);
+        if (height < pops) {
+            valid = false;
+            break;
+        }
+        if ((op == OP_GET_LOCAL || op == OP_SET_LOCAL) && chunk->code[offset + 1] >= height) valid = false;
+        int length = instructionLength(chunk, offset);
+        for (int i = offset + 3; op == OP_CLOSURE && i < offset + length; i += 2) {
+            if (chunk->code[i] && chunk->code[i + 1] >= height) valid = false; // [isLocal, index]
+        }
+        if (op == OP_RETURN) continue;
+
+        height += pushes - pops;
+        if (height > UINT8_COUNT) valid = false;
+
+        // Successors: the next instruction unless the jump is unconditional, and the target
+        int successors[2];
+        int successorCount = 0;
+        if (op != OP_JUMP && op != OP_LOOP) successors[successorCount++] = offset + length;
+        if (op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_LOOP) {
+            int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+            successors[successorCount++] = op == OP_LOOP ? offset + 3 - jump : offset + 3 + jump;
+        }
+        for (int i = 0; valid && i < successorCount; i++) {
+            int next = successors[i];
+            if (next >= chunk->count) {
+                valid = false; // Falls off the end of the code
+            } else if (heights[next] == -1) {
+                heights[next] = height;
+                pending[pendingCount++] = next;
+            } else if (heights[next] != height) {
+                valid = false;
+            }
+        }
+    }
+    free(heights);
+    free(pending);
+    return valid;
+}
+
+// Makes sure no instruction of 'chunk' (or of the functions in its pool)
+// reads past the code, the pool, its closure's upvalues or its stack frame,
+// and that every jump lands on an instruction; empties the inline caches on
+// the way. 'upvalueCount' and 'entryHeight' describe the owning function.
+static bool validateChunk(Chunk* chunk, int upvalueCount, int entryHeight, bool verified[]) {
+    bool* starts = (bool*)calloc(chunk->count, sizeof(bool));
+    if (starts == NULL) return false;
+    bool valid = true;
+    int offset = 0;
+    while (valid && offset < chunk->count) {
+        starts[offset] = true;
+        uint8_t op = chunk->code[offset];
+        if (op > OP_DIVIDE_CONSTANT) { // Past the last opcode: the dispatch table has no entry
+            valid = false;
+            break;
+        }
+        int length;
+        if (op == OP_CLOSURE) {
+            // Its length depends on the function constant, so check that first
+            int constant = offset + 3 <= chunk->count ? constantOperand(chunk, offset) : -1;
+            if (constant < 0 || constant >= chunk->constants.count ||
+                !IS_FUNCTION(chunk->constants.values[constant])) {
+                valid = false;
+                break;
+            }
+            length = 3 + 2 * AS_FUNCTION(chunk->constants.values[constant])->upvalueCount;
+        } else {
+            length = instructionLength(chunk, offset);
+        }
+        if (offset + length > chunk->count) {
+            valid = false;
+            break;
+        }
+
+        int constant = constantOperand(chunk, offset);
+        if (constant >= chunk->constants.count) valid = false;
+        bool isGlobal = op == OP_DEFINE_GLOBAL || op == OP_GET_GLOBAL || op == OP_SET_GLOBAL;
+        if (isGlobal && valid && !IS_STRING(chunk->constants.values[constant])) valid = false; // The VM trusts the name
+        if (op == OP_CALL_NATIVE && !verified[chunk->code[offset + 1]]) valid = false;
+        if (op == OP_GET_GLOBAL || op == OP_SET_GLOBAL) {
+            memset(chunk->code + offset + 3, 0, GLOBAL_CACHE_BYTES); // Caches are per process: start empty
+        }
+        if ((op == OP_GET_UPVALUE || op == OP_SET_UPVALUE) && chunk->code[offset + 1] >= upvalueCount) valid = false;
+        for (int i = offset + 3; op == OP_CLOSURE && i < offset + length; i += 2) {
+            // [isLocal, index]: a captured enclosing upvalue must exist
+            if (!chunk->code[i] && chunk->code[i + 1] >= upvalueCount) valid = false;
+        }
+        offset += length;
+    }
+
+    // Second pass, now that every instruction start is known
+    for (offset = 0; valid && offset < chunk->count; offset++) {
+        if (!starts[offset]) continue;
+        uint8_t op = chunk->code[offset];
+        if (op != OP_JUMP && op != OP_JUMP_IF_FALSE && op != OP_LOOP) continue;
+        int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+        int target = op == OP_LOOP ? offset + 3 - jump : offset + 3 + jump;
+        if (target < 0 || target >= chunk->count || !starts[target]) valid = false;
+    }
+    free(starts);
+    if (valid) valid = checkStackHeights(chunk, entryHeight);
+
+    for (int i = 0; valid && i < chunk->constants.count; i++) {
+        Value value = chunk->constants.values[i];
+        if (!IS_FUNCTION(value)) continue;
+        ObjFunction* function = AS_FUNCTION(value);
+        valid = validateChunk(&function->chunk, function->upvalueCount, function->arity + 1, verified);
+    }
+    return valid;
+}
+
+static bool readImage(Chunk* chunk, uint64_t sourceHash, Reader* reader) {
+    ImageHeader header;
+    if (!readBytes(reader, &header, sizeof(header))) return false;
+    if (header.magic != IMAGE_MAGIC || header.version != IMAGE_VERSION) return false;
+    if (header.sourceHash != sourceHash) return false;
+    if (hashBody(reader->at, (size_t)(reader->end - reader->at)) != header.bodyHash) return false;
+    if (optimizationEnabled() && !(header.flags & IMAGE_OPTIMIZED)) return false;
+    if (!readChunk(reader, chunk, header.codeLength, header.lineCount, header.constantCount, 0)) return false;
+
+    // Every native the code calls must sit at the same index in this host
+    bool verified[UINT8_COUNT] = {false};
+    for (uint32_t i = 0; i < header.nativeCount; i++) {
+        uint8_t entry[2];
+        char name[UINT8_COUNT];
+        if (!readBytes(reader, entry, 2) || !readBytes(reader, name, entry[1])) return false;
+        if (findNative(name, entry[1]) != entry[0]) return false;
+        verified[entry[0]] = true;
+    }
+
+    // Last, check the code itself
+    return validateChunk(chunk, 0, 0, verified) && reader->at == reader->end;
+}
+
+// Empties the chunks of the functions a failed load left in 'chunk's pool:
+// the objects live on until the next collection, and nothing may walk
+// unvalidated code meanwhile.
+static void discardFunctions(Chunk* chunk) {
+    for (int i = 0; i < chunk->constants.count; i++) {
+        Value value = chunk->constants.values[i];
+        if (!IS_FUNCTION(value)) continue;
+        discardFunctions(&AS_FUNCTION(value)->chunk);
+        freeChunk(&AS_FUNCTION(value)->chunk);
+    }
+}
+
+bool loadImage(Chunk* chunk, uint64_t sourceHash, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ImageHeader)) {
+        close(fd);
+        return false;
+    }
+
+    // Niche C: mmap instead of read(): no stdio buffer and no copy of the
+    // whole file, only of the sections. The mapping is gone before we return.
+    size_t size = (size_t)info.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    Reader reader = {(const uint8_t*)mapping, (const uint8_t*)mapping + size};
+    bool loaded = readImage(chunk, sourceHash, &reader);
+    munmap(mapping, size);
+    if (!loaded) {
+        discardFunctions(chunk);
+        freeChunk(chunk); // Back to empty
+    }
+    return loaded;
+}
@@ -0,0 +1,36 @@
+/* image.h - Serialized chunk images (the .csc bytecode cache) */
+#ifndef CLOX_IMAGE_H
+#define CLOX_IMAGE_H
+
+#include "common.h"
+#include "chunk.h"
+
+// --- Configuration ---
+// Bump IMAGE_VERSION whenever the bytecode or the image layout changes:
+// images of any other version are treated as stale.
+#define IMAGE_VERSION 6
+
+// --- Public API ---
+
+// FNV-1a 64 of the script source; an image is only used for the source it was compiled from.
+uint64_t hashSource(const char* source, size_t length);
+
+/**
+ * @brief Writes 'chunk' to 'path' as a versioned image.
+ * The file is written under a temporary name and renamed into place, so a
+ * concurrent reader sees either the old image or the complete new one.
+ * @return false (after printing why) if the file could not be written.
+ */
+bool saveImage(Chunk* chunk, uint64_t sourceHash, const char* path);
+
+/**
+ * @brief Maps the image at 'path' and loads it into the (initialized, empty) chunk.
+ * @return false if the file is missing, of another version, for another
+ *         source, unoptimized while -O is on, built for natives this host
+ *         does not define at the same index, changed since it was written
+ *         (body hash) or malformed. The chunk is left
+ *         empty then and the caller compiles the source instead.
+ */
+bool loadImage(Chunk* chunk, uint64_t sourceHash, const char* path);
+
+#endif
@@ -0,0 +1,114 @@
+/* image_test.c - Checks that damaged .csc images are refused and the source recompiled */
+#include "common.h"
+#include "chunk.h"
+#include "compiler.h"
+#include "image.h"
+#include "object.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_IMAGE "image_test.csc"
+
+static const char* source =
+    "fun add(a, b) { return a + b; }\n"
+    "var x = add(1, 2);\n"
+    "x * 10\n";
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("%s  %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) failures++;
+}
+
+// What the script evaluates to when run from 'chunk' (NIL_VAL on an error)
+static Value runResult(Chunk* chunk) {
+    Value value;
+    return runChunk(chunk, &value) == INTERPRET_OK ? value : NIL_VAL;
+}
+
+static bool isExpected(Value value) {
+    return IS_NUMBER(value) && AS_NUMBER(value) == 30;
+}
+
+// Loads TEST_IMAGE the way cscript does: from the image if it is accepted,
+// otherwise by compiling the source again. Reports which one happened.
+static Value loadOrRecompile(bool* fromImage) {
+    uint64_t hash = hashSource(source, strlen(source));
+    Chunk chunk;
+    initChunk(&chunk);
+    *fromImage = loadImage(&chunk, hash, TEST_IMAGE);
+    if (!*fromImage && !compile(source, &chunk)) {
+        freeChunk(&chunk);
+        return NIL_VAL;
+    }
+    Value value = runResult(&chunk);
+    freeChunk(&chunk);
+    return value;
+}
+
+// Compiles the source, lets 'corrupt' change the chunk in memory, and saves
+// it: the image then has a valid body hash, so only validation can refuse it.
+static void saveCompiled(void (*corrupt)(Chunk* chunk)) {
+    Chunk chunk;
+    initChunk(&chunk);
+    if (!compile(source, &chunk)) {
+        fprintf(stderr, "Could not compile the test script.\n");
+        exit(1);
+    }
+    if (corrupt != NULL) corrupt(&chunk);
+    if (!saveImage(&chunk, hashSource(source, strlen(source)), TEST_IMAGE)) exit(1);
+    freeChunk(&chunk);
+}
+
+// OP_CLOSURE -> OP_EQUAL: pops two values off the script's empty stack
+static void underflowScript(Chunk* chunk) {
+    chunk->code[0] = OP_EQUAL;
+}
+
+// add's first OP_GET_LOCAL reads a slot above its frame (callee + 2 arguments)
+static void localOutsideFrame(Chunk* chunk) {
+    for (int i = 0; i < chunk->constants.count; i++) {
+        Value value = chunk->constants.values[i];
+        if (!IS_FUNCTION(value)) continue;
+        Chunk* body = &AS_FUNCTION(value)->chunk;
+        if (body->code[0] == OP_GET_LOCAL) body->code[1] = 9;
+    }
+}
+
+// Flips one bit of the image's last byte: part of the body, past every header field
+static void flipLastByte() {
+    FILE* file = fopen(TEST_IMAGE, "r+b");
+    if (file == NULL || fseek(file, -1, SEEK_END) != 0) exit(1);
+    int byte = fgetc(file);
+    if (byte == EOF || fseek(file, -1, SEEK_END) != 0) exit(1);
+    fputc(byte ^ 0x01, file);
+    fclose(file);
+}
+
+int main() {
+    initVM();
+    bool fromImage;
+
+    saveCompiled(NULL);
+    Value value = loadOrRecompile(&fromImage);
+    check(fromImage && isExpected(value), "an intact image is loaded and runs");
+
+    flipLastByte();
+    value = loadOrRecompile(&fromImage);
+    check(!fromImage && isExpected(value), "an image changed on disk is refused (body hash), source recompiled");
+
+    saveCompiled(underflowScript);
+    value = loadOrRecompile(&fromImage);
+    check(!fromImage && isExpected(value), "code popping an empty stack is refused, source recompiled");
+
+    saveCompiled(localOutsideFrame);
+    value = loadOrRecompile(&fromImage);
+    check(!fromImage && isExpected(value), "a local outside the function's frame is refused, source recompiled");
+
+    remove(TEST_IMAGE);
+    freeVM();
+    return failures == 0 ? 0 : 1;
+}
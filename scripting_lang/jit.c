@@ -0,0 +1,640 @@
+/* jit.c - Baseline JIT: a machine code template per bytecode instruction */
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS under -std=c99
+#include "jit.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Each instruction becomes a fixed template that does exactly what the
+// interpreter does, but with no dispatch, no operand decoding, and the
+// stack top in a register. The state the code keeps is the interpreter's
+// own (the VM stack and the frame's slots), so the code can be entered at
+// any instruction and left at any instruction: whatever a template does not
+// handle it hands back. Number operations check their operands first and
+// "bail out" to the interpreter, before changing anything, if one is not a
+// number; the interpreter then runs that instruction (string concatenation,
+// the type error) as usual.
+//
+// Register use in the generated code:
+//   rbx  stack top (vm.stackTop while inside)   r12  the frame's slots
+//   r13  QNAN, for NaN-boxed number checks      r14  &vm
+//   rax, rcx, rdx, xmm0, xmm1                   scratch
+
+// --- Machine Code Buffer ---
+
+typedef struct {
+    uint8_t* code;
+    int count;
+    int capacity;
+} Assembler;
+
+static void emitByte(Assembler* as, uint8_t byte) {
+    if (as->capacity < as->count + 1) {
+        as->capacity = (as->capacity < 256) ? 256 : as->capacity * 2;
+        as->code = (uint8_t*)realloc(as->code, as->capacity);
+        if (as->code == NULL) {
+            perror("realloc JIT buffer");
+            exit(1);
+        }
+    }
+    as->code[as->count++] = byte;
+}
+
+static void emit32(Assembler* as, uint32_t value) {
+    for (int i = 0; i < 4; i++) emitByte(as, (uint8_t)(value >> (8 * i)));
+}
+
+static void emit64(Assembler* as, uint64_t value) {
+    for (int i = 0; i < 8; i++) emitByte(as, (uint8_t)(value >> (8 * i)));
+}
+
+// Points the rel32 field ending at 'end' (the next instruction) at 'target'.
+static void patchRel32(Assembler* as, int end, int target) {
+    int32_t rel = target - end;
+    memcpy(as->code + end - 4, &rel, sizeof(rel));
+}
+
+// --- x86-64 Encoding ---
+
+typedef enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 } Register;
+#define XMM0 0
+#define XMM1 1
+
+typedef enum { CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_NP = 0xb } Condition;
+
+// SSE2 double arithmetic (F2 0F xx)
+#define SD_ADD 0x0f58
+#define SD_MUL 0x0f59
+#define SD_SUB 0x0f5c
+#define SD_DIV 0x0f5e
+
+// [prefix] [REX] opcode (one byte, or 0F xx), then a ModRM for 'reg'
+// (a register or an opcode extension) and 'rm' (a register if 'direct').
+static void emitOpcode(Assembler* as, uint8_t prefix, bool wide, uint16_t opcode, int reg, int rm) {
+    if (prefix != 0) emitByte(as, prefix);
+    uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+    if (rex != 0x40) emitByte(as, rex);
+    if (opcode > 0xff) emitByte(as, (uint8_t)(opcode >> 8));
+    emitByte(as, (uint8_t)opcode);
+}
+
+// Register operand: "op reg, rm" with both in registers.
+static void emitReg(Assembler* as, uint8_t prefix, bool wide, uint16_t opcode, int reg, int rm) {
+    emitOpcode(as, prefix, wide, opcode, reg, rm);
+    emitByte(as, (uint8_t)(0xc0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// Memory operand: "op reg, [base + disp]".
+static void emitMem(Assembler* as, uint8_t prefix, bool wide, uint16_t opcode, int reg, Register base, int32_t disp) {
+    emitOpcode(as, prefix, wide, opcode, reg, base);
+    // rbp/r13 as a base always need a displacement; rsp/r12 always need a SIB byte
+    int mod = (disp == 0 && (base & 7) != RBP) ? 0 : (disp >= -128 && disp <= 127) ? 1 : 2;
+    emitByte(as, (uint8_t)((mod << 6) | ((reg & 7) << 3) | (base & 7)));
+    if ((base & 7) == RSP) emitByte(as, 0x24);
+    if (mod == 1) emitByte(as, (uint8_t)disp);
+    if (mod == 2) emit32(as, (uint32_t)disp);
+}
+
+static void loadQ(Assembler* as, Register dst, Register base, int32_t disp) {
+    emitMem(as, 0, true, 0x8b, dst, base, disp); // mov dst, [base + disp]
+}
+
+static void storeQ(Assembler* as, Register base, int32_t disp, Register src) {
+    emitMem(as, 0, true, 0x89, src, base, disp); // mov [base + disp], src
+}
+
+static void movImm64(Assembler* as, Register dst, uint64_t imm) {
+    emitOpcode(as, 0, true, (uint16_t)(0xb8 + (dst & 7)), 0, dst); // mov dst, imm64
+    emit64(as, imm);
+}
+
+// add/sub reg, imm8
+static void addImm(Assembler* as, Register reg, int8_t imm) {
+    emitReg(as, 0, true, 0x83, 0, reg);
+    emitByte(as, (uint8_t)imm);
+}
+
+static void subImm(Assembler* as, Register reg, int8_t imm) {
+    emitReg(as, 0, true, 0x83, 5, reg);
+    emitByte(as, (uint8_t)imm);
+}
+
+// mov qword [base + disp], imm: one store if it sign-extends from 32 bits
+static void storeImm(Assembler* as, Register base, int32_t disp, uint64_t imm) {
+    if ((int64_t)imm == (int32_t)imm) {
+        emitMem(as, 0, true, 0xc7, 0, base, disp);
+        emit32(as, (uint32_t)imm);
+    } else {
+        movImm64(as, RAX, imm);
+        storeQ(as, base, disp, RAX);
+    }
+}
+
+static void setcc(Assembler* as, Condition cc, Register dst) {
+    emitReg(as, 0, false, (uint16_t)(0x0f90 | cc), 0, dst); // set<cc> dst8 (al, cl or dl)
+}
+
+static void pushReg(Assembler* as, Register reg) {
+    if (reg & 8) emitByte(as, 0x41);
+    emitByte(as, (uint8_t)(0x50 + (reg & 7)));
+}
+
+static void popReg(Assembler* as, Register reg) {
+    if (reg & 8) emitByte(as, 0x41);
+    emitByte(as, (uint8_t)(0x58 + (reg & 7)));
+}
+
+// --- Value Layout ---
+
+#define VALUE_SIZE ((int)sizeof(Value))
+#define VALUE_WORDS (VALUE_SIZE / 8)
+#ifdef CSCRIPT_NAN_BOXING
+#define PAYLOAD 0                            // Offset of a number's double in a Value
+#define VALUE_SHIFT 3                        // log2(VALUE_SIZE)
+#else
+#define PAYLOAD ((int)offsetof(Value, as))
+#define VALUE_SHIFT 4
+#endif
+
+// Stack slot 'n' below the top: TOP(1) is the top value
+#define TOP(n) (-(n) * VALUE_SIZE)
+
+// Offsets of the VM fields the code reads, from r14
+#define VM_STACK_TOP      ((int32_t)offsetof(VM, stackTop))
+#define VM_GLOBAL_VERSION ((int32_t)offsetof(VM, globalVersion))
+#define VM_GLOBAL_VALUES  ((int32_t)(offsetof(VM, globalValues) + offsetof(ValueArray, values)))
+#define VM_POLL_COUNTDOWN ((int32_t)offsetof(VM, jitPollCountdown))
+
+// --- The Translator ---
+
+// A rel32 to patch once the code for bytecode offset 'target' exists.
+typedef struct {
+    int end;    // Where the jump instruction ends
+    int target;
+} Fixup;
+
+typedef struct {
+    Fixup* fixups;
+    int count;
+    int capacity;
+} FixupArray;
+
+typedef struct {
+    Assembler as;
+    Chunk* chunk;
+    int* entries;
+    int offset;       // Bytecode offset being translated
+    int exit;         // The shared exit sequence
+    FixupArray jumps; // To the code of a bytecode offset
+    FixupArray bails; // To a bail-out stub for a bytecode offset, in offset order
+} JitCompiler;
+
+static void addFixup(FixupArray* array, int end, int target) {
+    if (array->capacity < array->count + 1) {
+        array->capacity = (array->capacity < 16) ? 16 : array->capacity * 2;
+        array->fixups = (Fixup*)realloc(array->fixups, sizeof(Fixup) * array->capacity);
+        if (array->fixups == NULL) {
+            perror("realloc JIT fixups");
+            exit(1);
+        }
+    }
+    array->fixups[array->count].end = end;
+    array->fixups[array->count].target = target;
+    array->count++;
+}
+
+// Leaves the code: the interpreter resumes at bytecode offset 'offset'.
+static void exitTo(JitCompiler* c, int offset, bool poll) {
+    emitByte(&c->as, (uint8_t)(0xb8 + RAX)); // mov eax, imm32
+    emit32(&c->as, (uint32_t)((offset << 1) | (poll ? JIT_EXIT_POLL : 0)));
+    emitByte(&c->as, 0xe9); // jmp rel32
+    emit32(&c->as, 0);
+    patchRel32(&c->as, c->as.count, c->exit);
+}
+
+// Jumps to bytecode offset 'target' (always, or if 'cc' holds).
+static void jumpTo(JitCompiler* c, int target, bool conditional, Condition cc) {
+    if (conditional) {
+        emitByte(&c->as, 0x0f);
+        emitByte(&c->as, (uint8_t)(0x80 | cc));
+    } else {
+        emitByte(&c->as, 0xe9);
+    }
+    emit32(&c->as, 0);
+    addFixup(&c->jumps, c->as.count, target);
+}
+
+// Bails out of the current instruction if 'cc' holds: nothing is changed yet.
+static void bailIf(JitCompiler* c, Condition cc) {
+    emitByte(&c->as, 0x0f);
+    emitByte(&c->as, (uint8_t)(0x80 | cc));
+    emit32(&c->as, 0);
+    addFixup(&c->bails, c->as.count, c->offset);
+}
+
+// Bails out unless the Value at [rbx + disp] is a number.
+static void guardNumber(JitCompiler* c, int32_t disp) {
+#ifdef CSCRIPT_NAN_BOXING
+    loadQ(&c->as, RAX, RBX, disp);
+    emitReg(&c->as, 0, true, 0x21, R13, RAX); // and rax, r13
+    emitReg(&c->as, 0, true, 0x39, R13, RAX); // cmp rax, r13
+    bailIf(c, CC_E);                          // All QNAN bits set: not a number
+#else
+    emitMem(&c->as, 0, false, 0x83, 7, RBX, disp); // cmp dword [type], VAL_NUMBER
+    emitByte(&c->as, VAL_NUMBER);
+    bailIf(c, CC_NE);
+#endif
+}
+
+// Bails out if the Value at [rbx + disp] is an object (storing it somewhere
+// the collector may have scanned needs gcBarrier()).
+static void guardNotObject(JitCompiler* c, int32_t disp) {
+#ifdef CSCRIPT_NAN_BOXING
+    loadQ(&c->as, RAX, RBX, disp);
+    movImm64(&c->as, RCX, QNAN | SIGN_BIT);
+    emitReg(&c->as, 0, true, 0x21, RCX, RAX); // and rax, rcx
+    emitReg(&c->as, 0, true, 0x39, RCX, RAX); // cmp rax, rcx
+    bailIf(c, CC_E);
+#else
+    emitMem(&c->as, 0, false, 0x83, 7, RBX, disp); // cmp dword [type], VAL_OBJ
+    emitByte(&c->as, VAL_OBJ);
+    bailIf(c, CC_E);
+#endif
+}
+
+static void copyValue(Assembler* as, Register dst, int32_t dstDisp, Register src, int32_t srcDisp) {
+    for (int i = 0; i < VALUE_WORDS; i++) {
+        loadQ(as, RAX, src, srcDisp + 8 * i);
+        storeQ(as, dst, dstDisp + 8 * i, RAX);
+    }
+}
+
+// Stores the constant 'value' at [rbx + disp].
+static void storeValue(Assembler* as, int32_t disp, Value value) {
+    uint64_t words[VALUE_WORDS];
+#ifdef CSCRIPT_NAN_BOXING
+    words[0] = value;
+#else
+    // Padding and the union bytes a bool leaves unused: zeros, not whatever the pool held
+    Value clean;
+    memset(&clean, 0, sizeof(clean));
+    clean.type = value.type;
+    if (IS_BOOL(value)) {
+        clean.as.boolean = AS_BOOL(value);
+    } else if (IS_NUMBER(value)) {
+        clean.as.number = AS_NUMBER(value);
+    } else if (IS_OBJ(value)) {
+        clean.as.obj = AS_OBJ(value);
+    }
+    memcpy(words, &clean, sizeof(clean));
+#endif
+    for (int i = 0; i < VALUE_WORDS; i++) storeImm(as, RBX, disp + 8 * i, words[i]);
+}
+
+// Stores the bool in al (0 or 1) as a Value at [rbx + disp].
+static void storeBool(Assembler* as, int32_t disp) {
+    emitReg(as, 0, false, 0x0fb6, RAX, RAX); // movzx eax, al
+#ifdef CSCRIPT_NAN_BOXING
+    movImm64(as, RCX, FALSE_VAL);
+    emitReg(as, 0, true, 0x01, RCX, RAX);    // add rax, rcx: FALSE_VAL + 1 = TRUE_VAL
+    storeQ(as, RBX, disp, RAX);
+#else
+    storeQ(as, RBX, disp + PAYLOAD, RAX);
+    emitMem(as, 0, true, 0xc7, 0, RBX, disp); // mov qword [type], VAL_BOOL (and the padding)
+    emit32(as, VAL_BOOL);
+#endif
+}
+
+// al = isFalsey(the Value at [rbx + disp])
+static void emitFalsey(Assembler* as, int32_t disp) {
+#ifdef CSCRIPT_NAN_BOXING
+    loadQ(as, RDX, RBX, disp);
+    movImm64(as, RCX, NIL_VAL);
+    emitReg(as, 0, true, 0x39, RCX, RDX);  // cmp rdx, rcx
+    setcc(as, CC_E, RAX);
+    movImm64(as, RCX, FALSE_VAL);
+    emitReg(as, 0, true, 0x39, RCX, RDX);
+    setcc(as, CC_E, RCX);
+    emitReg(as, 0, false, 0x08, RCX, RAX); // or al, cl
+#else
+    emitMem(as, 0, false, 0x8b, RDX, RBX, disp); // mov edx, [type]
+    emitReg(as, 0, false, 0x83, 7, RDX);         // cmp edx, VAL_NIL
+    emitByte(as, VAL_NIL);
+    setcc(as, CC_E, RAX);
+    emitReg(as, 0, false, 0x83, 7, RDX);         // cmp edx, VAL_BOOL
+    emitByte(as, VAL_BOOL);
+    setcc(as, CC_E, RCX);
+    emitMem(as, 0, false, 0x80, 7, RBX, disp + PAYLOAD); // cmp byte [boolean], 0
+    emitByte(as, 0);
+    setcc(as, CC_E, RDX);
+    emitReg(as, 0, false, 0x20, RDX, RCX);       // and cl, dl
+    emitReg(as, 0, false, 0x08, RCX, RAX);       // or al, cl
+#endif
+}
+
+// rcx = the slot of the global an OP_GET_GLOBAL / OP_SET_GLOBAL names,
+// from its inline cache. A stale or empty cache bails out: the interpreter
+// does the lookup and fills it.
+static void globalSlot(JitCompiler* c) {
+    Assembler* as = &c->as;
+    movImm64(as, RAX, (uint64_t)(uintptr_t)(c->chunk->code + c->offset + 3));
+    emitMem(as, 0, false, 0x0fb7, RCX, RAX, (int32_t)offsetof(GlobalCache, version)); // movzx ecx, word
+    emitMem(as, 0, false, 0x0fb7, RDX, R14, VM_GLOBAL_VERSION);
+    emitReg(as, 0, false, 0x39, RDX, RCX);  // cmp ecx, edx
+    bailIf(c, CC_NE);
+    emitMem(as, 0, false, 0x0fb7, RAX, RAX, (int32_t)offsetof(GlobalCache, slot));
+    loadQ(as, RCX, R14, VM_GLOBAL_VALUES);
+    emitReg(as, 0, true, 0xc1, 4, RAX);     // shl rax, VALUE_SHIFT
+    emitByte(as, VALUE_SHIFT);
+    emitReg(as, 0, true, 0x01, RAX, RCX);   // add rcx, rax
+}
+
+static uint16_t readShort(Chunk* chunk, int offset) {
+    return (uint16_t)((chunk->code[offset] << 8) | chunk->code[offset + 1]);
+}
+
+// Function prologue, then the exit sequence every template leaves through.
+//   int code(Value* slots, uint8_t* entry)
+static void emitPrologue(JitCompiler* c) {
+    Assembler* as = &c->as;
+    pushReg(as, RBX);
+    pushReg(as, R12);
+    pushReg(as, R13);
+    pushReg(as, R14);
+    emitReg(as, 0, true, 0x89, RDI, R12); // mov r12, rdi
+    movImm64(as, R14, (uint64_t)(uintptr_t)&vm);
+    loadQ(as, RBX, R14, VM_STACK_TOP);
+#ifdef CSCRIPT_NAN_BOXING
+    movImm64(as, R13, QNAN);
+#endif
+    emitReg(as, 0, false, 0xff, 4, RSI);  // jmp rsi
+
+    c->exit = as->count;
+    storeQ(as, R14, VM_STACK_TOP, RBX);
+    popReg(as, R14);
+    popReg(as, R13);
+    popReg(as, R12);
+    popReg(as, RBX);
+    emitByte(as, 0xc3); // ret
+}
+
+static void translateInstruction(JitCompiler* c) {
+    Assembler* as = &c->as;
+    Chunk* chunk = c->chunk;
+    int offset = c->offset;
+    uint8_t* code = chunk->code;
+
+    switch (code[offset]) {
+        case OP_CONSTANT:
+            storeValue(as, 0, chunk->constants.values[code[offset + 1]]);
+            addImm(as, RBX, VALUE_SIZE);
+            break;
+        case OP_CONSTANT_LONG: {
+            int index = (code[offset + 1] << 16) | (code[offset + 2] << 8) | code[offset + 3];
+            storeValue(as, 0, chunk->constants.values[index]);
+            addImm(as, RBX, VALUE_SIZE);
+            break;
+        }
+        case OP_NIL:   storeValue(as, 0, NIL_VAL); addImm(as, RBX, VALUE_SIZE); break;
+        case OP_TRUE:  storeValue(as, 0, BOOL_VAL(true)); addImm(as, RBX, VALUE_SIZE); break;
+        case OP_FALSE: storeValue(as, 0, BOOL_VAL(false)); addImm(as, RBX, VALUE_SIZE); break;
+        case OP_POP:   subImm(as, RBX, VALUE_SIZE); break;
+
+        case OP_GET_LOCAL:
+            copyValue(as, RBX, 0, R12, code[offset + 1] * VALUE_SIZE);
+            addImm(as, RBX, VALUE_SIZE);
+            break;
+        case OP_SET_LOCAL:
+            copyValue(as, R12, code[offset + 1] * VALUE_SIZE, RBX, TOP(1));
+            break;
+
+        case OP_GET_GLOBAL:
+            globalSlot(c);
+            copyValue(as, RBX, 0, RCX, 0);
+            addImm(as, RBX, VALUE_SIZE);
+            break;
+        case OP_SET_GLOBAL:
+            guardNotObject(c, TOP(1));
+            globalSlot(c);
+            copyValue(as, RCX, 0, RBX, TOP(1));
+            break;
+
+        case OP_NEGATE:
+            guardNumber(c, TOP(1));
+            emitMem(as, 0, true, 0x0fba, 7, RBX, TOP(1) + PAYLOAD); // btc qword [number], 63
+            emitByte(as, 63);
+            break;
+
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE: {
+            static const uint16_t arithmetic[] = {
+                [OP_ADD] = SD_ADD, [OP_SUBTRACT] = SD_SUB, [OP_MULTIPLY] = SD_MUL, [OP_DIVIDE] = SD_DIV,
+            };
+            guardNumber(c, TOP(1));
+            guardNumber(c, TOP(2));
+            emitMem(as, 0xf2, false, 0x0f10, XMM0, RBX, TOP(2) + PAYLOAD); // movsd xmm0, a
+            emitMem(as, 0xf2, false, arithmetic[code[offset]], XMM0, RBX, TOP(1) + PAYLOAD);
+            emitMem(as, 0xf2, false, 0x0f11, XMM0, RBX, TOP(2) + PAYLOAD); // movsd a, xmm0
+            subImm(as, RBX, VALUE_SIZE);
+            break;
+        }
+
+        case OP_ADD_CONSTANT:
+        case OP_SUBTRACT_CONSTANT:
+        case OP_MULTIPLY_CONSTANT:
+        case OP_DIVIDE_CONSTANT: {
+            static const uint16_t arithmetic[] = {
+                [OP_ADD_CONSTANT] = SD_ADD, [OP_SUBTRACT_CONSTANT] = SD_SUB,
+                [OP_MULTIPLY_CONSTANT] = SD_MUL, [OP_DIVIDE_CONSTANT] = SD_DIV,
+            };
+            double b = AS_NUMBER(chunk->constants.values[code[offset + 1]]);
+            uint64_t bits;
+            memcpy(&bits, &b, sizeof(bits));
+            guardNumber(c, TOP(1));
+            emitMem(as, 0xf2, false, 0x0f10, XMM0, RBX, TOP(1) + PAYLOAD);
+            movImm64(as, RAX, bits);
+            emitReg(as, 0x66, true, 0x0f6e, XMM1, RAX); // movq xmm1, rax
+            emitReg(as, 0xf2, false, arithmetic[code[offset]], XMM0, XMM1);
+            emitMem(as, 0xf2, false, 0x0f11, XMM0, RBX, TOP(1) + PAYLOAD);
+            break;
+        }
+
+        // Numbers only; comparing anything else bails out. Unordered (NaN)
+        // sets ZF, PF and CF, so every comparison with a NaN is false.
+        case OP_EQUAL:
+        case OP_GREATER:
+        case OP_LESS: {
+            guardNumber(c, TOP(1));
+            guardNumber(c, TOP(2));
+            // a < b is b > a
+            int32_t left = (code[offset] == OP_LESS) ? TOP(1) : TOP(2);
+            int32_t right = (code[offset] == OP_LESS) ? TOP(2) : TOP(1);
+            emitMem(as, 0xf2, false, 0x0f10, XMM0, RBX, left + PAYLOAD);
+            emitMem(as, 0x66, false, 0x0f2e, XMM0, RBX, right + PAYLOAD); // ucomisd xmm0, right
+            if (code[offset] == OP_EQUAL) {
+                setcc(as, CC_E, RAX);
+                setcc(as, CC_NP, RCX);
+                emitReg(as, 0, false, 0x20, RCX, RAX); // and al, cl
+            } else {
+                setcc(as, CC_A, RAX);
+            }
+            storeBool(as, TOP(2));
+            subImm(as, RBX, VALUE_SIZE);
+            break;
+        }
+        case OP_NOT:
+            emitFalsey(as, TOP(1));
+            storeBool(as, TOP(1));
+            break;
+
+        case OP_JUMP:
+            jumpTo(c, offset + 3 + readShort(chunk, offset + 1), false, CC_E);
+            break;
+        case OP_JUMP_IF_FALSE:
+            emitFalsey(as, TOP(1));
+            emitReg(as, 0, false, 0x84, RAX, RAX); // test al, al
+            jumpTo(c, offset + 3 + readShort(chunk, offset + 1), true, CC_NE);
+            break;
+        case OP_LOOP: {
+            // Every JIT_POLL_INTERVAL back-edges the interpreter gets to poll the interrupt hook
+            int target = offset + 3 - readShort(chunk, offset + 1);
+            emitMem(as, 0, false, 0x83, 5, R14, VM_POLL_COUNTDOWN); // sub dword [countdown], 1
+            emitByte(as, 1);
+            jumpTo(c, target, true, CC_NE);
+            emitMem(as, 0, false, 0xc7, 0, R14, VM_POLL_COUNTDOWN);
+            emit32(as, JIT_POLL_INTERVAL);
+            exitTo(c, target, true);
+            break;
+        }
+
+        default:
+            // Calls, returns, closures, upvalues, natives, global definitions:
+            // the interpreter runs them
+            exitTo(c, offset, false);
+            break;
+    }
+}
+
+// Copies the finished code into a fresh mapping, then makes it executable.
+// Niche C: it is never writable and executable at once (W^X).
+static uint8_t* mapCode(Assembler* as, size_t* size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    *size = ((size_t)as->count + page - 1) / page * page;
+    void* code = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) return NULL;
+    memcpy(code, as->code, as->count);
+    if (mprotect(code, *size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, *size);
+        return NULL;
+    }
+    return (uint8_t*)code;
+}
+
+bool jitAvailable() {
+    return true;
+}
+
+JitCode* compileJit(Chunk* chunk) {
+    JitCompiler c;
+    memset(&c, 0, sizeof(c));
+    c.chunk = chunk;
+    c.entries = (int*)malloc(sizeof(int) * (chunk->count + 1));
+    if (c.entries == NULL) return NULL;
+    for (int i = 0; i <= chunk->count; i++) c.entries[i] = -1;
+
+    emitPrologue(&c);
+    for (c.offset = 0; c.offset < chunk->count; c.offset += instructionLength(chunk, c.offset)) {
+        c.entries[c.offset] = c.as.count;
+        translateInstruction(&c);
+    }
+    c.entries[chunk->count] = c.as.count; // Off the end: as far as the interpreter would get
+    exitTo(&c, chunk->count, false);
+
+    // Bail-out stubs, one per instruction that has guards
+    int stub = -1;
+    for (int i = 0; i < c.bails.count; i++) {
+        Fixup* bail = &c.bails.fixups[i];
+        if (i == 0 || bail->target != c.bails.fixups[i - 1].target) {
+            stub = c.as.count;
+            exitTo(&c, bail->target, false);
+        }
+        patchRel32(&c.as, bail->end, stub);
+    }
+
+    bool ok = true;
+    for (int i = 0; i < c.jumps.count; i++) {
+        Fixup* jump = &c.jumps.fixups[i];
+        if (jump->target < 0 || jump->target > chunk->count || c.entries[jump->target] < 0) {
+            ok = false; // Into the middle of an instruction: malformed code
+            break;
+        }
+        patchRel32(&c.as, jump->end, c.entries[jump->target]);
+    }
+
+    JitCode* jit = NULL;
+    if (ok) jit = (JitCode*)malloc(sizeof(JitCode));
+    if (jit != NULL) {
+        jit->code = mapCode(&c.as, &jit->size);
+        jit->entries = c.entries;
+        jit->count = chunk->count;
+        if (jit->code == NULL) {
+            free(jit);
+            jit = NULL;
+        }
+    }
+    if (jit == NULL) free(c.entries);
+    free(c.as.code);
+    free(c.jumps.fixups);
+    free(c.bails.fixups);
+    return jit;
+}
+
+typedef int (*JitFn)(Value* slots, uint8_t* entry);
+
+int runJit(JitCode* jit, Value* slots, int offset) {
+    if (offset < 0 || offset >= jit->count || jit->entries[offset] < 0) return offset << 1;
+    // Niche C: ISO C has no cast from a data pointer to a function pointer;
+    // copying the bits is what POSIX (dlsym) relies on as well.
+    JitFn function;
+    void* start = jit->code;
+    memcpy(&function, &start, sizeof(function));
+    return function(slots, jit->code + jit->entries[offset]);
+}
+
+void freeJitCode(JitCode* jit) {
+    if (jit == NULL) return;
+    munmap(jit->code, jit->size);
+    free(jit->entries);
+    free(jit);
+}
+
+#else
+// --- No JIT on this platform ---
+
+bool jitAvailable() {
+    return false;
+}
+
+JitCode* compileJit(Chunk* chunk) {
+    (void)chunk;
+    return NULL;
+}
+
+int runJit(JitCode* jit, Value* slots, int offset) {
+    (void)jit;
+    (void)slots;
+    return offset << 1;
+}
+
+void freeJitCode(JitCode* jit) {
+    (void)jit; // compileJit() never made one
+}
+
+#endif
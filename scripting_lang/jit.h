@@ -0,0 +1,51 @@
+/* jit.h - Baseline JIT: stack bytecode to x86-64 machine code */
+#ifndef CLOX_JIT_H
+#define CLOX_JIT_H
+
+#include "common.h"
+#include "chunk.h"
+
+// --- Configuration ---
+#define JIT_THRESHOLD 100       // Entries into a chunk's code before it is compiled
+#define JIT_POLL_INTERVAL 1024  // Loop back-edges in machine code between interrupt polls
+
+// runJit() result: the bytecode offset the interpreter resumes at, shifted
+// left by one, with JIT_EXIT_POLL set if the code only stopped for an
+// interrupt poll (and can be entered again at that offset).
+#define JIT_EXIT_POLL 1
+
+// Machine code for one chunk: a template per instruction, so it can be
+// entered at any instruction and left at any instruction.
+typedef struct JitCode {
+    uint8_t* code;   // Executable mapping
+    size_t size;     // Its length (whole pages)
+    int* entries;    // Per bytecode offset: offset of its machine code, -1 inside an instruction
+    int count;       // Bytecode length 'entries' covers
+} JitCode;
+
+// --- Public API ---
+
+// False where there is no JIT (compileJit() always fails): anything but x86-64 Linux.
+bool jitAvailable();
+
+/**
+ * @brief Translates 'chunk' to machine code.
+ * Instructions the templates do not cover (calls, closures, upvalues,
+ * natives, defining globals, returns) become exits to the interpreter, as
+ * does any number operation whose operands turn out not to be numbers.
+ * The chunk's code must not move or change after this, except for its
+ * inline caches, which the machine code reads as it runs.
+ * @return NULL if the JIT is unavailable or the code could not be mapped.
+ */
+JitCode* compileJit(Chunk* chunk);
+
+/**
+ * @brief Runs 'jit' from the instruction at 'offset', with 'slots' as the
+ * frame's locals and vm.stackTop as its stack, until it exits.
+ * @return The exit code described at JIT_EXIT_POLL; vm.stackTop is up to date.
+ */
+int runJit(JitCode* jit, Value* slots, int offset);
+
+void freeJitCode(JitCode* jit);
+
+#endif
@@ -18,6 +18,13 @@ static char advance() {
     return current[-1];
 }
 
+// Consumes the next character if it is 'expected' (two-character operators)
+static bool match(char expected) {
+    if (isAtEnd() || *current != expected) return false;
+    current++;
+    return true;
+}
+
 static Token makeToken(TokenType type) {
     Token token;
     token.type = type;
@@ -66,6 +73,12 @@ static bool isDigit(char c) {
     return c >= '0' && c <= '9';
 }
 
+static bool isAlpha(char c) {
+    return (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z') ||
+            c == '_';
+}
+
 static Token number() {
     while (isDigit(*current)) advance();
     if (*current == '.' && isDigit(current[1])) {
@@ -75,6 +88,65 @@ static Token number() {
     return makeToken(TOKEN_NUMBER);
 }
 
+// "..." may span lines; there are no escapes. The token includes the quotes.
+static Token string() {
+    while (*current != '"' && !isAtEnd()) {
+        if (*current == '\n') line++;
+        advance();
+    }
+    if (isAtEnd()) return errorToken("Unterminated string.");
+    advance(); // The closing quote
+    return makeToken(TOKEN_STRING);
+}
+
+// Is the rest of the current lexeme (from 'begin') exactly 'rest'?
+static TokenType checkKeyword(int begin, int length, const char* rest, TokenType type) {
+    if (current - start == begin + length && memcmp(start + begin, rest, length) == 0) {
+        return type;
+    }
+    return TOKEN_IDENTIFIER;
+}
+
+// Niche C: A hand-rolled trie (switch on the first letters) instead of a keyword table.
+static TokenType identifierType() {
+    switch (start[0]) {
+        case 'a': return checkKeyword(1, 2, "nd", TOKEN_AND);
+        case 'c': return checkKeyword(1, 4, "lass", TOKEN_CLASS);
+        case 'e': return checkKeyword(1, 3, "lse", TOKEN_ELSE);
+        case 'f':
+            if (current - start > 1) {
+                switch (start[1]) {
+                    case 'a': return checkKeyword(2, 3, "lse", TOKEN_FALSE);
+                    case 'o': return checkKeyword(2, 1, "r", TOKEN_FOR);
+                    case 'u': return checkKeyword(2, 1, "n", TOKEN_FUN);
+                }
+            }
+            break;
+        case 'i': return checkKeyword(1, 1, "f", TOKEN_IF);
+        case 'n': return checkKeyword(1, 2, "il", TOKEN_NIL);
+        case 'o': return checkKeyword(1, 1, "r", TOKEN_OR);
+        case 'p': return checkKeyword(1, 4, "rint", TOKEN_PRINT);
+        case 'r': return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
+        case 's': return checkKeyword(1, 4, "uper", TOKEN_SUPER);
+        case 't':
+            if (current - start > 1) {
+                switch (start[1]) {
+                    case 'h': return checkKeyword(2, 2, "is", TOKEN_THIS);
+                    case 'r': return checkKeyword(2, 2, "ue", TOKEN_TRUE);
+                }
+            }
+            break;
+        case 'v': return checkKeyword(1, 2, "ar", TOKEN_VAR);
+        case 'w': return checkKeyword(1, 4, "hile", TOKEN_WHILE);
+    }
+    return TOKEN_IDENTIFIER;
+}
+
+static Token identifier() {
+    while (isAlpha(*current) || isDigit(*current)) advance();
+    return makeToken(identifierType());
+}
+
 // --- Public API ---
 void initLexer(const char* source) {
     start = source;
@@ -89,6 +161,7 @@ Token scanToken() {
     if (isAtEnd()) return makeToken(TOKEN_EOF);
 
     char c = advance();
+    if (isAlpha(c)) return identifier();
     if (isDigit(c)) return number();
 
     switch (c) {
@@ -103,11 +176,11 @@ Token scanToken() {
         case '+': return makeToken(TOKEN_PLUS);
         case '/': return makeToken(TOKEN_SLASH);
         case '*': return makeToken(TOKEN_STAR);
-        
-        // Simplified: no '!', '!=', '=', etc.
-        case 'n': if (strncmp(start, "nil", 3) == 0) return makeToken(TOKEN_NIL); break;
-        case 't': if (strncmp(start, "true", 4) == 0) return makeToken(TOKEN_TRUE); break;
-        case 'f': if (strncmp(start, "false", 5) == 0) return makeToken(TOKEN_FALSE); break;
+        case '"': return string();
+        case '!': return makeToken(match('=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
+        case '=': return makeToken(match('=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
+        case '<': return makeToken(match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
+        case '>': return makeToken(match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
     }
 
     return errorToken("Unexpected character.");
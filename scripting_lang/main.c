@@ -1,7 +1,9 @@
 /* main.c - The REPL driver */
 #include "common.h"
 #include "chunk.h"
+#include "compiler.h"
 #include "debug.h"
+#include "image.h"
 #include "vm.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -53,30 +55,127 @@ static char* readFile(const char* path) {
 }
 
 /**
- * @brief Run a script from a file.
+ * @brief The bytecode cache next to a script: "foo.cs" -> "foo.csc", else path + ".csc".
+ */
+static void imagePath(const char* path, char* out, size_t size) {
+    size_t length = strlen(path);
+    if (length >= 3 && strcmp(path + length - 3, ".cs") == 0) {
+        snprintf(out, size, "%sc", path);
+    } else {
+        snprintf(out, size, "%s.csc", path);
+    }
+}
+
+/**
+ * @brief Compile a script and write its bytecode cache (--compile).
+ */
+static void compileFile(const char* path) {
+    char* source = readFile(path);
+    Chunk chunk;
+    initChunk(&chunk);
+    if (!compile(source, &chunk)) exit(65);
+
+    char image[4096];
+    imagePath(path, image, sizeof(image));
+    bool saved = saveImage(&chunk, hashSource(source, strlen(source)), image);
+    freeChunk(&chunk);
+    free(source);
+    if (!saved) exit(74);
+}
+
+/**
+ * @brief Run a script from a file, from its bytecode cache if that is fresh.
  */
 static void runFile(const char* path) {
     char* source = readFile(path);
-    InterpretResult result = interpret(source);
+    char image[4096];
+    imagePath(path, image, sizeof(image));
+
+    InterpretResult result;
+    Chunk chunk;
+    initChunk(&chunk);
+    if (loadImage(&chunk, hashSource(source, strlen(source)), image)) {
+        if (traceExecution()) disassembleChunk(&chunk, image);
+        Value value;
+        result = runChunk(&chunk, &value);
+        if (result == INTERPRET_OK) {
+            printValue(value);
+            printf("\n");
+        }
+        freeChunk(&chunk);
+    } else {
+        result = interpret(source); // No cache, or a stale one
+    }
     free(source);
 
     if (result == INTERPRET_COMPILE_ERROR) exit(65);
     if (result == INTERPRET_RUNTIME_ERROR) exit(70);
 }
 
+/**
+ * @brief Print the collector's counters (--gc-stats) to stderr.
+ */
+static void printGCStats() {
+    GCStats stats = gcStats();
+    fprintf(stderr, "gc: %llu collections, %llu objects (%llu bytes) freed, heap %zu bytes (next GC at %zu)\n",
+            (unsigned long long)stats.collections, (unsigned long long)stats.objectsFreed,
+            (unsigned long long)stats.bytesFreed, stats.bytesAllocated, stats.nextGC);
+    if (stats.pauses > 0) {
+        fprintf(stderr, "gc: %llu pauses (%llu incremental steps), total %.3f ms, mean %.1f us, max %.1f us\n",
+                (unsigned long long)stats.pauses, (unsigned long long)stats.steps, stats.totalPauseNs / 1e6,
+                stats.totalPauseNs / 1e3 / stats.pauses, stats.maxPauseNs / 1e3);
+    }
+}
+
 // --- Main ---
 int main(int argc, const char* argv[]) {
     initVM();
 
-    if (argc == 1) {
+    const char* path = NULL;
+    bool compileOnly = false;
+    bool showGCStats = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0) {
+            if (!setTraceExecution(true)) {
+                fprintf(stderr, "Built without CSCRIPT_TRACE (make TRACE=1): "
+                                "--trace only disassembles compiled code.\n");
+            }
+        } else if (strcmp(argv[i], "-O") == 0) {
+            setOptimization(true);
+        } else if (strcmp(argv[i], "--register") == 0) {
+            setBackend(BACKEND_REGISTER);
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            if (!setJit(true)) fprintf(stderr, "No JIT on this platform (x86-64 Linux only): --jit ignored.\n");
+        } else if (strcmp(argv[i], "--compile") == 0) {
+            compileOnly = true;
+        } else if (strcmp(argv[i], "--gc-stats") == 0) {
+            showGCStats = true;
+        } else if (strcmp(argv[i], "--gc-growth") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0) {
+            setGCGrowthFactor(atof(argv[++i]));
+        } else if (strcmp(argv[i], "--gc-step") == 0 && i + 1 < argc) {
+            setGCStepBudget(atol(argv[++i]));
+        } else if (path == NULL && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "Usage: cscript [-O] [--trace] [--register] [--jit] [--compile] [--gc-stats] "
+                            "[--gc-growth factor] [--gc-step units] [path]\n");
+            exit(64);
+        }
+    }
+
+    if (compileOnly && path == NULL) {
+        fprintf(stderr, "--compile needs a script path.\n");
+        exit(64);
+    }
+    if (path == NULL) {
         repl(); // No file given, start REPL
-    } else if (argc == 2) {
-        runFile(argv[1]); // Run the file
+    } else if (compileOnly) {
+        compileFile(path); // Only write path's .csc image
     } else {
-        fprintf(stderr, "Usage: cscript [path]\n");
-        exit(64);
+        runFile(path); // Run the file
     }
 
+    if (showGCStats) printGCStats();
     freeVM();
     return 0;
 }
@@ -0,0 +1,373 @@
+/* memory.c - Object allocation and the incremental mark-sweep garbage collector */
+#define _POSIX_C_SOURCE 199309L // clock_gettime under -std=c99
+#include "memory.h"
+#include "compiler.h"
+#include "table.h"
+#include "vm.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// --- The Collector ---
+// Tri-color mark-sweep, run as one cycle of three phases:
+//  IDLE   until the heap passes nextGC,
+//  MARK   roots are grayed; gray objects are popped off the gray stack and
+//         blackened by graying what they reference,
+//  SWEEP  the objects that existed when marking ended are walked; every
+//         white one is freed (and, for a string, dropped from the weak
+//         intern table), every black one kept.
+// In stop-the-world mode (step budget 0) a cycle runs start to finish
+// inside one allocation, like clox. In incremental mode every GC_STEP_BYTES
+// of allocation runs one step of at most vm.gcStepBudget work units, so a
+// pause is bounded by the budget rather than by the heap.
+//
+// Niche C: "marked" means obj->mark == markBit, and markBit flips when a
+// cycle ends. That turns every survivor white again without touching it,
+// and lets objects allocated mid-cycle be created black with one store.
+//
+// Invariant while marking: no black object or scanned root refers to a white
+// object. It holds because
+//  - objects allocated during a cycle start black,
+//  - stores into an already scanned place go through gcBarrier(): the only
+//    such places today are chunk constant pools, global variables, closure
+//    upvalues (captured, closed or assigned) and intern-table hits (strings
+//    hold no references),
+//  - the VM stack, the open upvalues and vm.result, written on every
+//    instruction without a barrier, are scanned again when marking ends (the
+//    one atomic part, bounded by STACK_MAX).
+// During SWEEP an intern-table hit may be a dead string not swept yet;
+// gcBarrier() blackens it, which is safe only because strings reference
+// nothing.
+//
+// Build with make STRESS_GC=1 (-DCSCRIPT_STRESS_GC) to run a collection (or
+// a one-unit step) on every allocation, which flushes out missing roots and
+// barriers quickly.
+
+typedef enum {
+    GC_IDLE,
+    GC_MARK,
+    GC_SWEEP,
+} GCPhase;
+
+static Chunk* liveChunks = NULL; // Chunks between initChunk() and freeChunk()
+
+static GCPhase phase = GC_IDLE;
+static bool markBit = true;      // The value of obj->mark that means "reached"
+static Chunk* scanChunk = NULL;  // MARK: next live chunk whose constants get grayed
+static int scanIndex = 0;        // ... and the next constant in it
+static Obj* sweeping = NULL;     // SWEEP: objects from before marking ended, not yet swept
+static size_t stepDebt = 0;      // Bytes allocated since the last incremental step
+
+void trackChunk(Chunk* chunk) {
+    // Added at the head, behind the MARK cursor: its constants arrive
+    // through addConstant(), which applies the barrier.
+    chunk->prevLive = NULL;
+    chunk->nextLive = liveChunks;
+    if (liveChunks != NULL) liveChunks->prevLive = chunk;
+    liveChunks = chunk;
+}
+
+void untrackChunk(Chunk* chunk) {
+    if (scanChunk == chunk) { // Freed while being scanned: go on with the next one
+        scanChunk = chunk->nextLive;
+        scanIndex = 0;
+    }
+    if (chunk->prevLive != NULL) {
+        chunk->prevLive->nextLive = chunk->nextLive;
+    } else if (liveChunks == chunk) {
+        liveChunks = chunk->nextLive;
+    }
+    if (chunk->nextLive != NULL) chunk->nextLive->prevLive = chunk->prevLive;
+    chunk->prevLive = chunk->nextLive = NULL;
+}
+
+void forEachChunk(void (*visit)(Chunk* chunk)) {
+    for (Chunk* chunk = liveChunks; chunk != NULL; chunk = chunk->nextLive) visit(chunk);
+    // Mid-sweep, part of the heap sits on the 'sweeping' list
+    Obj* lists[2] = {vm.objects, sweeping};
+    for (int i = 0; i < 2; i++) {
+        for (Obj* object = lists[i]; object != NULL; object = object->next) {
+            if (object->type == OBJ_FUNCTION) visit(&((ObjFunction*)object)->chunk);
+        }
+    }
+}
+
+static uint64_t nowNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void recordPause(uint64_t start) {
+    uint64_t pause = nowNs() - start;
+    vm.gc.pauses++;
+    vm.gc.totalPauseNs += pause;
+    if (pause > vm.gc.maxPauseNs) vm.gc.maxPauseNs = pause;
+    int bucket = 0;
+    while (bucket < GC_PAUSE_BUCKETS - 1 && (pause / 1000) >> bucket != 0) bucket++;
+    vm.gc.pauseBuckets[bucket]++;
+}
+
+static void gcStep(long budget);
+
+void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
+    vm.gc.bytesAllocated += newSize - oldSize;
+    if (newSize > oldSize) {
+#ifdef CSCRIPT_STRESS_GC
+        if (vm.gcStepBudget == 0) collectGarbage();
+        else gcStep(1);
+#else
+        if (vm.gcStepBudget == 0) {
+            if (vm.gc.bytesAllocated > vm.gc.nextGC) collectGarbage();
+        } else if (phase != GC_IDLE || vm.gc.bytesAllocated > vm.gc.nextGC) {
+            stepDebt += newSize - oldSize;
+            // Once the mutator outruns the steps (the heap doubled mid-cycle)
+            // step on every allocation: still bounded pauses, but more of them.
+            bool behind = vm.gc.bytesAllocated > vm.gc.nextGC * 2;
+            if (phase == GC_IDLE || stepDebt >= GC_STEP_BYTES || behind) {
+                stepDebt = 0;
+                gcStep(vm.gcStepBudget);
+            }
+        }
+#endif
+    }
+
+    if (newSize == 0) {
+        free(pointer);
+        return NULL;
+    }
+    void* result = realloc(pointer, newSize);
+    if (result == NULL) {
+        perror("realloc object");
+        exit(1);
+    }
+    return result;
+}
+
+Obj* allocateObject(size_t size, ObjType type) {
+    Obj* object = (Obj*)reallocate(NULL, 0, size);
+    object->type = type;
+    // Black during a cycle (it has already decided what lives), white otherwise
+    object->mark = (phase == GC_IDLE) ? !markBit : markBit;
+    object->next = vm.objects;
+    vm.objects = object;
+    return object;
+}
+
+static void freeObject(Obj* object) {
+    switch (object->type) {
+        case OBJ_STRING: {
+            ObjString* string = (ObjString*)object;
+            reallocate(object, sizeof(ObjString) + string->length + 1, 0);
+            break;
+        }
+        case OBJ_FUNCTION:
+            freeChunk(&((ObjFunction*)object)->chunk);
+            reallocate(object, sizeof(ObjFunction), 0);
+            break;
+        case OBJ_CLOSURE:
+            free(((ObjClosure*)object)->upvalues);
+            reallocate(object, sizeof(ObjClosure), 0);
+            break;
+        case OBJ_UPVALUE:
+            reallocate(object, sizeof(ObjUpvalue), 0);
+            break;
+    }
+}
+
+void markObject(Obj* object) {
+    if (object == NULL || object->mark == markBit) return;
+    object->mark = markBit;
+
+    // Niche C: the gray stack is plain malloc memory: growing it must not
+    // recurse into the collector that is running.
+    if (vm.grayCapacity < vm.grayCount + 1) {
+        vm.grayCapacity = (vm.grayCapacity < 8) ? 8 : vm.grayCapacity * 2;
+        vm.grayStack = (Obj**)realloc(vm.grayStack, sizeof(Obj*) * vm.grayCapacity);
+        if (vm.grayStack == NULL) {
+            perror("realloc gray stack");
+            exit(1);
+        }
+    }
+    vm.grayStack[vm.grayCount++] = object;
+}
+
+void markValue(Value value) {
+    if (IS_OBJ(value)) markObject(AS_OBJ(value));
+}
+
+// Grays everything 'object' references. Strings reference nothing.
+static void blackenObject(Obj* object) {
+    switch (object->type) {
+        case OBJ_STRING:
+            break;
+        case OBJ_FUNCTION: {
+            // One unit for the whole pool: functions are small next to the heap
+            ObjFunction* function = (ObjFunction*)object;
+            markObject((Obj*)function->name);
+            for (int i = 0; i < function->chunk.constants.count; i++) {
+                markValue(function->chunk.constants.values[i]);
+            }
+            break;
+        }
+        case OBJ_CLOSURE: {
+            ObjClosure* closure = (ObjClosure*)object;
+            markObject((Obj*)closure->function);
+            for (int i = 0; i < closure->upvalueCount; i++) markObject((Obj*)closure->upvalues[i]);
+            break;
+        }
+        case OBJ_UPVALUE:
+            markValue(((ObjUpvalue*)object)->closed);
+            break;
+    }
+}
+
+static void traceReferences() {
+    while (vm.grayCount > 0) blackenObject(vm.grayStack[--vm.grayCount]);
+}
+
+void gcBarrier(Value value) {
+    if (phase == GC_IDLE) return;
+    markValue(value);
+    if (phase == GC_SWEEP) traceReferences(); // Marking is over: no step will trace it
+}
+
+// The roots the mutator writes without a barrier. Call frames need no
+// marking: each closure being run sits in its frame's slot 0.
+static void markStackRoots() {
+    for (Value* slot = vm.stack; slot < vm.stackTop; slot++) markValue(*slot);
+    for (ObjUpvalue* upvalue = vm.openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
+        markObject((Obj*)upvalue);
+    }
+    markValue(vm.result);
+}
+
+// --- Phases ---
+// Each runs at most 'budget' units and returns how many it used.
+
+static void beginCycle() {
+    phase = GC_MARK;
+    scanChunk = liveChunks;
+    scanIndex = 0;
+    markStackRoots();
+    markCompilerRoots(); // Functions being compiled; their new constants are barriered
+    // Globals are grayed once: later definitions and assignments are barriered
+    markTable(&vm.globalSlots);
+    for (int i = 0; i < vm.globalValues.count; i++) markValue(vm.globalValues.values[i]);
+}
+
+static long markPhase(long budget) {
+    long work = 0;
+    while (work < budget) {
+        if (vm.grayCount > 0) {
+            blackenObject(vm.grayStack[--vm.grayCount]);
+        } else if (scanChunk != NULL) {
+            if (scanIndex < scanChunk->constants.count) {
+                markValue(scanChunk->constants.values[scanIndex++]);
+            } else {
+                scanChunk = scanChunk->nextLive;
+                scanIndex = 0;
+            }
+        } else {
+            // Everything reachable from the chunks is black; the stack may
+            // have picked up white objects since: gray it again and finish.
+            markStackRoots();
+            traceReferences();
+            // Detach the heap: new objects go to a fresh list, survivors join it
+            phase = GC_SWEEP;
+            sweeping = vm.objects;
+            vm.objects = NULL;
+            break;
+        }
+        work++;
+    }
+    return work;
+}
+
+static long sweepPhase(long budget) {
+    long work = 0;
+    while (work < budget && sweeping != NULL) {
+        Obj* object = sweeping;
+        sweeping = object->next;
+        if (object->mark == markBit) {
+            object->next = vm.objects;
+            vm.objects = object;
+        } else {
+            // The intern table is weak: a dead string leaves it as it is freed
+            if (object->type == OBJ_STRING) tableDelete(&vm.strings, (ObjString*)object);
+            size_t before = vm.gc.bytesAllocated;
+            freeObject(object);
+            vm.gc.objectsFreed++;
+            vm.gc.bytesFreed += before - vm.gc.bytesAllocated;
+        }
+        work++;
+    }
+
+    if (sweeping == NULL) {
+        markBit = !markBit; // Every object is white again
+        size_t next = (size_t)(vm.gc.bytesAllocated * vm.gcGrowthFactor);
+        vm.gc.nextGC = (next < GC_INITIAL_HEAP) ? GC_INITIAL_HEAP : next;
+        vm.gc.collections++;
+        phase = GC_IDLE;
+    }
+    return work;
+}
+
+// Runs phases until 'budget' units are used or the cycle ends.
+static void runCycle(long budget) {
+    if (phase == GC_IDLE) beginCycle();
+    while (budget > 0 && phase != GC_IDLE) {
+        switch (phase) {
+            case GC_MARK:  budget -= markPhase(budget); break;
+            case GC_SWEEP: budget -= sweepPhase(budget); break;
+            case GC_IDLE:  break;
+        }
+    }
+}
+
+static void gcStep(long budget) {
+    uint64_t start = nowNs();
+    runCycle(budget);
+    vm.gc.steps++;
+    recordPause(start);
+}
+
+void collectGarbage() {
+    uint64_t start = nowNs();
+    runCycle(LONG_MAX);
+    recordPause(start);
+}
+
+void freeObjects() {
+    // Mid-sweep, part of the heap sits on the 'sweeping' list
+    Obj* lists[2] = {vm.objects, sweeping};
+    for (int i = 0; i < 2; i++) {
+        Obj* object = lists[i];
+        while (object != NULL) {
+            Obj* next = object->next;
+            freeObject(object);
+            object = next;
+        }
+    }
+    vm.objects = NULL;
+    sweeping = NULL;
+    scanChunk = NULL;
+    phase = GC_IDLE;
+    stepDebt = 0;
+    free(vm.grayStack);
+    vm.grayStack = NULL;
+    vm.grayCount = vm.grayCapacity = 0;
+}
+
+void setGCGrowthFactor(double factor) {
+    vm.gcGrowthFactor = (factor < 1.1) ? 1.1 : factor;
+}
+
+void setGCStepBudget(long budget) {
+    vm.gcStepBudget = (budget < 0) ? 0 : budget;
+}
+
+GCStats gcStats() {
+    return vm.gc;
+}
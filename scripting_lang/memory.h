@@ -0,0 +1,72 @@
+/* memory.h - Object allocation and the incremental mark-sweep garbage collector */
+#ifndef CLOX_MEMORY_H
+#define CLOX_MEMORY_H
+
+#include "common.h"
+#include "chunk.h"
+#include "object.h"
+
+// --- Configuration ---
+#define GC_INITIAL_HEAP (1024 * 1024)  // Never collect below this many object bytes
+#define GC_DEFAULT_GROWTH_FACTOR 2.0   // Next collection once the heap is live bytes * factor
+#define GC_STEP_BYTES (16 * 1024)      // Incremental mode: one step per this many bytes allocated
+#define GC_DEFAULT_STEP_BUDGET 1024    // Work units per step (0 = stop-the-world)
+#define GC_PAUSE_BUCKETS 24            // Pause histogram: bucket i counts pauses under 2^i us
+
+// Counters since initVM(). A pause is the wall-clock time of one
+// stop-the-world collection or of one incremental step.
+typedef struct {
+    uint64_t collections;  // Completed cycles
+    uint64_t pauses;       // Stop-the-world collections + incremental steps
+    uint64_t steps;        // Incremental steps (0 in stop-the-world mode)
+    uint64_t objectsFreed;
+    uint64_t bytesFreed;
+    uint64_t totalPauseNs;
+    uint64_t maxPauseNs;
+    uint64_t pauseBuckets[GC_PAUSE_BUCKETS]; // The last bucket also takes anything longer
+    size_t bytesAllocated; // Object bytes right now (live + not yet collected garbage)
+    size_t nextGC;         // Heap size that starts the next cycle
+} GCStats;
+
+// Every object byte goes through here. Growing may run a collection (or a
+// step of one) first, so anything the caller still needs must be reachable
+// from a root: the VM stack, the last result, a global variable, or the
+// constants of a live Chunk.
+void* reallocate(void* pointer, size_t oldSize, size_t newSize);
+
+// Allocates 'size' bytes for an object of 'type' and links it into the heap.
+Obj* allocateObject(size_t size, ObjType type);
+
+void markObject(Obj* object);
+void markValue(Value value);
+// Runs a whole collection now, finishing any incremental cycle in progress.
+void collectGarbage();
+void freeObjects();
+
+/**
+ * @brief Write barrier: call after storing 'value' anywhere the collector
+ * scans incrementally (a chunk's constant pool, a global variable, or an
+ * interned string handed out again). While a cycle runs, a white object is marked so it cannot be
+ * swept. The VM stack needs no barrier: it is rescanned at the end of
+ * marking.
+ */
+void gcBarrier(Value value);
+
+// Chunks are roots: initChunk() registers a chunk and freeChunk() removes it,
+// so the host can keep compiled chunks (e.g. a script cache) between runs.
+void trackChunk(Chunk* chunk);
+void untrackChunk(Chunk* chunk);
+// Calls 'visit' on every chunk there is: the tracked ones and the code of
+// every function object (including ones the collector has not freed yet).
+void forEachChunk(void (*visit)(Chunk* chunk));
+
+// Heap growth between collections: lower means smaller heaps and more
+// frequent (but not shorter) pauses. Values below 1.1 are clamped to 1.1.
+void setGCGrowthFactor(double factor);
+// Work units (an object traced or swept, a constant or intern-table slot
+// scanned) per incremental step: smaller means shorter pauses but more of
+// them. 0 switches to stop-the-world collections.
+void setGCStepBudget(long budget);
+GCStats gcStats();
+
+#endif
@@ -0,0 +1,128 @@
+/* object.c - Allocating and interning heap objects */
+#include "object.h"
+#include "memory.h"
+#include "table.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t hashString(const char* chars, int length) {
+    // FNV-1a, 32-bit
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (uint8_t)chars[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+// Allocates a string object with room for 'length' chars (plus the NUL) and
+// links it into the object list. The caller fills in chars and hash.
+static ObjString* allocateString(int length) {
+    ObjString* string = (ObjString*)allocateObject(sizeof(ObjString) + length + 1, OBJ_STRING);
+    string->length = length;
+    string->chars[length] = '\0';
+    return string;
+}
+
+// Adds a freshly built string to the intern table, or, if an equal one is
+// already there, frees it and returns that one instead.
+static ObjString* internString(ObjString* string) {
+    ObjString* interned = tableFindString(&vm.strings, string->chars, string->length, string->hash);
+    if (interned != NULL) {
+        // Still the newest object: nothing has allocated since allocateString()
+        vm.objects = string->obj.next;
+        reallocate(string, sizeof(ObjString) + string->length + 1, 0);
+        gcBarrier(OBJ_VAL(interned)); // May be white mid-cycle: it is in use again
+        return interned;
+    }
+    tableSet(&vm.strings, string, NIL_VAL); // Used as a set: only keys matter
+    return string;
+}
+
+ObjString* copyString(const char* chars, int length) {
+    uint32_t hash = hashString(chars, length);
+    ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+    if (interned != NULL) {
+        gcBarrier(OBJ_VAL(interned));
+        return interned;
+    }
+
+    ObjString* string = allocateString(length);
+    memcpy(string->chars, chars, length);
+    string->hash = hash;
+    tableSet(&vm.strings, string, NIL_VAL);
+    return string;
+}
+
+ObjString* concatenateStrings(ObjString* a, ObjString* b) {
+    // Built in place in the new object (no temporary buffer), then interned.
+    // Allocating may collect: the caller keeps a and b reachable.
+    ObjString* result = allocateString(a->length + b->length);
+    memcpy(result->chars, a->chars, a->length);
+    memcpy(result->chars + a->length, b->chars, b->length);
+    result->hash = hashString(result->chars, result->length);
+    return internString(result);
+}
+
+ObjFunction* newFunction() {
+    ObjFunction* function = (ObjFunction*)allocateObject(sizeof(ObjFunction), OBJ_FUNCTION);
+    function->arity = 0;
+    function->upvalueCount = 0;
+    function->name = NULL;
+    initChunk(&function->chunk);
+    untrackChunk(&function->chunk); // Reached through the function instead
+    return function;
+}
+
+ObjClosure* newClosure(ObjFunction* function) {
+    // Niche C: the upvalue array is plain malloc memory, like Table entries,
+    // so only the closure itself can start a collection.
+    ObjUpvalue** upvalues = NULL;
+    if (function->upvalueCount > 0) {
+        upvalues = (ObjUpvalue**)calloc(function->upvalueCount, sizeof(ObjUpvalue*));
+        if (upvalues == NULL) {
+            perror("calloc upvalues");
+            exit(1);
+        }
+    }
+    ObjClosure* closure = (ObjClosure*)allocateObject(sizeof(ObjClosure), OBJ_CLOSURE);
+    closure->function = function;
+    closure->upvalues = upvalues;
+    closure->upvalueCount = function->upvalueCount;
+    return closure;
+}
+
+ObjUpvalue* newUpvalue(Value* slot) {
+    ObjUpvalue* upvalue = (ObjUpvalue*)allocateObject(sizeof(ObjUpvalue), OBJ_UPVALUE);
+    upvalue->location = slot;
+    upvalue->closed = NIL_VAL;
+    upvalue->next = NULL;
+    return upvalue;
+}
+
+static void printFunction(ObjFunction* function) {
+    if (function->name == NULL) {
+        printf("<script>");
+        return;
+    }
+    printf("<fn %s>", function->name->chars);
+}
+
+void printObject(Value value) {
+    switch (OBJ_TYPE(value)) {
+        case OBJ_STRING:
+            printf("%s", AS_CSTRING(value));
+            break;
+        case OBJ_FUNCTION:
+            printFunction(AS_FUNCTION(value));
+            break;
+        case OBJ_CLOSURE:
+            printFunction(AS_CLOSURE(value)->function);
+            break;
+        case OBJ_UPVALUE:
+            printf("upvalue");
+            break;
+    }
+}
@@ -0,0 +1,81 @@
+/* object.h - Heap-allocated values: strings, functions, closures and upvalues */
+#ifndef CLOX_OBJECT_H
+#define CLOX_OBJECT_H
+
+#include "common.h"
+#include "chunk.h"
+#include "value.h"
+
+// --- Object Types ---
+typedef enum {
+    OBJ_STRING,
+    OBJ_FUNCTION,
+    OBJ_CLOSURE,
+    OBJ_UPVALUE,
+} ObjType;
+
+// Header shared by every heap object. Niche C: each object struct starts with
+// an Obj, so an ObjString* can be cast to Obj* and back ("struct inheritance").
+struct Obj {
+    ObjType type;
+    bool mark;        // Equal to the collector's mark bit once reached (memory.c)
+    struct Obj* next; // All objects, newest first: what the sweep phase walks
+};
+
+// Immutable, and interned: two strings with the same characters are the same
+// object, so equality and table lookups compare pointers.
+struct ObjString {
+    Obj obj;
+    int length;
+    uint32_t hash;    // FNV-1a of chars, computed once
+    char chars[];     // Niche C: C99 flexible array member, allocated with the object
+};
+
+// Compiled code of one "fun" declaration. Functions live in the constant
+// pool of the code around them; at run time OP_CLOSURE wraps one in a closure.
+typedef struct {
+    Obj obj;
+    int arity;
+    int upvalueCount;
+    Chunk chunk;      // Not a GC root of its own: traced through the function
+    ObjString* name;
+} ObjFunction;
+
+// A variable a closure captured. Open while the variable is still on the VM
+// stack ('location' points at its slot); closed (moved into 'closed', and
+// 'location' pointed there) when the slot goes away.
+typedef struct ObjUpvalue {
+    Obj obj;
+    Value* location;
+    Value closed;
+    struct ObjUpvalue* next; // Open upvalues, sorted by stack slot, highest first
+} ObjUpvalue;
+
+typedef struct {
+    Obj obj;
+    ObjFunction* function;
+    ObjUpvalue** upvalues;
+    int upvalueCount;
+} ObjClosure;
+
+#define OBJ_TYPE(value)   (AS_OBJ(value)->type)
+#define IS_STRING(value)  (IS_OBJ(value) && OBJ_TYPE(value) == OBJ_STRING)
+#define IS_FUNCTION(value) (IS_OBJ(value) && OBJ_TYPE(value) == OBJ_FUNCTION)
+#define IS_CLOSURE(value) (IS_OBJ(value) && OBJ_TYPE(value) == OBJ_CLOSURE)
+#define AS_STRING(value)  ((ObjString*)AS_OBJ(value))
+#define AS_CSTRING(value) (((ObjString*)AS_OBJ(value))->chars)
+#define AS_FUNCTION(value) ((ObjFunction*)AS_OBJ(value))
+#define AS_CLOSURE(value) ((ObjClosure*)AS_OBJ(value))
+
+// Returns the interned string with these characters, creating it if needed.
+ObjString* copyString(const char* chars, int length);
+// The interned string a + b.
+ObjString* concatenateStrings(ObjString* a, ObjString* b);
+// A function with an empty chunk, for the compiler (or an image) to fill in.
+ObjFunction* newFunction();
+// Allocating may collect: 'function' must be reachable (e.g. a pool constant).
+ObjClosure* newClosure(ObjFunction* function);
+ObjUpvalue* newUpvalue(Value* slot);
+void printObject(Value value);
+
+#endif
@@ -0,0 +1,392 @@
+/* optimizer.c - Constant folding and peephole pass over stack bytecode */
+#include "optimizer.h"
+#include "object.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// The pass re-emits the chunk one instruction at a time into 'out' while
+// simulating the operand stack. Each stack slot remembers which emitted
+// instruction produced it; an operator whose operands were produced by the
+// last one or two emitted constant loads is evaluated now, and the loads are
+// replaced by a single load of the result. Being bottom-up, this folds whole
+// constant subtrees. Only straight-line code is rewritten: the pass stops at
+// the first jump or call, and before the first instruction a loop jumps back
+// to, so every jump lies in the tail that is copied as is and keeps its
+// offset.
+
+typedef struct {
+    uint8_t op;       // Constant loads are OP_CONSTANT here; the encoding picks the long form
+    int operands[2];
+    int line;
+} Instruction;
+
+// What the pass knows about one operand stack slot
+typedef struct {
+    int producer;       // Index in 'out' of the instruction that pushed it (-1 = unknown)
+    bool isNumber;      // Holds a number whenever execution gets past its producer
+    bool negatesNumber; // Pushed by an OP_NEGATE whose operand was known to be a number
+} Slot;
+
+typedef struct {
+    Chunk* chunk;
+    Instruction* out;
+    int count;
+    Slot stack[UINT8_COUNT];
+    int sp;
+} Optimizer;
+
+static void emit(Optimizer* opt, uint8_t op, int operand, int line) {
+    Instruction* in = &opt->out[opt->count++];
+    in->op = op;
+    in->operands[0] = operand;
+    in->operands[1] = 0;
+    in->line = line;
+}
+
+static void pushSlot(Optimizer* opt, int producer, bool isNumber) {
+    opt->stack[opt->sp].producer = producer;
+    opt->stack[opt->sp].isNumber = isNumber;
+    opt->stack[opt->sp].negatesNumber = false;
+    opt->sp++;
+}
+
+// True if 'slot' holds a number constant pushed by the instruction at out[index].
+static bool constantAt(Optimizer* opt, Slot* slot, int index, double* value) {
+    if (slot->producer != index || index < 0) return false;
+    Instruction* in = &opt->out[index];
+    if (in->op != OP_CONSTANT) return false;
+    Value constant = opt->chunk->constants.values[in->operands[0]];
+    if (!IS_NUMBER(constant)) return false;
+    *value = AS_NUMBER(constant);
+    return true;
+}
+
+static bool isGlobalOp(uint8_t op) {
+    return op == OP_DEFINE_GLOBAL || op == OP_GET_GLOBAL || op == OP_SET_GLOBAL;
+}
+
+// Opcodes whose constant index is 16 bits, high byte first
+static bool hasShortConstant(uint8_t op) {
+    return isGlobalOp(op) || op == OP_CLOSURE;
+}
+
+// Every opcode with a constant pool operand must be listed: compaction renumbers them.
+static bool usesConstant(uint8_t op) {
+    return op == OP_CONSTANT || op == OP_CONSTANT_LONG || op == OP_ADD_CONSTANT ||
+           op == OP_SUBTRACT_CONSTANT || op == OP_MULTIPLY_CONSTANT || op == OP_DIVIDE_CONSTANT ||
+           hasShortConstant(op);
+}
+
+static int readConstantIndex(Chunk* chunk, int offset) {
+    uint8_t* operand = &chunk->code[offset + 1];
+    if (hasShortConstant(chunk->code[offset])) return (operand[0] << 8) | operand[1];
+    if (chunk->code[offset] != OP_CONSTANT_LONG) return operand[0];
+    return (operand[0] << 16) | (operand[1] << 8) | operand[2];
+}
+
+static void writeConstantIndex(Chunk* chunk, int offset, int index) {
+    uint8_t* operand = &chunk->code[offset + 1];
+    if (hasShortConstant(chunk->code[offset])) {
+        operand[0] = (uint8_t)(index >> 8);
+        operand[1] = (uint8_t)index;
+        return;
+    }
+    if (chunk->code[offset] != OP_CONSTANT_LONG) {
+        operand[0] = (uint8_t)index;
+        return;
+    }
+    operand[0] = (uint8_t)(index >> 16);
+    operand[1] = (uint8_t)(index >> 8);
+    operand[2] = (uint8_t)index;
+}
+
+// Renumbers 'index' of the old pool into the chunk's new one.
+static int keepConstant(Chunk* chunk, ValueArray* old, int remap[], int index) {
+    if (remap[index] == -1) remap[index] = addConstant(chunk, old->values[index]);
+    return remap[index];
+}
+
+// Drops constants no instruction refers to (folding leaves the inputs behind),
+// renumbering 'out' and the code from 'tail' on that the pass kept as is.
+// Indices only shrink, so every operand still fits the form it is encoded in.
+static void compactConstants(Optimizer* opt, int tail) {
+    Chunk* chunk = opt->chunk;
+    ValueArray old = takeConstants(chunk);
+    int* remap = (int*)malloc(sizeof(int) * (old.count + 1));
+    if (remap == NULL) {
+        perror("malloc constant remap");
+        exit(1);
+    }
+    for (int i = 0; i < old.count; i++) remap[i] = -1;
+
+    for (int i = 0; i < opt->count; i++) {
+        if (!usesConstant(opt->out[i].op)) continue;
+        opt->out[i].operands[0] = keepConstant(chunk, &old, remap, opt->out[i].operands[0]);
+    }
+    for (int offset = tail; offset < chunk->count;) {
+        uint8_t op = chunk->code[offset];
+        // OP_CLOSURE's length comes from its function, which is still in the old pool
+        int length = op == OP_CLOSURE
+            ? 3 + 2 * AS_FUNCTION(old.values[readConstantIndex(chunk, offset)])->upvalueCount
+            : instructionLength(chunk, offset);
+        if (usesConstant(op)) {
+            writeConstantIndex(chunk, offset, keepConstant(chunk, &old, remap, readConstantIndex(chunk, offset)));
+        }
+        offset += length;
+    }
+    free(remap);
+    freeValueArray(&old);
+}
+
+// Turns out[index] into a load of 'value'. False if the pool is full.
+static bool rewriteAsConstant(Optimizer* opt, int index, double value) {
+    int constant = addConstant(opt->chunk, NUMBER_VAL(value));
+    if (constant >= MAX_CONSTANTS) return false; // Compaction drops the unused entry
+    opt->out[index].op = OP_CONSTANT;
+    opt->out[index].operands[0] = constant;
+    return true;
+}
+
+// Bytes 'in' takes once re-encoded
+static int encodedLength(Instruction* in) {
+    if (in->op == OP_GET_GLOBAL || in->op == OP_SET_GLOBAL) return 3 + GLOBAL_CACHE_BYTES;
+    if (in->op == OP_CALL_NATIVE || isGlobalOp(in->op)) return 3;
+    if (in->op == OP_CONSTANT && in->operands[0] > UINT8_MAX) return 4; // OP_CONSTANT_LONG
+    return (usesConstant(in->op) || in->op == OP_GET_LOCAL || in->op == OP_SET_LOCAL) ? 2 : 1;
+}
+
+// Appends 'in' to the chunk.
+static void encode(Chunk* chunk, Instruction* in) {
+    int length = encodedLength(in);
+    if (length == 4) {
+        writeChunk(chunk, OP_CONSTANT_LONG, in->line);
+        writeChunk(chunk, (uint8_t)(in->operands[0] >> 16), in->line);
+        writeChunk(chunk, (uint8_t)(in->operands[0] >> 8), in->line);
+        writeChunk(chunk, (uint8_t)in->operands[0], in->line);
+        return;
+    }
+    if (isGlobalOp(in->op)) { // 16-bit constant index, high byte first
+        writeChunk(chunk, in->op, in->line);
+        writeChunk(chunk, (uint8_t)(in->operands[0] >> 8), in->line);
+        writeChunk(chunk, (uint8_t)in->operands[0], in->line);
+        for (int b = 3; b < length; b++) writeChunk(chunk, 0, in->line); // Empty inline cache
+        return;
+    }
+    writeChunk(chunk, in->op, in->line);
+    for (int b = 1; b < length; b++) writeChunk(chunk, (uint8_t)in->operands[b - 1], in->line);
+}
+
+static double evaluate(uint8_t op, double a, double b) {
+    switch (op) {
+        case OP_ADD:      return a + b;
+        case OP_SUBTRACT: return a - b;
+        case OP_MULTIPLY: return a * b;
+        default:          return a / b;
+    }
+}
+
+static void optimizeNegate(Optimizer* opt, int line) {
+    Slot* top = &opt->stack[opt->sp - 1];
+    double value;
+    if (constantAt(opt, top, opt->count - 1, &value)) {
+        if (rewriteAsConstant(opt, opt->count - 1, -value)) return;
+    }
+    // -(-x) is x, provided x is a number (else the inner negate must still fail)
+    int last = opt->count - 1;
+    if (top->producer == last && last >= 0 && opt->out[last].op == OP_NEGATE && top->negatesNumber) {
+        opt->count--;
+        top->producer = -1;
+        top->negatesNumber = false;
+        return;
+    }
+    emit(opt, OP_NEGATE, 0, line);
+    top->producer = opt->count - 1;
+    top->negatesNumber = top->isNumber;
+    top->isNumber = true;
+}
+
+// A value pushed only to be discarded: drop the load along with the pop.
+static void optimizePop(Optimizer* opt, int line) {
+    Slot* top = &opt->stack[opt->sp - 1];
+    int last = opt->count - 1;
+    opt->sp--;
+    if (top->producer == last && last >= 0) {
+        uint8_t op = opt->out[last].op;
+        if (op == OP_CONSTANT || op == OP_NIL || op == OP_TRUE || op == OP_FALSE ||
+            op == OP_GET_LOCAL) {
+            opt->count--;
+            return;
+        }
+    }
+    emit(opt, OP_POP, 0, line);
+}
+
+static void optimizeBinary(Optimizer* opt, uint8_t op, int line) {
+    Slot* right = &opt->stack[opt->sp - 1];
+    Slot* left = &opt->stack[opt->sp - 2];
+    int last = opt->count - 1;
+    double a, b;
+
+    // 1. Both operands constant: evaluate now
+    if (constantAt(opt, left, last - 1, &a) && constantAt(opt, right, last, &b) &&
+        rewriteAsConstant(opt, last - 1, evaluate(op, a, b))) {
+        opt->count--;
+        opt->sp--;
+        return;
+    }
+
+    // 2. "a - -b" -> "a + b", "a + -b" -> "a - b" (b known to be a number)
+    if ((op == OP_ADD || op == OP_SUBTRACT) && right->producer == last && last >= 0 &&
+        opt->out[last].op == OP_NEGATE && right->negatesNumber) {
+        opt->count--;
+        op = (op == OP_ADD) ? OP_SUBTRACT : OP_ADD;
+        last = opt->count - 1;
+        right->producer = -1;
+    }
+
+    // 3. Right operand is a constant load: fuse it into the operator
+    opt->sp--;
+    if (constantAt(opt, right, last, &b) && opt->out[last].operands[0] <= UINT8_MAX) {
+        static const uint8_t fused[] = {
+            [OP_ADD] = OP_ADD_CONSTANT, [OP_SUBTRACT] = OP_SUBTRACT_CONSTANT,
+            [OP_MULTIPLY] = OP_MULTIPLY_CONSTANT, [OP_DIVIDE] = OP_DIVIDE_CONSTANT,
+        };
+        opt->out[last].op = fused[op];
+        opt->out[last].line = line;
+        left->producer = last;
+        left->isNumber = true;
+        left->negatesNumber = false;
+        return;
+    }
+    emit(opt, op, 0, line);
+    left->producer = opt->count - 1;
+    // Past an ADD both operands were numbers or both strings: one known number decides
+    left->isNumber = (op != OP_ADD) || left->isNumber || right->isNumber;
+    left->negatesNumber = false;
+}
+
+void optimizeChunk(Chunk* chunk) {
+    Optimizer opt;
+    opt.chunk = chunk;
+    opt.out = (Instruction*)malloc(sizeof(Instruction) * (chunk->count + 1));
+    opt.count = 0;
+    opt.sp = 0;
+    if (opt.out == NULL) return;
+
+    // Offset of the first instruction the pass does not model, or the first
+    // loop target if that comes earlier; from there on the compiler's code
+    // is kept as is.
+    int stop = chunk->count;
+    for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) {
+        if (chunk->code[offset] != OP_LOOP) continue;
+        int target = offset + 3 - ((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+        if (target < stop) stop = target;
+    }
+    int loopTarget = stop;
+    for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) {
+        if (offset >= loopTarget) break;
+        uint8_t op = chunk->code[offset];
+        int line = getLine(chunk, offset);
+        if (opt.sp >= UINT8_COUNT - 1) {
+            stop = offset;
+            break;
+        }
+
+        switch (op) {
+            case OP_CONSTANT:
+            case OP_CONSTANT_LONG: {
+                int index = readConstantIndex(chunk, offset);
+                emit(&opt, OP_CONSTANT, index, line);
+                pushSlot(&opt, opt.count - 1, IS_NUMBER(chunk->constants.values[index]));
+                break;
+            }
+            case OP_NIL:
+            case OP_TRUE:
+            case OP_FALSE:
+                emit(&opt, op, 0, line);
+                pushSlot(&opt, opt.count - 1, false);
+                break;
+            case OP_NEGATE:
+                optimizeNegate(&opt, line);
+                break;
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+                optimizeBinary(&opt, op, line);
+                break;
+            case OP_CALL_NATIVE: {
+                emit(&opt, op, chunk->code[offset + 1], line);
+                opt.out[opt.count - 1].operands[1] = chunk->code[offset + 2];
+                opt.sp -= chunk->code[offset + 2];
+                pushSlot(&opt, opt.count - 1, false); // Natives may return anything
+                break;
+            }
+            case OP_RETURN:
+                emit(&opt, op, 0, line);
+                opt.sp--;
+                break;
+            case OP_POP:
+                optimizePop(&opt, line);
+                break;
+            case OP_GET_LOCAL:
+            case OP_GET_GLOBAL:
+                emit(&opt, op, (op == OP_GET_LOCAL) ? chunk->code[offset + 1] : readConstantIndex(chunk, offset), line);
+                pushSlot(&opt, opt.count - 1, false);
+                break;
+            case OP_SET_LOCAL: {
+                // The local's slot now holds whatever is on top; forget what it was
+                int slot = chunk->code[offset + 1];
+                emit(&opt, op, slot, line);
+                if (slot < opt.sp) {
+                    opt.stack[slot].producer = -1;
+                    opt.stack[slot].isNumber = false;
+                    opt.stack[slot].negatesNumber = false;
+                }
+                break;
+            }
+            case OP_SET_GLOBAL:
+                emit(&opt, op, readConstantIndex(chunk, offset), line);
+                break;
+            case OP_DEFINE_GLOBAL:
+                emit(&opt, op, readConstantIndex(chunk, offset), line);
+                opt.sp--;
+                break;
+            case OP_EQUAL:
+            case OP_GREATER:
+            case OP_LESS:
+                emit(&opt, op, 0, line);
+                opt.sp -= 2;
+                pushSlot(&opt, opt.count - 1, false);
+                break;
+            case OP_NOT:
+                emit(&opt, op, 0, line);
+                opt.sp--;
+                pushSlot(&opt, opt.count - 1, false);
+                break;
+            default:
+                stop = offset; // Not modelled (yet)
+                break;
+        }
+        if (stop != loopTarget) break;
+    }
+
+    compactConstants(&opt, stop);
+
+    // Re-encode into fresh arrays: a folded load can come out longer than
+    // its input (CONSTANT k; NEGATE may become a 4-byte OP_CONSTANT_LONG).
+    Chunk old = *chunk; // Now owns the input code and line table
+    chunk->code = NULL;
+    chunk->count = 0;
+    chunk->capacity = 0;
+    chunk->lines = NULL;
+    chunk->lineCount = 0;
+    chunk->lineCapacity = 0;
+    for (int i = 0; i < opt.count; i++) encode(chunk, &opt.out[i]);
+    for (int offset = stop; offset < old.count; offset++) {
+        writeChunk(chunk, old.code[offset], getLine(&old, offset));
+    }
+    free(old.code);
+    free(old.lines);
+    free(opt.out);
+}
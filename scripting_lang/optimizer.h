@@ -0,0 +1,19 @@
+/* optimizer.h - Bytecode optimization pass (-O) */
+#ifndef CLOX_OPTIMIZER_H
+#define CLOX_OPTIMIZER_H
+
+#include "chunk.h"
+
+/**
+ * @brief Rewrites a freshly compiled chunk in place:
+ *  - folds operators whose operands are number constants ("(1 + 2) * 3" -> 9),
+ *  - drops negations that cancel ("-(-x)", "a - -b" -> "a + b") when the
+ *    operand is known to be a number, so no runtime error is lost,
+ *  - fuses "<constant> <operator>" into OP_ADD_CONSTANT and friends,
+ *  - drops values pushed only to be popped again ("1;"),
+ *  - then removes constants nothing refers to any more.
+ * Code from the first instruction the pass does not model onwards is kept as is.
+ */
+void optimizeChunk(Chunk* chunk);
+
+#endif
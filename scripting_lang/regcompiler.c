@@ -0,0 +1,267 @@
+/* regcompiler.c - Lowers stack bytecode to register code, and disassembles it */
+#include "regcompiler.h"
+#include "object.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// The stack compiler already resolved precedence and native calls, so this
+// pass only has to simulate the stack: slot i of the operand stack becomes
+// register R[i], and a literal sitting in a slot is not loaded at all but
+// kept as a constant operand until an instruction consumes it. "1 + 2 * 3"
+// goes from six stack instructions (4 pushes) to three register ones.
+// Reading a local works the same way: the slot just names the local's
+// register, so "a + b" is one ADD with no copies.
+
+static void emit(RegChunk* rc, RegInstruction instruction, int line) {
+    if (rc->capacity < rc->count + 1) {
+        rc->capacity = (rc->capacity < 8) ? 8 : rc->capacity * 2;
+        rc->code = (RegInstruction*)realloc(rc->code, sizeof(RegInstruction) * rc->capacity);
+        rc->lines = (int*)realloc(rc->lines, sizeof(int) * rc->capacity);
+        if (rc->code == NULL || rc->lines == NULL) {
+            perror("realloc RegChunk");
+            exit(1);
+        }
+    }
+    rc->code[rc->count] = instruction;
+    rc->lines[rc->count] = line;
+    rc->count++;
+}
+
+// Operand for a constant: inline RK if the index fits, else a load into 'slot'.
+static uint8_t constantOperand(RegChunk* rc, int constant, int slot, int line) {
+    if (constant <= RK_MAX_CONSTANT) return (uint8_t)(RK_CONSTANT | constant);
+    emit(rc, REG_ENCODE_BX(ROP_LOADK, slot, constant), line);
+    return (uint8_t)slot;
+}
+
+// Puts slot 'slot' in its own register if it still names a constant or a local.
+static void materialize(RegChunk* rc, uint8_t operands[], int slot, int line) {
+    if (operands[slot] == slot) return;
+    emit(rc, REG_ENCODE(ROP_MOVE, slot, operands[slot], 0), line);
+    operands[slot] = (uint8_t)slot;
+}
+
+RegChunk* lowerToRegisters(Chunk* chunk) {
+    RegChunk* rc = (RegChunk*)calloc(1, sizeof(RegChunk));
+    if (rc == NULL) return NULL;
+    rc->constants = &chunk->constants;
+
+    // operands[i]: what stack slot i holds. Either RK_CONSTANT|k, i itself
+    // (the value is in R[i]), or the register of a local it was read from.
+    uint8_t operands[REG_MAX];
+    int sp = 0;
+
+    for (int offset = 0; offset < chunk->count;) {
+        uint8_t instruction = chunk->code[offset];
+        int line = getLine(chunk, offset);
+        if (sp >= REG_MAX - 1) goto unsupported; // Deeper than an RK operand can name
+
+        switch (instruction) {
+            case OP_CONSTANT:
+                operands[sp] = constantOperand(rc, chunk->code[offset + 1], sp, line);
+                sp++;
+                offset += 2;
+                break;
+            case OP_CONSTANT_LONG: {
+                int constant = (chunk->code[offset + 1] << 16) | (chunk->code[offset + 2] << 8) |
+                               chunk->code[offset + 3];
+                if (constant > UINT16_MAX) goto unsupported; // Beyond LOADK's Bx
+                operands[sp] = constantOperand(rc, constant, sp, line);
+                sp++;
+                offset += 4;
+                break;
+            }
+            case OP_NIL:
+                emit(rc, REG_ENCODE(ROP_LOADNIL, sp, 0, 0), line);
+                operands[sp] = (uint8_t)sp;
+                sp++;
+                offset++;
+                break;
+            case OP_TRUE:
+            case OP_FALSE:
+                emit(rc, REG_ENCODE(ROP_LOADBOOL, sp, instruction == OP_TRUE, 0), line);
+                operands[sp] = (uint8_t)sp;
+                sp++;
+                offset++;
+                break;
+            case OP_NEGATE:
+                emit(rc, REG_ENCODE(ROP_NEGATE, sp - 1, operands[sp - 1], 0), line);
+                operands[sp - 1] = (uint8_t)(sp - 1);
+                offset++;
+                break;
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE: {
+                static const RegOpCode binary[] = {
+                    [OP_ADD] = ROP_ADD, [OP_SUBTRACT] = ROP_SUBTRACT,
+                    [OP_MULTIPLY] = ROP_MULTIPLY, [OP_DIVIDE] = ROP_DIVIDE,
+                };
+                sp--;
+                emit(rc, REG_ENCODE(binary[instruction], sp - 1, operands[sp - 1], operands[sp]), line);
+                operands[sp - 1] = (uint8_t)(sp - 1);
+                offset++;
+                break;
+            }
+            case OP_ADD_CONSTANT:
+            case OP_SUBTRACT_CONSTANT:
+            case OP_MULTIPLY_CONSTANT:
+            case OP_DIVIDE_CONSTANT: {
+                // The optimizer's superinstructions map onto a plain RK operand.
+                // The constant is loaded into the free slot above if it is out of RK range.
+                static const RegOpCode binary[] = {
+                    [OP_ADD_CONSTANT] = ROP_ADD, [OP_SUBTRACT_CONSTANT] = ROP_SUBTRACT,
+                    [OP_MULTIPLY_CONSTANT] = ROP_MULTIPLY, [OP_DIVIDE_CONSTANT] = ROP_DIVIDE,
+                };
+                uint8_t constant = constantOperand(rc, chunk->code[offset + 1], sp, line);
+                emit(rc, REG_ENCODE(binary[instruction], sp - 1, operands[sp - 1], constant), line);
+                operands[sp - 1] = (uint8_t)(sp - 1);
+                if (sp + 1 > rc->registers) rc->registers = sp + 1; // 'sp' may have held the load
+                offset += 2;
+                break;
+            }
+            case OP_CALL_NATIVE: {
+                // Natives take their arguments as a contiguous array: move any
+                // pending constants and locals into their registers first.
+                int native = chunk->code[offset + 1];
+                int argCount = chunk->code[offset + 2];
+                int base = sp - argCount;
+                for (int slot = base; slot < sp; slot++) materialize(rc, operands, slot, line);
+                emit(rc, REG_ENCODE(ROP_CALL_NATIVE, base, native, argCount), line);
+                sp = base;
+                operands[sp] = (uint8_t)sp;
+                sp++;
+                offset += 3;
+                break;
+            }
+            case OP_RETURN:
+                emit(rc, REG_ENCODE(ROP_RETURN, 0, operands[sp - 1], 0), line);
+                sp--;
+                offset++;
+                break;
+            case OP_POP:
+                sp--;
+                offset++;
+                break;
+            case OP_GET_LOCAL:
+                operands[sp] = operands[chunk->code[offset + 1]];
+                sp++;
+                offset += 2;
+                break;
+            case OP_SET_LOCAL: {
+                // Slots still reading the old value get their own copy first
+                int local = chunk->code[offset + 1];
+                for (int slot = local + 1; slot < sp; slot++) {
+                    if (operands[slot] == local) materialize(rc, operands, slot, line);
+                }
+                emit(rc, REG_ENCODE(ROP_MOVE, local, operands[sp - 1], 0), line);
+                operands[local] = (uint8_t)local;
+                offset += 2;
+                break;
+            }
+            case OP_DEFINE_GLOBAL:
+            case OP_GET_GLOBAL:
+            case OP_SET_GLOBAL: {
+                int name = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+                if (instruction == OP_GET_GLOBAL) {
+                    emit(rc, REG_ENCODE_BX(ROP_GET_GLOBAL, sp, name), line);
+                    operands[sp] = (uint8_t)sp;
+                    sp++;
+                } else {
+                    RegOpCode op = (instruction == OP_DEFINE_GLOBAL) ? ROP_DEFINE_GLOBAL : ROP_SET_GLOBAL;
+                    emit(rc, REG_ENCODE_BX(op, operands[sp - 1], name), line);
+                    if (instruction == OP_DEFINE_GLOBAL) sp--;
+                }
+                if (instruction != OP_DEFINE_GLOBAL) emit(rc, 0, line); // Empty inline cache
+                offset += instructionLength(chunk, offset);
+                break;
+            }
+            default:
+                goto unsupported;
+        }
+        if (sp > rc->registers) rc->registers = sp;
+    }
+    return rc;
+
+unsupported:
+    freeRegChunk(rc);
+    return NULL;
+}
+
+void freeRegChunk(RegChunk* rc) {
+    if (rc == NULL) return;
+    free(rc->code);
+    free(rc->lines);
+    free(rc);
+}
+
+// --- Disassembler ---
+
+static void printOperand(RegChunk* rc, int operand) {
+    if (operand & RK_CONSTANT) {
+        printf(" K%d'", operand & RK_MAX_CONSTANT);
+        printValue(rc->constants->values[operand & RK_MAX_CONSTANT]);
+        printf("'");
+    } else {
+        printf(" R%d", operand);
+    }
+}
+
+void disassembleRegChunk(RegChunk* rc, const char* name) {
+    static const char* names[] = {
+        [ROP_LOADK] = "LOADK", [ROP_LOADNIL] = "LOADNIL", [ROP_LOADBOOL] = "LOADBOOL",
+        [ROP_NEGATE] = "NEGATE", [ROP_ADD] = "ADD", [ROP_SUBTRACT] = "SUBTRACT",
+        [ROP_MULTIPLY] = "MULTIPLY", [ROP_DIVIDE] = "DIVIDE",
+        [ROP_CALL_NATIVE] = "CALL_NATIVE", [ROP_RETURN] = "RETURN", [ROP_MOVE] = "MOVE",
+        [ROP_DEFINE_GLOBAL] = "DEFINE_GLOBAL", [ROP_GET_GLOBAL] = "GET_GLOBAL",
+        [ROP_SET_GLOBAL] = "SET_GLOBAL",
+    };
+    printf("== %s (%d registers) ==\n", name, rc->registers);
+    for (int i = 0; i < rc->count; i++) {
+        RegInstruction in = rc->code[i];
+        printf("%04d ", i);
+        if (i > 0 && rc->lines[i] == rc->lines[i - 1]) printf("   | ");
+        else printf("%4d ", rc->lines[i]);
+        printf("%-12s", names[REG_OP(in)]);
+
+        switch (REG_OP(in)) {
+            case ROP_LOADK:
+                printf(" R%d K%d'", REG_A(in), REG_BX(in));
+                printValue(rc->constants->values[REG_BX(in)]);
+                printf("'");
+                break;
+            case ROP_LOADNIL:
+                printf(" R%d", REG_A(in));
+                break;
+            case ROP_LOADBOOL:
+                printf(" R%d %s", REG_A(in), REG_B(in) ? "true" : "false");
+                break;
+            case ROP_NEGATE:
+            case ROP_MOVE:
+                printf(" R%d", REG_A(in));
+                printOperand(rc, REG_B(in));
+                break;
+            case ROP_GET_GLOBAL:
+                printf(" R%d '%s'", REG_A(in), AS_CSTRING(rc->constants->values[REG_BX(in)]));
+                break;
+            case ROP_DEFINE_GLOBAL:
+            case ROP_SET_GLOBAL:
+                printf(" '%s' =", AS_CSTRING(rc->constants->values[REG_BX(in)]));
+                printOperand(rc, REG_A(in));
+                break;
+            case ROP_CALL_NATIVE:
+                printf(" R%d native %d (%d args)", REG_A(in), REG_B(in), REG_C(in));
+                break;
+            case ROP_RETURN:
+                printOperand(rc, REG_B(in));
+                break;
+            default: // Binary operators
+                printf(" R%d", REG_A(in));
+                printOperand(rc, REG_B(in));
+                printOperand(rc, REG_C(in));
+                break;
+        }
+        printf("\n");
+        if (REG_OP(in) == ROP_GET_GLOBAL || REG_OP(in) == ROP_SET_GLOBAL) i++; // Skip its cache word
+    }
+}
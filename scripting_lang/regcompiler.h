@@ -0,0 +1,70 @@
+/* regcompiler.h - Register-based backend: three-address code lowered from stack bytecode */
+#ifndef CLOX_REGCOMPILER_H
+#define CLOX_REGCOMPILER_H
+
+#include "common.h"
+#include "chunk.h"
+
+// --- The Register Instruction Set ---
+// Lua 5 style: one 32-bit word per instruction, [C:8][B:8][A:8][op:8].
+// A names the destination register. B and C are "RK" operands: a register,
+// or (with RK_CONSTANT set) a constant pool index, so "x + 1" needs no load.
+typedef enum {
+    ROP_LOADK,       // A Bx    R[A] = K[Bx]
+    ROP_LOADNIL,     // A       R[A] = nil
+    ROP_LOADBOOL,    // A B     R[A] = (B != 0)
+    ROP_NEGATE,      // A B     R[A] = -RK(B)
+    ROP_ADD,         // A B C   R[A] = RK(B) + RK(C)
+    ROP_SUBTRACT,    // A B C   R[A] = RK(B) - RK(C)
+    ROP_MULTIPLY,    // A B C   R[A] = RK(B) * RK(C)
+    ROP_DIVIDE,      // A B C   R[A] = RK(B) / RK(C)
+    ROP_CALL_NATIVE, // A B C   R[A] = natives[B](R[A] .. R[A+C-1])
+    ROP_RETURN,      // B       return RK(B)
+    ROP_MOVE,        // A B     R[A] = RK(B)
+    ROP_DEFINE_GLOBAL, // A Bx  globals[K[Bx]] = RK(A), defining it
+    ROP_GET_GLOBAL,  // A Bx    R[A] = globals[K[Bx]]
+    ROP_SET_GLOBAL,  // A Bx    globals[K[Bx]] = RK(A)
+} RegOpCode;
+// ROP_GET_GLOBAL and ROP_SET_GLOBAL are followed by one more word: their
+// inline cache (vm.c), zero while empty.
+
+typedef uint32_t RegInstruction;
+
+#define REG_ENCODE(op, a, b, c) \
+    ((RegInstruction)(op) | ((RegInstruction)(a) << 8) | ((RegInstruction)(b) << 16) | ((RegInstruction)(c) << 24))
+#define REG_ENCODE_BX(op, a, bx) ((RegInstruction)(op) | ((RegInstruction)(a) << 8) | ((RegInstruction)(bx) << 16))
+#define REG_OP(i)  ((i) & 0xff)
+#define REG_A(i)   (((i) >> 8) & 0xff)
+#define REG_B(i)   (((i) >> 16) & 0xff)
+#define REG_C(i)   ((i) >> 24)
+#define REG_BX(i)  ((i) >> 16)
+
+#define RK_CONSTANT 0x80             // Operand flag: constant index, not a register
+#define RK_MAX_CONSTANT 0x7f         // Higher constants are loaded with ROP_LOADK
+#define REG_MAX 0x80                 // Registers an RK operand can name
+
+/*
+ * Code for the register VM. It shares the constant pool of the stack chunk
+ * it was lowered from, and lives as long as that chunk (see Chunk.regCode).
+ */
+typedef struct RegChunk {
+    int count;
+    int capacity;
+    RegInstruction* code;
+    int* lines;             // Source line of each instruction
+    ValueArray* constants;  // The stack chunk's pool
+    int registers;          // Frame size: the deepest stack slot used + 1
+} RegChunk;
+
+/**
+ * @brief Translates a stack chunk into register code.
+ * Every stack slot becomes a register (a local's slot is its register);
+ * literals stay constant operands.
+ * @return The register code, or NULL if the chunk uses an opcode this
+ *         backend does not implement (the caller keeps the stack VM).
+ */
+RegChunk* lowerToRegisters(Chunk* chunk);
+void freeRegChunk(RegChunk* rc);
+void disassembleRegChunk(RegChunk* rc, const char* name);
+
+#endif
@@ -0,0 +1,127 @@
+/* table.c - Open-addressed hash table keyed by interned strings */
+#include "table.h"
+#include "memory.h"
+#include "object.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Table arrays come from malloc, not the GC heap: growing the string table
+// while a new string is being interned must never start a collection.
+
+void initTable(Table* table) {
+    table->count = 0;
+    table->capacity = 0;
+    table->entries = NULL;
+}
+
+void freeTable(Table* table) {
+    free(table->entries);
+    initTable(table);
+}
+
+static Entry* findEntry(Entry* entries, int capacity, ObjString* key) {
+    uint32_t index = key->hash & (capacity - 1);
+    Entry* tombstone = NULL;
+    for (;;) {
+        Entry* entry = &entries[index];
+        if (entry->key == NULL) {
+            if (IS_NIL(entry->value)) {
+                // Truly empty: reuse a tombstone passed on the way, if any
+                return tombstone != NULL ? tombstone : entry;
+            }
+            if (tombstone == NULL) tombstone = entry;
+        } else if (entry->key == key) {
+            return entry;
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+static void adjustCapacity(Table* table, int capacity) {
+    Entry* entries = (Entry*)malloc(sizeof(Entry) * capacity);
+    if (entries == NULL) {
+        perror("malloc Table");
+        exit(1);
+    }
+    for (int i = 0; i < capacity; i++) {
+        entries[i].key = NULL;
+        entries[i].value = NIL_VAL;
+    }
+
+    // Re-insert the live entries; tombstones are dropped, so recount
+    table->count = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        Entry* entry = &table->entries[i];
+        if (entry->key == NULL) continue;
+        Entry* dest = findEntry(entries, capacity, entry->key);
+        dest->key = entry->key;
+        dest->value = entry->value;
+        table->count++;
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+}
+
+bool tableGet(Table* table, ObjString* key, Value* value) {
+    if (table->count == 0) return false;
+    Entry* entry = findEntry(table->entries, table->capacity, key);
+    if (entry->key == NULL) return false;
+    *value = entry->value;
+    return true;
+}
+
+bool tableSet(Table* table, ObjString* key, Value value) {
+    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
+        // Count includes tombstones. When they are most of it (the string
+        // table after a collection) rehash at the same size: doubling each
+        // time would let the table, and every scan of it, grow without bound.
+        int live = 0;
+        for (int i = 0; i < table->capacity; i++) {
+            if (table->entries[i].key != NULL) live++;
+        }
+        int capacity = table->capacity < 8 ? 8 : table->capacity;
+        if (live + 1 > capacity * TABLE_MAX_LOAD / 2) capacity *= 2;
+        adjustCapacity(table, capacity);
+    }
+    Entry* entry = findEntry(table->entries, table->capacity, key);
+    bool isNewKey = entry->key == NULL;
+    if (isNewKey && IS_NIL(entry->value)) table->count++; // Reusing a tombstone keeps the count
+    entry->key = key;
+    entry->value = value;
+    return isNewKey;
+}
+
+bool tableDelete(Table* table, ObjString* key) {
+    if (table->count == 0) return false;
+    Entry* entry = findEntry(table->entries, table->capacity, key);
+    if (entry->key == NULL) return false;
+    // Leave a tombstone so probe sequences running through this slot go on
+    entry->key = NULL;
+    entry->value = BOOL_VAL(true);
+    return true;
+}
+
+ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash) {
+    if (table->count == 0) return NULL;
+    uint32_t index = hash & (table->capacity - 1);
+    for (;;) {
+        Entry* entry = &table->entries[index];
+        if (entry->key == NULL) {
+            if (IS_NIL(entry->value)) return NULL; // Empty, not a tombstone
+        } else if (entry->key->length == length && entry->key->hash == hash &&
+                   memcmp(entry->key->chars, chars, length) == 0) {
+            return entry->key;
+        }
+        index = (index + 1) & (table->capacity - 1);
+    }
+}
+
+void markTable(Table* table) {
+    for (int i = 0; i < table->capacity; i++) {
+        Entry* entry = &table->entries[i];
+        markObject((Obj*)entry->key);
+        markValue(entry->value);
+    }
+}
@@ -0,0 +1,36 @@
+/* table.h - Hash table keyed by interned strings */
+#ifndef CLOX_TABLE_H
+#define CLOX_TABLE_H
+
+#include "common.h"
+#include "value.h"
+
+// --- Configuration ---
+#define TABLE_MAX_LOAD 0.75 // Grow before more than 3/4 of the slots are in use
+
+typedef struct {
+    ObjString* key;   // NULL: empty, or a tombstone if value is true
+    Value value;
+} Entry;
+
+// Open addressing with linear probing. Keys are interned, so a probe
+// compares pointers; only tableFindString() looks at characters.
+typedef struct {
+    int count;        // Live entries plus tombstones
+    int capacity;     // Always a power of two (or 0)
+    Entry* entries;
+} Table;
+
+void initTable(Table* table);
+void freeTable(Table* table);
+bool tableGet(Table* table, ObjString* key, Value* value);
+// Returns true if 'key' was not in the table yet.
+bool tableSet(Table* table, ObjString* key, Value value);
+bool tableDelete(Table* table, ObjString* key);
+// Finds the interned string with these characters (the string table's lookup).
+ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash);
+
+// GC support: marks every key and value.
+void markTable(Table* table);
+
+#endif
@@ -1,6 +1,7 @@
 /* value.c - Implementation of ValueArray and printValue */
 #include "common.h"
 #include "value.h"
+#include "object.h"
 
 #include <stdio.h>
 #include <stdlib.h> // for realloc, free
@@ -31,10 +32,24 @@ void freeValueArray(ValueArray* array) {
     initValueArray(array);
 }
 
+bool valuesEqual(Value a, Value b) {
+    // Written with the IS_ macros so it works with either Value encoding
+    if (IS_NUMBER(a) && IS_NUMBER(b)) return AS_NUMBER(a) == AS_NUMBER(b); // NaN != NaN
+    if (IS_NUMBER(a) || IS_NUMBER(b)) return false;
+    if (IS_NIL(a) || IS_NIL(b)) return IS_NIL(a) && IS_NIL(b);
+    if (IS_BOOL(a) || IS_BOOL(b)) return IS_BOOL(a) && IS_BOOL(b) && AS_BOOL(a) == AS_BOOL(b);
+    return AS_OBJ(a) == AS_OBJ(b);
+}
+
 void printValue(Value value) {
-    switch (value.type) {
-        case VAL_BOOL:   printf(AS_BOOL(value) ? "true" : "false"); break;
-        case VAL_NIL:    printf("nil"); break;
-        case VAL_NUMBER: printf("%g", AS_NUMBER(value)); break;
+    // Written with the IS_ macros so it works with either Value encoding
+    if (IS_BOOL(value)) {
+        printf(AS_BOOL(value) ? "true" : "false");
+    } else if (IS_NIL(value)) {
+        printf("nil");
+    } else if (IS_NUMBER(value)) {
+        printf("%g", AS_NUMBER(value));
+    } else if (IS_OBJ(value)) {
+        printObject(value);
     }
 }
@@ -1,16 +1,70 @@
-/* value.h - Defines the Lox "Value" (a tagged union) */
+/* value.h - Defines the Lox "Value" (a tagged union, or NaN-boxed) */
 #ifndef CLOX_VALUE_H
 #define CLOX_VALUE_H
 
 #include "common.h"
 
+// Heap-allocated values (object.h)
+typedef struct Obj Obj;
+typedef struct ObjString ObjString;
+
+#ifdef CSCRIPT_NAN_BOXING
+// --- NaN Boxing ---
+// Niche C: a Value is a plain 64-bit word. Any double is stored as its own
+// bits; everything else hides in the payload of a quiet NaN, a bit pattern
+// no arithmetic ever produces. 8 bytes per value instead of 16 halves the
+// traffic of the stack and constant pool. Object pointers (48 bits on x86-64
+// and AArch64) go in the payload with the sign bit set.
+#include <string.h> // for memcpy
+
+typedef uint64_t Value;
+
+// Exponent all ones, the quiet bit, and one more so that the NaNs hardware
+// produces (0x7ff8..., 0xfff8...) still read as numbers.
+#define QNAN      ((uint64_t)0x7ffc000000000000)
+#define SIGN_BIT  ((uint64_t)0x8000000000000000)
+#define TAG_NIL   1
+#define TAG_FALSE 2
+#define TAG_TRUE  3
+
+#define IS_BOOL(value)    (((value) | 1) == TRUE_VAL) // FALSE and TRUE differ only in bit 0
+#define IS_NIL(value)     ((value) == NIL_VAL)
+#define IS_NUMBER(value)  (((value) & QNAN) != QNAN)
+#define IS_OBJ(value)     (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
+
+#define AS_BOOL(value)    ((value) == TRUE_VAL)
+#define AS_NUMBER(value)  valueToNum(value)
+#define AS_OBJ(value)     ((Obj*)(uintptr_t)((value) & ~(SIGN_BIT | QNAN)))
+
+#define BOOL_VAL(b)       ((b) ? TRUE_VAL : FALSE_VAL)
+#define FALSE_VAL         ((Value)(QNAN | TAG_FALSE))
+#define TRUE_VAL          ((Value)(QNAN | TAG_TRUE))
+#define NIL_VAL           ((Value)(QNAN | TAG_NIL))
+#define NUMBER_VAL(num)   numToValue(num)
+#define OBJ_VAL(obj)      (Value)(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(obj))
+
+// Niche C: memcpy is the defined way to reinterpret bits; it compiles to a register move.
+static inline double valueToNum(Value value) {
+    double num;
+    memcpy(&num, &value, sizeof(num));
+    return num;
+}
+
+static inline Value numToValue(double num) {
+    Value value;
+    memcpy(&value, &num, sizeof(num));
+    return value;
+}
+
+#else
 // --- The Tagged Union ---
 // This is the core C "niche" trick.
-// A single Value can be a bool, nil, or number.
+// A single Value can be a bool, nil, number, or a pointer to a heap object.
 typedef enum {
     VAL_BOOL,
     VAL_NIL,
     VAL_NUMBER,
+    VAL_OBJ,
 } ValueType;
 
 typedef struct {
@@ -18,6 +72,7 @@ typedef struct {
     union {
         bool boolean;
         double number;
+        Obj* obj;
     } as; // The "as" union
 } Value;
 
@@ -25,13 +80,17 @@ typedef struct {
 #define IS_BOOL(value)    ((value).type == VAL_BOOL)
 #define IS_NIL(value)     ((value).type == VAL_NIL)
 #define IS_NUMBER(value)  ((value).type == VAL_NUMBER)
+#define IS_OBJ(value)     ((value).type == VAL_OBJ)
 
 #define AS_BOOL(value)    ((value).as.boolean)
 #define AS_NUMBER(value)  ((value).as.number)
+#define AS_OBJ(value)     ((value).as.obj)
 
 #define BOOL_VAL(value)   ((Value){VAL_BOOL, {.boolean = value}})
 #define NIL_VAL           ((Value){VAL_NIL, {.number = 0}}) // 'as' is ignored
 #define NUMBER_VAL(value) ((Value){VAL_NUMBER, {.number = value}})
+#define OBJ_VAL(object)   ((Value){VAL_OBJ, {.obj = (Obj*)object}})
+#endif // CSCRIPT_NAN_BOXING
 
 
 // --- Dynamic Array (for constants) ---
@@ -46,6 +105,8 @@ void initValueArray(ValueArray* array);
 void writeValueArray(ValueArray* array, Value value);
 void freeValueArray(ValueArray* array);
 
+// ==: numbers by value, everything else by identity (strings are interned).
+bool valuesEqual(Value a, Value b);
 void printValue(Value value);
 
 #endif
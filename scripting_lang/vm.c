@@ -2,7 +2,11 @@
 #include "common.h"
 #include "debug.h"
 #include "compiler.h"
+#include "jit.h"
+#include "memory.h"
+#include "object.h"
 #include <stdio.h>
+#include <string.h>
 #include <stdarg.h> // for va_list
 
 VM vm; // Global VM object
@@ -10,6 +14,8 @@ VM vm; // Global VM object
 // --- Stack ---
 static void resetStack() {
     vm.stackTop = vm.stack;
+    vm.frameCount = 0;
+    vm.openUpvalues = NULL;
 }
 
 void push(Value value) {
@@ -34,19 +40,282 @@ static void runtimeError(const char* format, ...) {
     va_end(args);
     fputs("\n", stderr);
 
-    // Show stack trace
-    size_t instruction = vm.ip - vm.chunk->code - 1;
-    int line = vm.chunk->lines[instruction];
-    fprintf(stderr, "[line %d] in script\n", line);
+    // Show stack trace, innermost call first
+    if (vm.regChunk) {
+        fprintf(stderr, "[line %d] in script\n", vm.regChunk->lines[vm.pc - vm.regChunk->code - 1]);
+    } else {
+        for (int i = vm.frameCount - 1; i >= 0; i--) {
+            CallFrame* frame = &vm.frames[i];
+            int line = getLine(frame->chunk, (int)(frame->ip - frame->chunk->code - 1));
+            if (frame->closure == NULL) {
+                fprintf(stderr, "[line %d] in script\n", line);
+            } else {
+                fprintf(stderr, "[line %d] in %s()\n", line, frame->closure->function->name->chars);
+            }
+        }
+    }
     resetStack();
 }
 
 // --- Public API ---
 void initVM() {
     resetStack();
+    vm.result = NIL_VAL;
+    initTable(&vm.globalSlots);
+    initValueArray(&vm.globalValues);
+    vm.globalVersion = 1;
+    vm.inlineCaches = true;
+    vm.globalLookups = 0;
+    vm.nativeCount = 0;
+    vm.interrupt = NULL;
+    vm.interruptContext = NULL;
+    vm.instructionHook = NULL;
+    vm.hookContext = NULL;
+    vm.trace = false;
+    vm.optimize = false;
+    vm.backend = BACKEND_STACK;
+    vm.regChunk = NULL;
+    vm.pc = NULL;
+    vm.jit = false;
+    vm.jitPollCountdown = JIT_POLL_INTERVAL;
+
+    vm.objects = NULL;
+    initTable(&vm.strings);
+    vm.grayStack = NULL;
+    vm.grayCount = 0;
+    vm.grayCapacity = 0;
+    vm.gcGrowthFactor = GC_DEFAULT_GROWTH_FACTOR;
+    vm.gcStepBudget = GC_DEFAULT_STEP_BUDGET;
+    memset(&vm.gc, 0, sizeof(vm.gc));
+    vm.gc.nextGC = GC_INITIAL_HEAP;
+}
+
+void defineNative(const char* name, NativeFn function) {
+    if (vm.nativeCount == NATIVES_MAX) {
+        fprintf(stderr, "Too many natives (max %d).\n", NATIVES_MAX);
+        return;
+    }
+    vm.natives[vm.nativeCount].name = name;
+    vm.natives[vm.nativeCount].function = function;
+    vm.nativeCount++;
+}
+
+int findNative(const char* name, int length) {
+    for (int i = 0; i < vm.nativeCount; i++) {
+        if ((int)strlen(vm.natives[i].name) == length &&
+            memcmp(vm.natives[i].name, name, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* nativeName(int index) {
+    return vm.natives[index].name;
+}
+
+void setInterruptHook(InterruptFn interrupt, void* context) {
+    vm.interrupt = interrupt;
+    vm.interruptContext = context;
+}
+
+bool setInstructionHook(InstructionHookFn hook, void* context) {
+    vm.instructionHook = hook;
+    vm.hookContext = context;
+#ifdef CSCRIPT_TRACE
+    return true;
+#else
+    return hook == NULL;
+#endif
+}
+
+bool setTraceExecution(bool enabled) {
+    vm.trace = enabled;
+    return setInstructionHook(enabled ? traceInstruction : NULL, NULL);
+}
+
+bool traceExecution() {
+    return vm.trace;
+}
+
+void setOptimization(bool enabled) {
+    vm.optimize = enabled;
 }
+
+bool optimizationEnabled() {
+    return vm.optimize;
+}
+
+void setBackend(Backend backend) {
+    vm.backend = backend;
+}
+
+bool setJit(bool enabled) {
+    vm.jit = enabled && jitAvailable();
+    return vm.jit == enabled;
+}
+
+// Empties the inline caches in 'chunk' (stack and register code).
+static void resetGlobalCaches(Chunk* chunk) {
+    for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) {
+        uint8_t op = chunk->code[offset];
+        if (op == OP_GET_GLOBAL || op == OP_SET_GLOBAL) memset(chunk->code + offset + 3, 0, GLOBAL_CACHE_BYTES);
+    }
+    RegChunk* rc = chunk->regCode;
+    for (int i = 0; rc != NULL && i < rc->count; i++) {
+        RegOpCode op = (RegOpCode)REG_OP(rc->code[i]);
+        if (op == ROP_GET_GLOBAL || op == ROP_SET_GLOBAL) rc->code[++i] = 0;
+    }
+}
+
+void clearGlobals() {
+    freeTable(&vm.globalSlots);
+    freeValueArray(&vm.globalValues);
+    // Slots get handed out again from 0: every cache filled so far is stale.
+    // Niche C: a uint16_t version wraps after 65535 clears and an old cache
+    // could match again, so then every chunk's caches are emptied instead.
+    if (++vm.globalVersion == 0) {
+        forEachChunk(resetGlobalCaches);
+        vm.globalVersion = 1;
+    }
+}
+
+void setInlineCaches(bool enabled) {
+    vm.inlineCaches = enabled;
+}
+
 void freeVM() {
-    // We will need this when we add objects
+    clearGlobals();
+    freeTable(&vm.strings);
+    freeObjects();
+}
+
+// --- Calls ---
+
+// Pushes a frame for 'closure'; its arguments are the top 'argCount' values.
+static bool call(ObjClosure* closure, int argCount) {
+    if (argCount != closure->function->arity) {
+        runtimeError("Expected %d arguments but got %d.", closure->function->arity, argCount);
+        return false;
+    }
+    if (vm.frameCount == FRAMES_MAX || vm.stackTop + UINT8_COUNT > vm.stack + STACK_MAX) {
+        runtimeError("Stack overflow.");
+        return false;
+    }
+    CallFrame* frame = &vm.frames[vm.frameCount++];
+    frame->closure = closure;
+    frame->chunk = &closure->function->chunk;
+    frame->ip = frame->chunk->code;
+    frame->slots = vm.stackTop - argCount - 1;
+    return true;
+}
+
+static bool callValue(Value callee, int argCount) {
+    if (IS_CLOSURE(callee)) return call(AS_CLOSURE(callee), argCount);
+    runtimeError("Can only call functions.");
+    return false;
+}
+
+// The upvalue for stack slot 'local': shared by every closure capturing it.
+static ObjUpvalue* captureUpvalue(Value* local) {
+    ObjUpvalue* previous = NULL;
+    ObjUpvalue* upvalue = vm.openUpvalues;
+    while (upvalue != NULL && upvalue->location > local) {
+        previous = upvalue;
+        upvalue = upvalue->next;
+    }
+    if (upvalue != NULL && upvalue->location == local) return upvalue;
+
+    ObjUpvalue* created = newUpvalue(local);
+    created->next = upvalue;
+    if (previous == NULL) {
+        vm.openUpvalues = created;
+    } else {
+        previous->next = created;
+    }
+    return created;
+}
+
+// Closes every open upvalue at or above 'last': the slots are going away.
+static void closeUpvalues(Value* last) {
+    while (vm.openUpvalues != NULL && vm.openUpvalues->location >= last) {
+        ObjUpvalue* upvalue = vm.openUpvalues;
+        upvalue->closed = *upvalue->location;
+        upvalue->location = &upvalue->closed;
+        gcBarrier(upvalue->closed); // Leaves the rescanned stack for a maybe black object
+        vm.openUpvalues = upvalue->next;
+    }
+}
+
+static bool isFalsey(Value value) {
+    return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+// --- Globals ---
+// Shared by both backends. Table and array growth use plain malloc, so
+// nothing here can run the collector.
+
+// The value slot of global 'name', or NULL if it was never defined.
+static Value* findGlobal(ObjString* name) {
+    Value slot;
+    if (!tableGet(&vm.globalSlots, name, &slot)) return NULL;
+    return &vm.globalValues.values[(int)AS_NUMBER(slot)];
+}
+
+// Cache miss: finds 'name' by hashing and fills 'cache' for next time.
+static Value* lookupGlobal(ObjString* name, void* cache) {
+    vm.globalLookups++;
+    Value slot;
+    if (!tableGet(&vm.globalSlots, name, &slot)) return NULL;
+    int index = (int)AS_NUMBER(slot);
+    if (vm.inlineCaches && index <= UINT16_MAX) {
+        GlobalCache filled = {vm.globalVersion, (uint16_t)index};
+        memcpy(cache, &filled, sizeof(filled)); // Code bytes have no alignment
+    }
+    return &vm.globalValues.values[index];
+}
+
+// "var name = value;" at top level: defining an existing global assigns it.
+static void defineGlobal(ObjString* name, Value value) {
+    Value* slot = findGlobal(name);
+    if (slot != NULL) {
+        *slot = value;
+    } else {
+        tableSet(&vm.globalSlots, name, NUMBER_VAL(vm.globalValues.count));
+        writeValueArray(&vm.globalValues, value);
+        gcBarrier(OBJ_VAL(name));
+    }
+    gcBarrier(value);
+}
+
+// --- Baseline JIT ---
+
+// Called wherever a stack frame starts running from 'ip': its first
+// instruction, a loop's back-edge, or the return from a call. Counts the
+// entry; the JIT_THRESHOLD'th compiles the chunk (once: a chunk the JIT
+// cannot map stays interpreted). Chunks with machine code run it from 'ip'.
+// Returns where the interpreter picks up, or NULL if the interrupt hook
+// stopped the script (the runtime error is reported).
+static uint8_t* enterJit(CallFrame* frame, uint8_t* ip) {
+    Chunk* chunk = frame->chunk;
+    if (chunk->jit == NULL) {
+        // Traced runs must see every instruction
+        if (++chunk->hotness != JIT_THRESHOLD || vm.instructionHook != NULL) return ip;
+        chunk->jit = compileJit(chunk);
+        if (chunk->jit == NULL) return ip;
+    }
+    int offset = (int)(ip - chunk->code);
+    for (;;) {
+        int exit = runJit(chunk->jit, frame->slots, offset);
+        offset = exit >> 1;
+        if (!(exit & JIT_EXIT_POLL)) break;
+        if (vm.interrupt && vm.interrupt(vm.interruptContext)) {
+            frame->ip = chunk->code + offset;
+            runtimeError("Script interrupted: budget exceeded.");
+            return NULL;
+        }
+    }
+    return chunk->code + offset;
 }
 
 /**
@@ -57,18 +326,46 @@ static InterpretResult run() {
     // --- Niche C: Register Caching ---
     // We copy ip to a local var. Many C compilers
     // will place this in a CPU register, making the
-    // loop *much* faster than "vm.ip".
-    register uint8_t* ip = vm.ip;
+    // loop *much* faster than "frame->ip".
+    CallFrame* frame = &vm.frames[vm.frameCount - 1];
+    register uint8_t* ip = frame->ip;
+    int interruptCountdown = INTERRUPT_INTERVAL;
 
     // --- Helper Macros ---
     #define READ_BYTE() (*ip++)
-    #define READ_CONSTANT() (vm.chunk->constants.values[READ_BYTE()])
+    #define READ_SHORT() (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+    #define READ_CONSTANT() (frame->chunk->constants.values[READ_BYTE()])
+    #define READ_CONSTANT_LONG() \
+        (ip += 3, frame->chunk->constants.values[(ip[-3] << 16) | (ip[-2] << 8) | ip[-1]])
+    #define READ_CONSTANT_SHORT() (frame->chunk->constants.values[READ_SHORT()])
+    #define READ_STRING_SHORT() AS_STRING(READ_CONSTANT_SHORT())
+
+    // Sets 'slot' for the global an OP_GET_GLOBAL / OP_SET_GLOBAL names,
+    // from its inline cache when that is current, and steps past the operands.
+    #define GLOBAL_SLOT(slot) \
+        do { \
+            GlobalCache cache; \
+            memcpy(&cache, ip + 2, sizeof(cache)); \
+            if (cache.version == vm.globalVersion) { \
+                slot = &vm.globalValues.values[cache.slot]; \
+            } else { \
+                ObjString* name = AS_STRING(frame->chunk->constants.values[(ip[0] << 8) | ip[1]]); \
+                slot = lookupGlobal(name, ip + 2); \
+                if (slot == NULL) { \
+                    frame->ip = ip; \
+                    runtimeError("Undefined variable '%s'.", name->chars); \
+                    return INTERPRET_RUNTIME_ERROR; \
+                } \
+            } \
+            ip += 2 + GLOBAL_CACHE_BYTES; \
+        } while (false)
     
     // Niche C: This is a "binary" operator macro
     // It pops b, then a, performs the op, and pushes the result.
     #define BINARY_OP(valueType, op) \
         do { \
             if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
+                frame->ip = ip; \
                 runtimeError("Operands must be numbers."); \
                 return INTERPRET_RUNTIME_ERROR; \
             } \
@@ -77,57 +374,480 @@ static InterpretResult run() {
             push(valueType(a op b)); \
         } while (false)
 
+    // Superinstruction form: the right operand comes from the constant pool
+    // (the optimizer only fuses number constants) and the result replaces
+    // the left operand in place.
+    #define BINARY_CONSTANT_OP(valueType, op, message) \
+        do { \
+            double b = AS_NUMBER(READ_CONSTANT()); \
+            if (!IS_NUMBER(peek(0))) { \
+                frame->ip = ip; \
+                runtimeError(message); \
+                return INTERPRET_RUNTIME_ERROR; \
+            } \
+            vm.stackTop[-1] = valueType(AS_NUMBER(vm.stackTop[-1]) op b); \
+        } while (false)
+
+    // --- Instruction Prologue ---
+    // Runs before every instruction in both dispatch modes.
+    #ifdef CSCRIPT_TRACE
+    #define TRACE_INSTRUCTION() \
+        do { \
+            if (vm.instructionHook) { \
+                vm.instructionHook(frame->chunk, (int)(ip - frame->chunk->code), \
+                                   vm.stack, vm.stackTop, vm.hookContext); \
+            } \
+        } while (false)
+    #else
+    #define TRACE_INSTRUCTION() do {} while (false)
+    #endif
+
+    // Where a frame (re)starts: hand it to its machine code if it has any
+    #define ENTER_JIT() \
+        do { \
+            if (vm.jit) { \
+                ip = enterJit(frame, ip); \
+                if (ip == NULL) return INTERPRET_RUNTIME_ERROR; \
+            } \
+        } while (false)
+
+    // Let the host abort long-running scripts (e.g. a time budget)
+    #define POLL_INTERRUPT() \
+        do { \
+            if (--interruptCountdown == 0) { \
+                interruptCountdown = INTERRUPT_INTERVAL; \
+                if (vm.interrupt && vm.interrupt(vm.interruptContext)) { \
+                    frame->ip = ip; \
+                    runtimeError("Script interrupted: budget exceeded."); \
+                    return INTERPRET_RUNTIME_ERROR; \
+                } \
+            } \
+        } while (false)
+
+    // --- Dispatch ---
+    #ifdef CSCRIPT_THREADED_DISPATCH
+    // Niche C: "labels as values" (a GCC/Clang extension). Every handler ends
+    // in its own indirect jump through this table, so the branch predictor
+    // learns per-opcode successors instead of sharing one switch jump.
+    // Must list every OpCode.
+    static void* dispatchTable[] = {
+        [OP_CONSTANT]    = &&code_OP_CONSTANT,
+        [OP_CONSTANT_LONG] = &&code_OP_CONSTANT_LONG,
+        [OP_NIL]         = &&code_OP_NIL,
+        [OP_TRUE]        = &&code_OP_TRUE,
+        [OP_FALSE]       = &&code_OP_FALSE,
+        [OP_NEGATE]      = &&code_OP_NEGATE,
+        [OP_ADD]         = &&code_OP_ADD,
+        [OP_SUBTRACT]    = &&code_OP_SUBTRACT,
+        [OP_MULTIPLY]    = &&code_OP_MULTIPLY,
+        [OP_DIVIDE]      = &&code_OP_DIVIDE,
+        [OP_CALL_NATIVE] = &&code_OP_CALL_NATIVE,
+        [OP_RETURN]      = &&code_OP_RETURN,
+        [OP_POP]         = &&code_OP_POP,
+        [OP_GET_LOCAL]   = &&code_OP_GET_LOCAL,
+        [OP_SET_LOCAL]   = &&code_OP_SET_LOCAL,
+        [OP_DEFINE_GLOBAL] = &&code_OP_DEFINE_GLOBAL,
+        [OP_GET_GLOBAL]  = &&code_OP_GET_GLOBAL,
+        [OP_SET_GLOBAL]  = &&code_OP_SET_GLOBAL,
+        [OP_EQUAL]       = &&code_OP_EQUAL,
+        [OP_GREATER]     = &&code_OP_GREATER,
+        [OP_LESS]        = &&code_OP_LESS,
+        [OP_NOT]         = &&code_OP_NOT,
+        [OP_JUMP]        = &&code_OP_JUMP,
+        [OP_JUMP_IF_FALSE] = &&code_OP_JUMP_IF_FALSE,
+        [OP_LOOP]        = &&code_OP_LOOP,
+        [OP_CALL]        = &&code_OP_CALL,
+        [OP_CLOSURE]     = &&code_OP_CLOSURE,
+        [OP_GET_UPVALUE] = &&code_OP_GET_UPVALUE,
+        [OP_SET_UPVALUE] = &&code_OP_SET_UPVALUE,
+        [OP_CLOSE_UPVALUE] = &&code_OP_CLOSE_UPVALUE,
+        [OP_ADD_CONSTANT]      = &&code_OP_ADD_CONSTANT,
+        [OP_SUBTRACT_CONSTANT] = &&code_OP_SUBTRACT_CONSTANT,
+        [OP_MULTIPLY_CONSTANT] = &&code_OP_MULTIPLY_CONSTANT,
+        [OP_DIVIDE_CONSTANT]   = &&code_OP_DIVIDE_CONSTANT,
+    };
+
+    #define INTERPRET_LOOP    DISPATCH();
+    #define CASE_CODE(op)     code_##op
+    #define DISPATCH() \
+        do { \
+            TRACE_INSTRUCTION(); \
+            POLL_INTERRUPT(); \
+            goto *dispatchTable[READ_BYTE()]; \
+        } while (false)
+    #else
+    // Portable fallback: one switch, re-entered after every instruction.
+    #define INTERPRET_LOOP \
+        loop: \
+            TRACE_INSTRUCTION(); \
+            POLL_INTERRUPT(); \
+            switch (READ_BYTE())
+    #define CASE_CODE(op)     case op
+    #define DISPATCH()        goto loop
+    #endif
+
     // --- The Dispatch Loop ---
-    for (;;) {
-        #ifdef DEBUG_TRACE_EXECUTION
-        // Print the stack
-        printf("          ");
-        for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
-            printf("[ ");
-            printValue(*slot);
-            printf(" ]");
+    ENTER_JIT();
+    INTERPRET_LOOP
+    {
+        CASE_CODE(OP_CONSTANT): {
+            Value constant = READ_CONSTANT();
+            push(constant);
+            DISPATCH();
         }
-        printf("\n");
-        // Print the instruction
-        disassembleInstruction(vm.chunk, (int)(ip - vm.chunk->code));
-        #endif
-
-        uint8_t instruction;
-        switch (instruction = READ_BYTE()) {
-            case OP_CONSTANT: {
-                Value constant = READ_CONSTANT();
-                push(constant);
-                break;
+        CASE_CODE(OP_CONSTANT_LONG): {
+            Value constant = READ_CONSTANT_LONG();
+            push(constant);
+            DISPATCH();
+        }
+        CASE_CODE(OP_NIL):   push(NIL_VAL); DISPATCH();
+        CASE_CODE(OP_TRUE):  push(BOOL_VAL(true)); DISPATCH();
+        CASE_CODE(OP_FALSE): push(BOOL_VAL(false)); DISPATCH();
+
+        CASE_CODE(OP_NEGATE):
+            if (!IS_NUMBER(peek(0))) {
+                frame->ip = ip;
+                runtimeError("Operand must be a number.");
+                return INTERPRET_RUNTIME_ERROR;
             }
-            case OP_NIL: push(NIL_VAL); break;
-            case OP_TRUE: push(BOOL_VAL(true)); break;
-            case OP_FALSE: push(BOOL_VAL(false)); break;
-
-            case OP_NEGATE:
-                if (!IS_NUMBER(peek(0))) {
-                    runtimeError("Operand must be a number.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                push(NUMBER_VAL(-AS_NUMBER(pop())));
-                break;
-
-            case OP_ADD:      BINARY_OP(NUMBER_VAL, +); break;
-            case OP_SUBTRACT: BINARY_OP(NUMBER_VAL, -); break;
-            case OP_MULTIPLY: BINARY_OP(NUMBER_VAL, *); break;
-            case OP_DIVIDE:   BINARY_OP(NUMBER_VAL, /); break;
-
-            case OP_RETURN: {
-                printValue(pop());
-                printf("\n");
-                vm.ip = ip; // Write back the IP
+            push(NUMBER_VAL(-AS_NUMBER(pop())));
+            DISPATCH();
+
+        CASE_CODE(OP_ADD): {
+            if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
+                double b = AS_NUMBER(pop());
+                vm.stackTop[-1] = NUMBER_VAL(AS_NUMBER(vm.stackTop[-1]) + b);
+            } else if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
+                // Both stay on the stack while the result is allocated (it may collect)
+                ObjString* result = concatenateStrings(AS_STRING(peek(1)), AS_STRING(peek(0)));
+                vm.stackTop--;
+                vm.stackTop[-1] = OBJ_VAL(result);
+            } else {
+                frame->ip = ip;
+                runtimeError("Operands must be two numbers or two strings.");
+                return INTERPRET_RUNTIME_ERROR;
+            }
+            DISPATCH();
+        }
+        CASE_CODE(OP_SUBTRACT): BINARY_OP(NUMBER_VAL, -); DISPATCH();
+        CASE_CODE(OP_MULTIPLY): BINARY_OP(NUMBER_VAL, *); DISPATCH();
+        CASE_CODE(OP_DIVIDE):   BINARY_OP(NUMBER_VAL, /); DISPATCH();
+
+        // Same errors as the unfused instructions (the constant is a number)
+        CASE_CODE(OP_ADD_CONSTANT):
+            BINARY_CONSTANT_OP(NUMBER_VAL, +, "Operands must be two numbers or two strings.");
+            DISPATCH();
+        CASE_CODE(OP_SUBTRACT_CONSTANT): BINARY_CONSTANT_OP(NUMBER_VAL, -, "Operands must be numbers."); DISPATCH();
+        CASE_CODE(OP_MULTIPLY_CONSTANT): BINARY_CONSTANT_OP(NUMBER_VAL, *, "Operands must be numbers."); DISPATCH();
+        CASE_CODE(OP_DIVIDE_CONSTANT):   BINARY_CONSTANT_OP(NUMBER_VAL, /, "Operands must be numbers."); DISPATCH();
+
+        CASE_CODE(OP_CALL_NATIVE): {
+            Native* native = &vm.natives[READ_BYTE()];
+            int argCount = READ_BYTE();
+            Value* args = vm.stackTop - argCount;
+            Value result;
+            frame->ip = ip; // So runtimeError() reports the right line
+            if (!native->function(argCount, args, &result)) {
+                runtimeError("Error in native '%s'.", native->name);
+                return INTERPRET_RUNTIME_ERROR;
+            }
+            vm.stackTop = args; // Pop the arguments
+            push(result);
+            DISPATCH();
+        }
+
+        CASE_CODE(OP_POP): vm.stackTop--; DISPATCH();
+
+        // Locals are plain stack slots: an indexed load or store, no lookup
+        CASE_CODE(OP_GET_LOCAL): push(frame->slots[READ_BYTE()]); DISPATCH();
+        CASE_CODE(OP_SET_LOCAL): frame->slots[READ_BYTE()] = peek(0); DISPATCH();
+
+        CASE_CODE(OP_DEFINE_GLOBAL):
+            defineGlobal(READ_STRING_SHORT(), peek(0));
+            vm.stackTop--;
+            DISPATCH();
+        CASE_CODE(OP_GET_GLOBAL): {
+            Value* slot;
+            GLOBAL_SLOT(slot);
+            push(*slot);
+            DISPATCH();
+        }
+        CASE_CODE(OP_SET_GLOBAL): {
+            Value* slot;
+            GLOBAL_SLOT(slot);
+            *slot = peek(0); // Assignment is an expression: the value stays
+            gcBarrier(*slot);
+            DISPATCH();
+        }
+
+        CASE_CODE(OP_EQUAL): {
+            Value b = pop();
+            vm.stackTop[-1] = BOOL_VAL(valuesEqual(vm.stackTop[-1], b));
+            DISPATCH();
+        }
+        CASE_CODE(OP_GREATER): BINARY_OP(BOOL_VAL, >); DISPATCH();
+        CASE_CODE(OP_LESS):    BINARY_OP(BOOL_VAL, <); DISPATCH();
+        CASE_CODE(OP_NOT):     vm.stackTop[-1] = BOOL_VAL(isFalsey(vm.stackTop[-1])); DISPATCH();
+
+        CASE_CODE(OP_JUMP): {
+            uint16_t offset = READ_SHORT();
+            ip += offset;
+            DISPATCH();
+        }
+        CASE_CODE(OP_JUMP_IF_FALSE): {
+            uint16_t offset = READ_SHORT();
+            if (isFalsey(peek(0))) ip += offset;
+            DISPATCH();
+        }
+        CASE_CODE(OP_LOOP): {
+            uint16_t offset = READ_SHORT();
+            ip -= offset;
+            ENTER_JIT();
+            DISPATCH();
+        }
+
+        // The fast path: no allocation, just the next CallFrame in the array
+        CASE_CODE(OP_CALL): {
+            int argCount = READ_BYTE();
+            frame->ip = ip;
+            if (!callValue(peek(argCount), argCount)) return INTERPRET_RUNTIME_ERROR;
+            frame = &vm.frames[vm.frameCount - 1];
+            ip = frame->ip;
+            ENTER_JIT();
+            DISPATCH();
+        }
+        CASE_CODE(OP_CLOSURE): {
+            // The function sits in the constant pool, so the allocation may collect
+            ObjFunction* function = AS_FUNCTION(READ_CONSTANT_SHORT());
+            ObjClosure* closure = newClosure(function);
+            push(OBJ_VAL(closure)); // Rooted while the upvalues are allocated
+            for (int i = 0; i < closure->upvalueCount; i++) {
+                uint8_t isLocal = READ_BYTE();
+                uint8_t index = READ_BYTE();
+                closure->upvalues[i] = isLocal ? captureUpvalue(frame->slots + index)
+                                               : frame->closure->upvalues[index];
+                gcBarrier(OBJ_VAL(closure->upvalues[i]));
+            }
+            DISPATCH();
+        }
+        CASE_CODE(OP_GET_UPVALUE): push(*frame->closure->upvalues[READ_BYTE()]->location); DISPATCH();
+        CASE_CODE(OP_SET_UPVALUE):
+            *frame->closure->upvalues[READ_BYTE()]->location = peek(0);
+            gcBarrier(peek(0)); // The upvalue may be closed, inside a black object
+            DISPATCH();
+        CASE_CODE(OP_CLOSE_UPVALUE):
+            closeUpvalues(vm.stackTop - 1);
+            vm.stackTop--;
+            DISPATCH();
+
+        CASE_CODE(OP_RETURN): {
+            Value result = pop();
+            closeUpvalues(frame->slots);
+            vm.frameCount--;
+            if (vm.frameCount == 0) {
+                vm.result = result;
+                frame->ip = ip; // Write back the IP
                 return INTERPRET_OK;
             }
+            vm.stackTop = frame->slots; // Drop the callee, its arguments and locals
+            push(result);
+            frame = &vm.frames[vm.frameCount - 1];
+            ip = frame->ip;
+            ENTER_JIT();
+            DISPATCH();
         }
     }
-    
+
+    // Only reachable with a corrupt opcode in switch mode
+    frame->ip = ip;
+    runtimeError("Unknown opcode %d.", ip[-1]);
+    return INTERPRET_RUNTIME_ERROR;
+
     #undef READ_BYTE
+    #undef READ_SHORT
     #undef READ_CONSTANT
+    #undef READ_CONSTANT_LONG
+    #undef READ_CONSTANT_SHORT
+    #undef READ_STRING_SHORT
+    #undef GLOBAL_SLOT
     #undef BINARY_OP
+    #undef BINARY_CONSTANT_OP
+    #undef TRACE_INSTRUCTION
+    #undef ENTER_JIT
+    #undef POLL_INTERRUPT
+    #undef INTERPRET_LOOP
+    #undef CASE_CODE
+    #undef DISPATCH
+}
+
+/**
+ * @brief The register VM loop: runs code from lowerToRegisters().
+ * The VM stack doubles as the register file, R[i] = vm.stack[i].
+ */
+static InterpretResult runRegisters(RegChunk* rc) {
+    register RegInstruction* pc = rc->code;
+    Value* R = vm.stack;
+    Value* K = rc->constants->values;
+    int interruptCountdown = INTERRUPT_INTERVAL;
+    RegInstruction i;
+
+    // Natives get a stack above the live registers. The registers count as
+    // stack for the GC, so none may hold a stale object from an earlier run.
+    for (int r = 0; r < rc->registers; r++) R[r] = NIL_VAL;
+    vm.stackTop = vm.stack + rc->registers;
+
+    #define RK(operand) (((operand) & RK_CONSTANT) ? K[(operand) & RK_MAX_CONSTANT] : R[operand])
+
+    #define REG_ERROR(...) \
+        do { \
+            vm.pc = pc; \
+            runtimeError(__VA_ARGS__); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } while (false)
+
+    #define REG_BINARY_OP(op) \
+        do { \
+            Value b = RK(REG_B(i)); \
+            Value c = RK(REG_C(i)); \
+            if (!IS_NUMBER(b) || !IS_NUMBER(c)) REG_ERROR("Operands must be numbers."); \
+            R[REG_A(i)] = NUMBER_VAL(AS_NUMBER(b) op AS_NUMBER(c)); \
+        } while (false)
+
+    // Register form of GLOBAL_SLOT: the cache is the word after 'i'
+    #define REG_GLOBAL_SLOT(slot) \
+        do { \
+            GlobalCache cache; \
+            memcpy(&cache, pc, sizeof(cache)); \
+            if (cache.version == vm.globalVersion) { \
+                slot = &vm.globalValues.values[cache.slot]; \
+            } else { \
+                ObjString* name = AS_STRING(K[REG_BX(i)]); \
+                slot = lookupGlobal(name, pc); \
+                if (slot == NULL) REG_ERROR("Undefined variable '%s'.", name->chars); \
+            } \
+            pc++; \
+        } while (false)
+
+    #define REG_POLL_INTERRUPT() \
+        do { \
+            if (--interruptCountdown == 0) { \
+                interruptCountdown = INTERRUPT_INTERVAL; \
+                if (vm.interrupt && vm.interrupt(vm.interruptContext)) { \
+                    REG_ERROR("Script interrupted: budget exceeded."); \
+                } \
+            } \
+        } while (false)
+
+    #ifdef CSCRIPT_THREADED_DISPATCH
+    static void* dispatchTable[] = {
+        [ROP_LOADK]       = &&code_ROP_LOADK,
+        [ROP_LOADNIL]     = &&code_ROP_LOADNIL,
+        [ROP_LOADBOOL]    = &&code_ROP_LOADBOOL,
+        [ROP_NEGATE]      = &&code_ROP_NEGATE,
+        [ROP_ADD]         = &&code_ROP_ADD,
+        [ROP_SUBTRACT]    = &&code_ROP_SUBTRACT,
+        [ROP_MULTIPLY]    = &&code_ROP_MULTIPLY,
+        [ROP_DIVIDE]      = &&code_ROP_DIVIDE,
+        [ROP_CALL_NATIVE] = &&code_ROP_CALL_NATIVE,
+        [ROP_RETURN]      = &&code_ROP_RETURN,
+        [ROP_MOVE]        = &&code_ROP_MOVE,
+        [ROP_DEFINE_GLOBAL] = &&code_ROP_DEFINE_GLOBAL,
+        [ROP_GET_GLOBAL]  = &&code_ROP_GET_GLOBAL,
+        [ROP_SET_GLOBAL]  = &&code_ROP_SET_GLOBAL,
+    };
+
+    #define INTERPRET_LOOP    DISPATCH();
+    #define CASE_CODE(op)     code_##op
+    #define DISPATCH() \
+        do { \
+            REG_POLL_INTERRUPT(); \
+            i = *pc++; \
+            goto *dispatchTable[REG_OP(i)]; \
+        } while (false)
+    #else
+    #define INTERPRET_LOOP \
+        loop: \
+            REG_POLL_INTERRUPT(); \
+            i = *pc++; \
+            switch (REG_OP(i))
+    #define CASE_CODE(op)     case op
+    #define DISPATCH()        goto loop
+    #endif
+
+    INTERPRET_LOOP
+    {
+        CASE_CODE(ROP_LOADK):    R[REG_A(i)] = K[REG_BX(i)]; DISPATCH();
+        CASE_CODE(ROP_LOADNIL):  R[REG_A(i)] = NIL_VAL; DISPATCH();
+        CASE_CODE(ROP_LOADBOOL): R[REG_A(i)] = BOOL_VAL(REG_B(i) != 0); DISPATCH();
+
+        CASE_CODE(ROP_NEGATE): {
+            Value b = RK(REG_B(i));
+            if (!IS_NUMBER(b)) REG_ERROR("Operand must be a number.");
+            R[REG_A(i)] = NUMBER_VAL(-AS_NUMBER(b));
+            DISPATCH();
+        }
+
+        CASE_CODE(ROP_ADD): {
+            Value b = RK(REG_B(i));
+            Value c = RK(REG_C(i));
+            if (IS_NUMBER(b) && IS_NUMBER(c)) {
+                R[REG_A(i)] = NUMBER_VAL(AS_NUMBER(b) + AS_NUMBER(c));
+            } else if (IS_STRING(b) && IS_STRING(c)) {
+                // b and c sit in registers or the constant pool: both are GC roots
+                R[REG_A(i)] = OBJ_VAL(concatenateStrings(AS_STRING(b), AS_STRING(c)));
+            } else {
+                REG_ERROR("Operands must be two numbers or two strings.");
+            }
+            DISPATCH();
+        }
+        CASE_CODE(ROP_SUBTRACT): REG_BINARY_OP(-); DISPATCH();
+        CASE_CODE(ROP_MULTIPLY): REG_BINARY_OP(*); DISPATCH();
+        CASE_CODE(ROP_DIVIDE):   REG_BINARY_OP(/); DISPATCH();
+
+        CASE_CODE(ROP_CALL_NATIVE): {
+            Native* native = &vm.natives[REG_B(i)];
+            Value result;
+            vm.pc = pc; // So runtimeError() reports the right line
+            if (!native->function(REG_C(i), &R[REG_A(i)], &result)) {
+                REG_ERROR("Error in native '%s'.", native->name);
+            }
+            R[REG_A(i)] = result;
+            DISPATCH();
+        }
+
+        CASE_CODE(ROP_MOVE): R[REG_A(i)] = RK(REG_B(i)); DISPATCH();
+
+        CASE_CODE(ROP_DEFINE_GLOBAL): defineGlobal(AS_STRING(K[REG_BX(i)]), RK(REG_A(i))); DISPATCH();
+        CASE_CODE(ROP_GET_GLOBAL): {
+            Value* slot;
+            REG_GLOBAL_SLOT(slot);
+            R[REG_A(i)] = *slot;
+            DISPATCH();
+        }
+        CASE_CODE(ROP_SET_GLOBAL): {
+            Value* slot;
+            REG_GLOBAL_SLOT(slot);
+            *slot = RK(REG_A(i));
+            gcBarrier(*slot);
+            DISPATCH();
+        }
+
+        CASE_CODE(ROP_RETURN):
+            vm.result = RK(REG_B(i));
+            vm.pc = pc;
+            return INTERPRET_OK;
+    }
+
+    REG_ERROR("Unknown register opcode %d.", (int)REG_OP(i));
+
+    #undef RK
+    #undef REG_ERROR
+    #undef REG_BINARY_OP
+    #undef REG_GLOBAL_SLOT
+    #undef REG_POLL_INTERRUPT
+    #undef INTERPRET_LOOP
+    #undef CASE_CODE
+    #undef DISPATCH
 }
 
 InterpretResult interpret(const char* source) {
@@ -139,11 +859,41 @@ InterpretResult interpret(const char* source) {
         return INTERPRET_COMPILE_ERROR;
     }
 
-    vm.chunk = &chunk;
-    vm.ip = vm.chunk->code;
-
-    InterpretResult result = run();
+    Value value;
+    InterpretResult result = runChunk(&chunk, &value);
+    if (result == INTERPRET_OK) {
+        printValue(value);
+        printf("\n");
+    }
     
     freeChunk(&chunk);
     return result;
 }
+
+InterpretResult runChunk(Chunk* chunk, Value* result) {
+    vm.regChunk = NULL;
+    resetStack();
+    // The script's own frame: no closure, locals from stack[0]
+    CallFrame* frame = &vm.frames[vm.frameCount++];
+    frame->closure = NULL;
+    frame->chunk = chunk;
+    frame->ip = chunk->code;
+    frame->slots = vm.stack;
+
+    if (vm.backend == BACKEND_REGISTER && !chunk->regLowered) {
+        chunk->regLowered = true; // Lowered once; EVALSHA-style reruns reuse it
+        chunk->regCode = lowerToRegisters(chunk);
+        if (vm.trace && chunk->regCode) disassembleRegChunk(chunk->regCode, "register code");
+    }
+
+    InterpretResult status;
+    if (vm.backend == BACKEND_REGISTER && chunk->regCode) {
+        vm.regChunk = chunk->regCode;
+        status = runRegisters(chunk->regCode);
+        vm.regChunk = NULL;
+    } else {
+        status = run();
+    }
+    *result = vm.result;
+    return status;
+}
@@ -4,20 +4,111 @@
 
 #include "chunk.h"
 #include "value.h"
+#include "memory.h"
+#include "object.h"
+#include "regcompiler.h"
+#include "table.h"
 
-#define STACK_MAX 256
+#define FRAMES_MAX 64                       // Call depth limit ("Stack overflow.")
+#define STACK_MAX (FRAMES_MAX * UINT8_COUNT) // Room for every frame's 256 local slots
+#define NATIVES_MAX 64
+#define INTERRUPT_INTERVAL 1024 // Instructions between interrupt hook calls
+
+// --- Host Functions ("natives") ---
+// Writes the call's value to *result. Returning false raises a runtime error.
+typedef bool (*NativeFn)(int argCount, Value* args, Value* result);
+
+typedef struct {
+    const char* name;
+    NativeFn function;
+} Native;
+
+// Polled every INTERRUPT_INTERVAL instructions; returning true aborts the script.
+typedef bool (*InterruptFn)(void* context);
+
+// --- Instrumentation ---
+// Called before each instruction runs; 'offset' is its position in chunk->code
+// and stack[0..stackTop) the VM stack. Only CSCRIPT_TRACE builds call it.
+typedef void (*InstructionHookFn)(Chunk* chunk, int offset, Value* stack, Value* stackTop, void* context);
+
+// --- Backends ---
+typedef enum {
+    BACKEND_STACK,    // The stack bytecode, as compiled
+    BACKEND_REGISTER, // Chunks lowered to register code (regcompiler.h) when possible
+} Backend;
+
+// --- Inline Caches ---
+// Inline cache of a global read or assignment, stored in the code right
+// after the instruction's name operand (GLOBAL_CACHE_BYTES in a stack
+// chunk, the next word in register code). A cache whose version is the
+// current vm.globalVersion holds the variable's slot.
+typedef struct {
+    uint16_t version;
+    uint16_t slot;
+} GlobalCache;
+
+// --- Call Frames ---
+// One per running call, in a fixed array: calling a function fills in the
+// next frame, nothing is allocated.
+typedef struct {
+    ObjClosure* closure; // NULL for the script's own frame
+    Chunk* chunk;        // The code being run (closure->function->chunk, or the script)
+    uint8_t* ip;         // Where the caller resumes; written back before anything can inspect it
+    Value* slots;        // The frame's first stack slot (the callee, or stack[0] for the script)
+} CallFrame;
 
 // --- The VM Struct ---
 // This holds the entire state of the running program.
 typedef struct {
-    Chunk* chunk;      // The bytecode being run
-    uint8_t* ip;       // Instruction Pointer
-    
+    CallFrame frames[FRAMES_MAX];
+    int frameCount;
+
     Value stack[STACK_MAX];
     Value* stackTop;   // Points *just past* the last item
+    ObjUpvalue* openUpvalues; // Captured locals still on the stack, highest slot first
+    
+    Value result;      // Value returned by the last script
+
+    // Globals: the table maps each name to a slot (a NUMBER_VAL index) in
+    // globalValues. A slot is never reused, so a found index stays valid
+    // until clearGlobals(), which moves on to the next globalVersion.
+    Table globalSlots;
+    ValueArray globalValues;
+    uint16_t globalVersion; // Inline caches of another version are stale; never 0 (the empty cache)
+    bool inlineCaches;      // false: no cache is filled and every access hashes the name
+    uint64_t globalLookups; // Hash lookups by global reads and assignments (cache misses)
+    
+    Native natives[NATIVES_MAX];
+    int nativeCount;
     
+    InterruptFn interrupt; // NULL = never interrupted
+    void* interruptContext;
+
+    InstructionHookFn instructionHook; // NULL = no per-instruction callback
+    void* hookContext;
+    bool trace;        // --trace: dump compiled chunks, trace execution
+
+    bool optimize;     // -O: run the optimizer on every compiled chunk
+    Backend backend;
+    RegChunk* regChunk;   // Register code being run (NULL while the stack VM runs)
+    RegInstruction* pc;   // Its instruction pointer, written back like 'ip'
+    bool jit;             // --jit: hot stack chunks run as machine code (jit.h)
+    int jitPollCountdown; // Loop back-edges machine code has left before an interrupt poll
+
+    // --- Heap (memory.h) ---
+    Obj* objects;         // Every live object, newest first
+    Table strings;        // Intern table; weak: the GC drops unmarked strings
+    Obj** grayStack;      // Marked objects whose references are not traced yet
+    int grayCount;
+    int grayCapacity;
+    double gcGrowthFactor;
+    long gcStepBudget;    // Work units per incremental GC step; 0 = stop-the-world
+    GCStats gc;
+
 } VM;
 
+extern VM vm; // The one VM (vm.c); the GC and object code reach the heap through it
+
 // Result of running the VM
 typedef enum {
     INTERPRET_OK,
@@ -29,6 +120,38 @@ void initVM();
 void freeVM();
 InterpretResult interpret(const char* source);
 
+// --- Embedding API ---
+// Natives must be defined before compiling code that calls them.
+void defineNative(const char* name, NativeFn function);
+int findNative(const char* name, int length); // -1 if unknown
+const char* nativeName(int index);
+void setInterruptHook(InterruptFn interrupt, void* context);
+// Installs (or, with NULL, removes) the per-instruction hook.
+// Returns false if this build was made without CSCRIPT_TRACE.
+bool setInstructionHook(InstructionHookFn hook, void* context);
+// Disassembles each compiled chunk and, in CSCRIPT_TRACE builds, prints the
+// stack and instruction as it runs. Returns false if only the first is available.
+bool setTraceExecution(bool enabled);
+bool traceExecution();
+// -O: compile() passes each chunk through optimizeChunk() (optimizer.h).
+void setOptimization(bool enabled);
+bool optimizationEnabled();
+// Backend used by interpret() and runChunk(). BACKEND_REGISTER still runs a
+// chunk on the stack VM if it cannot be lowered.
+void setBackend(Backend backend);
+// Compiles chunks to machine code once they are hot (JIT_THRESHOLD entries)
+// and runs that instead of the stack bytecode. Returns false, and leaves
+// the JIT off, where there is no JIT (jitAvailable()).
+bool setJit(bool enabled);
+// Runs an already-compiled chunk (it can be run any number of times).
+InterpretResult runChunk(Chunk* chunk, Value* result);
+// Forgets every global variable, e.g. between scripts that must not share state.
+void clearGlobals();
+// Global reads and assignments remember their slot in the bytecode (on by
+// default). Turning caching off leaves filled caches in place until the
+// next clearGlobals().
+void setInlineCaches(bool enabled);
+
 // Stack operations
 void push(Value value);
 Value pop();